@@ -0,0 +1,82 @@
+/**
+ * @file rerun_bench.c
+ * @author Sayed Sadeed
+ * @brief Microbenchmark comparing a full rerun of a Frame with an incremental one.
+ *
+ * A generated script derives a host and url from one of 50 inputs per variable. After a
+ * first run one input is changed (Frame_set_var) and the second run is timed, once with a
+ * plain Frame and once with incremental recomputation (Frame_set_incremental).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "program.h"
+#include "vstring.h"
+
+// Elapsed milliseconds since start.
+static double elapsed_ms(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Script of vars hosts each deriving a url from one of 50 inputs.
+static char *build_chain_script(size_t vars) {
+	VString src = VString_new(NULL);
+	char line[128];
+
+	for (size_t i = 0; i < 50; i++) {
+		snprintf(line, sizeof(line), "$in_%lu = \"web%lu\"\n", i, i);
+		VString_pushs(&src, line);
+	}
+
+	VString_pushs(&src, "$port = 8000\n");
+
+	for (size_t i = 0; i < vars; i++) {
+		snprintf(line, sizeof(line), "$host_%lu = `$in_%lu.%lu`\n", i, i % 50, i);
+		VString_pushs(&src, line);
+		snprintf(line, sizeof(line), "$url_%lu = `http://$host_%lu:$port/status`\n", i, i);
+		VString_pushs(&src, line);
+	}
+
+	char *out = malloc(src.str_size + 1);
+	memcpy(out, VString_str(&src), src.str_size + 1);
+	VString_free(&src);
+	return out;
+}
+
+// Time a rerun of frame after changing in_0.
+static double rerun_ms(Program *program, Frame *frame) {
+	struct timespec start;
+
+	Program_run(program, frame);
+	Frame_set_var(frame, "in_0", "changed");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	Program_run(program, frame);
+	return elapsed_ms(&start);
+}
+
+int main(int argc, char *argv[]) {
+	size_t vars = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+	char *script = build_chain_script(vars);
+	Error *err_handle = Error_new(NULL);
+	Program *program = Program_compile(script, 0, NULL, err_handle);
+
+	Frame *frame = Frame_new(program, NULL);
+	double full_ms = rerun_ms(program, frame);
+	Frame_free(frame);
+
+	frame = Frame_new(program, NULL);
+	Frame_set_incremental(frame, 1);
+	double inc_ms = rerun_ms(program, frame);
+
+	printf("Incremental rerun: %lu statements | %lu reused | %.2f ms full | %.2f ms incremental\n",
+		program->node_mgr->nodes_ctr, frame->reused, full_ms, inc_ms);
+
+	Frame_free(frame);
+	Program_free(program);
+	Error_free(err_handle);
+	free(script);
+	return 0;
+}
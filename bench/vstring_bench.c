@@ -0,0 +1,165 @@
+/**
+ * @file vstring_bench.c
+ * @author Sayed Sadeed
+ * @brief Microbenchmark counting heap allocations made by string heavy paths.
+ *
+ * Linked with --wrap for malloc, calloc and realloc so every allocation made by the
+ * interpreter sources is counted. Two workloads are measured, tokenizing a generated
+ * script (TokenMgr_build_tokens) and executing statements built from backtick templates
+ * (exec_mixed_string).
+ *
+ * The same source is built a second time as vstring_bench_heap with VSTRING_SSO_SIZE set
+ * to 0, so every non empty VString lives on the heap as before inline strings. vstring_bench
+ * runs it on the same script with --raw and reports the difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "program.h"
+#include "tokenizer.h"
+#include "vstring.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static size_t allocs = 0;
+
+void *__wrap_malloc(size_t size) {
+	allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	allocs++;
+	return __real_realloc(ptr, size);
+}
+
+// Counts and times of one run of both workloads.
+typedef struct {
+	size_t tokens;
+	size_t tok_allocs;
+	double tok_ms;
+	size_t stmts;
+	size_t run_allocs;
+	double run_ms;
+} BenchResult;
+
+// Elapsed milliseconds since start.
+static double elapsed_ms(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Script of stmts statements mixing identifiers, integers, operators and templates.
+static char *build_script(size_t stmts) {
+	VString src = VString_new(NULL);
+	char line[128];
+
+	for (size_t i = 0; i < stmts; i++) {
+		snprintf(line, sizeof(line), "$host_%lu = \"web%lu\"\n$port = 8000 + %lu\n", i % 50, i, i % 100);
+		VString_pushs(&src, line);
+		snprintf(line, sizeof(line), "$url = `http://$host_%lu:$port/status`\n", i % 50);
+		VString_pushs(&src, line);
+	}
+
+	char *out = malloc(src.str_size + 1);
+	memcpy(out, VString_str(&src), src.str_size + 1);
+	VString_free(&src);
+	return out;
+}
+
+static void bench_run(char *script, BenchResult *res) {
+	struct timespec start;
+	size_t before = 0;
+
+	// Tokenizer workload.
+	TokenMgr *tok_mgr = TokenMgr_new(NULL);
+	before = allocs;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	TokenMgr_build_tokens(script, tok_mgr);
+	res->tok_ms = elapsed_ms(&start);
+	res->tok_allocs = allocs - before;
+	res->tokens = tok_mgr->tok_ctr;
+	TokenMgr_free(tok_mgr);
+
+	// Template expansion workload.
+	Error *err_handle = Error_new(NULL);
+	Program *program = Program_compile(script, 0, NULL, err_handle);
+	Frame *frame = Frame_new(program, NULL);
+	before = allocs;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	Program_run(program, frame);
+	res->run_ms = elapsed_ms(&start);
+	res->run_allocs = allocs - before;
+	res->stmts = program->node_mgr->nodes_ctr;
+
+	Frame_free(frame);
+	Program_free(program);
+	Error_free(err_handle);
+}
+
+// Change from base to val in percent.
+static double delta(double val, double base) {
+	return base > 0 ? (val - base) * 100 / base : 0;
+}
+
+// Run the heap only build on the same number of statements, return 0 if its counts were read.
+static int bench_baseline(size_t stmts, BenchResult *res) {
+#ifdef VSTRING_BENCH_BASELINE
+	char cmd[4096];
+	snprintf(cmd, sizeof(cmd), "'%s' %lu --raw", VSTRING_BENCH_BASELINE, stmts);
+
+	FILE *fp = popen(cmd, "r");
+	if (!fp)
+		return -1;
+
+	int n = fscanf(fp, "%lu %lu %lf %lu %lu %lf", &res->tokens, &res->tok_allocs, &res->tok_ms,
+		&res->stmts, &res->run_allocs, &res->run_ms);
+	return pclose(fp) == 0 && n == 6 ? 0 : -1;
+#else
+	(void) stmts;
+	(void) res;
+	return -1;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+	size_t stmts = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+	int raw = argc > 2 && strcmp(argv[2], "--raw") == 0;
+	char *script = build_script(stmts);
+	BenchResult res;
+	BenchResult base;
+
+	bench_run(script, &res);
+	free(script);
+
+	if (raw) {
+		printf("%lu %lu %f %lu %lu %f\n", res.tokens, res.tok_allocs, res.tok_ms, res.stmts, res.run_allocs, res.run_ms);
+		return 0;
+	}
+
+	printf("TokenMgr_build_tokens: %lu tokens | %lu allocations | %.3f allocations/token | %.2f ms\n",
+		res.tokens, res.tok_allocs, (double) res.tok_allocs / res.tokens, res.tok_ms);
+	printf("Program_run:           %lu statements | %lu allocations | %.3f allocations/statement | %.2f ms\n",
+		res.stmts, res.run_allocs, (double) res.run_allocs / res.stmts, res.run_ms);
+
+	if (bench_baseline(stmts, &base)) {
+		printf("No baseline, build with -DVMEL_BUILD_BENCH=ON to get vstring_bench_heap\n");
+		return 0;
+	}
+
+	printf("Without inline strings (VSTRING_SSO_SIZE=0):\n");
+	printf("TokenMgr_build_tokens: %lu allocations | %.2f ms | %+.1f%% allocations | %+.1f%% time\n",
+		base.tok_allocs, base.tok_ms, delta(res.tok_allocs, base.tok_allocs), delta(res.tok_ms, base.tok_ms));
+	printf("Program_run:           %lu allocations | %.2f ms | %+.1f%% allocations | %+.1f%% time\n",
+		base.run_allocs, base.run_ms, delta(res.run_allocs, base.run_allocs), delta(res.run_ms, base.run_ms));
+	return 0;
+}
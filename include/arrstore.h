@@ -0,0 +1,134 @@
+/**
+ * @file arrstore.h
+ * @author Sayed Sadeed
+ * @brief Contiguous storage for the elements of an array literal.
+ *
+ * Elements are kept by kind instead of as a Node each. Integers are stored in one int
+ * buffer, strings as pointers to their token value in one pointer buffer and only nested
+ * arrays remain Nodes. Consecutive elements of the same kind form a run, so an array of
+ * only integers or only strings is a single run and indexing it is a plain buffer lookup.
+ *
+ * Buffers double in size when full, appending is amortized O(1) and everything is
+ * released by a single ArrStore_free().
+ */
+
+#ifndef ARRSTORE_H
+#define ARRSTORE_H
+
+#include <stddef.h>
+#include "valloc.h"
+
+struct Node;
+
+enum ArrKind {
+	ARR_EMPTY, ARR_INT, ARR_STR, ARR_NODE, ARR_MIXED
+};
+
+/**
+ * @brief Consecutive elements of the same kind.
+ *
+ * Elements start up to start + len are found at offset off of the buffer for kind.
+ */
+typedef struct {
+	enum ArrKind kind;
+	size_t start;
+	size_t len;
+	size_t off;
+} ArrRun;
+
+/**
+ * @brief Single element as returned by ArrStore_get().
+ */
+typedef struct {
+	enum ArrKind kind;
+	union {
+		int num;
+		const char *str;
+		struct Node *node;
+	} val;
+} ArrItem;
+
+/**
+ * @brief Elements of an array along with the runs describing their order.
+ *
+ * kind is the kind shared by every element, ARR_MIXED if they differ.
+ */
+typedef struct {
+	int *ints;
+	size_t int_ctr;
+	size_t int_cap;
+	const char **strs;
+	size_t str_ctr;
+	size_t str_cap;
+	struct Node **nodes;
+	size_t node_ctr;
+	size_t node_cap;
+	ArrRun *runs;
+	size_t run_ctr;
+	size_t run_cap;
+	size_t len;
+	enum ArrKind kind;
+	VAllocator *alloc;
+} ArrStore;
+
+/**
+ * @brief Create new empty ArrStore instance.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of ArrStore or NULL if failed.
+ */
+ArrStore *ArrStore_new(VAllocator *alloc);
+
+/**
+ * @brief Append an integer.
+ *
+ * @param store ArrStore instance.
+ * @param num Value to append.
+ * @return 0 if success otherwise -1.
+ */
+int ArrStore_push_int(ArrStore *store, int num);
+
+/**
+ * @brief Append a string, the string isn't copied and must outlive the store.
+ *
+ * @param store ArrStore instance.
+ * @param str Value to append.
+ * @return 0 if success otherwise -1.
+ */
+int ArrStore_push_str(ArrStore *store, const char *str);
+
+/**
+ * @brief Append a node, ownership stays with the caller.
+ *
+ * @param store ArrStore instance.
+ * @param node Value to append.
+ * @return 0 if success otherwise -1.
+ */
+int ArrStore_push_node(ArrStore *store, struct Node *node);
+
+/**
+ * @brief Fetch the element at an index.
+ *
+ * @param store ArrStore instance.
+ * @param idx Index of element.
+ * @param item Where the element is stored.
+ * @return 0 if success otherwise -1 when idx is out of range.
+ */
+int ArrStore_get(ArrStore *store, size_t idx, ArrItem *item);
+
+/**
+ * @brief Release memory reserved beyond the elements currently held.
+ *
+ * @param store ArrStore instance.
+ * @return 0 if success otherwise -1.
+ */
+int ArrStore_trim(ArrStore *store);
+
+/**
+ * @brief Free ArrStore instance, nodes it holds aren't freed.
+ *
+ * @param store ArrStore instance.
+ */
+void ArrStore_free(ArrStore *store);
+
+#endif
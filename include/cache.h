@@ -0,0 +1,130 @@
+/**
+ * @file cache.h
+ * @author Sayed Sadeed
+ * @brief Results of group commands kept between runs, addressed by what they depend on.
+ *
+ * A step is one command of a group declared with cache. Its key is a SHA-256 digest of
+ * the command after variables were substituted, the host it runs on, the declared inputs
+ * and the key of the step before it, so changing a command also runs every later one.
+ * An input naming a file or directory stands for its contents, any other input for its
+ * text, which lets a checksum or version be declared directly.
+ *
+ * Only steps which succeeded are kept. An entry records the exit status and the digest of
+ * the output the step printed. Once every step of a group succeeded the digest of every
+ * output path it declared is recorded under the key following its last step. Steps are
+ * only skipped while those outputs still hold what was recorded, a step is then skipped
+ * when its key is found and the stored output matches its digest, the output is printed
+ * again.
+ *
+ * Entries live in steps/ below the cache directory, outputs in blobs/ named by their
+ * digest so steps printing the same thing share it. Both are written to a temporary
+ * file first and renamed, several runs or threads may use one cache at once.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "sha256.h"
+#include "vstring.h"
+#include "valloc.h"
+
+/**
+ * @brief Struct representing a StepCache.
+ *
+ * Nothing changes after creation so one instance is shared by every thread of a run.
+ */
+typedef struct {
+	VString dir;
+	VAllocator *alloc;
+} StepCache;
+
+/**
+ * @brief Create new StepCache instance, the directory is only created by the first store.
+ *
+ * @param dir Directory holding the cache.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of StepCache or NULL if failed.
+ */
+StepCache *StepCache_new(const char *dir, VAllocator *alloc);
+
+/**
+ * @brief Digest a path, files by their contents and directories by the names and digests of their entries.
+ *
+ * @param ctx Digest to add the path to.
+ * @param path Path to digest, a missing path adds a marker of its own.
+ * @return 1 if the path exists otherwise 0.
+ */
+int StepCache_path(Sha256 *ctx, const char *path);
+
+/**
+ * @brief Digest the declared inputs of a group once for all its steps.
+ *
+ * @param inputs Declared inputs.
+ * @param input_ctr Number of inputs.
+ * @param digest Receives SHA256_SIZE bytes.
+ */
+void StepCache_inputs(char **inputs, size_t input_ctr, unsigned char *digest);
+
+/**
+ * @brief Compute the key of a step.
+ *
+ * @param prev Key of the step before or NULL for the first step.
+ * @param host Identity of the host the step runs on.
+ * @param inputs Digest from StepCache_inputs().
+ * @param cmd Command with variables substituted.
+ * @param key Receives SHA256_SIZE bytes.
+ */
+void StepCache_key(const unsigned char *prev, const char *host, const unsigned char *inputs, const char *cmd, unsigned char *key);
+
+/**
+ * @brief Find the result of a step.
+ *
+ * @param cache StepCache instance.
+ * @param key Key of the step.
+ * @param output Receives what the step printed on a hit.
+ * @return 1 if the step may be skipped otherwise 0.
+ */
+int StepCache_lookup(StepCache *cache, const unsigned char *key, VString *output);
+
+/**
+ * @brief Keep the result of a step which succeeded.
+ *
+ * @param cache StepCache instance.
+ * @param key Key of the step.
+ * @param status Exit status, entries are only written for 0.
+ * @param output What the step printed.
+ * @param len Length of output.
+ * @return 0 if stored or not kept otherwise -1.
+ */
+int StepCache_store(StepCache *cache, const unsigned char *key, int status, const char *output, size_t len);
+
+/**
+ * @brief Determine whether declared outputs still hold what a group left.
+ *
+ * @param cache StepCache instance.
+ * @param key Key following the last step of the group.
+ * @param outputs Declared output paths.
+ * @param output_ctr Number of outputs.
+ * @return 1 if every output matches what StepCache_record() found or none is declared, otherwise 0.
+ */
+int StepCache_check(StepCache *cache, const unsigned char *key, char **outputs, size_t output_ctr);
+
+/**
+ * @brief Record the declared outputs of a group which succeeded.
+ *
+ * @param cache StepCache instance.
+ * @param key Key following the last step of the group.
+ * @param outputs Declared output paths.
+ * @param output_ctr Number of outputs.
+ * @return 0 if recorded otherwise -1.
+ */
+int StepCache_record(StepCache *cache, const unsigned char *key, char **outputs, size_t output_ctr);
+
+/**
+ * @brief Free StepCache instance.
+ *
+ * @param cache StepCache instance.
+ */
+void StepCache_free(StepCache *cache);
+
+#endif
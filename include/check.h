@@ -0,0 +1,39 @@
+/**
+ * @file check.h
+ * @author Sayed Sadeed
+ * @brief Validate scripts without running them.
+ *
+ * Every script is tokenized and parsed on a pool of worker threads, each file getting
+ * its own arena and Error instance. Diagnostics are printed once all files are done,
+ * in the order the files were given, so the output doesn't depend on scheduling.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include "errors.h"
+
+/**
+ * @brief Outcome of checking a single file.
+ *
+ * status is 0 if the file is valid otherwise 1.
+ */
+typedef struct {
+	const char *path;
+	Error *err_handle;
+	int status;
+} CheckResult;
+
+/**
+ * @brief Lex and parse a list of files in parallel and report their errors.
+ *
+ * @param paths Files to check.
+ * @param count Number of files.
+ * @param jobs Maximum number of worker threads, 0 to use one per online cpu.
+ * @param out Stream to print results to.
+ * @return Number of files which contain errors.
+ */
+size_t Check_files(char **paths, size_t count, unsigned int jobs, FILE *out);
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file cmdclass.h
+ * @author Sayed Sadeed
+ * @brief Classify group commands by what they touch, to tell which may run at once.
+ *
+ * A command is scanned once after its variables were substituted. Commands changing the
+ * shell itself, such as cd, export or an assignment, are ordered: they run after every
+ * earlier command of the group and before every later one. So are commands which can't
+ * be analysed, those expanding shell variables, substituting commands, running in the
+ * background, using subshells or here documents, or naming a program without arguments.
+ *
+ * Any other command is assumed to only touch the paths it names. Arguments of programs
+ * known to only read, like cat or grep, are reads, every other argument and the target of
+ * an output redirection is a write. A glob stands for the directory it matches in.
+ * Two commands conflict when one writes a path the other reads or writes, where a path
+ * also covers everything below it. Paths are compared as written, a relative path is
+ * taken to overlap any absolute one since the directory isn't known.
+ *
+ * Package managers write a key shared by all of them since they hold a common lock.
+ * Programs taking a verb first, like systemctl or git, skip the verb and read a key of
+ * their own, or write it when they name nothing else, so `systemctl daemon-reload`
+ * still orders against `systemctl enable nginx`.
+ *
+ * The analysis is a heuristic, a command touching something it doesn't name, like a
+ * script writing files, may run at the same time as commands it affects.
+ */
+
+#ifndef CMDCLASS_H
+#define CMDCLASS_H
+
+#include "vstring.h"
+#include "valloc.h"
+
+/**
+ * @brief Struct representing a CmdClass.
+ *
+ * Path i is the lens[i] bytes of text from starts[i], writes[i] is set when the
+ * command writes it. Keys of programs start with a byte no path starts with. shell is
+ * set when the command changes the shell itself, which also makes it ordered.
+ */
+typedef struct {
+	int ordered;
+	int shell;
+	VString text;
+	size_t *starts;
+	size_t *lens;
+	unsigned char *writes;
+	size_t path_ctr;
+	size_t path_cap;
+	VAllocator *alloc;
+} CmdClass;
+
+/**
+ * @brief Initialise a CmdClass without any paths.
+ *
+ * @param cls CmdClass instance.
+ * @param alloc Allocator instance or NULL for system.
+ */
+void CmdClass_init(CmdClass *cls, VAllocator *alloc);
+
+/**
+ * @brief Classify a command, replacing what cls held.
+ *
+ * @param cls CmdClass instance.
+ * @param cmd Command line with variables of the script substituted.
+ * @return 0 if success otherwise -1, cls is then ordered.
+ */
+int CmdClass_scan(CmdClass *cls, const char *cmd);
+
+/**
+ * @brief Determine whether two commands must keep their order.
+ *
+ * @param a Classified command.
+ * @param b Classified command.
+ * @return 1 if either is ordered or they touch a common path which one writes, otherwise 0.
+ */
+int CmdClass_conflicts(const CmdClass *a, const CmdClass *b);
+
+/**
+ * @brief Release the paths held by a CmdClass.
+ *
+ * @param cls CmdClass instance.
+ */
+void CmdClass_free(CmdClass *cls);
+
+#endif
@@ -13,10 +13,16 @@
  * INIT_SYTABLE_SIZE initial size of symbol table.
  * INIT_NODEMGR_SIZE initial number of nodes that can be stored inside NodeMgr class.
  * INIT_TOKMGR_TOKS_SIZE initial number of tokens that can be stored inside TokenMgr class.
+ * INIT_STRPOOL_BLOCK_SIZE minimum number of bytes allocated per StrPool block.
+ * INIT_NODECONS_SIZE initial number of slots in hash-consing table, must be power of 2.
+ * INIT_ARRSTORE_SIZE initial number of elements of each kind an ArrStore can hold.
  */
 #define INIT_SYTABLE_SIZE 7
 #define INIT_NODEMGR_SIZE 100
 #define INIT_TOKMGR_TOKS_SIZE 40
+#define INIT_STRPOOL_BLOCK_SIZE 4096
+#define INIT_NODECONS_SIZE 256
+#define INIT_ARRSTORE_SIZE 16
 
 /**
  * Fixed structure sizing.
@@ -26,4 +32,74 @@
  */
 #define TOKENTYPE_SIZE 20
 
+/**
+ * Execution tuning.
+ * 
+ * VMEL_ROPE_THRESHOLD length from which expanded templates are stored as VRope instead of flat strings.
+ * VMEL_OUT_BUFFER_SIZE number of bytes of output buffered before it is written.
+ * VMEL_PARALLEL_MIN_WAVE number of independent statements from which a wave is handed to worker threads.
+ * VMEL_EVLOOP_MAX_BUFFERED number of output bytes held per command before the event loop stops reading it.
+ * VMEL_EVLOOP_REAP_MS interval at which exits are polled for when they can't be waited on through a descriptor.
+ */
+#define VMEL_ROPE_THRESHOLD 32768
+#define VMEL_OUT_BUFFER_SIZE 65536
+#define VMEL_PARALLEL_MIN_WAVE 32
+#define VMEL_EVLOOP_MAX_BUFFERED 1048576
+#define VMEL_EVLOOP_REAP_MS 10
+
+/**
+ * Transports.
+ *
+ * VMEL_LOCAL_HOST host group commands run on when none is given.
+ * VMEL_FAKE_ROOT directory holding the sandbox of every host of the fake transport.
+ * VMEL_FAKE_OPEN_TRIPS round trips the fake transport charges for opening a session.
+ * VMEL_SSH_CONTROL_PATH socket ssh shares a connection per host through, % tokens are expanded by ssh.
+ * VMEL_SSH_PERSIST seconds an idle shared ssh connection is kept.
+ * VMEL_FANOUT_HOSTS number of hosts worked on at once, by one run statement and by the whole run.
+ * VMEL_POOL_LIVE_SHELLS number of shells kept running once their group ended, further ones are closed.
+ */
+#define VMEL_LOCAL_HOST "localhost"
+#define VMEL_FAKE_ROOT ".vmel-hosts"
+#define VMEL_FAKE_OPEN_TRIPS 3
+#define VMEL_SSH_CONTROL_PATH "/tmp/vmel-ssh-%C"
+#define VMEL_SSH_PERSIST "60"
+#define VMEL_FANOUT_HOSTS 64
+#define VMEL_POOL_LIVE_SHELLS 256
+
+/**
+ * Group dependencies.
+ *
+ * VMEL_DAG_HISTORY file the durations of groups are kept in between runs.
+ * VMEL_DAG_COMMAND_US microseconds a command of a group which never ran is assumed to take.
+ * VMEL_GROUP_JOBS number of commands of a parallel group running at once when it sets no limit.
+ */
+#define VMEL_DAG_HISTORY ".vmel-durations"
+#define VMEL_DAG_COMMAND_US 100000
+#define VMEL_GROUP_JOBS 8
+
+/**
+ * Step cache.
+ *
+ * VMEL_CACHE_DIR directory results of commands of groups declared with cache are kept in.
+ */
+#define VMEL_CACHE_DIR ".vmel-cache"
+
+/**
+ * Resuming failed runs.
+ *
+ * VMEL_JOURNAL file the progress of a run is kept in until it finishes without errors.
+ */
+#define VMEL_JOURNAL ".vmel-journal"
+
+/**
+ * Hedged commands.
+ *
+ * VMEL_HEDGE_PERCENTILE percentile of the durations of its peers a command of an idempotent group may run for.
+ * VMEL_HEDGE_PEERS number of peers which must have finished before a command is hedged.
+ * VMEL_HEDGE_MIN_MS milliseconds a command may always run for before it is hedged.
+ */
+#define VMEL_HEDGE_PERCENTILE 95
+#define VMEL_HEDGE_PEERS 4
+#define VMEL_HEDGE_MIN_MS 100
+
 #endif
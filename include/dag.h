@@ -0,0 +1,187 @@
+/**
+ * @file dag.h
+ * @author Sayed Sadeed
+ * @brief Dependencies between groups declared with needs.
+ *
+ * A GroupDag is built once a Program is parsed. Every group is a vertex with an edge to
+ * each group it needs, a need which isn't defined or a cycle is reported as an error so
+ * a program which compiles always has an order to run its groups in.
+ *
+ * Running a group first runs everything it needs, directly or not, each group once.
+ * Groups whose needs have all finished are ready, of those the one starting the longest
+ * remaining path to the group being run goes first, so the critical path is never kept
+ * waiting. Path lengths are the durations groups took on earlier runs, kept by a
+ * DagHistory, or an estimate from their number of commands before they ran once.
+ *
+ * Ready groups may run at the same time, each in a shell of its own. A group continues in
+ * the shell of the first group it needs unless a group planned earlier already does, then
+ * it starts from a copy of the directory and environment that group left. Groups of one
+ * shell need each other so they never run at once, and the shells are the same whether
+ * groups run one at a time or not.
+ */
+
+#ifndef DAG_H
+#define DAG_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "node.h"
+#include "errors.h"
+#include "valloc.h"
+
+/**
+ * @brief A group and its edges.
+ *
+ * needs holds the index of every group this one needs, users the index of every group
+ * needing this one. cmd_ctr is the number of commands of the group.
+ */
+typedef struct {
+	Node *group;
+	size_t *needs;
+	size_t need_ctr;
+	size_t *users;
+	size_t user_ctr;
+	size_t cmd_ctr;
+} DagGroup;
+
+/**
+ * @brief Struct representing a GroupDag.
+ *
+ * groups are in order of definition, topo lists their indices so every group comes
+ * after the groups it needs.
+ */
+typedef struct {
+	DagGroup *groups;
+	size_t group_ctr;
+	size_t *topo;
+	VAllocator *alloc;
+} GroupDag;
+
+/**
+ * @brief Durations of groups, shared by the threads of a run.
+ *
+ * us holds the duration of every group of a GroupDag in microseconds, 0 while unknown.
+ * dirty is set once a duration changed since the history was loaded.
+ */
+typedef struct {
+	long long *us;
+	size_t ctr;
+	int dirty;
+	pthread_mutex_t lock;
+	VAllocator *alloc;
+} DagHistory;
+
+/**
+ * @brief Build the dependencies of every group of node_mgr.
+ *
+ * Undefined needs and cycles are added to err_handle.
+ *
+ * @param node_mgr NodeMgr holding the parsed statements.
+ * @param layout Symbol table of the parser, for line numbers of groups.
+ * @param err_handle Error instance.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of GroupDag or NULL if no group needs another or failed.
+ */
+GroupDag *GroupDag_build(NodeMgr *node_mgr, SyTable *layout, Error *err_handle, VAllocator *alloc);
+
+/**
+ * @brief Find the index of a group.
+ *
+ * @param dag GroupDag instance.
+ * @param group Group node.
+ * @return Index of the group or -1 if not part of dag.
+ */
+long GroupDag_find(GroupDag *dag, Node *group);
+
+/**
+ * @brief Order the groups needed to run a group.
+ *
+ * order receives target and every group it needs, directly or not, in the order a single
+ * thread would run them: each time the ready group with the longest remaining path.
+ * prio receives the remaining path of every group, indexed like the groups of dag.
+ *
+ * @param dag GroupDag instance.
+ * @param history Durations or NULL to estimate them.
+ * @param target Index of the group being run.
+ * @param order Room for group_ctr indices.
+ * @param prio Room for group_ctr lengths.
+ * @return Number of indices stored in order.
+ */
+size_t GroupDag_plan(GroupDag *dag, DagHistory *history, size_t target, size_t *order, long long *prio);
+
+/**
+ * @brief Assign the groups of a plan to shells.
+ *
+ * lane receives the shell of every group of order, numbered from 0. seed receives the
+ * group whose directory and environment a group starts from when it starts a shell of its
+ * own, or -1 when it continues the shell of its first need or needs nothing. Both are
+ * indexed like the groups of dag, groups outside order get lane 0 and seed -1.
+ *
+ * @param dag GroupDag instance.
+ * @param order Groups as ordered by GroupDag_plan().
+ * @param len Number of groups in order.
+ * @param lane Room for group_ctr lanes.
+ * @param seed Room for group_ctr groups.
+ * @return Number of lanes used.
+ */
+size_t GroupDag_lanes(GroupDag *dag, const size_t *order, size_t len, size_t *lane, long *seed);
+
+/**
+ * @brief Free GroupDag instance.
+ *
+ * @param dag GroupDag instance.
+ */
+void GroupDag_free(GroupDag *dag);
+
+/**
+ * @brief Create new DagHistory instance with every duration unknown.
+ *
+ * @param dag GroupDag instance the durations belong to.
+ * @param alloc Allocator instance or NULL for system, must be thread safe if the history is shared.
+ * @return New instance of DagHistory or NULL if failed.
+ */
+DagHistory *DagHistory_new(GroupDag *dag, VAllocator *alloc);
+
+/**
+ * @brief Read durations saved by DagHistory_save().
+ *
+ * Lines hold a group name followed by its duration in microseconds, groups which
+ * no longer exist are ignored.
+ *
+ * @param history DagHistory instance.
+ * @param dag GroupDag instance.
+ * @param path File to read.
+ * @return 0 if read otherwise -1, for instance when the file doesn't exist yet.
+ */
+int DagHistory_load(DagHistory *history, GroupDag *dag, const char *path);
+
+/**
+ * @brief Record the time a group took.
+ *
+ * Known durations move a quarter of the way towards the new one so a single slow run
+ * doesn't reorder everything.
+ *
+ * @param history DagHistory instance.
+ * @param idx Index of the group.
+ * @param us Duration in microseconds.
+ */
+void DagHistory_record(DagHistory *history, size_t idx, long long us);
+
+/**
+ * @brief Write known durations if any changed.
+ *
+ * @param history DagHistory instance.
+ * @param dag GroupDag instance.
+ * @param path File to write.
+ * @return 0 if written or unchanged otherwise -1.
+ */
+int DagHistory_save(DagHistory *history, GroupDag *dag, const char *path);
+
+/**
+ * @brief Free DagHistory instance.
+ *
+ * @param history DagHistory instance.
+ */
+void DagHistory_free(DagHistory *history);
+
+#endif
@@ -3,33 +3,61 @@
  * @author Sayed Sadeed
  * @brief File containing a generic error interface which can be consumed by modules.
  * 
- * Error module is simply a store of malloc'ed strings. It is upto an individual module to 
- * determing how they produce those errors and the nature of them. Error simply keeps track
- * of them in a organized structure so that they can be correctly accessed freed.
+ * Errors are stored as compact records made up of a template, line number and the
+ * arguments substituted into the template. It is upto an individual module to determine
+ * the templates it uses and the nature of its errors. Records are only formatted once
+ * they are flushed, so adding an error never formats or allocates a message.
  * 
+ * Templates refer to arguments with @0 to @9 and to the line number with @L.
  */
 
 #ifndef ERRORS_H
 #define ERRORS_H
 #define INIT_MAX_ERRORS 20
+#define ERROR_MAX_ARGS 4
+#define ERROR_LIMIT 1024
 
+#include <stdio.h>
 #include <string.h>
+#include "valloc.h"
 
 /**
- * @brief Store all the errors related to parsing process.
+ * @brief Single error waiting to be formatted.
+ * 
+ * Arguments are offsets into the argument buffer of the owning Error.
+ */
+typedef struct {
+    const char *const *templates;
+    unsigned int code;
+    unsigned int lineno;
+    unsigned int argc;
+    size_t args[ERROR_MAX_ARGS];
+} ErrorRecord;
+
+/**
+ * @brief Store all the errors related to parsing and execution.
+ * 
+ * error_ctr is the number of records stored and error_flushed how many of them
+ * have already been printed by Error_flush().
  */
 typedef struct {
-    char *errors[INIT_MAX_ERRORS];
+    ErrorRecord *records;
     size_t error_ctr;
     size_t error_cap;
+    size_t error_flushed;
+    char *args;
+    size_t args_len;
+    size_t args_cap;
+    VAllocator *alloc;
 } Error;
 
 /**
- * @brief Create new malloced Error instance.
+ * @brief Create new Error instance.
  * 
+ * @param alloc Allocator instance or NULL for system.
  * @return New instance of Error or Null if failed.
  */
-Error *Error_new(void);
+Error *Error_new(VAllocator *alloc);
 
 /**
  * @brief Instruct error handler to release all of its stored errors.
@@ -47,12 +75,59 @@ int Error_free(Error *err_handle);
 void Error_print_all(Error *err_handle);
 
 /**
- * @brief Add a single error to Error handle.
+ * @brief Print errors which were added since the previous flush.
  * 
  * @param err_handle Error instance.
- * @param err error message.
+ * @param out Stream to print to.
+ * @return Number of errors printed.
+ */
+size_t Error_flush(Error *err_handle, FILE *out);
+
+/**
+ * @brief Add an error record.
+ * 
+ * Arguments are copied so they don't need to outlive the call. Once ERROR_LIMIT
+ * errors are stored further errors are dropped.
+ * 
+ * @code
+ * static const char *Templates[] = { "Unknown '@0' found in line @L" };
+ * Error_add_record(err_handle, Templates, 0, 12, 1, "^");
+ * @endcode
+ * 
+ * @param err_handle Error instance.
+ * @param templates Table of templates which outlives err_handle.
+ * @param code Index of template in templates.
+ * @param lineno Line number substituted for @L.
+ * @param argc Number of string arguments which follow, at most ERROR_MAX_ARGS.
  * @return 0 if success otherwise -1.
  */
-int Error_add(Error *err_handle, char *err);
+int Error_add_record(Error *err_handle, const char *const *templates, unsigned int code, unsigned int lineno, unsigned int argc, ...);
+
+/**
+ * @brief Add a single preformatted error to Error handle.
+ * 
+ * @param err_handle Error instance.
+ * @param err error message, copied.
+ * @return 0 if success otherwise -1.
+ */
+int Error_add(Error *err_handle, const char *err);
+
+/**
+ * @brief Copy a range of records from one Error to another.
+ * 
+ * @param dest Error instance receiving the records.
+ * @param src Error instance holding the records.
+ * @param from Index of first record to copy.
+ * @param to Index after the last record to copy.
+ * @return 0 if success otherwise -1.
+ */
+int Error_append(Error *dest, Error *src, size_t from, size_t to);
+
+/**
+ * @brief Remove every record, keeping buffers for reuse.
+ * 
+ * @param err_handle Error instance.
+ */
+void Error_clear(Error *err_handle);
 
 #endif
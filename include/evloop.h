@@ -0,0 +1,137 @@
+/**
+ * @file evloop.h
+ * @author Sayed Sadeed
+ * @brief Single threaded event loop driving running commands.
+ *
+ * An EvLoop owns the stdout and stderr pipes of every command added to it and waits on
+ * all of them with one epoll instance, so any number of children cost one thread. Exits
+ * are noticed through a pidfd per child, or a signalfd receiving SIGCHLD on kernels
+ * without pidfd_open.
+ *
+ * Output is either handed to a callback as it arrives or buffered inside the Proc. A
+ * buffering child holding VMEL_EVLOOP_MAX_BUFFERED bytes is no longer read until it is
+ * switched to a callback, its pipe fills up and the child blocks writing. This bounds
+ * memory when many commands run but only one may print at a time.
+ *
+ * Finished commands are handed to their done callback from EvLoop_run_once(), never
+ * while events are being read, so a callback may add further commands.
+ */
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <signal.h>
+#include "proc.h"
+#include "valloc.h"
+
+/**
+ * @brief Called with output of a command as it is read.
+ *
+ * Standard output and standard error are passed alike, in the order they were read.
+ */
+typedef void (*EvData)(Proc *proc, const char *data, size_t len, void *ctx);
+
+/**
+ * @brief Called once a command has exited and all its output was read.
+ */
+typedef void (*EvDone)(Proc *proc, void *ctx);
+
+typedef struct EvChild EvChild;
+
+/**
+ * @brief Struct representing an EvLoop.
+ *
+ * sig_fd is -1 unless exits are received through a signalfd, old_mask then holds the
+ * signal mask of the thread before SIGCHLD was blocked. child_ctr is the number of
+ * commands which haven't been handed to their done callback yet.
+ */
+typedef struct {
+	int ep_fd;
+	int sig_fd;
+	sigset_t old_mask;
+	EvChild **children;
+	size_t child_ctr;
+	size_t child_cap;
+	size_t max_buffered;
+	VAllocator *alloc;
+} EvLoop;
+
+/**
+ * @brief Create new EvLoop instance.
+ *
+ * The loop must only be used by the thread which created it.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param max_buffered Output bytes held per buffering command, 0 for VMEL_EVLOOP_MAX_BUFFERED.
+ * @return New instance of EvLoop or NULL if failed.
+ */
+EvLoop *EvLoop_new(VAllocator *alloc, size_t max_buffered);
+
+/**
+ * @brief Start watching a command started with Proc_spawn().
+ *
+ * @param loop EvLoop instance.
+ * @param proc Running command, must stay valid until done is called.
+ * @param data Callback receiving output or NULL to buffer it in proc.
+ * @param done Callback invoked once finished or NULL.
+ * @param ctx Passed to both callbacks.
+ * @return 0 if success otherwise -1.
+ */
+int EvLoop_add(EvLoop *loop, Proc *proc, EvData data, EvDone done, void *ctx);
+
+/**
+ * @brief Hand buffered and future output of a command to a callback.
+ *
+ * Output buffered so far is passed to data first, stdout before stderr, then reading
+ * resumes if the command was paused.
+ *
+ * @param loop EvLoop instance.
+ * @param proc Command added to loop.
+ * @param data Callback receiving output.
+ * @param ctx Passed to data.
+ * @return 0 if success otherwise -1 when proc isn't watched by loop.
+ */
+int EvLoop_stream(EvLoop *loop, Proc *proc, EvData data, void *ctx);
+
+/**
+ * @brief Wait for events and dispatch finished commands.
+ *
+ * @param loop EvLoop instance.
+ * @param timeout_ms Longest time to wait, -1 to wait until something happens.
+ * @return Number of commands finished or -1 if failed.
+ */
+int EvLoop_run_once(EvLoop *loop, int timeout_ms);
+
+/**
+ * @brief Run the loop until a command has finished.
+ *
+ * Other commands progress meanwhile. A buffering proc isn't paused while waited on.
+ *
+ * @param loop EvLoop instance.
+ * @param proc Command added to loop.
+ * @return Exit status of proc.
+ */
+int EvLoop_wait(EvLoop *loop, Proc *proc);
+
+/**
+ * @brief Stop watching a command, killing it if still running.
+ *
+ * Its done callback isn't called, output read so far is left in proc. Only the command
+ * itself is killed, not what it started.
+ *
+ * @param loop EvLoop instance.
+ * @param proc Command added to loop.
+ * @return 0 if success otherwise -1 when proc isn't watched by loop.
+ */
+int EvLoop_cancel(EvLoop *loop, Proc *proc);
+
+/**
+ * @brief Free EvLoop instance.
+ *
+ * Commands still running are killed and reaped without calling their callbacks.
+ *
+ * @param loop EvLoop instance.
+ */
+void EvLoop_free(EvLoop *loop);
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file hedge.h
+ * @author Sayed Sadeed
+ * @brief Durations of group commands used to decide when a slow one is started twice.
+ *
+ * Peers of a command are the runs of the same command of the same group, on other hosts
+ * or by earlier runs of the group. Once VMEL_HEDGE_PEERS of them finished, a command
+ * of an idempotent group running longer than the configured percentile of their
+ * durations is hedged: a second copy is started and whichever succeeds first is kept,
+ * the other is killed. The threshold is never below VMEL_HEDGE_MIN_MS so fast commands
+ * aren't doubled over noise.
+ */
+
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#include <pthread.h>
+#include "valloc.h"
+
+/**
+ * @brief Sorted durations of one command of a group in microseconds.
+ */
+typedef struct {
+	const void *group;
+	size_t idx;
+	long long *us;
+	size_t us_ctr;
+	size_t us_cap;
+} HedgePeers;
+
+/**
+ * @brief Struct representing a Hedge, shared by the threads of a run.
+ *
+ * percentile is between 1 and 100.
+ */
+typedef struct {
+	unsigned int percentile;
+	HedgePeers *peers;
+	size_t peer_ctr;
+	size_t peer_cap;
+	pthread_mutex_t lock;
+	VAllocator *alloc;
+} Hedge;
+
+/**
+ * @brief Create new Hedge instance.
+ *
+ * @param percentile Percentile of the durations of peers a command may run for before it is hedged.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of Hedge or NULL if failed.
+ */
+Hedge *Hedge_new(unsigned int percentile, VAllocator *alloc);
+
+/**
+ * @brief Time a command may run before a second copy is started.
+ *
+ * @param hedge Hedge instance.
+ * @param group Group the command belongs to.
+ * @param idx Position of the command in the group.
+ * @return Threshold in microseconds or -1 while too few peers finished.
+ */
+long long Hedge_threshold(Hedge *hedge, const void *group, size_t idx);
+
+/**
+ * @brief Record how long a command took until it succeeded.
+ *
+ * @param hedge Hedge instance.
+ * @param group Group the command belongs to.
+ * @param idx Position of the command in the group.
+ * @param us Duration in microseconds.
+ */
+void Hedge_record(Hedge *hedge, const void *group, size_t idx, long long us);
+
+/**
+ * @brief Free Hedge instance.
+ *
+ * @param hedge Hedge instance.
+ */
+void Hedge_free(Hedge *hedge);
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file journal.h
+ * @author Sayed Sadeed
+ * @brief Progress of a run kept on disk so a failed run can be resumed.
+ *
+ * Every group command which succeeded is recorded with the statement it ran under and a
+ * key identifying the host, the group, its place in the group and the command after
+ * variables were substituted. Statements run one at a time also record whether they
+ * failed and the value of every variable they changed.
+ *
+ * A resumed run restores the variables as they were before the first statement which
+ * failed and starts there. Commands found in the journal are skipped once for every time
+ * they were recorded, so a group run twice by a statement skips both runs. The journal
+ * belongs to the digest of the script it was written for, it is removed once a run
+ * finishes without errors and only created once a command succeeded.
+ *
+ * Records are lines, values of variables follow their line and are prefixed by their length:
+ *
+ * @code
+ * vmel-journal 1 <script digest>
+ * set <name> s|i|a <len>
+ * <value>
+ * done|fail <statement>
+ * cmd <statement> <key>
+ * @endcode
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include "sha256.h"
+#include "sytable.h"
+#include "vstring.h"
+#include "valloc.h"
+
+/**
+ * @brief Command recorded by the run being resumed, left is the number of times it may still be skipped.
+ */
+typedef struct {
+	size_t stmt;
+	unsigned char key[SHA256_SIZE];
+	size_t left;
+} JournalCmd;
+
+/**
+ * @brief Struct representing a Journal.
+ *
+ * resume is the first statement to run. cmds are sorted by statement and key. snapshot
+ * holds the records of the variables restored, written again when the journal is
+ * started. pending holds statement records not written yet, they only matter once a
+ * command succeeded. versions holds the version of every symbol when it was last
+ * recorded. Commands may be recorded and skipped from any thread, statements only from
+ * the thread running the script.
+ */
+typedef struct {
+	VString path;
+	unsigned char script[SHA256_SIZE];
+	int fd;
+	size_t resume;
+	JournalCmd *cmds;
+	size_t cmd_ctr;
+	size_t cmd_cap;
+	VString snapshot;
+	VString pending;
+	unsigned long *versions;
+	size_t version_ctr;
+	pthread_mutex_t lock;
+	VAllocator *alloc;
+} Journal;
+
+/**
+ * @brief Create new Journal instance, nothing is read or written yet.
+ *
+ * @param path File holding the journal.
+ * @param source Source of the script being run.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of Journal or NULL if failed.
+ */
+Journal *Journal_new(const char *path, const char *source, VAllocator *alloc);
+
+/**
+ * @brief Read the journal of a failed run and restore its variables into sy_table.
+ *
+ * @param journal Journal instance.
+ * @param sy_table SyTable of the run, pinned symbols are left alone.
+ * @return 0 if the journal was read otherwise -1, when missing or written for another script.
+ */
+int Journal_resume(Journal *journal, SyTable *sy_table);
+
+/**
+ * @brief Start recording a run of sy_table.
+ *
+ * A resumed journal is written again holding only what was restored and the commands
+ * recorded, otherwise any journal left by an earlier run is removed.
+ *
+ * @param journal Journal instance.
+ * @param sy_table SyTable of the run.
+ * @return 0 if success otherwise -1.
+ */
+int Journal_start(Journal *journal, SyTable *sy_table);
+
+/**
+ * @brief Record a statement which ran, along with the variables it changed.
+ *
+ * @param journal Journal instance.
+ * @param sy_table SyTable of the run.
+ * @param stmt Index of the statement.
+ * @param failed 1 if the statement raised errors otherwise 0.
+ */
+void Journal_statement(Journal *journal, SyTable *sy_table, size_t stmt, int failed);
+
+/**
+ * @brief Record a command which succeeded.
+ *
+ * @param journal Journal instance.
+ * @param stmt Statement the command ran under.
+ * @param key Key of the command.
+ */
+void Journal_command(Journal *journal, size_t stmt, const unsigned char *key);
+
+/**
+ * @brief Determine whether a command already succeeded in the run being resumed.
+ *
+ * @param journal Journal instance.
+ * @param stmt Statement the command runs under.
+ * @param key Key of the command.
+ * @return 1 if the command is to be skipped otherwise 0.
+ */
+int Journal_skip(Journal *journal, size_t stmt, const unsigned char *key);
+
+/**
+ * @brief Finish the run, the journal is removed unless it failed.
+ *
+ * @param journal Journal instance.
+ * @param failed 1 if the run raised errors otherwise 0.
+ */
+void Journal_end(Journal *journal, int failed);
+
+/**
+ * @brief Free Journal instance.
+ *
+ * @param journal Journal instance.
+ */
+void Journal_free(Journal *journal);
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file liveness.h
+ * @author Sayed Sadeed
+ * @brief Liveness analysis over the top level statements of a Program.
+ *
+ * A variable is live at a statement if some later statement may read it before it is
+ * definitely overwritten. Reads include identifiers, `$var` references inside templates
+ * and group commands, which a run statement reads from the group it runs. Every variable
+ * is considered live once the program ends since the symbol table of a Frame is its result.
+ * Statements running commands all write one pseudo variable so they keep their order.
+ *
+ * An assignment to a variable which isn't live is a dead store. If evaluating its right
+ * hand side can't raise an error, it can be skipped without changing output or the final
+ * symbol table.
+ */
+
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <stdio.h>
+#include "node.h"
+#include "valloc.h"
+
+// Statement assigns no variable.
+#define LIVE_NONE ((size_t) -1)
+
+/**
+ * @brief Result of analysing a NodeMgr.
+ *
+ * Variables are numbered from 0 to var_ctr. For statement i, defs[i] is the variable
+ * it assigns or LIVE_NONE, and the variables it reads are uses[use_start[i]] up to
+ * uses[use_start[i + 1]]. dead holds 1 for statements which are dead stores.
+ */
+typedef struct {
+	unsigned char *dead;
+	size_t *defs;
+	size_t *use_start;
+	size_t *uses;
+	size_t stmt_ctr;
+	size_t dead_ctr;
+	size_t var_ctr;
+	VAllocator *alloc;
+} Liveness;
+
+/**
+ * @brief Compute liveness of every variable and find dead stores.
+ *
+ * @param node_mgr NodeMgr holding top level statements.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of Liveness or NULL if failed.
+ */
+Liveness *Liveness_analyse(NodeMgr *node_mgr, VAllocator *alloc);
+
+/**
+ * @brief Print statements found to be dead stores.
+ *
+ * @param live Liveness instance.
+ * @param node_mgr NodeMgr which was analysed.
+ * @param out Stream to print to.
+ */
+void Liveness_print_report(Liveness *live, NodeMgr *node_mgr, FILE *out);
+
+/**
+ * @brief Free Liveness instance.
+ *
+ * @param live Liveness instance.
+ */
+void Liveness_free(Liveness *live);
+
+#endif
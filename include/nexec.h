@@ -4,10 +4,58 @@
  * @brief The execution module implementation. This module described how each node in an AST is executed.
  */
 
+#ifndef NEXEC_H
+#define NEXEC_H
+
 #include "sytable.h"
 #include "node.h"
 #include "errors.h"
 #include "vstring.h"
+#include "outsink.h"
+#include "proc.h"
+#include "evloop.h"
+#include "transport.h"
+#include "dag.h"
+#include "cache.h"
+#include "journal.h"
+#include "hedge.h"
+
+/**
+ * @brief Piece of an expanded template.
+ * 
+ * Either literal text from the template or the value of symbol sy.
+ */
+typedef struct {
+	const char *str;
+	size_t len;
+	Symbol *sy;
+} TmplSeg;
+
+/**
+ * @brief Symbol read by a statement along with the version which was read.
+ *
+ * sy is NULL when the name read doesn't exist.
+ */
+typedef struct {
+	Symbol *sy;
+	unsigned long version;
+} SymRead;
+
+/**
+ * @brief Groups of a plan and the shells they run in.
+ *
+ * order and prio come from GroupDag_plan(), lane and seed from GroupDag_lanes(). sessions
+ * holds the session of every lane, all NULL when the run has no pool.
+ */
+typedef struct {
+	size_t *order;
+	size_t len;
+	long long *prio;
+	size_t *lane;
+	long *seed;
+	Session **sessions;
+	size_t lane_ctr;
+} DagRun;
 
 /**
  * @brief Maintain state between tree executions.
@@ -18,15 +66,61 @@ typedef struct {
 	NodeMgr *node_mgr;
 	Node *curr_node;
 	VString buff;
+	VString name;
+	TmplSeg *segs;
+	size_t seg_ctr;
+	size_t seg_cap;
 	unsigned int scope;
+	// Every symbol read while track is set.
+	SymRead *reads;
+	size_t read_ctr;
+	size_t read_cap;
+	int track;
+	// Symbols of sy_table which assignments must leave alone.
+	size_t pinned;
+	// Leave errors in err_handle for the caller to report.
+	int defer_errors;
+	// Threads array builtins such as sort may use.
+	unsigned int jobs;
+	// Statements may run on threads, the sy_table allocator must be thread safe.
+	int threaded;
+	// Symbols groups read are flat already, so a plan may run on threads without flattening them.
+	int flat;
+	OutSink *out;
+	// Records every command run by a group when set.
+	ProcLog *log;
+	// Drives commands of this manager, created on first use, one per thread.
+	EvLoop *loop;
+	// Sessions per host, shared by every thread of a run.
+	TransportPool *pool;
+	// Host of the group being run, NULL for VMEL_LOCAL_HOST.
+	const char *host;
+	// Session the group being run uses, NULL to acquire the one of host.
+	Session *session;
+	// Hosts a run statement works on at once, also groups while running what a group needs.
+	unsigned int fanout;
+	// Needs of groups, NULL when no group needs another.
+	GroupDag *dag;
+	// Durations of groups, NULL along with dag.
+	DagHistory *history;
+	// Results of groups declared with cache, NULL to always run commands.
+	StepCache *steps;
+	// Records commands which succeeded under stmt when set.
+	Journal *journal;
+	// Index of the statement being run.
+	size_t stmt;
+	// Restarts slow commands of idempotent groups, never when NULL.
+	Hedge *hedge;
+	VAllocator *alloc;
 } NexecMgr;
 
 /**
  * @brief Create instance of NexecMgr.
  * 
+ * @param alloc Allocator for the manager and its buffers, NULL for system.
  * @return Pointer to new NexecMgr or NULL.
  */
-NexecMgr *NexecMgr_new(void);
+NexecMgr *NexecMgr_new(VAllocator *alloc);
 
 /**
  * @brief Free instance of NexecMgr;
@@ -62,19 +156,74 @@ int Nexec_expr_node(NexecMgr *nexec_mgr);
 /**
  * @brief Execute a group node.
  * 
- * Evaluate the commands within a group and perform
- * the appropriate actions.
+ * Every command of the group held by curr_node is expanded and run in order on host, its
+ * output is written to out. The group stops at the first command which fails. Commands
+ * run in session, otherwise the session of the host is held for the whole group.
  * 
  * @param nexec_mgr Pointer to NexecMgr instance.
  * @return 0 if success otherwise returns -1.
  */
 int Nexec_group_node(NexecMgr *nexec_mgr);
 
+/**
+ * @brief Execute a loop node.
+ * 
+ * Every iteration runs in a frame of its own holding the loop variable and whatever
+ * the body assigns, so nothing leaks between iterations or out of the loop. The
+ * parallel form spreads iterations over threads and emits their output in order.
+ * 
+ * @param nexec_mgr Pointer to NexecMgr instance.
+ * @return 0 if success otherwise returns -1.
+ */
+int Nexec_foreach_node(NexecMgr *nexec_mgr);
+
+/**
+ * @brief Run a single iteration of a loop.
+ * 
+ * The sy_table of nexec_mgr must be a frame, it is cleared before the loop variable is
+ * bound to element idx of items.
+ * 
+ * @param nexec_mgr Pointer to NexecMgr instance.
+ * @param loop Loop node.
+ * @param items Elements iterated over.
+ * @param idx Index of element.
+ * @return 0 if success otherwise returns -1.
+ */
+int Nexec_iteration(NexecMgr *nexec_mgr, Node *loop, VArray *items, size_t idx);
+
+/**
+ * @brief Run a group on one host of a list.
+ *
+ * Output is preceded by a line holding the host name in brackets.
+ *
+ * @param nexec_mgr Pointer to NexecMgr instance.
+ * @param group Group node.
+ * @param hosts Host names.
+ * @param idx Index of the host.
+ * @return 0 if success otherwise returns -1.
+ */
+int Nexec_host(NexecMgr *nexec_mgr, Node *group, VArray *hosts, size_t idx);
+
+/**
+ * @brief Run group idx of the dag of nexec_mgr and record how long it took.
+ *
+ * A group whose needs failed isn't run, an error naming the failed group is added instead.
+ * With a run the group uses the session of its lane, afterwards the groups starting a
+ * shell of their own from it get its directory and environment.
+ *
+ * @param nexec_mgr Pointer to NexecMgr instance.
+ * @param run Plan the group is part of or NULL to use the session of the host.
+ * @param idx Index of the group in dag.
+ * @param blocker Index of the failed group idx depends on or -1 to run it.
+ * @return 0 if success otherwise returns -1, also when skipped.
+ */
+int Nexec_dag_group(NexecMgr *nexec_mgr, DagRun *run, size_t idx, long blocker);
+
 /**
  * @brief Constructor for NexecMgr.
  * 
  * Create a new instance of NexecMgr and assign required 
- * structures.
+ * structures. The allocator of sy_table is used.
  * 
  * @param sy_table instance of SyTable.
  * @param node_mgr instance of NodeMgr.
@@ -101,3 +250,5 @@ int Nexec_exec(NexecMgr *nexec_mgr, Node *node);
  * @param hint additional information pertaining to error.
  */
 void NexecMgr_add_error(Error *err_handle, char *offender, char *hint);
+
+#endif
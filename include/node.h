@@ -9,6 +9,7 @@
 
 #include <string.h>
 #include "sytable.h"
+#include "arrstore.h"
 
 enum NodeType {
 	E_ADD_NODE, 
@@ -30,6 +31,9 @@ enum NodeType {
 	E_GREATERTHAN_NODE,
 	E_GREATERTHANEQ_NODE,
 	E_BETWEEN_NODE,
+	E_REDUCE_NODE,
+	E_SETOP_NODE,
+	E_FOREACH_NODE,
 	E_EOF_NODE
 };
 
@@ -43,6 +47,8 @@ struct Node {
     union SyntaxNode *data;
     enum NodeType type;
 	unsigned int depth;
+	unsigned int refs;
+	unsigned long hash;
 	char *value;
 };
 
@@ -51,6 +57,16 @@ typedef struct Node Node;
 
 /**
  * @brief SyntaxNode desscribes the data stored in each Node. 
+ * 
+ * ForeachNode runs the body_ctr statements of body once per element of items. jobs caps
+ * the number of threads of a parallel loop, 0 when no limit was given. FuncNode hosts is
+ * the host list a run statement fans out to, NULL for other functions. GroupNode needs
+ * holds the need_ctr names of the groups a group needs, parallel is set when commands
+ * of the group which don't conflict may run at once, at most jobs of them or 0 for the
+ * default. cached is set when results of its commands are kept in the step cache, keyed
+ * by the input_ctr inputs and checked against the output_ctr outputs declared. idempotent is
+ * set when its commands may be run again while still running, see Hedge. All of these are
+ * only set on the group node itself and not on the commands linked from it.
  */
 union SyntaxNode {
 	struct {
@@ -63,17 +79,55 @@ union SyntaxNode {
 	} AsnStmtNode;
     struct {
         Node *next;
+		char **needs;
+		size_t need_ctr;
+		unsigned int jobs;
+		int parallel;
+		char **inputs;
+		size_t input_ctr;
+		char **outputs;
+		size_t output_ctr;
+		int cached;
+		int idempotent;
 	} GroupNode;
 	struct {
 		Node *args;
+		Node *hosts;
 	} FuncNode;
 	struct {
-		size_t dctr;
-		size_t dcap;
-		Node **items;
+		Node *args;
+	} ReduceNode;
+	struct {
+		Node *left;
+		Node *right;
+	} SetOpNode;
+	struct {
+		ArrStore *store;
 	} ArrayNode;
+	struct {
+		Node *var;
+		Node *items;
+		Node **body;
+		size_t body_ctr;
+		unsigned int jobs;
+		int parallel;
+	} ForeachNode;
 };
 
+/**
+ * @brief Hash table of structurally unique nodes.
+ * 
+ * When enabled NodeMgr uses this table to share identical immutable subtrees
+ * (literals, identifiers and operations) instead of keeping duplicates.
+ */
+typedef struct {
+	Node **slots;
+	size_t slot_ctr;
+	size_t slot_cap;
+	size_t hits;
+	size_t bytes_saved;
+} NodeCons;
+
 /**
  * @brief NodeMgr manages holds all the nodes at the root level.
  * 
@@ -85,17 +139,21 @@ typedef struct {
     Node **nodes; 
     size_t nodes_ctr;
     size_t nodes_cap;
+    NodeCons *cons;
+    VAllocator *alloc;
 } NodeMgr;
 
 /**
  * @brief Create new node instance.
  * 
- * Will create a new node instance irrespective of NodeMgr.
+ * Will create a new node instance irrespective of NodeMgr. The node must be allocated
+ * from the same allocator as the NodeMgr which will eventually free it.
  * 
- * @param wdata With Data flag determines whether to malloc the data *.
+ * @param alloc Allocator instance or NULL for system.
+ * @param wdata With Data flag determines whether to allocate the data *.
  * @return Pointer to newly created node or null ptr if something went wrong.
  */
-Node *Node_new(int wdata);
+Node *Node_new(VAllocator *alloc, int wdata);
 
 /**
  * @brief Add an existing Node to the internal NodeMgr store.
@@ -112,6 +170,30 @@ Node *Node_new(int wdata);
 
  Node *NodeMgr_find_node(NodeMgr *node_mgr, char *value);
 
+/**
+ * @brief Enable hash-consing of nodes passed to NodeMgr_cons_node().
+ * 
+ * @param node_mgr NodeMgr instance.
+ * @return 0 if successful otherwise -1.
+ */
+int NodeMgr_enable_cons(NodeMgr *node_mgr);
+
+/**
+ * @brief Replace a freshly built node with an identical shared node if one exists.
+ * 
+ * Children of node are expected to have been passed through this function already,
+ * so two subtrees are identical when their type, value and child pointers match.
+ * If a match is found node is freed and the shared node is returned with its
+ * reference count incremented. Otherwise node is stored for future lookups.
+ * node->hash is set whether or not hash-consing has been enabled. Nodes which are
+ * mutable (groups, arrays, statements) are returned untouched.
+ * 
+ * @param node_mgr NodeMgr instance.
+ * @param node Node to be deduplicated.
+ * @return The node which should be used in place of node.
+ */
+Node *NodeMgr_cons_node(NodeMgr *node_mgr, Node *node);
+
 /**
  * @brief Free all resources creates by node manager. Including node manager itself.
  *
@@ -121,13 +203,14 @@ Node *Node_new(int wdata);
 int NodeMgr_free(NodeMgr *node_mgr);
 
 /**
- * @brief Create node manager malloc'ed.
+ * @brief Create node manager.
  * 
  * This function acts as a constructor for the Node manager.
  *
+ * @param alloc Allocator for the manager and its nodes, NULL for system.
  * @return newly created NodeMgr pointer.
  */
-NodeMgr *NodeMgr_new(void);
+NodeMgr *NodeMgr_new(VAllocator *alloc);
 
 /**
  * @brief Perform relloc on array of of nodes in Manager.
@@ -0,0 +1,145 @@
+/**
+ * @file outsink.h
+ * @author Sayed Sadeed
+ * @brief Buffered destination for everything a script prints.
+ *
+ * Output is collected in a large buffer and handed to the kernel with writev, so many
+ * lines cost a single system call. Large pieces such as rope leaves aren't copied, they
+ * are queued next to the buffered text and written in the same writev call.
+ *
+ * When to write is decided by the flush policy.
+ * - SINK_FLUSH_STATEMENT : after every statement, output appears as soon as it is produced.
+ * - SINK_FLUSH_SIZE      : whenever the buffer is full.
+ * - SINK_FLUSH_EXIT      : buffer grows as needed and is written when flushed explicitly or freed.
+ *
+ * A sink created with a negative fd captures output in memory instead, see OutSink_data().
+ */
+
+#ifndef OUTSINK_H
+#define OUTSINK_H
+
+#include <sys/uio.h>
+#include "valloc.h"
+#include "vrope.h"
+
+#define OUTSINK_IOV 64
+
+enum SinkFlush {
+	SINK_FLUSH_STATEMENT, SINK_FLUSH_SIZE, SINK_FLUSH_EXIT
+};
+
+/**
+ * @brief Output buffer along with pieces queued for the next write.
+ *
+ * iov holds the pending writes in order, entries either point into buf or at
+ * pieces referenced by OutSink_write_rope(). seg_start is where the part of buf
+ * not yet queued in iov begins.
+ */
+typedef struct {
+	int fd;
+	enum SinkFlush policy;
+	char *buf;
+	size_t len;
+	size_t cap;
+	size_t seg_start;
+	struct iovec iov[OUTSINK_IOV];
+	int iov_ctr;
+	size_t written;
+	int error;
+	VAllocator *alloc;
+} OutSink;
+
+/**
+ * @brief Create new OutSink instance.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param fd File descriptor to write to, negative to capture in memory.
+ * @param cap Size of the buffer, 0 for VMEL_OUT_BUFFER_SIZE.
+ * @param policy When buffered output is written.
+ * @return New instance of OutSink or NULL if failed.
+ */
+OutSink *OutSink_new(VAllocator *alloc, int fd, size_t cap, enum SinkFlush policy);
+
+/**
+ * @brief Append len bytes to the sink.
+ *
+ * @param sink OutSink instance.
+ * @param str Bytes to write.
+ * @param len Number of bytes.
+ * @return 0 if success otherwise -1.
+ */
+int OutSink_write(OutSink *sink, const char *str, size_t len);
+
+/**
+ * @brief Append a null terminated string followed by a newline.
+ *
+ * @param sink OutSink instance.
+ * @param str String to write.
+ * @return 0 if success otherwise -1.
+ */
+int OutSink_puts(OutSink *sink, const char *str);
+
+/**
+ * @brief Append every piece of a rope.
+ *
+ * Large pieces are referenced rather than copied and are written before returning,
+ * so the rope may be freed afterwards.
+ *
+ * @param sink OutSink instance.
+ * @param rope Rope to write.
+ * @return 0 if success otherwise -1.
+ */
+int OutSink_write_rope(OutSink *sink, VRope *rope);
+
+/**
+ * @brief Signal the end of a statement, flushes if policy is SINK_FLUSH_STATEMENT.
+ *
+ * @param sink OutSink instance.
+ */
+void OutSink_end_statement(OutSink *sink);
+
+/**
+ * @brief Write everything pending to the file descriptor.
+ *
+ * Has no effect on capturing sinks.
+ *
+ * @param sink OutSink instance.
+ * @return 0 if success otherwise -1.
+ */
+int OutSink_flush(OutSink *sink);
+
+/**
+ * @brief Change where a sink writes to, pending output is flushed first.
+ *
+ * @param sink OutSink instance.
+ * @param fd New file descriptor.
+ * @param policy New flush policy.
+ * @return 0 if success otherwise -1.
+ */
+int OutSink_redirect(OutSink *sink, int fd, enum SinkFlush policy);
+
+/**
+ * @brief Access output captured by a sink created with a negative fd.
+ *
+ * @param sink OutSink instance.
+ * @param len Set to number of bytes captured.
+ * @return Captured bytes, not null terminated.
+ */
+const char *OutSink_data(OutSink *sink, size_t *len);
+
+/**
+ * @brief Discard captured or buffered output which hasn't been written.
+ *
+ * @param sink OutSink instance.
+ */
+void OutSink_clear(OutSink *sink);
+
+/**
+ * @brief Flush and free OutSink instance.
+ *
+ * @param sink OutSink instance.
+ * @return 0 if every write succeeded otherwise -1.
+ */
+int OutSink_free(OutSink *sink);
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file parallel.h
+ * @author Sayed Sadeed
+ * @brief Run independent top level statements on worker threads.
+ *
+ * Statements are grouped into waves from the variables each one reads and writes. A
+ * statement is placed in the wave after the last earlier statement it conflicts with,
+ * which is one writing a variable it reads, reading a variable it writes or writing the
+ * same variable. Statements of a wave never conflict so they can run in any order.
+ *
+ * While a wave runs every statement captures its output and errors, afterwards they
+ * are emitted in program order so the result is the same as running sequentially.
+ *
+ * Iterations of a parallel loop are handed out the same way. Each thread starts with a
+ * contiguous range of iterations and once it runs out steals the upper half of the
+ * range of another thread, output and errors are emitted in iteration order. A group
+ * run on a list of hosts is split into one task per host likewise.
+ *
+ * Groups a run statement needs are taken from a shared ready list instead, the group
+ * with the longest path left first, and their output is emitted in plan order.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "liveness.h"
+#include "nexec.h"
+
+/**
+ * @brief Statements of a Program grouped into waves.
+ *
+ * Statements of wave w are order[wave_start[w]] up to order[wave_start[w + 1]], in
+ * program order. widest is the number of statements in the largest wave.
+ */
+typedef struct {
+	size_t *order;
+	size_t *wave_start;
+	size_t wave_ctr;
+	size_t widest;
+	size_t stmt_ctr;
+	VAllocator *alloc;
+} Schedule;
+
+/**
+ * @brief Build waves from the reads and writes found by liveness analysis.
+ *
+ * @param live Liveness instance.
+ * @param skip_dead Leave out statements marked as dead stores.
+ * @param alloc Allocator instance or NULL for system.
+ * @return New instance of Schedule or NULL if failed.
+ */
+Schedule *Schedule_build(Liveness *live, int skip_dead, VAllocator *alloc);
+
+/**
+ * @brief Free Schedule instance.
+ *
+ * @param sched Schedule instance.
+ */
+void Schedule_free(Schedule *sched);
+
+/**
+ * @brief Execute the statements of a schedule, wave by wave.
+ *
+ * Symbols, output and errors are those of nexec_mgr. The allocator of its symbol table
+ * must be safe to use from several threads.
+ *
+ * @param sched Schedule instance.
+ * @param nexec_mgr NexecMgr the statements would otherwise be executed with.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return 0 if success otherwise -1.
+ */
+int Parallel_run(Schedule *sched, NexecMgr *nexec_mgr, unsigned int jobs);
+
+/**
+ * @brief Execute every iteration of a loop on up to jobs threads.
+ *
+ * Every thread runs iterations in a frame of its own on top of the symbol table of
+ * nexec_mgr, which is only read. The allocator of the symbol table must be safe to use
+ * from several threads.
+ *
+ * @param nexec_mgr NexecMgr the loop would otherwise be executed with.
+ * @param loop Loop node.
+ * @param items Elements iterated over.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return 0 if success otherwise -1.
+ */
+int Parallel_foreach(NexecMgr *nexec_mgr, Node *loop, VArray *items, unsigned int jobs);
+
+/**
+ * @brief Run a group once per host on up to jobs threads.
+ *
+ * Output of every host is emitted in the order of hosts. A host listed more than once
+ * is worked on by one thread at a time, the transport pool of nexec_mgr also bounds the
+ * number of hosts worked on across every statement of the run.
+ *
+ * @param nexec_mgr NexecMgr the group would otherwise be run with.
+ * @param group Group node.
+ * @param hosts Host names.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return 0 if success otherwise -1.
+ */
+int Parallel_fanout(NexecMgr *nexec_mgr, Node *group, VArray *hosts, unsigned int jobs);
+
+/**
+ * @brief Run the groups of a plan on up to jobs threads.
+ *
+ * A group starts once every group it needs finished, of the groups ready the one with the
+ * highest prio goes first. Groups depending on one which failed are skipped. Every group
+ * runs in the session of its lane, which threads take from run rather than the pool, so
+ * shells are the same as when the plan runs on one thread. Output and errors are emitted
+ * in plan order.
+ *
+ * @param nexec_mgr NexecMgr holding the dag the plan was made from.
+ * @param run Plan along with the session of every lane.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return 0 if every group succeeded otherwise -1.
+ */
+int Parallel_dag(NexecMgr *nexec_mgr, DagRun *run, unsigned int jobs);
+
+#endif
@@ -25,14 +25,16 @@ typedef struct {
 	SyTable *sy_table;
 	TokenMgr *tok_mgr;
 	Error *err_handle;
+	VAllocator *alloc;
 } ParserMgr;
 
 /**
- * @brief Create new malloced ParserMgr instance.
+ * @brief Create new ParserMgr instance.
  * 
+ * @param alloc Allocator instance or NULL for system.
  * @return new instance of ParserMgr or null if failed. 
  */
-ParserMgr *ParserMgr_new();
+ParserMgr *ParserMgr_new(VAllocator *alloc);
 
 /**
  * @brief Free ParserMgr instance.
@@ -54,7 +56,8 @@ void ParserMgr_add_error(Error *err_handle, Token *offender, int err_type);
 /**
  * @brief Will consume a group based on grammar defintion.
  * 
- * Group = string | string_list
+ * Group = valid_idn [needs valid_idn {[,] valid_idn}] [parallel [INTEGER]] [idempotent]
+ *         [cache {string [,]} [creates string {[,] string}]] { string | string_list }
  * 
  * @param par_mgr ParserMgr instance.
  * @return Node generated from production.
@@ -72,6 +75,26 @@ Node *parse_compare(ParserMgr *par_mgr);
  */
 Node *parse_keyword(ParserMgr *par_mgr);
 
+/**
+ * @brief Will consume a loop based on grammar definition.
+ * 
+ * foreach = foreach IDENTIFIER in expression [parallel [INTEGER]] { statement_list }
+ * 
+ * @param par_mgr ParserMgr instance.
+ * @return Node generated from production.
+ */
+Node *parse_foreach(ParserMgr *par_mgr);
+
+/**
+ * @brief Will consume a statement running a group based on grammar definition.
+ * 
+ * run = run valid_idn [on expression]
+ * 
+ * @param par_mgr ParserMgr instance.
+ * @return Node generated from production.
+ */
+Node *parse_run(ParserMgr *par_mgr);
+
 /**
  * @brief Will consume assignment based on grammar.
  * 
@@ -102,10 +125,32 @@ Node *parse_expr(ParserMgr *par_mgr);
  */
 Node *parse_factor(ParserMgr *par_mgr);
 
+/**
+ * @brief Will consume an array literal based on grammar.
+ * 
+ * array = LBRACKET (INTEGER | STRING | array) {COMMA (INTEGER | STRING | array)} RBRACKET
+ * 
+ * @param par_mgr ParserMgr instance.
+ * @return Node generated from production.
+ */
+Node *parse_array(ParserMgr *par_mgr);
+
+/**
+ * @brief Will consume a call to an array builtin based on grammar.
+ * 
+ * builtin = (sum | min | max | count | sort | unique) LPAREN expression RPAREN
+ *         | (union | intersect | difference) LPAREN expression COMMA expression RPAREN
+ * 
+ * @param par_mgr ParserMgr instance.
+ * @return Node generated from production.
+ */
+Node *parse_builtin(ParserMgr *par_mgr);
+
 /**
  * @brief Initialise parser with required structs before parsing.
  * 
  * Function will initialise the components of ParserMgr to a ready state.
+ * Nodes are created with the allocator of node_mgr.
  * 
  * @param tok_mgr TokenMgr containing all token information.
  * @param sy_table SyTable instance to store resulting symbol information.
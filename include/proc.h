@@ -0,0 +1,192 @@
+/**
+ * @file proc.h
+ * @author Sayed Sadeed
+ * @brief Process engine used to run the commands of a group.
+ *
+ * Commands are started with posix_spawn, which forks through vfork so the cost doesn't
+ * grow with the size of the interpreter. A command made of plain words is split on
+ * whitespace and executed directly, only commands using shell syntax such as pipes,
+ * redirection, quotes, globs or builtins like cd are handed to /bin/sh -c.
+ *
+ * Stdout and stderr of the child are read through pipes while it runs, stdin is
+ * /dev/null. Exit status and wall time are recorded per command.
+ */
+
+#ifndef PROC_H
+#define PROC_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "vstring.h"
+#include "valloc.h"
+
+/**
+ * @brief A spawned command.
+ *
+ * status is the exit code of the command, 128 plus the signal number when it was killed
+ * and 127 when it couldn't be started. direct is set when the command was executed
+ * without a shell, cached when its result was taken from a StepCache instead of running and
+ * hedged when a second copy was started because it ran longer than its peers. elapsed_us is the time from spawning until the child was reaped.
+ */
+typedef struct {
+	pid_t pid;
+	int out_fd;
+	int err_fd;
+	int status;
+	int direct;
+	int cached;
+	int hedged;
+	long long start_us;
+	long long elapsed_us;
+	VString out;
+	VString err;
+} Proc;
+
+/**
+ * @brief Status and timing of one command run by a group.
+ *
+ * host is NULL for commands run on the default host.
+ */
+typedef struct {
+	const char *group;
+	char *host;
+	char *cmd;
+	int status;
+	int direct;
+	int cached;
+	int hedged;
+	long long elapsed_us;
+} ProcStat;
+
+/**
+ * @brief Log of every command run, shared between threads.
+ */
+typedef struct {
+	ProcStat *stats;
+	size_t ctr;
+	size_t cap;
+	pthread_mutex_t lock;
+	VAllocator *alloc;
+} ProcLog;
+
+/**
+ * @brief Determine whether a command must be run by /bin/sh.
+ *
+ * @param cmd Command line.
+ * @return 1 if the command uses shell syntax or a shell builtin otherwise 0.
+ */
+int Proc_needs_shell(const char *cmd);
+
+/**
+ * @brief Initialise a Proc and start its clock without spawning anything.
+ *
+ * Used for commands run by other means such as a Session, which fill in output and
+ * status then call Proc_exited().
+ *
+ * @param proc Proc instance.
+ * @param direct Whether the command runs without a shell.
+ * @param alloc Allocator for the captured output, NULL for system.
+ */
+void Proc_init(Proc *proc, int direct, VAllocator *alloc);
+
+/**
+ * @brief Start a command with its output connected to pipes.
+ *
+ * When the command can't be started status is set to 127 and the reason stored in err,
+ * Proc_wait() can be called either way.
+ *
+ * @param proc Proc instance to initialise.
+ * @param cmd Command line.
+ * @param alloc Allocator for the captured output, NULL for system.
+ * @return 0 if started otherwise -1.
+ */
+int Proc_spawn(Proc *proc, const char *cmd, VAllocator *alloc);
+
+/**
+ * @brief Start a command in a given directory and environment.
+ *
+ * Same as Proc_spawn() except the child starts in cwd with env as its environment.
+ *
+ * @param proc Proc instance to initialise.
+ * @param cmd Command line.
+ * @param cwd Working directory or NULL to inherit.
+ * @param env NULL terminated NAME=VALUE strings or NULL to inherit.
+ * @param alloc Allocator for the captured output, NULL for system.
+ * @return 0 if started otherwise -1.
+ */
+int Proc_spawn_in(Proc *proc, const char *cmd, const char *cwd, char *const *env, VAllocator *alloc);
+
+/**
+ * @brief Start a program with arguments which are already split, without a shell.
+ *
+ * @param proc Proc instance to initialise.
+ * @param argv NULL terminated arguments, argv[0] is looked up in PATH.
+ * @param cwd Working directory or NULL to inherit.
+ * @param env NULL terminated NAME=VALUE strings or NULL to inherit.
+ * @param alloc Allocator for the captured output, NULL for system.
+ * @return 0 if started otherwise -1.
+ */
+int Proc_spawn_argv(Proc *proc, char *const *argv, const char *cwd, char *const *env, VAllocator *alloc);
+
+/**
+ * @brief Read all output of a command and wait for it to exit.
+ *
+ * @param proc Proc instance started with Proc_spawn().
+ * @return Exit status of the command.
+ */
+int Proc_wait(Proc *proc);
+
+/**
+ * @brief Record how a reaped command exited along with its elapsed time.
+ *
+ * status is left alone when the command wasn't spawned.
+ *
+ * @param proc Proc instance.
+ * @param wstatus Status as returned by waitpid.
+ */
+void Proc_exited(Proc *proc, int wstatus);
+
+/**
+ * @brief Release output captured by a Proc.
+ *
+ * @param proc Proc instance.
+ */
+void Proc_free(Proc *proc);
+
+/**
+ * @brief Create new ProcLog instance.
+ *
+ * @param alloc Allocator instance or NULL for system, must be thread safe if the log is shared.
+ * @return New instance of ProcLog or NULL if failed.
+ */
+ProcLog *ProcLog_new(VAllocator *alloc);
+
+/**
+ * @brief Record a finished command.
+ *
+ * @param log ProcLog instance.
+ * @param group Name of the group the command belongs to.
+ * @param host Host the command ran on, copied into the log, or NULL for the default host.
+ * @param proc Finished command.
+ * @param cmd Command line as run, copied into the log.
+ * @return 0 if success otherwise -1.
+ */
+int ProcLog_add(ProcLog *log, const char *group, const char *host, Proc *proc, const char *cmd);
+
+/**
+ * @brief Print status and time of every command along with totals.
+ *
+ * @param log ProcLog instance.
+ * @param out Stream to print to.
+ */
+void ProcLog_print(ProcLog *log, FILE *out);
+
+/**
+ * @brief Free ProcLog instance.
+ *
+ * @param log ProcLog instance.
+ */
+void ProcLog_free(ProcLog *log);
+
+#endif
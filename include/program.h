@@ -0,0 +1,288 @@
+/**
+ * @file program.h
+ * @author Sayed Sadeed
+ * @brief Compiled representation of a script and the state required to run it.
+ *
+ * A Program is produced once from source and is never modified afterwards. It owns the
+ * ast, the constant strings referenced by nodes and the symbol layout declared by the parser.
+ * Every execution happens against a Frame which holds the values and buffers of that run.
+ * Since a Program is read only it can be shared by any number of Frames, including Frames
+ * being executed on different threads.
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdio.h>
+#include "node.h"
+#include "sytable.h"
+#include "errors.h"
+#include "strpool.h"
+#include "nexec.h"
+#include "outsink.h"
+#include "liveness.h"
+#include "parallel.h"
+#include "dag.h"
+#include "cache.h"
+#include "journal.h"
+#include "hedge.h"
+
+/**
+ * Flags which alter how a Program is compiled.
+ *
+ * PROGRAM_HASH_CONS share structurally identical subtrees between statements.
+ * PROGRAM_DUMP_TOKENS print the tokens of the script to stdout once it is tokenized.
+ * PROGRAM_DSE skip assignments whose value is overwritten before it is read.
+ * PROGRAM_PARALLEL group independent statements into waves, see Frame_set_jobs().
+ */
+#define PROGRAM_HASH_CONS 0x1
+#define PROGRAM_DUMP_TOKENS 0x2
+#define PROGRAM_DSE 0x4
+#define PROGRAM_PARALLEL 0x8
+
+/**
+ * @brief Immutable result of tokenizing and parsing a script.
+ *
+ * liveness is only computed when compiled with PROGRAM_DSE or PROGRAM_PARALLEL and
+ * schedule only with PROGRAM_PARALLEL, otherwise they are NULL. dag holds the needs of
+ * groups, NULL when no group needs another. group_ctr is the number of groups defined.
+ */
+typedef struct {
+	NodeMgr *node_mgr;
+	SyTable *layout;
+	StrPool *consts;
+	Liveness *liveness;
+	Schedule *schedule;
+	GroupDag *dag;
+	size_t group_ctr;
+	unsigned int flags;
+	VAllocator *alloc;
+} Program;
+
+/**
+ * @brief Inputs and result of an assignment from the last time it ran.
+ *
+ * The assignment is up to date while target still has version and every
+ * symbol in reads still has the version which was read.
+ */
+typedef struct {
+	Symbol *target;
+	unsigned long version;
+	SymRead *reads;
+	size_t read_ctr;
+	size_t read_cap;
+	int valid;
+} StmtCache;
+
+/**
+ * @brief Per run state of a Program.
+ *
+ * Everything printed by the run goes through out. When incremental is set, cache holds
+ * one entry per statement so repeated runs only recompute assignments whose inputs
+ * changed, reused counts the assignments skipped so far. jobs is the number of threads
+ * a run may use. pool holds the session of every host group commands ran on, which keeps
+ * connections, directory and environment between runs. history holds the durations of
+ * groups when the Program has a dag. steps keeps the results of commands of groups
+ * declared with cache in VMEL_CACHE_DIR. hedge holds the durations slow commands of
+ * idempotent groups are compared against, NULL when they are never hedged. These are
+ * created by the first run of a Program with groups, from transport, latency_ms and
+ * hedge_pct, and stay NULL otherwise. journal records the progress of the run when set,
+ * see Frame_set_journal().
+ */
+typedef struct {
+	SyTable *sy_table;
+	Error *err_handle;
+	NexecMgr *nexec_mgr;
+	OutSink *out;
+	TransportPool *pool;
+	DagHistory *history;
+	StepCache *steps;
+	Journal *journal;
+	Hedge *hedge;
+	const Transport *transport;
+	unsigned int latency_ms;
+	unsigned int hedge_pct;
+	unsigned int jobs;
+	int incremental;
+	StmtCache *cache;
+	size_t cache_ctr;
+	size_t reused;
+	VAllocator *alloc;
+} Frame;
+
+/**
+ * @brief Tokenize and parse source into a new Program.
+ *
+ * Token and parse errors are stored inside err_handle. Caller should check error_ctr
+ * before running the returned Program.
+ *
+ * @param buff Source to be compiled.
+ * @param flags Combination of PROGRAM_* flags or 0.
+ * @param alloc Allocator for everything owned by the Program, NULL for system.
+ * @param err_handle Error instance where compile errors will be logged.
+ * @return New instance of Program or NULL if source could not be tokenized.
+ */
+Program *Program_compile(char *buff, unsigned int flags, VAllocator *alloc, Error *err_handle);
+
+/**
+ * @brief Print a summary of how a Program was compiled. 
+ *
+ * @param program Program instance.
+ * @param out Stream to print to.
+ */
+void Program_print_report(Program *program, FILE *out);
+
+/**
+ * @brief Free all resources owned by Program.
+ *
+ * All Frames created from the Program must be freed beforehand.
+ *
+ * @param program Program instance.
+ */
+void Program_free(Program *program);
+
+/**
+ * @brief Execute every statement of a Program against a Frame.
+ *
+ * @param program Program instance.
+ * @param frame Frame created from the same Program.
+ * @return 0 if success otherwise -1.
+ */
+int Program_run(Program *program, Frame *frame);
+
+/**
+ * @brief Create new Frame ready to run Program.
+ *
+ * Symbol layout of the Program is copied into the Frame. Output is written to stdout
+ * once VMEL_OUT_BUFFER_SIZE bytes are buffered, see Frame_set_output(). Passing an arena as alloc
+ * allows everything a run allocates to be released at once with VAlloc_reset()
+ * after Frame_free().
+ *
+ * @param program Program instance.
+ * @param alloc Allocator for the Frame, NULL for system.
+ * @return New instance of Frame or NULL if failed.
+ */
+Frame *Frame_new(Program *program, VAllocator *alloc);
+
+/**
+ * @brief Change where and when output of a Frame is written.
+ *
+ * Anything buffered so far is written to the previous destination first.
+ *
+ * @param frame Frame instance.
+ * @param fd File descriptor to write to, negative to capture output in memory.
+ * @param policy When buffered output is written.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_output(Frame *frame, int fd, enum SinkFlush policy);
+
+/**
+ * @brief Enable or disable reuse of assignments between runs of a Frame.
+ *
+ * Every statement is executed on the first run, afterwards an assignment is only
+ * recomputed if a symbol it read has changed. Output statements always run.
+ *
+ * @param frame Frame instance.
+ * @param enable 1 to enable otherwise 0.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_incremental(Frame *frame, int enable);
+
+/**
+ * @brief Set the number of threads used to run independent statements.
+ *
+ * Only has an effect for Programs compiled with PROGRAM_PARALLEL and Frames using the
+ * system allocator, without incremental recomputation. Output is the same as a
+ * sequential run.
+ *
+ * @param frame Frame instance.
+ * @param jobs Number of threads, 0 for one per online cpu.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_jobs(Frame *frame, unsigned int jobs);
+
+/**
+ * @brief Record the progress of runs so a failed one can be resumed.
+ *
+ * Statements before journal->resume are skipped, any journal resumed must have been read
+ * with Journal_resume() into the SyTable of this Frame. Runs with a journal to resume run
+ * their statements one at a time. The journal must outlive the Frame's runs, the caller
+ * finishes it with Journal_end().
+ *
+ * @param frame Frame instance.
+ * @param journal Journal instance or NULL to stop recording.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_journal(Frame *frame, Journal *journal);
+
+/**
+ * @brief Set when commands of idempotent groups are hedged.
+ *
+ * A command running longer than percentile of the durations of its peers is started a
+ * second time, the first copy to succeed is kept. Frames start with VMEL_HEDGE_PERCENTILE.
+ *
+ * @param frame Frame instance.
+ * @param percentile Percentile from 1 to 100, 0 to never hedge.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_hedge(Frame *frame, unsigned int percentile);
+
+/**
+ * @brief Record status and time of every command run by groups.
+ *
+ * The log is shared by every thread of a run and must outlive the Frame's runs.
+ *
+ * @param frame Frame instance.
+ * @param log ProcLog instance or NULL to stop recording.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_log(Frame *frame, ProcLog *log);
+
+/**
+ * @brief Reach hosts of group commands through another transport.
+ *
+ * Sessions opened so far are closed, call before the first run.
+ *
+ * @param frame Frame instance.
+ * @param transport Transport found with Transport_find().
+ * @param latency_ms Delay per round trip for the fake transport.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_transport(Frame *frame, const Transport *transport, unsigned int latency_ms);
+
+/**
+ * @brief Set how many hosts are worked on at once.
+ *
+ * Bounds the threads of each run statement given hosts as well as the hosts held at
+ * once by the whole run.
+ *
+ * @param frame Frame instance.
+ * @param hosts Number of hosts, 0 for VMEL_FANOUT_HOSTS.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_fanout(Frame *frame, unsigned int hosts);
+
+/**
+ * @brief Change the value of a variable before the next run.
+ *
+ * The variable must be declared by the script. From then on the value is pinned,
+ * assignments made by the script no longer change it.
+ *
+ * @param frame Frame instance.
+ * @param name Name of the variable without $.
+ * @param value New value.
+ * @return 0 if success otherwise -1.
+ */
+int Frame_set_var(Frame *frame, char *name, char *value);
+
+/**
+ * @brief Free Frame instance.
+ *
+ * Buffered output is written before the Frame is released.
+ *
+ * @param frame Frame instance.
+ * @return 0 if successfully freed otherwise -1.
+ */
+int Frame_free(Frame *frame);
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * @file session.h
+ * @author Sayed Sadeed
+ * @brief Long lived shell which keeps directory and environment between commands.
+ *
+ * A Session belongs to one host and starts a shell there once through its Transport,
+ * every command needing a shell is then written to the stdin of that shell,
+ * so a `cd` or `export` made by one command is seen by the next. Each command is
+ * followed by a footer which prints a marker unique to the session together with the
+ * exit status, working directory and exported environment of the shell. Output up to
+ * the marker belongs to the command, what follows it is the new context.
+ *
+ * Commands without shell syntax may still be spawned directly where the transport can,
+ * Session_spawn() starts them in the directory and environment last reported by the shell.
+ *
+ * If the shell exits, for instance because a command called exit or the connection
+ * dropped, it is started again on next use in the last known directory and environment.
+ *
+ * Session_exec(), Session_spawn(), Session_put() and Session_get() take the lock of the
+ * session and dispatch to its transport. Session_start(), Session_run() and Session_stop()
+ * are the building blocks transports implement those with and expect the lock held.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <pthread.h>
+#include "evloop.h"
+#include "proc.h"
+#include "varray.h"
+#include "vstring.h"
+#include "valloc.h"
+
+struct Transport;
+
+/**
+ * @brief Struct representing a Session.
+ *
+ * pid is -1 while no shell is running. cwd is empty and env_ptrs NULL until the shell
+ * first reported them, children inherit those of vmel until then. env_ptrs holds a
+ * pointer to every element of env followed by NULL. lock serialises commands since
+ * the shell runs one at a time, started counts how often the shell was started. home
+ * is the directory the transport starts the shell in, empty for the default, and
+ * latency_ms the delay a simulating transport adds to every round trip. busy is set
+ * while a group holds the session through TransportPool_acquire(), live while the
+ * pool counts its shell as running. spare is set for sessions of a host beyond the
+ * first, they share its connection, next links the sessions of one host. stream is
+ * given output of the running command as it arrives together with stream_ctx, it is
+ * only set during Session_stream().
+ */
+typedef struct Session {
+	const struct Transport *transport;
+	VString host;
+	VString home;
+	unsigned int latency_ms;
+	pid_t pid;
+	int in_fd;
+	int out_fd;
+	int err_fd;
+	char marker[64];
+	VString cwd;
+	VArray *env;
+	char **env_ptrs;
+	VString out;
+	VString err;
+	VString cmd;
+	size_t started;
+	int busy;
+	int live;
+	int spare;
+	struct Session *next;
+	EvData stream;
+	void *stream_ctx;
+	pthread_mutex_t lock;
+	VAllocator *alloc;
+} Session;
+
+/**
+ * @brief Create new Session instance.
+ *
+ * The shell is only started by the first command.
+ *
+ * @param transport Transport reaching host.
+ * @param host Name of the host, handed to the transport.
+ * @param latency_ms Delay per round trip for transports simulating a network, otherwise ignored.
+ * @param alloc Allocator instance or NULL for system, must be thread safe if the session is shared.
+ * @return New instance of Session or NULL if failed.
+ */
+Session *Session_new(const struct Transport *transport, const char *host, unsigned int latency_ms, VAllocator *alloc);
+
+/**
+ * @brief Run a command through the shell of the session and wait for it.
+ *
+ * Output, status and elapsed time are stored in proc, which must be released with
+ * Proc_free() afterwards.
+ *
+ * @param session Session instance.
+ * @param cmd Command line.
+ * @param proc Proc instance to initialise.
+ * @return Exit status of the command.
+ */
+int Session_exec(Session *session, const char *cmd, Proc *proc);
+
+/**
+ * @brief Run a command through the shell of the session, passing its output on as it arrives.
+ *
+ * Same as Session_exec() except output is handed to data instead of stored in proc,
+ * apart from what a transport without a shell leaves there.
+ *
+ * @param session Session instance.
+ * @param cmd Command line.
+ * @param proc Proc instance to initialise.
+ * @param data Called with each piece of output of the command.
+ * @param ctx Handed to data.
+ * @return Exit status of the command.
+ */
+int Session_stream(Session *session, const char *cmd, Proc *proc, EvData data, void *ctx);
+
+/**
+ * @brief Start a command without a shell in the directory and environment of the session.
+ *
+ * Output is read from the pipes of proc, for instance by an EvLoop.
+ *
+ * @param session Session instance.
+ * @param cmd Command line made of plain words.
+ * @param proc Proc instance to initialise.
+ * @return 0 if started, 1 if the transport can't start commands outside the shell, otherwise -1.
+ */
+int Session_spawn(Session *session, const char *cmd, Proc *proc);
+
+/**
+ * @brief Copy a local file to the host of the session.
+ *
+ * Relative remote paths are resolved against the directory of the shell.
+ *
+ * @param session Session instance.
+ * @param local Path of the file on this machine.
+ * @param remote Path to write on the host.
+ * @return 0 if copied otherwise -1.
+ */
+int Session_put(Session *session, const char *local, const char *remote);
+
+/**
+ * @brief Copy a file from the host of the session.
+ *
+ * @param session Session instance.
+ * @param remote Path of the file on the host, relative to the directory of the shell.
+ * @param local Path to write on this machine.
+ * @return 0 if copied otherwise -1.
+ */
+int Session_get(Session *session, const char *remote, const char *local);
+
+/**
+ * @brief Close the connection of the session, keeping directory and environment.
+ *
+ * The shell is started again in the same context by the next command.
+ *
+ * @param session Session instance.
+ */
+void Session_close(Session *session);
+
+/**
+ * @brief Give session the directory and environment last reported by from.
+ *
+ * A running shell of session is stopped, the next command starts it again in that context.
+ * Neither session may be running a command.
+ *
+ * @param session Session instance to change.
+ * @param from Session of the same host to copy from.
+ */
+void Session_inherit(Session *session, Session *from);
+
+/**
+ * @brief Start argv as the shell of the session, reading commands from its stdin.
+ *
+ * @param session Session instance without a running shell.
+ * @param argv NULL terminated arguments, argv[0] is looked up in PATH.
+ * @param cwd Directory to start in or NULL to inherit.
+ * @param env NULL terminated NAME=VALUE strings or NULL to inherit.
+ * @return 0 if started otherwise -1 with errno set.
+ */
+int Session_start(Session *session, char *const *argv, const char *cwd, char *const *env);
+
+/**
+ * @brief Run a command in the running shell of the session and wait for it.
+ *
+ * Directory and environment reported after the command are stored in the session.
+ * If the shell exits meanwhile, everything it printed belongs to the command and its
+ * exit code is the status.
+ *
+ * @param session Session instance with a running shell.
+ * @param cmd Command line.
+ * @param proc Proc instance initialised by the caller.
+ * @return Exit status of the command.
+ */
+int Session_run(Session *session, const char *cmd, Proc *proc);
+
+/**
+ * @brief Close the pipes to the shell and reap it.
+ *
+ * @param session Session instance.
+ * @return Wait status of the shell.
+ */
+int Session_stop(Session *session);
+
+/**
+ * @brief Free Session instance.
+ *
+ * The transport closes the session, the shell sees the end of its input and exits.
+ *
+ * @param session Session instance.
+ */
+void Session_free(Session *session);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file sha256.h
+ * @author Sayed Sadeed
+ * @brief SHA-256 digests of strings and files.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bytes of a digest and characters of its hex form without the terminator.
+ */
+#define SHA256_SIZE 32
+#define SHA256_HEX 64
+
+/**
+ * @brief Struct representing a digest being computed.
+ *
+ * buf holds buf_len bytes not yet processed, len counts every byte passed in.
+ */
+typedef struct {
+	uint32_t state[8];
+	uint64_t len;
+	unsigned char buf[64];
+	size_t buf_len;
+} Sha256;
+
+/**
+ * @brief Start a new digest.
+ *
+ * @param ctx Sha256 instance.
+ */
+void Sha256_init(Sha256 *ctx);
+
+/**
+ * @brief Add bytes to a digest.
+ *
+ * @param ctx Sha256 instance.
+ * @param data Bytes to add.
+ * @param len Number of bytes.
+ */
+void Sha256_update(Sha256 *ctx, const void *data, size_t len);
+
+/**
+ * @brief Finish a digest, ctx must be initialised again before further use.
+ *
+ * @param ctx Sha256 instance.
+ * @param digest Receives SHA256_SIZE bytes.
+ */
+void Sha256_final(Sha256 *ctx, unsigned char *digest);
+
+/**
+ * @brief Add the contents of a file to a digest.
+ *
+ * @param ctx Sha256 instance.
+ * @param path File to read.
+ * @return 0 if read otherwise -1.
+ */
+int Sha256_file(Sha256 *ctx, const char *path);
+
+/**
+ * @brief Write a digest as lowercase hex.
+ *
+ * @param digest SHA256_SIZE bytes.
+ * @param hex Room for SHA256_HEX characters and a terminator.
+ */
+void Sha256_hex(const unsigned char *digest, char *hex);
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file stats.h
+ * @author Sayed Sadeed
+ * @brief Memory accounting and hot path counters.
+ *
+ * Counters are only compiled in when VMEL_STATS is defined (cmake -DVMEL_STATS=ON),
+ * otherwise every macro below expands to nothing so there is no cost at all.
+ *
+ * Allocations are attributed to a subsystem by wrapping the allocator a manager is
+ * constructed with, see STATS_ALLOC(). Counters are updated with relaxed atomics so
+ * they may be shared between threads.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include "valloc.h"
+
+/**
+ * @brief Subsystems which counters are kept for.
+ */
+enum StatSubsys {
+	STAT_TOKENIZER, STAT_PARSER, STAT_SYTABLE, STAT_VSTRING, STAT_ERROR, STAT_EXEC, STAT_SUBSYS_SIZE
+};
+
+/**
+ * @brief Counters of a single subsystem.
+ */
+typedef struct {
+	size_t allocs;
+	size_t bytes;
+	size_t live;
+	size_t peak;
+	size_t lookups;
+	size_t copies;
+	size_t nodes;
+} StatCounters;
+
+#ifdef VMEL_STATS
+
+extern StatCounters Stat_Table[STAT_SUBSYS_SIZE];
+
+/**
+ * @brief Wrap an allocator so every allocation is counted against subsystem.
+ *
+ * Wrapping an allocator which is already wrapped for another subsystem rewraps
+ * the underlying allocator, so counts are never attributed twice.
+ *
+ * @param subsys Subsystem allocations are attributed to.
+ * @param alloc Allocator instance or NULL for system.
+ * @return Counting allocator or alloc itself if no more wrappers are available.
+ */
+VAllocator *Stats_allocator(enum StatSubsys subsys, VAllocator *alloc);
+
+#define STATS_ALLOC(subsys, alloc) Stats_allocator(subsys, alloc)
+#define STATS_INC(subsys, field) __atomic_fetch_add(&Stat_Table[subsys].field, 1, __ATOMIC_RELAXED)
+
+#else
+
+#define STATS_ALLOC(subsys, alloc) (alloc)
+#define STATS_INC(subsys, field) ((void) 0)
+
+#endif
+
+/**
+ * @brief Print every counter as a table.
+ *
+ * If counters weren't compiled in a note saying so is printed instead.
+ *
+ * @param out Stream to print to.
+ */
+void Stats_print(FILE *out);
+
+#endif
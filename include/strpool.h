@@ -0,0 +1,60 @@
+/**
+ * @file strpool.h
+ * @author Sayed Sadeed
+ * @brief Append only storage for constant strings.
+ *
+ * StrPool copies strings into large blocks which are never moved once allocated.
+ * Pointers handed out by the pool therefore remain valid until the pool itself is freed.
+ * This allows token values to outlive the TokenMgr that produced them.
+ */
+
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+#include <string.h>
+#include "valloc.h"
+
+/**
+ * @brief Single block of storage inside a StrPool.
+ */
+typedef struct StrBlock {
+	struct StrBlock *next;
+	size_t used;
+	size_t cap;
+	char data[];
+} StrBlock;
+
+/**
+ * @brief Collection of blocks which hold strings.
+ */
+typedef struct {
+	StrBlock *head;
+	size_t bytes;
+	VAllocator *alloc;
+} StrPool;
+
+/**
+ * @brief Create new StrPool instance.
+ *
+ * @param alloc Allocator for the pool and its blocks, NULL for system.
+ * @return New instance of StrPool or NULL if failed.
+ */
+StrPool *StrPool_new(VAllocator *alloc);
+
+/**
+ * @brief Copy a null terminated string into the pool.
+ *
+ * @param pool StrPool instance.
+ * @param str String to be copied.
+ * @return Pointer to the pooled copy or NULL if failed.
+ */
+char *StrPool_add(StrPool *pool, const char *str);
+
+/**
+ * @brief Free every block owned by the pool as well as the pool.
+ *
+ * @param pool StrPool instance.
+ */
+void StrPool_free(StrPool *pool);
+
+#endif
@@ -11,6 +11,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "tokenizer.h"
+#include "vrope.h"
+#include "varray.h"
 
 enum SyType {
 	E_GROUP_TYPE, E_INTEGER_TYPE, E_IDN_TYPE, E_STRING_TYPE, E_FUNC_TYPE
@@ -18,29 +20,76 @@ enum SyType {
 
 /**
  * @brief Store relevant token pertaining to symbol entry.
+ * 
+ * Large values are kept in rope so they can be shared without copying and arrays
+ * are kept in arr, in both cases val is only filled in once a flat copy is requested.
+ * See Symbol_value().
+ * val_cap is the number of characters val can hold so updates may reuse it.
+ * version is bumped every time an update changes the value. Pinned symbols were
+ * given a value by the host and ignore assignments made by the script.
  */
 typedef struct {
 	char *label;
 	char *val;
+	size_t val_cap;
+	unsigned long version;
+	int pinned;
+	VRope rope;
+	VArray *arr;
 	unsigned int lineno;
 	enum SyType sy_type;
+	VAllocator *alloc;
 } Symbol;
 
 /**
  * @brief SymbolTable which stores collection of symbols.
+ * 
+ * A table with a parent is a frame. Lookups which miss the frame continue in parent
+ * while updates always land in the frame, so parent is never modified through it.
  */
-typedef struct {
+typedef struct SyTable {
 	Symbol **symbols;
 	size_t sym_cap;
 	size_t sym_ctr;
+	struct SyTable *parent;
+	VAllocator *alloc;
 } SyTable;
 
 /**
- * @brief Create malloc'ed SyTable instance.
+ * @brief Create SyTable instance.
  * 
+ * @param alloc Allocator for the table, its symbols and their values, NULL for system.
  * @return New instance of SyTable.
  */
-SyTable *SyTable_new();
+SyTable *SyTable_new(VAllocator *alloc);
+
+/**
+ * @brief Create a copy of an existing SyTable.
+ * 
+ * Every symbol including its current value is duplicated so the copy
+ * can be modified without affecting the source table.
+ * 
+ * @param src SyTable instance to copy.
+ * @param alloc Allocator used by the copy, NULL for system.
+ * @return New instance of SyTable or NULL if failed.
+ */
+SyTable *SyTable_clone(SyTable *src, VAllocator *alloc);
+
+/**
+ * @brief Create an empty frame on top of an existing SyTable.
+ * 
+ * @param parent SyTable instance symbols are looked up in when missing from the frame.
+ * @param alloc Allocator used by the frame, NULL for system.
+ * @return New instance of SyTable or NULL if failed.
+ */
+SyTable *SyTable_new_frame(SyTable *parent, VAllocator *alloc);
+
+/**
+ * @brief Remove every symbol held by SyTable instance, its parent is left alone.
+ * 
+ * @param sy_table SyTable instance.
+ */
+void SyTable_clear(SyTable *sy_table);
 
 /**
  * @brief Add a symbol to SyTable instance.
@@ -69,16 +118,29 @@ void SyTable_print_symbols(SyTable *sy_table);
 void SyTable_free(SyTable *sy_table);
 
 /**
- * @brief Create malloc'ed instance of Symbol.
+ * @brief Create instance of Symbol.
  * 
+ * @param alloc Allocator for the symbol and its values, NULL for system.
  * @return Symbol pointer.
  */
-Symbol *Symbol_new(void);
+Symbol *Symbol_new(VAllocator *alloc);
+
+/**
+ * @brief Get the value of a symbol as a null terminated string.
+ * 
+ * Symbols holding a rope are flattened and arrays formatted as [a, b] on first
+ * access, the result is kept until the symbol is updated.
+ * 
+ * @param sy Symbol instance.
+ * @return Value of symbol or NULL if undefined.
+ */
+char *Symbol_value(Symbol *sy);
 
 /**
  * @brief Get an existing symbol from SyTable instance.
  * 
- * Function can be used to determine if a symbol already exist.
+ * Function can be used to determine if a symbol already exist. Frames fall back
+ * to their parent.
  * 
  * @param sy_table SyTable instance.
  * @param sy_name name of the symbol to return.
@@ -89,12 +151,39 @@ Symbol *SyTable_get_symbol(SyTable *sy_table, char *sy_name);
 /**
  * @brief Update the value stored inside a symbol
  *
+ * Storing the value a symbol already holds leaves it, and its version, untouched.
+ *
  * @param sy_table SyTable instance.
  * @param sy_name name of the symbol to return.
  * @return 0 if successfully updated otherwise -1.
  */
 int SyTable_update_symbol(SyTable *sy_table, char *sy_name, char *sy_n_value);
 
+/**
+ * @brief Update the value stored inside a symbol with a rope.
+ *
+ * The symbol takes ownership of rope, caller must not free it afterwards.
+ *
+ * @param sy_table SyTable instance.
+ * @param sy_name name of the symbol to update.
+ * @param rope new value.
+ * @return 0 if successfully updated otherwise -1.
+ */
+int SyTable_update_symbol_rope(SyTable *sy_table, char *sy_name, VRope *rope);
+
+/**
+ * @brief Update the value stored inside a symbol with an array.
+ *
+ * The symbol takes ownership of arr, caller must not use it afterwards. Storing an
+ * array equal to the current one leaves the symbol, and its version, untouched.
+ *
+ * @param sy_table SyTable instance.
+ * @param sy_name name of the symbol to update.
+ * @param arr new value.
+ * @return 0 if successfully updated otherwise -1.
+ */
+int SyTable_update_symbol_array(SyTable *sy_table, char *sy_name, VArray *arr);
+
 /**
  * @brief Perform relloc on array of of symbols in SyTable.
  * 
@@ -10,6 +10,8 @@
 #include <string.h>
 #include "tokens.h"
 #include "conf.h"
+#include "strpool.h"
+#include "errors.h"
 
 /**
  * @brief Represent a single token read from input.
@@ -35,6 +37,9 @@ typedef struct {
 	Token *toks_tail;
 	size_t tok_ctr;
 	size_t tok_cap;
+	StrPool *pool;
+	Error *err_handle;
+	VAllocator *alloc;
 } TokenMgr;
 
 
@@ -53,7 +58,8 @@ Token **grow_curr_tokens(TokenMgr *tok_mgr);
  * @brief Build tokens from steam of input.
  * 
  * Provides a decoupled implementation for building tokens from
- * any source stream. Can be contents of file or stdin.
+ * any source stream. Can be contents of file or stdin. Errors are added to
+ * err_handle of tokmgr when set, otherwise they are printed.
  * 
  * @param buff the contents which should be tokenized.
  * @param tokmgr Token Manager to handle tokenization.
@@ -62,13 +68,14 @@ Token **grow_curr_tokens(TokenMgr *tok_mgr);
 int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr);
 
 /**
- * @brief Create token manager malloc'ed.
+ * @brief Create token manager.
  * 
  * This function acts as a constructor for the Token manager.
  * 
+ * @param alloc Allocator for tokens and their values, NULL for system.
  * @return newly created TokenMgr pointer.
  */
-TokenMgr *TokenMgr_new(void);
+TokenMgr *TokenMgr_new(VAllocator *alloc);
 
 /**
  * @brief Add another token to token manager.
@@ -91,6 +98,17 @@ int TokenMgr_add_token(TokenMgr *tok_mgr, TokenType tok_type, char *tok_val, int
  */
 int TokenMgr_free(TokenMgr *tok_mgr);
 
+/**
+ * @brief Hand over ownership of the pool holding token values.
+ * 
+ * Token values are stored inside a StrPool. Once released the pool is no longer
+ * freed by TokenMgr_free() so the values remain valid for the caller. 
+ * 
+ * @param tok_mgr Pointer to token manager.
+ * @return StrPool containing every token value.
+ */
+StrPool *TokenMgr_release_pool(TokenMgr *tok_mgr);
+
 /**
  * @brief Print contents of token manager. Useful for debugging.
  * 
@@ -30,7 +30,7 @@
 #define DOT '.'
 #define BTICK '`'
 
-#define KWORDS_SIZE 7
+#define KWORDS_SIZE 23
 
 /**
  * brief Token type in conjunction to the derived types.
@@ -0,0 +1,149 @@
+/**
+ * @file transport.h
+ * @author Sayed Sadeed
+ * @brief Ways of reaching a host and the pool of sessions open to hosts.
+ *
+ * A Transport is a table of functions a Session calls to start its shell, run a command,
+ * spawn a command outside the shell, copy files and close. Three are provided:
+ *
+ * local runs commands on this machine.
+ *
+ * fake stands in for remote hosts without a network. Every host gets a sandbox directory
+ * below VMEL_FAKE_ROOT its shell starts in, absolute paths given to put and get are taken
+ * relative to it, and every round trip sleeps for the latency of the session. Commands
+ * may still leave the sandbox, it separates hosts but isn't a jail.
+ *
+ * ssh keeps one `ssh host sh -s` per host as shell, with connection sharing enabled so
+ * scp transfers reuse the connection. Commands spawned outside the shell run as an `ssh`
+ * of their own over that connection, in the directory and environment of the shell.
+ *
+ * A TransportPool hands out one Session per host, so each connection is set up once per
+ * run no matter how many groups use the host. Groups acquire the session of their host
+ * for as long as they run, which keeps groups on one host from interleaving and bounds
+ * the number of hosts worked on at once. Groups of one host which may run at the same
+ * time take spare sessions of the host besides, which share its connection. Past VMEL_POOL_LIVE_SHELLS running shells, or
+ * fewer when the descriptor limit is low, a released session is closed so fanning out
+ * to thousands of hosts doesn't hold a connection and three descriptors for each.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <pthread.h>
+#include "session.h"
+#include "valloc.h"
+
+/**
+ * @brief Struct representing a Transport.
+ *
+ * All functions are called with the lock of the session held. open starts the shell and
+ * returns 0 or -1 with errno set, exec runs a command in the running shell like
+ * Session_run(). spawn returns like Session_spawn(), put and get like Session_put() and
+ * Session_get(). close stops the shell and releases whatever else the transport holds.
+ */
+typedef struct Transport {
+	const char *name;
+	int (*open)(Session *session);
+	int (*exec)(Session *session, const char *cmd, Proc *proc);
+	int (*spawn)(Session *session, const char *cmd, Proc *proc);
+	int (*put)(Session *session, const char *local, const char *remote);
+	int (*get)(Session *session, const char *remote, const char *local);
+	void (*close)(Session *session);
+} Transport;
+
+/**
+ * @brief Struct representing a TransportPool.
+ *
+ * sessions holds the sessions of every host used so far, lock guards it since threads
+ * of a run share the pool. slots is an open addressing index into sessions by host
+ * name, holding index + 1 of the first session of the host or 0 when free. active counts sessions acquired, at most
+ * max_active at once unless max_active is 0, threads waiting for a session sleep on released.
+ * live_ctr counts sessions with a running shell, as last seen when released, live_max
+ * is the number kept running and also bounds active.
+ */
+typedef struct {
+	const Transport *transport;
+	unsigned int latency_ms;
+	Session **sessions;
+	size_t ctr;
+	size_t cap;
+	size_t *slots;
+	size_t slot_cap;
+	unsigned int active;
+	unsigned int max_active;
+	size_t live_ctr;
+	size_t live_max;
+	pthread_mutex_t lock;
+	pthread_cond_t released;
+	VAllocator *alloc;
+} TransportPool;
+
+/**
+ * @brief Look up a transport by name.
+ *
+ * @param name One of local, fake or ssh.
+ * @return Transport or NULL if unknown.
+ */
+const Transport *Transport_find(const char *name);
+
+/**
+ * @brief Create new TransportPool instance.
+ *
+ * @param transport Transport of every session in the pool.
+ * @param latency_ms Delay per round trip handed to each session.
+ * @param max_active Number of sessions which may be acquired at once, 0 for no limit.
+ * @param alloc Allocator instance or NULL for system, must be thread safe if the pool is shared.
+ * @return New instance of TransportPool or NULL if failed.
+ */
+TransportPool *TransportPool_new(const Transport *transport, unsigned int latency_ms, unsigned int max_active, VAllocator *alloc);
+
+/**
+ * @brief Get the session of a host, creating it on first use.
+ *
+ * @param pool TransportPool instance.
+ * @param host Name of the host.
+ * @return Session owned by the pool or NULL if failed.
+ */
+Session *TransportPool_get(TransportPool *pool, const char *host);
+
+/**
+ * @brief Get the session of a host for exclusive use.
+ *
+ * Waits while another thread holds the session of host or max_active sessions are held.
+ *
+ * @param pool TransportPool instance.
+ * @param host Name of the host.
+ * @return Session owned by the pool or NULL if failed, release with TransportPool_release().
+ */
+Session *TransportPool_acquire(TransportPool *pool, const char *host);
+
+/**
+ * @brief Get another session of a host for exclusive use.
+ *
+ * An idle spare session of host is reused, otherwise a new one is added. Spares never wait
+ * and don't count towards max_active, the host is already being worked on.
+ *
+ * @param pool TransportPool instance.
+ * @param host Name of the host.
+ * @return Session owned by the pool or NULL if failed, release with TransportPool_release().
+ */
+Session *TransportPool_acquire_spare(TransportPool *pool, const char *host);
+
+/**
+ * @brief Hand a session acquired with TransportPool_acquire() or TransportPool_acquire_spare() back.
+ *
+ * The session is closed if the pool holds too many running shells.
+ *
+ * @param pool TransportPool instance.
+ * @param session Session acquired from pool.
+ */
+void TransportPool_release(TransportPool *pool, Session *session);
+
+/**
+ * @brief Free TransportPool instance and close every session in it.
+ *
+ * @param pool TransportPool instance.
+ */
+void TransportPool_free(TransportPool *pool);
+
+#endif
@@ -127,6 +127,18 @@ char *string_dup(char *src);
  */
 char *string_find_var(char *hstack, char vprefix);
 
+/**
+ * @brief Hash a null terminated string using FNV-1a.
+ * 
+ * The seed allows hashes to be chained, pass the result of a previous
+ * call to combine several values into a single hash.
+ * 
+ * @param str String to hash.
+ * @param seed Initial hash value, use 0 for a fresh hash.
+ * @return Resulting hash.
+ */
+unsigned long string_hash(const char *str, unsigned long seed);
+
 /**
  * @brief Determine if char is one of accepted identifiers.
  * 
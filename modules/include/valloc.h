@@ -0,0 +1,125 @@
+/**
+ * @file valloc.h
+ * @author Sayed Sadeed
+ * @brief Pluggable allocator interface used by every manager.
+ *
+ * A VAllocator is a small table of functions along with the state they operate on.
+ * Managers keep the allocator they were constructed with and route every allocation
+ * through it. Passing NULL wherever an allocator is accepted selects the system allocator.
+ *
+ * Three implementations are provided.
+ * - System : thin wrapper around malloc, realloc and free.
+ * - Arena  : bump allocator, free is a no-op and everything is released at once by reset.
+ * - Pool   : size-class free lists carved out of large slabs, reset releases every slab.
+ *
+ * Arena and Pool aren't thread safe, use a separate instance per thread.
+ */
+
+#ifndef VALLOC_H
+#define VALLOC_H
+
+#include <string.h>
+
+/**
+ * @brief Allocator function table.
+ */
+typedef struct VAllocator {
+	void *(*alloc)(void *ctx, size_t size);
+	void *(*realloc)(void *ctx, void *ptr, size_t size);
+	void (*free)(void *ctx, void *ptr);
+	void (*reset)(void *ctx);
+	void (*destroy)(void *ctx);
+	void *ctx;
+} VAllocator;
+
+/**
+ * @brief Shared system allocator.
+ *
+ * @return Pointer to the allocator, it must not be destroyed.
+ */
+VAllocator *VAlloc_system(void);
+
+/**
+ * @brief Create a bump arena allocator.
+ *
+ * Memory is handed out from blocks of block_size bytes, larger requests get a block
+ * of their own. Once limit bytes have been reserved further allocations fail.
+ *
+ * @param block_size Size of each block, 0 for default.
+ * @param limit Maximum number of bytes the arena may reserve, 0 for no limit.
+ * @return New allocator or NULL if failed.
+ */
+VAllocator *VAlloc_arena_new(size_t block_size, size_t limit);
+
+/**
+ * @brief Create a size-class pool allocator.
+ *
+ * Requests up to 2048 bytes are rounded up to a power of two and served from free
+ * lists, larger requests are passed through to the system allocator.
+ *
+ * @return New allocator or NULL if failed.
+ */
+VAllocator *VAlloc_pool_new(void);
+
+/**
+ * @brief Release every allocation made through an arena or pool at once.
+ *
+ * Has no effect on the system allocator.
+ *
+ * @param alloc Allocator instance.
+ */
+void VAlloc_reset(VAllocator *alloc);
+
+/**
+ * @brief Free an allocator created by VAlloc_arena_new() or VAlloc_pool_new().
+ *
+ * @param alloc Allocator instance.
+ */
+void VAlloc_destroy(VAllocator *alloc);
+
+/**
+ * @brief Allocate size bytes.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param size Number of bytes.
+ * @return Pointer to memory or NULL if failed.
+ */
+void *VAlloc_alloc(VAllocator *alloc, size_t size);
+
+/**
+ * @brief Allocate size zeroed bytes.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param size Number of bytes.
+ * @return Pointer to memory or NULL if failed.
+ */
+void *VAlloc_calloc(VAllocator *alloc, size_t size);
+
+/**
+ * @brief Resize memory previously returned by the same allocator.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param ptr Existing memory or NULL.
+ * @param size New number of bytes.
+ * @return Pointer to memory or NULL if failed, in which case ptr is unchanged.
+ */
+void *VAlloc_realloc(VAllocator *alloc, void *ptr, size_t size);
+
+/**
+ * @brief Free memory previously returned by the same allocator.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param ptr Memory to free, may be NULL.
+ */
+void VAlloc_free(VAllocator *alloc, void *ptr);
+
+/**
+ * @brief Duplicate a null terminated string.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param src String to duplicate.
+ * @return Copy of src or NULL if src is NULL or allocation failed.
+ */
+char *VAlloc_strdup(VAllocator *alloc, const char *src);
+
+#endif
@@ -0,0 +1,264 @@
+/**
+ * @file varray.h
+ * @author Sayed Sadeed
+ * @brief Implementation of typed arrays along with element-wise kernels.
+ *
+ * A VArray holds either integers or strings. Integers live in one contiguous buffer,
+ * strings are stored back to back in a single character buffer with an offset per
+ * element. Kernels operate on whole integer buffers in straight loops without branches
+ * so the compiler can vectorize them.
+ *
+ * Sorting and set operations split large arrays between up to jobs threads. Integers
+ * are sorted with a radix sort and strings with a merge sort. Set operations hash the
+ * elements into a table shared by the threads and keep the first occurrence of each
+ * element in the order of the left array.
+ */
+
+#ifndef VARRAY_H
+#define VARRAY_H
+
+#include <string.h>
+#include "valloc.h"
+
+enum VArrayKind {
+	VARRAY_INT, VARRAY_STR
+};
+
+/**
+ * @brief Operation applied by VArray_map() and VArray_zip().
+ *
+ * Comparisons produce 1 or 0 for each element.
+ */
+enum VArrayOp {
+	VARRAY_ADD, VARRAY_SUB, VARRAY_MUL, VARRAY_DIV,
+	VARRAY_EQ, VARRAY_NE, VARRAY_LT, VARRAY_LE, VARRAY_GT, VARRAY_GE
+};
+
+/**
+ * @brief Struct representing a VArray.
+ *
+ * For VARRAY_INT elements are ints[0] up to ints[len]. For VARRAY_STR element i is the
+ * null terminated string starting at chars + offs[i]. cap is the number of elements
+ * which fit without growing, chars_cap the number of characters.
+ */
+typedef struct {
+	enum VArrayKind kind;
+	int *ints;
+	size_t *offs;
+	char *chars;
+	size_t len;
+	size_t cap;
+	size_t chars_len;
+	size_t chars_cap;
+	VAllocator *alloc;
+} VArray;
+
+/**
+ * @brief Create a new empty VArray.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @param kind Kind of elements held.
+ * @param cap Number of elements to reserve room for.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_new(VAllocator *alloc, enum VArrayKind kind, size_t cap);
+
+/**
+ * @brief Create a copy of a VArray.
+ *
+ * @param src VArray to copy.
+ * @param alloc Allocator used by the copy, NULL for system.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_copy(VArray *src, VAllocator *alloc);
+
+/**
+ * @brief Make room for at least cap elements.
+ *
+ * @param arr VArray instance.
+ * @param cap Number of elements.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_reserve(VArray *arr, size_t cap);
+
+/**
+ * @brief Append an integer to a VARRAY_INT array.
+ *
+ * @param arr VArray instance.
+ * @param num Value to append.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_push_int(VArray *arr, int num);
+
+/**
+ * @brief Append a copy of n integers to a VARRAY_INT array.
+ *
+ * @param arr VArray instance.
+ * @param nums Values to append.
+ * @param n Number of values.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_push_ints(VArray *arr, const int *nums, size_t n);
+
+/**
+ * @brief Append a copy of len characters as one element of a VARRAY_STR array.
+ *
+ * @param arr VArray instance.
+ * @param str Characters to append.
+ * @param len Number of characters.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_push_str(VArray *arr, const char *str, size_t len);
+
+/**
+ * @brief Get string element of a VARRAY_STR array.
+ *
+ * @param arr VArray instance.
+ * @param idx Index of element.
+ * @return Null terminated element or NULL if out of range.
+ */
+const char *VArray_str_at(VArray *arr, size_t idx);
+
+/**
+ * @brief Determine whether two arrays hold the same elements.
+ *
+ * @param a VArray instance.
+ * @param b VArray instance.
+ * @return 1 if equal otherwise 0.
+ */
+int VArray_equal(VArray *a, VArray *b);
+
+/**
+ * @brief Apply op between every element of src and a scalar.
+ *
+ * dest is replaced with the result and must not be src.
+ *
+ * @param dest VARRAY_INT array receiving the result.
+ * @param src VARRAY_INT array.
+ * @param op Operation.
+ * @param num Scalar operand.
+ * @param num_left Use num as left operand instead of right.
+ * @return 0 if success otherwise -1, including division by zero.
+ */
+int VArray_map(VArray *dest, VArray *src, enum VArrayOp op, int num, int num_left);
+
+/**
+ * @brief Apply op between elements at the same index of two arrays.
+ *
+ * Elements past the end of the shorter array are ignored. dest is replaced with the
+ * result and must be neither a nor b.
+ *
+ * @param dest VARRAY_INT array receiving the result.
+ * @param a VARRAY_INT array, left operands.
+ * @param b VARRAY_INT array, right operands.
+ * @param op Operation.
+ * @return 0 if success otherwise -1, including division by zero.
+ */
+int VArray_zip(VArray *dest, VArray *a, VArray *b, enum VArrayOp op);
+
+/**
+ * @brief Keep the elements of src within [lo, hi], in order.
+ *
+ * @param dest VARRAY_INT array receiving the result, must not be src.
+ * @param src VARRAY_INT array.
+ * @param lo Smallest value kept.
+ * @param hi Largest value kept.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_filter_range(VArray *dest, VArray *src, int lo, int hi);
+
+/**
+ * @brief Sum of the elements of a VARRAY_INT array.
+ *
+ * @param arr VArray instance.
+ * @return Sum, 0 for an empty array.
+ */
+long long VArray_sum(VArray *arr);
+
+/**
+ * @brief Smallest element of a VARRAY_INT array.
+ *
+ * @param arr VArray instance.
+ * @param out Where the result is stored.
+ * @return 0 if success otherwise -1 when arr is empty.
+ */
+int VArray_min(VArray *arr, int *out);
+
+/**
+ * @brief Largest element of a VARRAY_INT array.
+ *
+ * @param arr VArray instance.
+ * @param out Where the result is stored.
+ * @return 0 if success otherwise -1 when arr is empty.
+ */
+int VArray_max(VArray *arr, int *out);
+
+/**
+ * @brief Sort elements in ascending order, strings byte wise.
+ *
+ * @param arr VArray instance.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return 0 if success otherwise -1.
+ */
+int VArray_sort(VArray *arr, unsigned int jobs);
+
+/**
+ * @brief Create an array holding the first occurrence of every element.
+ *
+ * @param arr VArray instance.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_unique(VArray *arr, unsigned int jobs);
+
+/**
+ * @brief Create an array of the distinct elements of a followed by those only in b.
+ *
+ * @param a VArray instance.
+ * @param b VArray instance of the same kind as a.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_union(VArray *a, VArray *b, unsigned int jobs);
+
+/**
+ * @brief Create an array of the distinct elements of a which are also in b.
+ *
+ * @param a VArray instance.
+ * @param b VArray instance of the same kind as a.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_intersect(VArray *a, VArray *b, unsigned int jobs);
+
+/**
+ * @brief Create an array of the distinct elements of a which aren't in b.
+ *
+ * @param a VArray instance.
+ * @param b VArray instance of the same kind as a.
+ * @param jobs Maximum number of threads, including the calling one.
+ * @return New VArray or NULL if failed.
+ */
+VArray *VArray_difference(VArray *a, VArray *b, unsigned int jobs);
+
+/**
+ * @brief Format array as text such as [1, 2, 3].
+ *
+ * Behaves like snprintf, at most size characters including the null terminator are
+ * written to dest.
+ *
+ * @param arr VArray instance.
+ * @param dest Buffer or NULL when size is 0.
+ * @param size Size of dest.
+ * @return Length of the full text excluding the null terminator.
+ */
+size_t VArray_format(VArray *arr, char *dest, size_t size);
+
+/**
+ * @brief Free VArray instance.
+ *
+ * @param arr VArray instance, may be NULL.
+ */
+void VArray_free(VArray *arr);
+
+#endif
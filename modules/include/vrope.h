@@ -0,0 +1,159 @@
+/**
+ * @file vrope.h
+ * @author Sayed Sadeed
+ * @brief Implementation of a rope for building large strings without repeated copying.
+ *
+ * A VRope is a balanced tree whose leaves are pieces of text. Appending, inserting
+ * and slicing only create O(log n) new nodes, existing pieces are shared rather than copied.
+ * Nodes are reference counted and never modified once built, so a slice or another
+ * rope appended into this one stay valid independently of the source.
+ */
+
+#ifndef VROPE_H
+#define VROPE_H
+
+#include <string.h>
+#include <sys/types.h>
+#include "valloc.h"
+
+/**
+ * @brief Piece of text or concatenation of two sub ropes.
+ *
+ * Leaves have no children. A leaf either owns its buffer, borrows it from the
+ * caller or is a slice which keeps the leaf it was cut from alive through base.
+ * alloc is the allocator the node and its buffer came from, nodes shared into a rope
+ * with another allocator are still released through it.
+ */
+typedef struct VRopeNode {
+	struct VRopeNode *left;
+	struct VRopeNode *right;
+	struct VRopeNode *base;
+	const char *str;
+	char *owned;
+	size_t len;
+	unsigned int height;
+	unsigned int refs;
+	VAllocator *alloc;
+} VRopeNode;
+
+/**
+ * @brief Struct representing a VRope.
+ *
+ * Nodes built for the rope are allocated through alloc.
+ */
+typedef struct {
+	VRopeNode *root;
+	VAllocator *alloc;
+} VRope;
+
+/**
+ * @brief Instantiate a new empty VRope.
+ *
+ * @param alloc Allocator instance or NULL for system.
+ * @return VRope object.
+ */
+VRope VRope_new(VAllocator *alloc);
+
+/**
+ * @brief Total number of characters stored in VRope.
+ *
+ * @param rope VRope instance.
+ * @return Length of rope.
+ */
+size_t VRope_length(VRope *rope);
+
+/**
+ * @brief Append a copy of len characters to the end of VRope.
+ *
+ * @param rope VRope instance.
+ * @param str Characters to append.
+ * @param len Number of characters.
+ * @return 0 if success otherwise -1.
+ */
+int VRope_append(VRope *rope, const char *str, size_t len);
+
+/**
+ * @brief Append len characters to the end of VRope without copying.
+ *
+ * The characters are referenced directly, so caller must keep them alive
+ * and unchanged for as long as the rope or any rope sharing it exists.
+ *
+ * @param rope VRope instance.
+ * @param str Characters to append.
+ * @param len Number of characters.
+ * @return 0 if success otherwise -1.
+ */
+int VRope_append_ref(VRope *rope, const char *str, size_t len);
+
+/**
+ * @brief Append the contents of another VRope, sharing its pieces.
+ *
+ * @param rope VRope instance being appended to.
+ * @param other VRope which is appended, it is left unchanged.
+ * @return 0 if success otherwise -1.
+ */
+int VRope_append_rope(VRope *rope, VRope *other);
+
+/**
+ * @brief Insert a copy of len characters at position pos.
+ *
+ * @param rope VRope instance.
+ * @param pos Position to insert at, clamped to the length of rope.
+ * @param str Characters to insert.
+ * @param len Number of characters.
+ * @return 0 if success otherwise -1.
+ */
+int VRope_insert(VRope *rope, size_t pos, const char *str, size_t len);
+
+/**
+ * @brief Create a new VRope holding characters [start, end) of rope.
+ *
+ * @param rope VRope instance, left unchanged.
+ * @param start First character of slice.
+ * @param end One past the last character of slice, clamped to the length of rope.
+ * @return New VRope using the allocator of rope, must be freed by caller.
+ */
+VRope VRope_slice(VRope *rope, size_t start, size_t end);
+
+/**
+ * @brief Call fn for every piece of VRope in order.
+ *
+ * Iteration stops early if fn returns non zero.
+ *
+ * @param rope VRope instance.
+ * @param fn Callback receiving each piece.
+ * @param ctx Passed through to fn.
+ * @return 0 if every piece was visited otherwise the value returned by fn.
+ */
+int VRope_each(VRope *rope, int (*fn)(const char *str, size_t len, void *ctx), void *ctx);
+
+/**
+ * @brief Copy the contents of VRope into a single buffer.
+ *
+ * @param rope VRope instance.
+ * @param out Buffer of at least VRope_length() + 1 characters, will be null terminated.
+ * @return Number of characters copied excluding null terminator.
+ */
+size_t VRope_flatten(VRope *rope, char *out);
+
+/**
+ * @brief Write the contents of VRope to a file descriptor without flattening.
+ *
+ * Pieces are handed to writev() directly, in batches of at most IOV_MAX.
+ *
+ * @param rope VRope instance.
+ * @param fd File descriptor to write to.
+ * @return Number of bytes written or -1 if failed.
+ */
+ssize_t VRope_writev(VRope *rope, int fd);
+
+/**
+ * @brief Free resources.
+ *
+ * VRope is left empty and may be reused afterwards.
+ *
+ * @param rope Pointer to VRope object.
+ */
+int VRope_free(VRope *rope);
+
+#endif
@@ -2,41 +2,67 @@
  * @file vstring.h
  * @author Sayed Sadeed
  * @brief Implementation of a string module to allow better string handling.
+ *
+ * Strings of up to VSTRING_SSO_SIZE characters are stored inline inside the VString
+ * itself, only longer strings are moved to a malloc'ed buffer. Since the location of the
+ * characters depends on the length always access them through VString_str().
+ * Defining VSTRING_SSO_SIZE as 0 for every source stores any non empty string on the heap.
  */
 
 #ifndef VSTRING_H
 #define VSTRING_H
 
-#define INIT_STRING_SIZE 15
+#ifndef VSTRING_SSO_SIZE
+#define VSTRING_SSO_SIZE 15
+#endif
 
 #include <string.h>
+#include "valloc.h"
 
 /**
  * @brief Struct representing a VString.
- * 
+ *
+ * str_cap is the number of characters which fit without growing, excluding
+ * the null terminator. A capacity of VSTRING_SSO_SIZE means the inline buffer is in use.
+ * Heap buffers are allocated through alloc.
  */
 typedef struct {
+	VAllocator *alloc;
 	size_t str_size;
 	size_t str_cap;
-	char *str;
+	union {
+		char *heap;
+		char sso[VSTRING_SSO_SIZE + 1];
+	} buf;
 } VString;
 
+/**
+ * @brief Access the null terminated characters of a VString.
+ *
+ * @param vstr VString instance.
+ * @return Pointer to the characters, only valid until the VString is next modified.
+ */
+static inline char *VString_str(VString *vstr) {
+	return vstr->str_cap > VSTRING_SSO_SIZE ? vstr->buf.heap : vstr->buf.sso;
+}
+
 /**
  * @brief Instantiate a new empty VString string object.
- * 
- * Function will create an emptu VString object along with a
- * malloc'ed str based on default size.
- * 
+ *
+ * Function will create an empty VString object using the inline buffer,
+ * no allocation is made.
+ *
+ * @param alloc Allocator used once the string outgrows the inline buffer, NULL for system.
  * @return VString object.
  */
-VString VString_new(void); 
+VString VString_new(VAllocator *alloc);
 
 /**
  * @brief Set the entire VString object to new string value.
- * 
- * Will wipe out existing data. Note that if the current buffer size
- * isn't significantly bigger than no reallocation will be made..
- * 
+ *
+ * Will wipe out existing data. Note that if the current buffer is
+ * big enough no reallocation will be made.
+ *
  * @param vstr VString instance.
  * @param str String value.
  * @return Pointer to VString.
@@ -45,10 +71,10 @@ VString *VString_set(VString *vstr, char *str);
 
 /**
  * @brief Push a single character into a VString.
- * 
+ *
  * Function will append a single character to the passed
  * VString instance. Unlike VString_pushs() which operates on string.
- * 
+ *
  * @param vstr VString instance.
  * @param c char to append.
  * @return Pointer to VString.
@@ -57,42 +83,83 @@ VString *VString_pushc(VString *vstr, char c);
 
 /**
  * @brief Push a string into a VString.
- * 
+ *
  * Function will append a string to the passed
  * VString instance. Unlike VString_pushc() which operates on a single char.
- * 
+ *
  * @param vstr VString instance.
  * @param str String to append to instance.
  * @return Pointer to VString.
  */
 VString *VString_pushs(VString *vstr, char *str);
 
+/**
+ * @brief Push len characters of a string into a VString.
+ *
+ * Same as VString_pushs() except str doesn't need to be null terminated.
+ *
+ * @param vstr VString instance.
+ * @param str Characters to append to instance.
+ * @param len Number of characters to append.
+ * @return Pointer to VString.
+ */
+VString *VString_pushn(VString *vstr, const char *str, size_t len);
 
 /**
  * @brief Instantiate a new VString instance with a string parameter.
- * 
- * Create a VString object and set the string value 
+ *
+ * Create a VString object and set the string value
  * as the passed str parameter. It is also possible to set the capcity using
  * the second paramter cap. This will allocate the buffer size to equate to cap.
  * Note that there is no implicit enforcement on fixed sizing however it will help
  * lessen memory wastage if known string sizes are instantiated with an explicit capacity.
- * 
+ *
  * @code
- * VString fixed_string = VString_create("I am a string", 12);
- * VString string = VString_create("I am a string too", 0);
+ * VString fixed_string = VString_create(NULL, "I am a string", 12);
+ * VString string = VString_create(NULL, "I am a string too", 0);
  * @endcode
- * 
+ *
+ * @param alloc Allocator for the string, NULL for system.
  * @param str Value to set str to.
  * @param cap a predefined size if constant.
  * @return Pointer to VString object.
  */
-VString VString_create(char *str, size_t cap); 
+VString VString_create(VAllocator *alloc, char *str, size_t cap);
+
+/**
+ * @brief Ensure a VString can hold cap characters without growing.
+ *
+ * @param vstr VString instance.
+ * @param cap Number of characters excluding null terminator.
+ * @return 0 if success otherwise -1.
+ */
+int VString_reserve(VString *vstr, size_t cap);
+
+/**
+ * @brief Release capacity which isn't used by the current string.
+ *
+ * Strings short enough are moved back to the inline buffer.
+ *
+ * @param vstr VString instance.
+ * @return 0 if success otherwise -1.
+ */
+int VString_shrink_to_fit(VString *vstr);
 
+/**
+ * @brief Replace every occurrence of find with replace.
+ *
+ * @param vstr VString instance.
+ * @param find String to search for.
+ * @param replace Replacement value.
+ * @return 0 if success otherwise -1.
+ */
 int VString_replace(VString *vstr, char *find, char *replace);
 
 /**
  * @brief Free resources.
- * 
+ *
+ * VString is left empty and may be reused afterwards.
+ *
  * @param vstr Pointer to VString object.
  */
 int VString_free(VString *vstr);
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "valloc.h"
+
+#define VALLOC_ALIGN 16
+#define VALLOC_ARENA_BLOCK 65536
+#define VALLOC_POOL_SLAB 65536
+#define VALLOC_POOL_CLASSES 8
+#define VALLOC_POOL_MIN 16
+#define VALLOC_POOL_LARGE ((size_t) -1)
+
+// Round size up to alignment.
+static size_t align_up(size_t size) {
+	return (size + VALLOC_ALIGN - 1) & ~((size_t) VALLOC_ALIGN - 1);
+}
+
+// Header stored in front of every arena and pool allocation.
+typedef struct {
+	size_t size;
+	size_t cls;
+} VAllocHdr;
+
+/**
+ * System allocator.
+ */
+
+static void *system_alloc(void *ctx, size_t size) {
+	(void) ctx;
+	return malloc(size);
+}
+
+static void *system_realloc(void *ctx, void *ptr, size_t size) {
+	(void) ctx;
+	return realloc(ptr, size);
+}
+
+static void system_free(void *ctx, void *ptr) {
+	(void) ctx;
+	free(ptr);
+}
+
+static void system_reset(void *ctx) {
+	(void) ctx;
+}
+
+static VAllocator System_Allocator = {
+	system_alloc, system_realloc, system_free, system_reset, NULL, NULL
+};
+
+VAllocator *VAlloc_system(void) {
+	return &System_Allocator;
+}
+
+/**
+ * Arena allocator.
+ */
+
+typedef struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t used;
+	size_t cap;
+	size_t pad;
+	unsigned char data[];
+} ArenaBlock;
+
+typedef struct {
+	VAllocator iface;
+	ArenaBlock *head;
+	void *last;
+	size_t block_size;
+	size_t limit;
+	size_t reserved;
+} Arena;
+
+static ArenaBlock *arena_block(Arena *arena, size_t size) {
+	size_t cap = size > arena->block_size ? size : arena->block_size;
+
+	if (arena->limit && arena->reserved + cap > arena->limit)
+		return NULL;
+
+	ArenaBlock *blk = malloc(sizeof(ArenaBlock) + cap);
+	if (!blk)
+		return NULL;
+
+	blk->used = 0;
+	blk->cap = cap;
+	blk->next = arena->head;
+	arena->head = blk;
+	arena->reserved += cap;
+	return blk;
+}
+
+static void *arena_alloc(void *ctx, size_t size) {
+	Arena *arena = ctx;
+	size_t need = align_up(sizeof(VAllocHdr)) + align_up(size);
+	ArenaBlock *blk = arena->head;
+
+	if (!blk || blk->cap - blk->used < need) {
+		blk = arena_block(arena, need);
+		if (!blk)
+			return NULL;
+	}
+
+	VAllocHdr *hdr = (VAllocHdr *) (blk->data + blk->used);
+	hdr->size = size;
+	hdr->cls = 0;
+	blk->used += need;
+	arena->last = hdr + 1;
+	return arena->last;
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size) {
+	Arena *arena = ctx;
+
+	if (!ptr)
+		return arena_alloc(ctx, size);
+
+	VAllocHdr *hdr = (VAllocHdr *) ptr - 1;
+	ArenaBlock *blk = arena->head;
+
+	// Most recent allocation can grow in place.
+	if (ptr == arena->last) {
+		size_t old_need = align_up(hdr->size);
+		size_t new_need = align_up(size);
+		if (new_need <= old_need || blk->cap - blk->used >= new_need - old_need) {
+			blk->used = blk->used - old_need + new_need;
+			hdr->size = size;
+			return ptr;
+		}
+	}
+
+	if (size <= hdr->size) {
+		hdr->size = size;
+		return ptr;
+	}
+
+	void *n_ptr = arena_alloc(ctx, size);
+	if (n_ptr)
+		memcpy(n_ptr, ptr, hdr->size);
+	return n_ptr;
+}
+
+static void arena_free(void *ctx, void *ptr) {
+	(void) ctx;
+	(void) ptr;
+}
+
+static void arena_reset(void *ctx) {
+	Arena *arena = ctx;
+	ArenaBlock *blk = arena->head;
+
+	// Keep the most recent block around for reuse.
+	if (!blk)
+		return;
+
+	ArenaBlock *itr = blk->next;
+	while (itr) {
+		ArenaBlock *next = itr->next;
+		free(itr);
+		itr = next;
+	}
+
+	blk->next = NULL;
+	blk->used = 0;
+	arena->reserved = blk->cap;
+	arena->last = NULL;
+}
+
+static void arena_destroy(void *ctx) {
+	Arena *arena = ctx;
+	ArenaBlock *itr = arena->head;
+
+	while (itr) {
+		ArenaBlock *next = itr->next;
+		free(itr);
+		itr = next;
+	}
+	free(arena);
+}
+
+VAllocator *VAlloc_arena_new(size_t block_size, size_t limit) {
+	Arena *arena = malloc(sizeof(Arena));
+	if (!arena)
+		return NULL;
+
+	arena->iface.alloc = arena_alloc;
+	arena->iface.realloc = arena_realloc;
+	arena->iface.free = arena_free;
+	arena->iface.reset = arena_reset;
+	arena->iface.destroy = arena_destroy;
+	arena->iface.ctx = arena;
+	arena->head = NULL;
+	arena->last = NULL;
+	arena->block_size = block_size ? block_size : VALLOC_ARENA_BLOCK;
+	arena->limit = limit;
+	arena->reserved = 0;
+	return &arena->iface;
+}
+
+/**
+ * Pool allocator.
+ */
+
+typedef struct PoolSlab {
+	struct PoolSlab *next;
+	size_t pad;
+	unsigned char data[];
+} PoolSlab;
+
+// Header of allocations too large for any class.
+typedef struct PoolLarge {
+	struct PoolLarge *prev;
+	struct PoolLarge *next;
+	VAllocHdr hdr;
+} PoolLarge;
+
+typedef struct PoolSlot {
+	struct PoolSlot *next;
+} PoolSlot;
+
+typedef struct {
+	VAllocator iface;
+	PoolSlab *slabs;
+	PoolLarge *large;
+	PoolSlot *free_lists[VALLOC_POOL_CLASSES];
+} Pool;
+
+// Find smallest class which fits size or VALLOC_POOL_LARGE.
+static size_t pool_class(size_t size) {
+	size_t cls = 0;
+	size_t cap = VALLOC_POOL_MIN;
+
+	while (cap < size) {
+		cap <<= 1;
+		cls++;
+	}
+
+	return cls < VALLOC_POOL_CLASSES ? cls : VALLOC_POOL_LARGE;
+}
+
+// Carve a fresh slab into slots for class cls.
+static int pool_refill(Pool *pool, size_t cls) {
+	size_t slot_size = sizeof(VAllocHdr) + ((size_t) VALLOC_POOL_MIN << cls);
+	PoolSlab *slab = malloc(sizeof(PoolSlab) + VALLOC_POOL_SLAB);
+
+	if (!slab)
+		return -1;
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	for (size_t off = 0; off + slot_size <= VALLOC_POOL_SLAB; off += slot_size) {
+		VAllocHdr *hdr = (VAllocHdr *) (slab->data + off);
+		PoolSlot *slot = (PoolSlot *) (hdr + 1);
+		slot->next = pool->free_lists[cls];
+		pool->free_lists[cls] = slot;
+	}
+
+	return 0;
+}
+
+static void *pool_alloc(void *ctx, size_t size) {
+	Pool *pool = ctx;
+	size_t cls = pool_class(size);
+
+	if (cls == VALLOC_POOL_LARGE) {
+		PoolLarge *large = malloc(sizeof(PoolLarge) + size);
+		if (!large)
+			return NULL;
+
+		large->prev = NULL;
+		large->next = pool->large;
+		if (pool->large)
+			pool->large->prev = large;
+		pool->large = large;
+		large->hdr.size = size;
+		large->hdr.cls = VALLOC_POOL_LARGE;
+		return &large->hdr + 1;
+	}
+
+	if (!pool->free_lists[cls] && pool_refill(pool, cls))
+		return NULL;
+
+	PoolSlot *slot = pool->free_lists[cls];
+	pool->free_lists[cls] = slot->next;
+
+	VAllocHdr *hdr = (VAllocHdr *) slot - 1;
+	hdr->size = size;
+	hdr->cls = cls;
+	return slot;
+}
+
+static void pool_free(void *ctx, void *ptr) {
+	Pool *pool = ctx;
+
+	if (!ptr)
+		return;
+
+	VAllocHdr *hdr = (VAllocHdr *) ptr - 1;
+
+	if (hdr->cls == VALLOC_POOL_LARGE) {
+		PoolLarge *large = (PoolLarge *) ((unsigned char *) hdr - offsetof(PoolLarge, hdr));
+		if (large->prev)
+			large->prev->next = large->next;
+		else
+			pool->large = large->next;
+		if (large->next)
+			large->next->prev = large->prev;
+		free(large);
+		return;
+	}
+
+	PoolSlot *slot = ptr;
+	slot->next = pool->free_lists[hdr->cls];
+	pool->free_lists[hdr->cls] = slot;
+}
+
+static void *pool_realloc(void *ctx, void *ptr, size_t size) {
+	if (!ptr)
+		return pool_alloc(ctx, size);
+
+	VAllocHdr *hdr = (VAllocHdr *) ptr - 1;
+
+	// Still fits inside the same class.
+	if (hdr->cls != VALLOC_POOL_LARGE && pool_class(size) == hdr->cls) {
+		hdr->size = size;
+		return ptr;
+	}
+
+	void *n_ptr = pool_alloc(ctx, size);
+	if (!n_ptr)
+		return NULL;
+
+	memcpy(n_ptr, ptr, hdr->size < size ? hdr->size : size);
+	pool_free(ctx, ptr);
+	return n_ptr;
+}
+
+static void pool_reset(void *ctx) {
+	Pool *pool = ctx;
+
+	while (pool->slabs) {
+		PoolSlab *next = pool->slabs->next;
+		free(pool->slabs);
+		pool->slabs = next;
+	}
+
+	while (pool->large) {
+		PoolLarge *next = pool->large->next;
+		free(pool->large);
+		pool->large = next;
+	}
+
+	memset(pool->free_lists, 0, sizeof(pool->free_lists));
+}
+
+static void pool_destroy(void *ctx) {
+	pool_reset(ctx);
+	free(ctx);
+}
+
+VAllocator *VAlloc_pool_new(void) {
+	Pool *pool = malloc(sizeof(Pool));
+	if (!pool)
+		return NULL;
+
+	pool->iface.alloc = pool_alloc;
+	pool->iface.realloc = pool_realloc;
+	pool->iface.free = pool_free;
+	pool->iface.reset = pool_reset;
+	pool->iface.destroy = pool_destroy;
+	pool->iface.ctx = pool;
+	pool->slabs = NULL;
+	pool->large = NULL;
+	memset(pool->free_lists, 0, sizeof(pool->free_lists));
+	return &pool->iface;
+}
+
+/**
+ * Generic interface.
+ */
+
+void VAlloc_reset(VAllocator *alloc) {
+	if (alloc)
+		alloc->reset(alloc->ctx);
+}
+
+void VAlloc_destroy(VAllocator *alloc) {
+	if (alloc && alloc->destroy)
+		alloc->destroy(alloc->ctx);
+}
+
+void *VAlloc_alloc(VAllocator *alloc, size_t size) {
+	if (!alloc)
+		return malloc(size);
+	return alloc->alloc(alloc->ctx, size);
+}
+
+void *VAlloc_calloc(VAllocator *alloc, size_t size) {
+	void *ptr = VAlloc_alloc(alloc, size);
+	if (ptr)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+void *VAlloc_realloc(VAllocator *alloc, void *ptr, size_t size) {
+	if (!alloc)
+		return realloc(ptr, size);
+	return alloc->realloc(alloc->ctx, ptr, size);
+}
+
+void VAlloc_free(VAllocator *alloc, void *ptr) {
+	if (!ptr)
+		return;
+	if (!alloc)
+		free(ptr);
+	else
+		alloc->free(alloc->ctx, ptr);
+}
+
+char *VAlloc_strdup(VAllocator *alloc, const char *src) {
+	if (!src)
+		return NULL;
+
+	size_t len = strlen(src) + 1;
+	char *dest = VAlloc_alloc(alloc, len);
+	if (dest)
+		memcpy(dest, src, len);
+	return dest;
+}
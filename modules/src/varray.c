@@ -0,0 +1,926 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "varray.h"
+
+// Initial number of elements reserved when growing an empty array.
+#define VARRAY_INIT_SIZE 16
+
+// Elements tested at a time by VArray_filter_range() before compacting.
+#define VARRAY_FILTER_BLOCK 64
+
+// Fewest elements handed to each thread by sorting and set operations.
+#define VARRAY_PARALLEL_MIN 32768
+
+// Most threads used by a single operation.
+#define VARRAY_MAX_JOBS 64
+
+VArray *VArray_new(VAllocator *alloc, enum VArrayKind kind, size_t cap) {
+	VArray *arr = VAlloc_alloc(alloc, sizeof(VArray));
+	if (!arr)
+		return NULL;
+
+	arr->kind = kind;
+	arr->ints = NULL;
+	arr->offs = NULL;
+	arr->chars = NULL;
+	arr->len = 0;
+	arr->cap = 0;
+	arr->chars_len = 0;
+	arr->chars_cap = 0;
+	arr->alloc = alloc;
+
+	if (cap && VArray_reserve(arr, cap)) {
+		VAlloc_free(alloc, arr);
+		return NULL;
+	}
+
+	return arr;
+}
+
+VArray *VArray_copy(VArray *src, VAllocator *alloc) {
+	if (!src)
+		return NULL;
+
+	VArray *arr = VArray_new(alloc, src->kind, src->len);
+	if (!arr)
+		return NULL;
+
+	if (src->kind == VARRAY_INT) {
+		if (src->len)
+			memcpy(arr->ints, src->ints, src->len * sizeof(int));
+	}
+	else {
+		if (src->len)
+			memcpy(arr->offs, src->offs, src->len * sizeof(size_t));
+
+		if (src->chars_len) {
+			arr->chars = VAlloc_alloc(alloc, src->chars_len);
+			if (!arr->chars) {
+				VArray_free(arr);
+				return NULL;
+			}
+			memcpy(arr->chars, src->chars, src->chars_len);
+			arr->chars_len = src->chars_len;
+			arr->chars_cap = src->chars_len;
+		}
+	}
+
+	arr->len = src->len;
+	return arr;
+}
+
+int VArray_reserve(VArray *arr, size_t cap) {
+	if (!arr)
+		return -1;
+
+	if (cap <= arr->cap)
+		return 0;
+
+	if (arr->kind == VARRAY_INT) {
+		int *n_ints = VAlloc_realloc(arr->alloc, arr->ints, cap * sizeof(int));
+		if (!n_ints)
+			return -1;
+		arr->ints = n_ints;
+	}
+	else {
+		size_t *n_offs = VAlloc_realloc(arr->alloc, arr->offs, cap * sizeof(size_t));
+		if (!n_offs)
+			return -1;
+		arr->offs = n_offs;
+	}
+
+	arr->cap = cap;
+	return 0;
+}
+
+// Ensure room for one more element, doubling capacity when full.
+static int varray_grow(VArray *arr) {
+	if (arr->len < arr->cap)
+		return 0;
+	return VArray_reserve(arr, arr->cap ? arr->cap * 2 : VARRAY_INIT_SIZE);
+}
+
+int VArray_push_int(VArray *arr, int num) {
+	if (!arr || arr->kind != VARRAY_INT || varray_grow(arr))
+		return -1;
+
+	arr->ints[arr->len++] = num;
+	return 0;
+}
+
+int VArray_push_ints(VArray *arr, const int *nums, size_t n) {
+	if (!arr || arr->kind != VARRAY_INT || (n && !nums))
+		return -1;
+
+	if (arr->len + n > arr->cap) {
+		size_t n_cap = arr->cap ? arr->cap : VARRAY_INIT_SIZE;
+		while (n_cap < arr->len + n)
+			n_cap *= 2;
+		if (VArray_reserve(arr, n_cap))
+			return -1;
+	}
+
+	if (n)
+		memcpy(arr->ints + arr->len, nums, n * sizeof(int));
+	arr->len += n;
+	return 0;
+}
+
+int VArray_push_str(VArray *arr, const char *str, size_t len) {
+	if (!arr || !str || arr->kind != VARRAY_STR || varray_grow(arr))
+		return -1;
+
+	if (arr->chars_cap - arr->chars_len < len + 1) {
+		size_t n_cap = arr->chars_cap ? arr->chars_cap : VARRAY_INIT_SIZE * 8;
+		while (n_cap - arr->chars_len < len + 1)
+			n_cap *= 2;
+
+		char *n_chars = VAlloc_realloc(arr->alloc, arr->chars, n_cap);
+		if (!n_chars)
+			return -1;
+		arr->chars = n_chars;
+		arr->chars_cap = n_cap;
+	}
+
+	memcpy(arr->chars + arr->chars_len, str, len);
+	arr->chars[arr->chars_len + len] = '\0';
+	arr->offs[arr->len++] = arr->chars_len;
+	arr->chars_len += len + 1;
+	return 0;
+}
+
+const char *VArray_str_at(VArray *arr, size_t idx) {
+	if (!arr || arr->kind != VARRAY_STR || idx >= arr->len)
+		return NULL;
+	return arr->chars + arr->offs[idx];
+}
+
+int VArray_equal(VArray *a, VArray *b) {
+	if (!a || !b)
+		return 0;
+
+	if (a->kind != b->kind || a->len != b->len)
+		return 0;
+
+	if (a->len == 0)
+		return 1;
+
+	if (a->kind == VARRAY_INT)
+		return memcmp(a->ints, b->ints, a->len * sizeof(int)) == 0;
+
+	// Offsets follow from the characters since elements are stored back to back.
+	return a->chars_len == b->chars_len && memcmp(a->chars, b->chars, a->chars_len) == 0;
+}
+
+// Size dest to hold len integer results.
+static int varray_prepare(VArray *dest, size_t len) {
+	if (!dest || dest->kind != VARRAY_INT || VArray_reserve(dest, len))
+		return -1;
+
+	dest->len = len;
+	return 0;
+}
+
+// Arithmetic is done unsigned so overflow wraps instead of being undefined.
+static int *varray_map_arith(int *restrict d, const int *restrict s, size_t n, enum VArrayOp op, int num, int num_left) {
+	unsigned int u = (unsigned int) num;
+
+	switch (op) {
+		case VARRAY_ADD:
+			for (size_t i = 0; i < n; i++)
+				d[i] = (int) ((unsigned int) s[i] + u);
+			break;
+		case VARRAY_SUB:
+			if (num_left) {
+				for (size_t i = 0; i < n; i++)
+					d[i] = (int) (u - (unsigned int) s[i]);
+			}
+			else {
+				for (size_t i = 0; i < n; i++)
+					d[i] = (int) ((unsigned int) s[i] - u);
+			}
+			break;
+		case VARRAY_MUL:
+			for (size_t i = 0; i < n; i++)
+				d[i] = (int) ((unsigned int) s[i] * u);
+			break;
+		case VARRAY_DIV:
+			if (num_left) {
+				for (size_t i = 0; i < n; i++)
+					d[i] = s[i] == -1 ? (int) (0u - u) : num / s[i];
+			}
+			else if (num == -1) {
+				for (size_t i = 0; i < n; i++)
+					d[i] = (int) (0u - (unsigned int) s[i]);
+			}
+			else {
+				for (size_t i = 0; i < n; i++)
+					d[i] = s[i] / num;
+			}
+			break;
+		default:
+			return NULL;
+	}
+
+	return d;
+}
+
+// Comparisons with a scalar on the left are the mirrored comparison with it on the right.
+static int *varray_map_compare(int *restrict d, const int *restrict s, size_t n, enum VArrayOp op, int num, int num_left) {
+	if (num_left) {
+		if (op == VARRAY_LT) op = VARRAY_GT;
+		else if (op == VARRAY_GT) op = VARRAY_LT;
+		else if (op == VARRAY_LE) op = VARRAY_GE;
+		else if (op == VARRAY_GE) op = VARRAY_LE;
+	}
+
+	switch (op) {
+		case VARRAY_EQ:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] == num;
+			break;
+		case VARRAY_NE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] != num;
+			break;
+		case VARRAY_LT:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] < num;
+			break;
+		case VARRAY_LE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] <= num;
+			break;
+		case VARRAY_GT:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] > num;
+			break;
+		case VARRAY_GE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = s[i] >= num;
+			break;
+		default:
+			return NULL;
+	}
+
+	return d;
+}
+
+int VArray_map(VArray *dest, VArray *src, enum VArrayOp op, int num, int num_left) {
+	if (!src || dest == src || src->kind != VARRAY_INT)
+		return -1;
+
+	// Division by an element which is zero is checked below.
+	if (op == VARRAY_DIV && !num_left && num == 0)
+		return -1;
+
+	if (op == VARRAY_DIV && num_left) {
+		for (size_t i = 0; i < src->len; i++) {
+			if (src->ints[i] == 0)
+				return -1;
+		}
+	}
+
+	if (varray_prepare(dest, src->len))
+		return -1;
+
+	if (op <= VARRAY_DIV)
+		return varray_map_arith(dest->ints, src->ints, src->len, op, num, num_left) ? 0 : -1;
+	return varray_map_compare(dest->ints, src->ints, src->len, op, num, num_left) ? 0 : -1;
+}
+
+int VArray_zip(VArray *dest, VArray *a, VArray *b, enum VArrayOp op) {
+	if (!a || !b || dest == a || dest == b || a->kind != VARRAY_INT || b->kind != VARRAY_INT)
+		return -1;
+
+	size_t n = a->len < b->len ? a->len : b->len;
+
+	if (op == VARRAY_DIV) {
+		for (size_t i = 0; i < n; i++) {
+			if (b->ints[i] == 0)
+				return -1;
+		}
+	}
+
+	if (varray_prepare(dest, n))
+		return -1;
+
+	int *restrict d = dest->ints;
+	const int *restrict x = a->ints;
+	const int *restrict y = b->ints;
+
+	switch (op) {
+		case VARRAY_ADD:
+			for (size_t i = 0; i < n; i++)
+				d[i] = (int) ((unsigned int) x[i] + (unsigned int) y[i]);
+			break;
+		case VARRAY_SUB:
+			for (size_t i = 0; i < n; i++)
+				d[i] = (int) ((unsigned int) x[i] - (unsigned int) y[i]);
+			break;
+		case VARRAY_MUL:
+			for (size_t i = 0; i < n; i++)
+				d[i] = (int) ((unsigned int) x[i] * (unsigned int) y[i]);
+			break;
+		case VARRAY_DIV:
+			for (size_t i = 0; i < n; i++)
+				d[i] = y[i] == -1 ? (int) (0u - (unsigned int) x[i]) : x[i] / y[i];
+			break;
+		case VARRAY_EQ:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] == y[i];
+			break;
+		case VARRAY_NE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] != y[i];
+			break;
+		case VARRAY_LT:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] < y[i];
+			break;
+		case VARRAY_LE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] <= y[i];
+			break;
+		case VARRAY_GT:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] > y[i];
+			break;
+		case VARRAY_GE:
+			for (size_t i = 0; i < n; i++)
+				d[i] = x[i] >= y[i];
+			break;
+	}
+
+	return 0;
+}
+
+int VArray_filter_range(VArray *dest, VArray *src, int lo, int hi) {
+	if (!src || dest == src || src->kind != VARRAY_INT || varray_prepare(dest, src->len))
+		return -1;
+
+	dest->len = 0;
+	if (lo > hi)
+		return 0;
+
+	int *restrict d = dest->ints;
+	const int *restrict s = src->ints;
+	// x is within [lo, hi] when x - lo doesn't exceed span as unsigned.
+	unsigned int base = (unsigned int) lo;
+	unsigned int span = (unsigned int) hi - base;
+	size_t n = 0;
+
+	for (size_t i = 0; i < src->len; i += VARRAY_FILTER_BLOCK) {
+		size_t end = src->len - i < VARRAY_FILTER_BLOCK ? src->len : i + VARRAY_FILTER_BLOCK;
+		size_t hits = 0;
+
+		// Counting vectorizes, blocks entirely in or out of range skip compaction.
+		for (size_t j = i; j < end; j++)
+			hits += (unsigned int) s[j] - base <= span;
+
+		if (hits == 0)
+			continue;
+
+		if (hits == end - i) {
+			memcpy(d + n, s + i, hits * sizeof(int));
+			n += hits;
+			continue;
+		}
+
+		// Store unconditionally, only advance when kept.
+		for (size_t j = i; j < end; j++) {
+			d[n] = s[j];
+			n += (unsigned int) s[j] - base <= span;
+		}
+	}
+
+	dest->len = n;
+	return 0;
+}
+
+long long VArray_sum(VArray *arr) {
+	if (!arr || arr->kind != VARRAY_INT)
+		return 0;
+
+	const int *restrict s = arr->ints;
+	long long sum = 0;
+
+	for (size_t i = 0; i < arr->len; i++)
+		sum += s[i];
+	return sum;
+}
+
+int VArray_min(VArray *arr, int *out) {
+	if (!arr || !out || arr->kind != VARRAY_INT || arr->len == 0)
+		return -1;
+
+	const int *restrict s = arr->ints;
+	int res = s[0];
+
+	for (size_t i = 1; i < arr->len; i++)
+		res = s[i] < res ? s[i] : res;
+
+	*out = res;
+	return 0;
+}
+
+int VArray_max(VArray *arr, int *out) {
+	if (!arr || !out || arr->kind != VARRAY_INT || arr->len == 0)
+		return -1;
+
+	const int *restrict s = arr->ints;
+	int res = s[0];
+
+	for (size_t i = 1; i < arr->len; i++)
+		res = s[i] > res ? s[i] : res;
+
+	*out = res;
+	return 0;
+}
+
+// Task run on one part of an array, parts are numbered from 0.
+typedef void (*VArrayTask)(void *ctx, unsigned int part);
+
+typedef struct {
+	VArrayTask task;
+	void *ctx;
+	unsigned int part;
+} VArrayThread;
+
+static void *varray_thread(void *arg) {
+	VArrayThread *th = arg;
+	th->task(th->ctx, th->part);
+	return NULL;
+}
+
+// Number of parts worth splitting n elements into.
+static unsigned int varray_parts(size_t n, unsigned int jobs) {
+	size_t parts = n / VARRAY_PARALLEL_MIN;
+
+	if (jobs > VARRAY_MAX_JOBS)
+		jobs = VARRAY_MAX_JOBS;
+	if (parts > jobs)
+		parts = jobs;
+	return parts > 1 ? (unsigned int) parts : 1;
+}
+
+// First element of part p when n elements are split into parts.
+static size_t part_start(size_t n, unsigned int parts, unsigned int p) {
+	return (size_t) ((unsigned long long) n * p / parts);
+}
+
+// Run task for every part, part 0 on the calling thread. Parts whose thread can't be started run inline.
+static void varray_run(unsigned int parts, VArrayTask task, void *ctx) {
+	pthread_t tids[VARRAY_MAX_JOBS];
+	VArrayThread ths[VARRAY_MAX_JOBS];
+	int started[VARRAY_MAX_JOBS];
+
+	for (unsigned int p = 1; p < parts; p++) {
+		ths[p].task = task;
+		ths[p].ctx = ctx;
+		ths[p].part = p;
+		started[p] = pthread_create(&tids[p], NULL, varray_thread, &ths[p]) == 0;
+	}
+
+	task(ctx, 0);
+
+	for (unsigned int p = 1; p < parts; p++) {
+		if (started[p])
+			pthread_join(tids[p], NULL);
+		else
+			task(ctx, p);
+	}
+}
+
+// State of one radix sort pass over 8 bits.
+typedef struct {
+	const int *src;
+	int *dst;
+	size_t len;
+	unsigned int parts;
+	unsigned int shift;
+	size_t (*counts)[256];
+} RadixPass;
+
+// Signed order matches unsigned order once the sign bit is flipped.
+static unsigned int radix_digit(int x, unsigned int shift) {
+	return (((unsigned int) x ^ 0x80000000u) >> shift) & 0xff;
+}
+
+static void radix_count(void *ctx, unsigned int part) {
+	RadixPass *r = ctx;
+	size_t *counts = r->counts[part];
+	size_t hi = part_start(r->len, r->parts, part + 1);
+
+	memset(counts, 0, 256 * sizeof(size_t));
+	for (size_t i = part_start(r->len, r->parts, part); i < hi; i++)
+		counts[radix_digit(r->src[i], r->shift)]++;
+}
+
+// Counts have been turned into the position each part writes its first element of a digit.
+static void radix_scatter(void *ctx, unsigned int part) {
+	RadixPass *r = ctx;
+	size_t *pos = r->counts[part];
+	size_t hi = part_start(r->len, r->parts, part + 1);
+
+	for (size_t i = part_start(r->len, r->parts, part); i < hi; i++)
+		r->dst[pos[radix_digit(r->src[i], r->shift)]++] = r->src[i];
+}
+
+static int varray_sort_ints(VArray *arr, unsigned int jobs) {
+	unsigned int parts = varray_parts(arr->len, jobs);
+	int *tmp = VAlloc_alloc(arr->alloc, arr->len * sizeof(int));
+	size_t (*counts)[256] = VAlloc_alloc(arr->alloc, parts * sizeof(*counts));
+
+	if (!tmp || !counts) {
+		VAlloc_free(arr->alloc, tmp);
+		VAlloc_free(arr->alloc, counts);
+		return -1;
+	}
+
+	RadixPass r = { arr->ints, tmp, arr->len, parts, 0, counts };
+
+	for (r.shift = 0; r.shift < 32; r.shift += 8) {
+		varray_run(parts, radix_count, &r);
+
+		// Digits are stable across parts, part p of a digit follows part p - 1.
+		size_t pos = 0;
+		int skip = 0;
+		for (unsigned int d = 0; d < 256; d++) {
+			size_t total = 0;
+			for (unsigned int p = 0; p < parts; p++) {
+				size_t cnt = counts[p][d];
+				counts[p][d] = pos;
+				pos += cnt;
+				total += cnt;
+			}
+
+			// Every element shares this digit so the pass wouldn't move anything.
+			if (total == arr->len)
+				skip = 1;
+		}
+
+		if (skip)
+			continue;
+
+		varray_run(parts, radix_scatter, &r);
+
+		const int *src = r.src;
+		r.src = r.dst;
+		r.dst = (int *) src;
+	}
+
+	if (r.src != arr->ints)
+		memcpy(arr->ints, r.src, arr->len * sizeof(int));
+
+	VAlloc_free(arr->alloc, tmp);
+	VAlloc_free(arr->alloc, counts);
+	return 0;
+}
+
+static int compare_strs(const void *a, const void *b) {
+	return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+// State of a merge sort over pointers to string elements.
+typedef struct {
+	const char **src;
+	const char **dst;
+	size_t len;
+	unsigned int parts;
+	size_t width;
+} MergeSort;
+
+static void merge_sort_part(void *ctx, unsigned int part) {
+	MergeSort *m = ctx;
+	size_t lo = part_start(m->len, m->parts, part);
+	size_t hi = part_start(m->len, m->parts, part + 1);
+
+	qsort(m->src + lo, hi - lo, sizeof(char *), compare_strs);
+}
+
+// Merge the pair of sorted runs starting at run 2 * part, runs are width parts wide.
+static void merge_sort_pair(void *ctx, unsigned int part) {
+	MergeSort *m = ctx;
+	unsigned int first = part * 2 * (unsigned int) m->width;
+	unsigned int mid = first + (unsigned int) m->width;
+	unsigned int last = mid + (unsigned int) m->width;
+
+	if (mid > m->parts) mid = m->parts;
+	if (last > m->parts) last = m->parts;
+
+	size_t i = part_start(m->len, m->parts, first);
+	size_t j = part_start(m->len, m->parts, mid);
+	size_t i_end = j;
+	size_t j_end = part_start(m->len, m->parts, last);
+	size_t k = i;
+
+	while (i < i_end && j < j_end)
+		m->dst[k++] = strcmp(m->src[j], m->src[i]) < 0 ? m->src[j++] : m->src[i++];
+	while (i < i_end)
+		m->dst[k++] = m->src[i++];
+	while (j < j_end)
+		m->dst[k++] = m->src[j++];
+}
+
+static int varray_sort_strs(VArray *arr, unsigned int jobs) {
+	const char **ptrs = VAlloc_alloc(arr->alloc, arr->len * 2 * sizeof(char *));
+	char *chars = VAlloc_alloc(arr->alloc, arr->chars_len ? arr->chars_len : 1);
+
+	if (!ptrs || !chars) {
+		VAlloc_free(arr->alloc, ptrs);
+		VAlloc_free(arr->alloc, chars);
+		return -1;
+	}
+
+	for (size_t i = 0; i < arr->len; i++)
+		ptrs[i] = arr->chars + arr->offs[i];
+
+	MergeSort m = { ptrs, ptrs + arr->len, arr->len, varray_parts(arr->len, jobs), 1 };
+
+	// Parts are sorted separately then merged pairwise, doubling the run width each round.
+	varray_run(m.parts, merge_sort_part, &m);
+
+	for (m.width = 1; m.width < m.parts; m.width *= 2) {
+		unsigned int pairs = (m.parts + 2 * (unsigned int) m.width - 1) / (2 * (unsigned int) m.width);
+		varray_run(pairs, merge_sort_pair, &m);
+
+		const char **src = m.src;
+		m.src = m.dst;
+		m.dst = src;
+	}
+
+	// Lay the strings out again in sorted order.
+	size_t pos = 0;
+	for (size_t i = 0; i < arr->len; i++) {
+		size_t len = strlen(m.src[i]) + 1;
+		memcpy(chars + pos, m.src[i], len);
+		arr->offs[i] = pos;
+		pos += len;
+	}
+
+	VAlloc_free(arr->alloc, arr->chars);
+	VAlloc_free(arr->alloc, ptrs);
+	arr->chars = chars;
+	arr->chars_cap = arr->chars_len ? arr->chars_len : 1;
+	return 0;
+}
+
+int VArray_sort(VArray *arr, unsigned int jobs) {
+	if (!arr)
+		return -1;
+
+	if (arr->len < 2)
+		return 0;
+
+	if (arr->kind == VARRAY_INT)
+		return varray_sort_ints(arr, jobs);
+	return varray_sort_strs(arr, jobs);
+}
+
+/**
+ * Hash table over the elements of an array. Slots hold the index of an element plus
+ * one, 0 when empty. Threads insert concurrently, an occupied slot only ever changes to
+ * a smaller index of the same element so every slot ends up at its first occurrence.
+ */
+typedef struct {
+	VArray *arr;
+	size_t *slots;
+	size_t mask;
+} VArraySet;
+
+static size_t elem_hash(VArray *arr, size_t idx) {
+	if (arr->kind == VARRAY_INT) {
+		unsigned long long x = (unsigned int) arr->ints[idx];
+		x *= 0x9E3779B97F4A7C15ULL;
+		return (size_t) (x ^ (x >> 32));
+	}
+
+	size_t hash = 14695981039346656037UL;
+	for (const char *c = arr->chars + arr->offs[idx]; *c; c++)
+		hash = (hash ^ (unsigned char) *c) * 1099511628211UL;
+	return hash;
+}
+
+static int elem_equal(VArray *a, size_t i, VArray *b, size_t j) {
+	if (a->kind == VARRAY_INT)
+		return a->ints[i] == b->ints[j];
+	return strcmp(a->chars + a->offs[i], b->chars + b->offs[j]) == 0;
+}
+
+static int set_init(VArraySet *set, VArray *arr) {
+	size_t cap = VARRAY_INIT_SIZE;
+	while (cap < arr->len * 2)
+		cap *= 2;
+
+	set->arr = arr;
+	set->mask = cap - 1;
+	set->slots = VAlloc_calloc(arr->alloc, cap * sizeof(size_t));
+	return set->slots ? 0 : -1;
+}
+
+static void set_insert(VArraySet *set, size_t idx) {
+	size_t h = elem_hash(set->arr, idx) & set->mask;
+	size_t want = idx + 1;
+
+	for (;;) {
+		size_t cur = __atomic_load_n(&set->slots[h], __ATOMIC_ACQUIRE);
+
+		if (cur == 0 && __atomic_compare_exchange_n(&set->slots[h], &cur, want, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return;
+
+		// Slot was taken, possibly just now by the same element.
+		if (elem_equal(set->arr, cur - 1, set->arr, idx)) {
+			while (want < cur && !__atomic_compare_exchange_n(&set->slots[h], &cur, want, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+			return;
+		}
+
+		h = (h + 1) & set->mask;
+	}
+}
+
+// Index plus one of the first occurrence of element idx of arr, 0 if absent.
+static size_t set_find(VArraySet *set, VArray *arr, size_t idx) {
+	size_t h = elem_hash(arr, idx) & set->mask;
+
+	for (;;) {
+		size_t cur = set->slots[h];
+		if (cur == 0 || elem_equal(set->arr, cur - 1, arr, idx))
+			return cur;
+		h = (h + 1) & set->mask;
+	}
+}
+
+enum SetMode {
+	SET_UNIQUE, SET_INTERSECT, SET_DIFFERENCE
+};
+
+// State shared by the threads of a set operation.
+typedef struct {
+	VArraySet left;
+	VArraySet right;
+	enum SetMode mode;
+	unsigned char *keep;
+	unsigned int parts;
+	unsigned int right_parts;
+} SetOp;
+
+static void set_insert_left(void *ctx, unsigned int part) {
+	SetOp *op = ctx;
+	size_t len = op->left.arr->len;
+	size_t hi = part_start(len, op->parts, part + 1);
+
+	for (size_t i = part_start(len, op->parts, part); i < hi; i++)
+		set_insert(&op->left, i);
+}
+
+static void set_insert_right(void *ctx, unsigned int part) {
+	SetOp *op = ctx;
+	size_t len = op->right.arr->len;
+	size_t hi = part_start(len, op->right_parts, part + 1);
+
+	for (size_t i = part_start(len, op->right_parts, part); i < hi; i++)
+		set_insert(&op->right, i);
+}
+
+static void set_mark(void *ctx, unsigned int part) {
+	SetOp *op = ctx;
+	VArray *arr = op->left.arr;
+	size_t hi = part_start(arr->len, op->parts, part + 1);
+
+	for (size_t i = part_start(arr->len, op->parts, part); i < hi; i++) {
+		int keep = set_find(&op->left, arr, i) == i + 1;
+
+		if (keep && op->mode == SET_INTERSECT)
+			keep = set_find(&op->right, arr, i) != 0;
+		else if (keep && op->mode == SET_DIFFERENCE)
+			keep = set_find(&op->right, arr, i) == 0;
+
+		op->keep[i] = (unsigned char) keep;
+	}
+}
+
+// Build array of the elements of a selected by mode, right is only used when comparing with b.
+static VArray *varray_set_op(VArray *a, VArray *b, enum SetMode mode, unsigned int jobs) {
+	if (!a || (mode != SET_UNIQUE && (!b || b->kind != a->kind)))
+		return NULL;
+
+	SetOp op;
+	op.mode = mode;
+	op.parts = varray_parts(a->len, jobs);
+	op.right_parts = b ? varray_parts(b->len, jobs) : 1;
+	op.left.slots = NULL;
+	op.right.slots = NULL;
+	op.keep = VAlloc_alloc(a->alloc, a->len ? a->len : 1);
+
+	VArray *res = VArray_new(a->alloc, a->kind, 0);
+
+	if (!op.keep || !res || set_init(&op.left, a) || (mode != SET_UNIQUE && set_init(&op.right, b))) {
+		VAlloc_free(a->alloc, op.keep);
+		VAlloc_free(a->alloc, op.left.slots);
+		VAlloc_free(b ? b->alloc : NULL, op.right.slots);
+		VArray_free(res);
+		return NULL;
+	}
+
+	varray_run(op.parts, set_insert_left, &op);
+	if (mode != SET_UNIQUE)
+		varray_run(op.right_parts, set_insert_right, &op);
+	varray_run(op.parts, set_mark, &op);
+
+	for (size_t i = 0; i < a->len; i++) {
+		if (!op.keep[i])
+			continue;
+
+		if (a->kind == VARRAY_INT)
+			VArray_push_int(res, a->ints[i]);
+		else
+			VArray_push_str(res, a->chars + a->offs[i], strlen(a->chars + a->offs[i]));
+	}
+
+	VAlloc_free(a->alloc, op.keep);
+	VAlloc_free(a->alloc, op.left.slots);
+	if (mode != SET_UNIQUE)
+		VAlloc_free(b->alloc, op.right.slots);
+	return res;
+}
+
+VArray *VArray_unique(VArray *arr, unsigned int jobs) {
+	return varray_set_op(arr, NULL, SET_UNIQUE, jobs);
+}
+
+VArray *VArray_union(VArray *a, VArray *b, unsigned int jobs) {
+	if (!a || !b || a->kind != b->kind)
+		return NULL;
+
+	VArray *both = VArray_copy(a, a->alloc);
+	if (!both)
+		return NULL;
+
+	if (a->kind == VARRAY_INT) {
+		VArray_push_ints(both, b->ints, b->len);
+	}
+	else {
+		for (size_t i = 0; i < b->len; i++)
+			VArray_push_str(both, b->chars + b->offs[i], strlen(b->chars + b->offs[i]));
+	}
+
+	VArray *res = varray_set_op(both, NULL, SET_UNIQUE, jobs);
+	VArray_free(both);
+	return res;
+}
+
+VArray *VArray_intersect(VArray *a, VArray *b, unsigned int jobs) {
+	return varray_set_op(a, b, SET_INTERSECT, jobs);
+}
+
+VArray *VArray_difference(VArray *a, VArray *b, unsigned int jobs) {
+	return varray_set_op(a, b, SET_DIFFERENCE, jobs);
+}
+
+// Append characters to dest while room is left, pos counts every character.
+static void format_put(char *dest, size_t size, size_t *pos, const char *str, size_t len) {
+	if (*pos + 1 < size) {
+		size_t room = size - 1 - *pos;
+		memcpy(dest + *pos, str, len < room ? len : room);
+	}
+	*pos += len;
+}
+
+size_t VArray_format(VArray *arr, char *dest, size_t size) {
+	size_t pos = 0;
+	char num[16];
+
+	format_put(dest, size, &pos, "[", 1);
+
+	for (size_t i = 0; arr && i < arr->len; i++) {
+		if (i > 0)
+			format_put(dest, size, &pos, ", ", 2);
+
+		if (arr->kind == VARRAY_INT) {
+			int n = snprintf(num, sizeof(num), "%d", arr->ints[i]);
+			format_put(dest, size, &pos, num, n);
+		}
+		else {
+			const char *str = arr->chars + arr->offs[i];
+			format_put(dest, size, &pos, str, strlen(str));
+		}
+	}
+
+	format_put(dest, size, &pos, "]", 1);
+
+	if (size > 0)
+		dest[pos < size ? pos : size - 1] = '\0';
+	return pos;
+}
+
+void VArray_free(VArray *arr) {
+	if (!arr)
+		return;
+
+	VAlloc_free(arr->alloc, arr->ints);
+	VAlloc_free(arr->alloc, arr->offs);
+	VAlloc_free(arr->alloc, arr->chars);
+	VAlloc_free(arr->alloc, arr);
+}
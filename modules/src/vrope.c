@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include "vrope.h"
+
+// Adjacent leaves whose combined length is below this are merged into one.
+#define VROPE_MERGE_SIZE 256
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Batch of pieces waiting to be written.
+typedef struct {
+	struct iovec iov[IOV_MAX];
+	int iov_ctr;
+	int fd;
+	ssize_t written;
+} VRopeWriter;
+
+static unsigned int node_height(VRopeNode *n) {
+	return n ? n->height : 0;
+}
+
+static size_t node_len(VRopeNode *n) {
+	return n ? n->len : 0;
+}
+
+// Counts are atomic so ropes sharing nodes may be used from different threads.
+static VRopeNode *node_retain(VRopeNode *n) {
+	if (n)
+		__atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED);
+	return n;
+}
+
+static void node_release(VRopeNode *n) {
+	if (!n || __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	node_release(n->left);
+	node_release(n->right);
+	node_release(n->base);
+	VAlloc_free(n->alloc, n->owned);
+	VAlloc_free(n->alloc, n);
+}
+
+// Create leaf, owned is freed along with the leaf when non NULL and must come from alloc.
+static VRopeNode *node_leaf(VAllocator *alloc, const char *str, size_t len, char *owned, VRopeNode *base) {
+	VRopeNode *n = VAlloc_alloc(alloc, sizeof(VRopeNode));
+	if (!n)
+		return NULL;
+
+	n->alloc = alloc;
+	n->left = NULL;
+	n->right = NULL;
+	n->base = base;
+	n->str = str;
+	n->owned = owned;
+	n->len = len;
+	n->height = 1;
+	n->refs = 1;
+	return n;
+}
+
+// Create leaf holding a copy of two pieces.
+static VRopeNode *node_leaf_copy(VAllocator *alloc, const char *a, size_t a_len, const char *b, size_t b_len) {
+	char *buf = VAlloc_alloc(alloc, a_len + b_len + 1);
+	if (!buf)
+		return NULL;
+
+	memcpy(buf, a, a_len);
+	memcpy(buf + a_len, b, b_len);
+	buf[a_len + b_len] = '\0';
+
+	VRopeNode *n = node_leaf(alloc, buf, a_len + b_len, buf, NULL);
+	if (!n)
+		VAlloc_free(alloc, buf);
+	return n;
+}
+
+// Create concat node, consumes references to left and right.
+static VRopeNode *node_concat(VAllocator *alloc, VRopeNode *left, VRopeNode *right) {
+	VRopeNode *n = VAlloc_alloc(alloc, sizeof(VRopeNode));
+	if (!n)
+		return NULL;
+
+	unsigned int hl = node_height(left);
+	unsigned int hr = node_height(right);
+
+	n->alloc = alloc;
+	n->left = left;
+	n->right = right;
+	n->base = NULL;
+	n->str = NULL;
+	n->owned = NULL;
+	n->len = node_len(left) + node_len(right);
+	n->height = (hl > hr ? hl : hr) + 1;
+	n->refs = 1;
+	return n;
+}
+
+// Rotations consume n and return a new subtree sharing its grandchildren.
+static VRopeNode *rotate_right(VAllocator *alloc, VRopeNode *n) {
+	VRopeNode *l = n->left;
+	VRopeNode *r = node_concat(alloc, node_retain(l->right), node_retain(n->right));
+	VRopeNode *root = node_concat(alloc, node_retain(l->left), r);
+	node_release(n);
+	return root;
+}
+
+static VRopeNode *rotate_left(VAllocator *alloc, VRopeNode *n) {
+	VRopeNode *r = n->right;
+	VRopeNode *l = node_concat(alloc, node_retain(n->left), node_retain(r->left));
+	VRopeNode *root = node_concat(alloc, l, node_retain(r->right));
+	node_release(n);
+	return root;
+}
+
+// Restore AVL balance of a freshly created concat node.
+static VRopeNode *rebalance(VAllocator *alloc, VRopeNode *n) {
+	int bal = (int) node_height(n->left) - (int) node_height(n->right);
+
+	if (bal > 1) {
+		if (node_height(n->left->left) < node_height(n->left->right)) {
+			VRopeNode *l = rotate_left(alloc, node_retain(n->left));
+			node_release(n->left);
+			n->left = l;
+		}
+		return rotate_right(alloc, n);
+	}
+
+	if (bal < -1) {
+		if (node_height(n->right->right) < node_height(n->right->left)) {
+			VRopeNode *r = rotate_right(alloc, node_retain(n->right));
+			node_release(n->right);
+			n->right = r;
+		}
+		return rotate_left(alloc, n);
+	}
+
+	return n;
+}
+
+// Concatenate two ropes keeping the result balanced, consumes both references. New nodes
+// come from alloc, shared ones are freed by the allocator they were made with.
+static VRopeNode *join(VAllocator *alloc, VRopeNode *l, VRopeNode *r) {
+	if (!l)
+		return r;
+	if (!r)
+		return l;
+
+	// Small neighbouring leaves are cheaper as a single piece.
+	if (!l->left && !r->left && l->len + r->len <= VROPE_MERGE_SIZE) {
+		VRopeNode *n = node_leaf_copy(alloc, l->str, l->len, r->str, r->len);
+		node_release(l);
+		node_release(r);
+		return n;
+	}
+
+	unsigned int hl = node_height(l);
+	unsigned int hr = node_height(r);
+
+	if (hl > hr + 1) {
+		VRopeNode *n = node_concat(alloc, node_retain(l->left), join(alloc, node_retain(l->right), r));
+		node_release(l);
+		return rebalance(alloc, n);
+	}
+
+	if (hr > hl + 1) {
+		VRopeNode *n = node_concat(alloc, join(alloc, l, node_retain(r->left)), node_retain(r->right));
+		node_release(r);
+		return rebalance(alloc, n);
+	}
+
+	return node_concat(alloc, l, r);
+}
+
+// Split n at position pos into two new references, n itself is borrowed.
+static void split(VAllocator *alloc, VRopeNode *n, size_t pos, VRopeNode **out_l, VRopeNode **out_r) {
+	if (!n) {
+		*out_l = NULL;
+		*out_r = NULL;
+		return;
+	}
+
+	if (pos == 0) {
+		*out_l = NULL;
+		*out_r = node_retain(n);
+		return;
+	}
+
+	if (pos >= n->len) {
+		*out_l = node_retain(n);
+		*out_r = NULL;
+		return;
+	}
+
+	// Leaf, create two slices referencing the original piece.
+	if (!n->left) {
+		VRopeNode *base = n->base ? n->base : n;
+		*out_l = node_leaf(alloc, n->str, pos, NULL, node_retain(base));
+		*out_r = node_leaf(alloc, n->str + pos, n->len - pos, NULL, node_retain(base));
+		return;
+	}
+
+	VRopeNode *a = NULL;
+	VRopeNode *b = NULL;
+	size_t left_len = n->left->len;
+
+	if (pos < left_len) {
+		split(alloc, n->left, pos, &a, &b);
+		*out_l = a;
+		*out_r = join(alloc, b, node_retain(n->right));
+	}
+	else if (pos > left_len) {
+		split(alloc, n->right, pos - left_len, &a, &b);
+		*out_l = join(alloc, node_retain(n->left), a);
+		*out_r = b;
+	}
+	else {
+		*out_l = node_retain(n->left);
+		*out_r = node_retain(n->right);
+	}
+}
+
+static int node_each(VRopeNode *n, int (*fn)(const char *str, size_t len, void *ctx), void *ctx) {
+	if (!n)
+		return 0;
+
+	if (!n->left && !n->right)
+		return n->len ? fn(n->str, n->len, ctx) : 0;
+
+	int ret = node_each(n->left, fn, ctx);
+	if (ret)
+		return ret;
+	return node_each(n->right, fn, ctx);
+}
+
+VRope VRope_new(VAllocator *alloc) {
+	VRope rope;
+	rope.root = NULL;
+	rope.alloc = alloc;
+	return rope;
+}
+
+size_t VRope_length(VRope *rope) {
+	return rope ? node_len(rope->root) : 0;
+}
+
+int VRope_append(VRope *rope, const char *str, size_t len) {
+	if (!rope || !str)
+		return -1;
+
+	if (len == 0)
+		return 0;
+
+	VRopeNode *leaf = node_leaf_copy(rope->alloc, str, len, "", 0);
+	if (!leaf)
+		return -1;
+
+	rope->root = join(rope->alloc, rope->root, leaf);
+	return 0;
+}
+
+int VRope_append_ref(VRope *rope, const char *str, size_t len) {
+	if (!rope || !str)
+		return -1;
+
+	if (len == 0)
+		return 0;
+
+	VRopeNode *leaf = node_leaf(rope->alloc, str, len, NULL, NULL);
+	if (!leaf)
+		return -1;
+
+	rope->root = join(rope->alloc, rope->root, leaf);
+	return 0;
+}
+
+int VRope_append_rope(VRope *rope, VRope *other) {
+	if (!rope || !other)
+		return -1;
+
+	rope->root = join(rope->alloc, rope->root, node_retain(other->root));
+	return 0;
+}
+
+int VRope_insert(VRope *rope, size_t pos, const char *str, size_t len) {
+	if (!rope || !str)
+		return -1;
+
+	if (len == 0)
+		return 0;
+
+	VRopeNode *leaf = node_leaf_copy(rope->alloc, str, len, "", 0);
+	if (!leaf)
+		return -1;
+
+	VRopeNode *l = NULL;
+	VRopeNode *r = NULL;
+	split(rope->alloc, rope->root, pos, &l, &r);
+	node_release(rope->root);
+	rope->root = join(rope->alloc, join(rope->alloc, l, leaf), r);
+	return 0;
+}
+
+VRope VRope_slice(VRope *rope, size_t start, size_t end) {
+	VRope slice = VRope_new(rope ? rope->alloc : NULL);
+
+	if (!rope || start >= end)
+		return slice;
+
+	VRopeNode *head = NULL;
+	VRopeNode *mid = NULL;
+	VRopeNode *tail = NULL;
+	VRopeNode *rest = NULL;
+
+	split(rope->alloc, rope->root, start, &head, &rest);
+	split(rope->alloc, rest, end - start, &mid, &tail);
+	node_release(head);
+	node_release(rest);
+	node_release(tail);
+
+	slice.root = mid;
+	return slice;
+}
+
+int VRope_each(VRope *rope, int (*fn)(const char *str, size_t len, void *ctx), void *ctx) {
+	if (!rope || !fn)
+		return -1;
+	return node_each(rope->root, fn, ctx);
+}
+
+// Copy a single piece into the flatten buffer.
+static int flatten_piece(const char *str, size_t len, void *ctx) {
+	char **out = ctx;
+	memcpy(*out, str, len);
+	*out += len;
+	return 0;
+}
+
+size_t VRope_flatten(VRope *rope, char *out) {
+	if (!rope || !out)
+		return 0;
+
+	char *itr = out;
+	node_each(rope->root, flatten_piece, &itr);
+	*itr = '\0';
+	return itr - out;
+}
+
+// Write every queued iovec handling partial writes.
+static int writer_flush(VRopeWriter *wr) {
+	struct iovec *iov = wr->iov;
+	int cnt = wr->iov_ctr;
+
+	while (cnt > 0) {
+		ssize_t n = writev(wr->fd, iov, cnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		wr->written += n;
+
+		// Skip fully written pieces then adjust the partially written one.
+		while (cnt > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+
+		if (cnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	wr->iov_ctr = 0;
+	return 0;
+}
+
+static int writer_piece(const char *str, size_t len, void *ctx) {
+	VRopeWriter *wr = ctx;
+
+	if (wr->iov_ctr == IOV_MAX && writer_flush(wr))
+		return -1;
+
+	wr->iov[wr->iov_ctr].iov_base = (void *) str;
+	wr->iov[wr->iov_ctr].iov_len = len;
+	wr->iov_ctr++;
+	return 0;
+}
+
+ssize_t VRope_writev(VRope *rope, int fd) {
+	if (!rope)
+		return -1;
+
+	VRopeWriter *wr = VAlloc_alloc(rope->alloc, sizeof(VRopeWriter));
+	if (!wr)
+		return -1;
+
+	wr->iov_ctr = 0;
+	wr->fd = fd;
+	wr->written = 0;
+
+	ssize_t ret = -1;
+	if (node_each(rope->root, writer_piece, wr) == 0 && writer_flush(wr) == 0)
+		ret = wr->written;
+
+	VAlloc_free(rope->alloc, wr);
+	return ret;
+}
+
+int VRope_free(VRope *rope) {
+	if (!rope)
+		return -1;
+
+	node_release(rope->root);
+	rope->root = NULL;
+	return 0;
+}
@@ -2,52 +2,103 @@
 #include <stdlib.h>
 #include "vstring.h"
 
-// Implicit function to allocate more memory for string.
-static VString *VString_grow_str(VString *vstr, size_t factor) {
-	size_t str_cap = sizeof(char) * factor;
-	char *new_str = realloc(vstr->str, str_cap);
-	vstr->str = new_str;
-	vstr->str_cap = str_cap;
-	return vstr;
+// Determine if we need to grow.
+static int VString_needs_grow(VString *vstr, size_t n_size) {
+	return n_size > vstr->str_cap;
 }
 
-// Determine if we need to grow/shrink.
-static int VString_needs_grow(VString *vstr, size_t n_size) {
-	return n_size >= vstr->str_cap;
+// Single growth policy, at least double the current capacity.
+static size_t VString_next_cap(VString *vstr, size_t n_size) {
+	size_t cap = vstr->str_cap * 2;
+	return cap > n_size ? cap : n_size;
 }
 
-VString VString_new(void) {
+// Move characters to a buffer able to hold cap characters.
+static int VString_realloc(VString *vstr, size_t cap) {
+	char *new_str = NULL;
+
+	// Heap to heap can simply be resized.
+	if (vstr->str_cap > VSTRING_SSO_SIZE) {
+		new_str = VAlloc_realloc(vstr->alloc, vstr->buf.heap, cap + 1);
+		if (!new_str)
+			return -1;
+	}
+	else {
+		new_str = VAlloc_alloc(vstr->alloc, cap + 1);
+		if (!new_str)
+			return -1;
+		memcpy(new_str, vstr->buf.sso, vstr->str_size + 1);
+	}
+
+	vstr->buf.heap = new_str;
+	vstr->str_cap = cap;
+	return 0;
+}
+
+// Grow following the growth policy if n_size doesn't fit.
+static int VString_grow(VString *vstr, size_t n_size) {
+	if (!VString_needs_grow(vstr, n_size))
+		return 0;
+	return VString_realloc(vstr, VString_next_cap(vstr, n_size));
+}
+
+VString VString_new(VAllocator *alloc) {
 	VString vstr;
-	vstr.str_cap = INIT_STRING_SIZE;
+	vstr.alloc = alloc;
+	vstr.str_cap = VSTRING_SSO_SIZE;
 	vstr.str_size = 0;
-	vstr.str = malloc(vstr.str_cap * sizeof(char) + 1);
-	*vstr.str = '\0';
+	vstr.buf.sso[0] = '\0';
 	return vstr;
 }
 
-VString VString_create(char *str, size_t cap) {
-	VString vstr;
-	vstr.str_cap = cap < 1 ? INIT_STRING_SIZE : cap;
-	vstr.str_size = 0;
-	vstr.str = malloc(vstr.str_cap * sizeof(char) + 1);
-	*vstr.str = '\0';
-	if (str) 
+VString VString_create(VAllocator *alloc, char *str, size_t cap) {
+	VString vstr = VString_new(alloc);
+	VString_reserve(&vstr, cap);
+	if (str)
 		VString_pushs(&vstr, str);
 	return vstr;
 }
 
+int VString_reserve(VString *vstr, size_t cap) {
+	if (!vstr)
+		return -1;
+
+	if (!VString_needs_grow(vstr, cap))
+		return 0;
+
+	return VString_realloc(vstr, cap);
+}
+
+int VString_shrink_to_fit(VString *vstr) {
+	if (!vstr)
+		return -1;
+
+	// Nothing to release.
+	if (vstr->str_cap <= VSTRING_SSO_SIZE || vstr->str_cap == vstr->str_size)
+		return 0;
+
+	if (vstr->str_size <= VSTRING_SSO_SIZE) {
+		char *heap = vstr->buf.heap;
+		memcpy(vstr->buf.sso, heap, vstr->str_size + 1);
+		vstr->str_cap = VSTRING_SSO_SIZE;
+		VAlloc_free(vstr->alloc, heap);
+		return 0;
+	}
+
+	return VString_realloc(vstr, vstr->str_size);
+}
+
 VString *VString_set(VString *vstr, char *str) {
 	if (!vstr || !str)
 		return NULL;
-	
+
 	size_t n_size = strlen(str);
-	
-	if (VString_needs_grow(vstr, n_size)) {
-		VString *n_vstr = VString_grow_str(vstr, n_size * 2);
-		vstr = n_vstr;
-	}
 
-	strncpy(vstr->str, str, strlen(str)+1);
+	if (VString_grow(vstr, n_size))
+		return NULL;
+
+	// Source may be a part of the current value.
+	memmove(VString_str(vstr), str, n_size + 1);
 	vstr->str_size = n_size;
 	return vstr;
 }
@@ -56,117 +107,121 @@ VString *VString_pushc(VString *vstr, char c) {
 	if (!vstr)
 		return NULL;
 
-	size_t n_size = vstr->str_size + sizeof(char);
-	
-	if (VString_needs_grow(vstr, n_size)) {
-		VString *n_vstr = VString_grow_str(vstr, n_size * 8);
-		vstr = n_vstr;
-	}
+	size_t n_size = vstr->str_size + 1;
 
-	vstr->str[n_size-1] = c;
-	vstr->str[n_size] = '\0';
+	if (VString_grow(vstr, n_size))
+		return NULL;
+
+	char *str = VString_str(vstr);
+	str[n_size-1] = c;
+	str[n_size] = '\0';
 	vstr->str_size = n_size;
 	return vstr;
 }
 
-VString *VString_pushs(VString *vstr, char *str) {
+VString *VString_pushn(VString *vstr, const char *str, size_t len) {
 	if (!vstr || !str)
 		return NULL;
-	
-	size_t n_size = vstr->str_size + strlen(str);
-	
-	if (VString_needs_grow(vstr, n_size)) {
-		VString *n_vstr = VString_grow_str(vstr, n_size * 2);
-		vstr = n_vstr;
+
+	size_t n_size = vstr->str_size + len;
+	char *old = VString_str(vstr);
+
+	// Pushing part of itself, keep offset in case buffer moves.
+	if (str >= old && str <= old + vstr->str_size) {
+		size_t offset = str - old;
+		if (VString_grow(vstr, n_size))
+			return NULL;
+		str = VString_str(vstr) + offset;
+	}
+	else if (VString_grow(vstr, n_size)) {
+		return NULL;
 	}
 
-	strncat(vstr->str, str, strlen(str));
+	char *dest = VString_str(vstr);
+	memmove(dest + vstr->str_size, str, len);
+	dest[n_size] = '\0';
 	vstr->str_size = n_size;
 	return vstr;
 }
 
+VString *VString_pushs(VString *vstr, char *str) {
+	if (!vstr || !str)
+		return NULL;
+
+	return VString_pushn(vstr, str, strlen(str));
+}
+
 int VString_replace(VString *vstr, char *find, char *replace) {
 	if (!vstr || !find || !replace)
 		return -1;
-	
+
 	// Length of find value (needle).
 	size_t len_find = strlen(find);
 
 	if (len_find < 1)
 		return 0;
-	
+
 	// Length of replace value.
 	size_t len_rep = strlen(replace);
 	// Number of occurrences in source/haystack.
-	int num_finds = 0;
-	// Iterator pointer.
-	char *itr = vstr->str;
+	size_t num_finds = 0;
 	// Pointer to original source.
-	char *hstack = vstr->str;
-	// Length of original source;
-	size_t len_hstack = vstr->str_size;
-	// Last word in string.
-	char *lword = itr + len_hstack - len_find;
+	char *hstack = VString_str(vstr);
+	// Iterator pointer.
+	char *itr = hstack;
 
 	for (num_finds = 0; (itr = strstr(itr, find)); num_finds++) {
 		itr += len_find;
 	}
 
+	if (num_finds == 0)
+		return 0;
+
 	// Find new size of string.
-	len_hstack = len_hstack - ((len_find - len_rep) * num_finds);
-
-	while (num_finds--) {
-		itr = strstr(hstack, find);
-
-		// A shrink.
-		if (len_find > len_rep) {
-			
-			// Only shift to the left if source is not last word.
-			// "Hello source" <--- no left shit required.
-			// "Hello source there" <--- left shift required.
-			if (itr != lword)
-				memmove((itr + len_find) - (len_find - len_rep), itr + len_find, vstr->str_size - len_find); 
-			
-			memmove(itr, replace, len_rep);
-		}
-		// A grow.
-		else if (len_find < len_rep) {
-			if (VString_needs_grow(vstr, len_hstack)) {
-				VString *n_vstr = VString_grow_str(vstr, len_hstack * 2);
-				
-				if (!n_vstr)
-					return -1;
-				
-				// After realloc reassign pointers.
-				vstr = n_vstr;
-				hstack = vstr->str;
-				itr = strstr(hstack, find);
-			}
-
-			// Only shift to the right if source is not last word.
-			// "Hello bigger source" <--- no right shit required.
-			// "Hello bigger source there" <--- right shift required.
-			if (itr != lword)
-				memmove(itr + len_rep, itr + len_find, vstr->str_size - len_find); 
-			
-			memmove(itr, replace, len_rep);
-		}
-		// A direct copy.
-		else if (len_find == len_rep) {
-			memmove(itr, replace, len_rep);
-		}
+	size_t len_new = vstr->str_size - (len_find * num_finds) + (len_rep * num_finds);
+
+	// Shrinks and direct copies can be done in place moving left to right.
+	// Grows are written to a new buffer so each character is only moved once.
+	VString out = VString_new(vstr->alloc);
+	VString *dest = vstr;
+
+	if (len_rep > len_find) {
+		if (VString_reserve(&out, len_new))
+			return -1;
+		dest = &out;
+	}
+
+	char *wr = VString_str(dest);
+	char *rd = hstack;
+
+	while ((itr = strstr(rd, find))) {
+		size_t len_seg = itr - rd;
+		memmove(wr, rd, len_seg);
+		wr += len_seg;
+		memmove(wr, replace, len_rep);
+		wr += len_rep;
+		rd = itr + len_find;
 	}
 
-	vstr->str_size = len_hstack;
-	vstr->str[len_hstack] = '\0';
+	// Remaining tail including null terminator.
+	memmove(wr, rd, strlen(rd) + 1);
 
+	if (dest == &out) {
+		VString_free(vstr);
+		*vstr = out;
+	}
+
+	vstr->str_size = len_new;
 	return 0;
 }
 
 int VString_free(VString *vstr) {
-	if (!vstr->str)
+	if (!vstr)
 		return -1;
 
-	free(vstr->str);
+	if (vstr->str_cap > VSTRING_SSO_SIZE)
+		VAlloc_free(vstr->alloc, vstr->buf.heap);
+
+	*vstr = VString_new(vstr->alloc);
 	return 0;
 }
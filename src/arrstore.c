@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arrstore.h"
+#include "utils.h"
+#include "conf.h"
+
+ArrStore *ArrStore_new(VAllocator *alloc) {
+	ArrStore *store = VAlloc_alloc(alloc, sizeof(ArrStore));
+	if (null_check(store, "arrstore new")) return NULL;
+
+	// Buffers are allocated on first use, most arrays only need one of them.
+	store->ints = NULL;
+	store->int_ctr = 0;
+	store->int_cap = 0;
+	store->strs = NULL;
+	store->str_ctr = 0;
+	store->str_cap = 0;
+	store->nodes = NULL;
+	store->node_ctr = 0;
+	store->node_cap = 0;
+	store->runs = NULL;
+	store->run_ctr = 0;
+	store->run_cap = 0;
+	store->len = 0;
+	store->kind = ARR_EMPTY;
+	store->alloc = alloc;
+	return store;
+}
+
+// Make room for one more entry of size bytes, doubling capacity when full.
+static int store_reserve(ArrStore *store, void **buf, size_t *cap, size_t ctr, size_t size) {
+	if (ctr < *cap)
+		return 0;
+
+	size_t n_cap = *cap ? *cap * 2 : INIT_ARRSTORE_SIZE;
+	void *n_buf = VAlloc_realloc(store->alloc, *buf, n_cap * size);
+	if (null_check(n_buf, "arrstore reserve")) return -1;
+
+	*buf = n_buf;
+	*cap = n_cap;
+	return 0;
+}
+
+// Account for a new element of kind stored at offset off of its buffer.
+static int store_extend_run(ArrStore *store, enum ArrKind kind, size_t off) {
+	if (store->run_ctr > 0 && store->runs[store->run_ctr - 1].kind == kind) {
+		store->runs[store->run_ctr - 1].len++;
+	}
+	else {
+		if (store_reserve(store, (void **) &store->runs, &store->run_cap, store->run_ctr, sizeof(ArrRun)))
+			return -1;
+
+		ArrRun *run = &store->runs[store->run_ctr++];
+		run->kind = kind;
+		run->start = store->len;
+		run->len = 1;
+		run->off = off;
+	}
+
+	if (store->kind == ARR_EMPTY)
+		store->kind = kind;
+	else if (store->kind != kind)
+		store->kind = ARR_MIXED;
+
+	store->len++;
+	return 0;
+}
+
+int ArrStore_push_int(ArrStore *store, int num) {
+	if (null_check(store, "arrstore push int")) return -1;
+
+	if (store_reserve(store, (void **) &store->ints, &store->int_cap, store->int_ctr, sizeof(int)))
+		return -1;
+
+	if (store_extend_run(store, ARR_INT, store->int_ctr))
+		return -1;
+
+	store->ints[store->int_ctr++] = num;
+	return 0;
+}
+
+int ArrStore_push_str(ArrStore *store, const char *str) {
+	if (null_check(store, "arrstore push str") || !str) return -1;
+
+	if (store_reserve(store, (void **) &store->strs, &store->str_cap, store->str_ctr, sizeof(char *)))
+		return -1;
+
+	if (store_extend_run(store, ARR_STR, store->str_ctr))
+		return -1;
+
+	store->strs[store->str_ctr++] = str;
+	return 0;
+}
+
+int ArrStore_push_node(ArrStore *store, struct Node *node) {
+	if (null_check(store, "arrstore push node") || null_check(node, "arrstore push node")) return -1;
+
+	if (store_reserve(store, (void **) &store->nodes, &store->node_cap, store->node_ctr, sizeof(struct Node *)))
+		return -1;
+
+	if (store_extend_run(store, ARR_NODE, store->node_ctr))
+		return -1;
+
+	store->nodes[store->node_ctr++] = node;
+	return 0;
+}
+
+int ArrStore_get(ArrStore *store, size_t idx, ArrItem *item) {
+	if (null_check(store, "arrstore get") || null_check(item, "arrstore get")) return -1;
+
+	if (idx >= store->len)
+		return -1;
+
+	// Find last run starting at or before idx.
+	size_t lo = 0;
+	size_t hi = store->run_ctr;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (store->runs[mid].start <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	ArrRun *run = &store->runs[lo];
+	size_t off = run->off + (idx - run->start);
+	item->kind = run->kind;
+
+	switch (run->kind) {
+		case ARR_INT:
+			item->val.num = store->ints[off];
+			break;
+		case ARR_STR:
+			item->val.str = store->strs[off];
+			break;
+		default:
+			item->val.node = store->nodes[off];
+			break;
+	}
+
+	return 0;
+}
+
+// Shrink buffer to exactly ctr entries.
+static int store_shrink(ArrStore *store, void **buf, size_t *cap, size_t ctr, size_t size) {
+	if (ctr == *cap)
+		return 0;
+
+	if (ctr == 0) {
+		VAlloc_free(store->alloc, *buf);
+		*buf = NULL;
+		*cap = 0;
+		return 0;
+	}
+
+	void *n_buf = VAlloc_realloc(store->alloc, *buf, ctr * size);
+	if (null_check(n_buf, "arrstore trim")) return -1;
+
+	*buf = n_buf;
+	*cap = ctr;
+	return 0;
+}
+
+int ArrStore_trim(ArrStore *store) {
+	if (null_check(store, "arrstore trim")) return -1;
+
+	int ret = 0;
+	ret |= store_shrink(store, (void **) &store->ints, &store->int_cap, store->int_ctr, sizeof(int));
+	ret |= store_shrink(store, (void **) &store->strs, &store->str_cap, store->str_ctr, sizeof(char *));
+	ret |= store_shrink(store, (void **) &store->nodes, &store->node_cap, store->node_ctr, sizeof(struct Node *));
+	ret |= store_shrink(store, (void **) &store->runs, &store->run_cap, store->run_ctr, sizeof(ArrRun));
+	return ret ? -1 : 0;
+}
+
+void ArrStore_free(ArrStore *store) {
+	if (null_check(store, "arrstore free")) return;
+
+	VAlloc_free(store->alloc, store->ints);
+	VAlloc_free(store->alloc, store->strs);
+	VAlloc_free(store->alloc, store->nodes);
+	VAlloc_free(store->alloc, store->runs);
+	VAlloc_free(store->alloc, store);
+}
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "utils.h"
+
+// Changing how keys are computed must change this so old entries are never matched.
+#define CACHE_KEY_TAG "vmel-step 1"
+
+StepCache *StepCache_new(const char *dir, VAllocator *alloc) {
+	if (null_check((void *) dir, "stepcache new")) return NULL;
+
+	StepCache *cache = VAlloc_alloc(alloc, sizeof(StepCache));
+	if (null_check(cache, "stepcache new")) return NULL;
+
+	cache->dir = VString_new(alloc);
+	VString_set(&cache->dir, (char *) dir);
+	cache->alloc = alloc;
+	return cache;
+}
+
+int StepCache_path(Sha256 *ctx, const char *path) {
+	if (null_check(ctx, "stepcache path") || null_check((void *) path, "stepcache path")) return 0;
+
+	struct stat st;
+	char head[64];
+
+	if (lstat(path, &st)) {
+		Sha256_update(ctx, "-", 2);
+		return 0;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		int len = snprintf(head, sizeof(head), "f %lld", (long long) st.st_size);
+		Sha256_update(ctx, head, len + 1);
+		Sha256_file(ctx, path);
+	}
+	else if (S_ISLNK(st.st_mode)) {
+		char target[4096];
+		ssize_t len = readlink(path, target, sizeof(target));
+		Sha256_update(ctx, "l", 2);
+		if (len > 0)
+			Sha256_update(ctx, target, len);
+	}
+	else if (S_ISDIR(st.st_mode)) {
+		struct dirent **entries = NULL;
+		int entry_ctr = scandir(path, &entries, NULL, alphasort);
+		VString child = VString_new(NULL);
+
+		Sha256_update(ctx, "d", 2);
+
+		// Entries are sorted so the digest doesn't depend on the order the directory lists them in.
+		for (int i = 0; i < entry_ctr; i++) {
+			char *name = entries[i]->d_name;
+
+			if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+				Sha256_update(ctx, name, strlen(name) + 1);
+				VString_set(&child, (char *) path);
+				VString_pushc(&child, '/');
+				VString_pushs(&child, name);
+				StepCache_path(ctx, VString_str(&child));
+			}
+
+			free(entries[i]);
+		}
+
+		VString_free(&child);
+		free(entries);
+	}
+	else {
+		Sha256_update(ctx, "o", 2);
+	}
+
+	return 1;
+}
+
+void StepCache_inputs(char **inputs, size_t input_ctr, unsigned char *digest) {
+	Sha256 ctx;
+	Sha256_init(&ctx);
+
+	// The text always counts, the contents as well when it names something.
+	for (size_t i = 0; i < input_ctr; i++) {
+		Sha256_update(&ctx, inputs[i], strlen(inputs[i]) + 1);
+		StepCache_path(&ctx, inputs[i]);
+	}
+
+	Sha256_final(&ctx, digest);
+}
+
+void StepCache_key(const unsigned char *prev, const char *host, const unsigned char *inputs, const char *cmd, unsigned char *key) {
+	static const unsigned char None[SHA256_SIZE];
+	Sha256 ctx;
+
+	Sha256_init(&ctx);
+	Sha256_update(&ctx, CACHE_KEY_TAG, sizeof(CACHE_KEY_TAG));
+	Sha256_update(&ctx, prev ? prev : None, SHA256_SIZE);
+	Sha256_update(&ctx, host, strlen(host) + 1);
+	Sha256_update(&ctx, inputs, SHA256_SIZE);
+	Sha256_update(&ctx, cmd, strlen(cmd));
+	Sha256_final(&ctx, key);
+}
+
+// Set file to the path of an entry or blob of the cache.
+static char *cache_file(StepCache *cache, VString *file, const char *kind, const unsigned char *digest) {
+	char hex[SHA256_HEX + 1];
+
+	Sha256_hex(digest, hex);
+	VString_set(file, VString_str(&cache->dir));
+	VString_pushc(file, '/');
+	VString_pushs(file, (char *) kind);
+	VString_pushc(file, '/');
+	VString_pushs(file, hex);
+	return VString_str(file);
+}
+
+// Digest of a declared output as hex.
+static void output_digest(const char *path, char *hex) {
+	unsigned char digest[SHA256_SIZE];
+	Sha256 ctx;
+
+	Sha256_init(&ctx);
+	StepCache_path(&ctx, path);
+	Sha256_final(&ctx, digest);
+	Sha256_hex(digest, hex);
+}
+
+// Read a blob into output, checking it still has the digest it is named by.
+static int blob_read(const char *file, const char *hex, size_t len, VString *output) {
+	unsigned char digest[SHA256_SIZE];
+	char found[SHA256_HEX + 1];
+	char buf[16384];
+	size_t n;
+	Sha256 ctx;
+
+	FILE *fp = fopen(file, "rb");
+	if (!fp)
+		return -1;
+
+	Sha256_init(&ctx);
+	VString_set(output, "");
+
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		Sha256_update(&ctx, buf, n);
+		VString_pushn(output, buf, n);
+	}
+
+	fclose(fp);
+	Sha256_final(&ctx, digest);
+	Sha256_hex(digest, found);
+	return output->str_size == len && strcmp(found, hex) == 0 ? 0 : -1;
+}
+
+// Open the entry stored under key, NULL when there is none.
+static FILE *entry_open(StepCache *cache, const unsigned char *key) {
+	VString file = VString_new(cache->alloc);
+	FILE *fp = fopen(cache_file(cache, &file, "steps", key), "r");
+	VString_free(&file);
+	return fp;
+}
+
+int StepCache_lookup(StepCache *cache, const unsigned char *key, VString *output) {
+	if (null_check(cache, "stepcache lookup") || null_check(output, "stepcache lookup")) return 0;
+
+	FILE *fp = entry_open(cache, key);
+	if (!fp)
+		return 0;
+
+	char line[SHA256_HEX + 64];
+	char blob[SHA256_HEX + 1] = "";
+	size_t len = 0;
+	int status = -1;
+	int hit = 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "status %d", &status) != 1)
+			sscanf(line, "output %64s %zu", blob, &len);
+	}
+
+	fclose(fp);
+
+	if (status == 0 && strlen(blob) == SHA256_HEX) {
+		unsigned char digest[SHA256_SIZE];
+		VString file = VString_new(cache->alloc);
+
+		// Blob names are hex, turn it back into bytes to find the file.
+		for (int i = 0; i < SHA256_SIZE; i++)
+			sscanf(blob + i * 2, "%2hhx", &digest[i]);
+
+		hit = blob_read(cache_file(cache, &file, "blobs", digest), blob, len, output) == 0;
+		VString_free(&file);
+	}
+
+	return hit;
+}
+
+int StepCache_check(StepCache *cache, const unsigned char *key, char **outputs, size_t output_ctr) {
+	if (null_check(cache, "stepcache check")) return 0;
+
+	if (!output_ctr)
+		return 1;
+
+	FILE *fp = entry_open(cache, key);
+	if (!fp)
+		return 0;
+
+	char line[4096 + SHA256_HEX + 16];
+	char hex[SHA256_HEX + 1];
+	size_t matched = 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char recorded[SHA256_HEX + 1];
+		int path_at = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (sscanf(line, "creates %64s %n", recorded, &path_at) != 1 || !path_at)
+			continue;
+
+		for (size_t i = 0; i < output_ctr; i++) {
+			if (strcmp(outputs[i], line + path_at) != 0)
+				continue;
+
+			output_digest(outputs[i], hex);
+			if (strcmp(hex, recorded) == 0)
+				matched++;
+			break;
+		}
+	}
+
+	fclose(fp);
+	return matched == output_ctr;
+}
+
+// Write data under file through a temporary file, so readers never see part of it.
+static int cache_write(StepCache *cache, const char *file, const char *data, size_t len) {
+	VString tmp = VString_new(cache->alloc);
+	VString_set(&tmp, VString_str(&cache->dir));
+	VString_pushs(&tmp, "/tmp.XXXXXX");
+
+	int ret = -1;
+	int fd = mkstemp(VString_str(&tmp));
+
+	if (fd >= 0) {
+		FILE *fp = fdopen(fd, "wb");
+
+		if (fp) {
+			int failed = fwrite(data, 1, len, fp) != len;
+			failed |= fclose(fp) != 0;
+			ret = failed ? -1 : rename(VString_str(&tmp), file);
+		}
+		else {
+			close(fd);
+		}
+
+		if (ret)
+			unlink(VString_str(&tmp));
+	}
+
+	VString_free(&tmp);
+	return ret;
+}
+
+// Create the directories of the cache, several runs may race to do so.
+static int cache_dirs(StepCache *cache) {
+	VString dir = VString_new(cache->alloc);
+	const char *kinds[] = {"", "/steps", "/blobs"};
+	int ret = 0;
+
+	for (int i = 0; i < 3 && ret == 0; i++) {
+		VString_set(&dir, VString_str(&cache->dir));
+		VString_pushs(&dir, (char *) kinds[i]);
+		if (mkdir(VString_str(&dir), 0755) && errno != EEXIST)
+			ret = -1;
+	}
+
+	VString_free(&dir);
+	return ret;
+}
+
+int StepCache_store(StepCache *cache, const unsigned char *key, int status, const char *output, size_t len) {
+	if (null_check(cache, "stepcache store")) return -1;
+
+	// Failures run again next time.
+	if (status != 0)
+		return 0;
+
+	if (cache_dirs(cache))
+		return -1;
+
+	unsigned char digest[SHA256_SIZE];
+	char hex[SHA256_HEX + 1];
+	char entry[SHA256_HEX + 64];
+	Sha256 ctx;
+
+	Sha256_init(&ctx);
+	Sha256_update(&ctx, output ? output : "", len);
+	Sha256_final(&ctx, digest);
+
+	VString file = VString_new(cache->alloc);
+	int ret = 0;
+
+	// Blobs are named by their contents, one which exists holds the same bytes.
+	if (access(cache_file(cache, &file, "blobs", digest), F_OK))
+		ret = cache_write(cache, VString_str(&file), output ? output : "", len);
+
+	Sha256_hex(digest, hex);
+	int entry_len = snprintf(entry, sizeof(entry), "status %d\noutput %s %zu\n", status, hex, len);
+
+	if (ret == 0)
+		ret = cache_write(cache, cache_file(cache, &file, "steps", key), entry, entry_len);
+
+	VString_free(&file);
+	return ret;
+}
+
+int StepCache_record(StepCache *cache, const unsigned char *key, char **outputs, size_t output_ctr) {
+	if (null_check(cache, "stepcache record")) return -1;
+
+	if (!output_ctr)
+		return 0;
+
+	if (cache_dirs(cache))
+		return -1;
+
+	VString file = VString_new(cache->alloc);
+	VString entry = VString_new(cache->alloc);
+	char hex[SHA256_HEX + 1];
+
+	for (size_t i = 0; i < output_ctr; i++) {
+		output_digest(outputs[i], hex);
+		VString_pushs(&entry, "creates ");
+		VString_pushs(&entry, hex);
+		VString_pushc(&entry, ' ');
+		VString_pushs(&entry, outputs[i]);
+		VString_pushc(&entry, '\n');
+	}
+
+	int ret = cache_write(cache, cache_file(cache, &file, "steps", key), VString_str(&entry), entry.str_size);
+
+	VString_free(&file);
+	VString_free(&entry);
+	return ret;
+}
+
+void StepCache_free(StepCache *cache) {
+	if (null_check(cache, "stepcache free")) return;
+
+	VString_free(&cache->dir);
+	VAlloc_free(cache->alloc, cache);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "check.h"
+#include "program.h"
+#include "utils.h"
+
+#define ERR_UNREADABLE 0
+
+static const char *Error_Templates[] = {
+	"Check error: unable to read '@0'"
+};
+
+// Shared state of workers.
+typedef struct {
+	CheckResult *results;
+	size_t count;
+	size_t next;
+} CheckJob;
+
+// Read whole file, unlike file_to_buffer() failures are returned rather than exiting.
+static int check_read_file(const char *path, char **out) {
+	FILE *fptr = fopen(path, "r");
+	long f_size = 0;
+
+	*out = NULL;
+
+	if (!fptr)
+		return -1;
+
+	fseek(fptr, 0, SEEK_END);
+	f_size = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+
+	if (f_size > 0) {
+		*out = calloc(1, f_size + 1);
+		if (!*out || fread(*out, f_size, 1, fptr) != 1) {
+			free(*out);
+			*out = NULL;
+			fclose(fptr);
+			return -1;
+		}
+	}
+
+	fclose(fptr);
+	return 0;
+}
+
+static void check_file(CheckResult *res) {
+	char *buff = NULL;
+
+	// Diagnostics outlive the arena so they are kept on the system allocator.
+	res->err_handle = Error_new(NULL);
+
+	if (check_read_file(res->path, &buff)) {
+		Error_add_record(res->err_handle, Error_Templates, ERR_UNREADABLE, 0, 1, res->path);
+	}
+	else if (buff) {
+		VAllocator *arena = VAlloc_arena_new(0, 0);
+		Program *program = Program_compile(buff, 0, arena, res->err_handle);
+
+		if (program)
+			Program_free(program);
+		VAlloc_destroy(arena);
+		free(buff);
+	}
+
+	res->status = res->err_handle->error_ctr ? 1 : 0;
+}
+
+static void *check_worker(void *arg) {
+	CheckJob *job = arg;
+	size_t idx;
+
+	while ((idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+		check_file(&job->results[idx]);
+
+	return NULL;
+}
+
+size_t Check_files(char **paths, size_t count, unsigned int jobs, FILE *out) {
+	if (null_check(paths, "check files") || count == 0) return 0;
+
+	CheckJob job;
+	job.results = calloc(count, sizeof(CheckResult));
+	job.count = count;
+	job.next = 0;
+
+	if (null_check(job.results, "check files")) return count;
+
+	for (size_t i = 0; i < count; i++)
+		job.results[i].path = paths[i];
+
+	if (jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+
+	if (jobs > count)
+		jobs = count;
+
+	pthread_t *workers = malloc(jobs * sizeof(pthread_t));
+	size_t started = 0;
+
+	while (workers && started < jobs && pthread_create(&workers[started], NULL, check_worker, &job) == 0)
+		started++;
+
+	// Calling thread picks up whatever is left, covering the case no thread could be started.
+	check_worker(&job);
+
+	for (size_t i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	size_t failed = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		CheckResult *res = &job.results[i];
+
+		if (res->status == 0) {
+			fprintf(out, "%s: ok\n", res->path);
+		}
+		else {
+			fprintf(out, "%s:\n", res->path);
+			Error_flush(res->err_handle, out);
+			failed++;
+		}
+
+		Error_free(res->err_handle);
+	}
+
+	fprintf(out, "Checked %lu files, %lu with errors\n", count, failed);
+
+	free(workers);
+	free(job.results);
+	return failed;
+}
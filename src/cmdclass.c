@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "cmdclass.h"
+#include "utils.h"
+
+// Keys of programs start with this byte so they never match a path.
+#define KEY_MARK '\x01'
+
+// Programs which change the shell running the group.
+static const char *Shell_State[] = {
+	"cd", "pushd", "popd", "export", "unset", "source", ".", "exit", "set", "alias",
+	"unalias", "ulimit", "umask", "exec", "eval", "read", "wait", "trap", "shift",
+	"readonly", "local", "declare", "typeset", "hash", "shopt", "builtin"
+};
+
+// Programs which only read what they are given.
+static const char *Readers[] = {
+	"cat", "ls", "grep", "egrep", "fgrep", "head", "tail", "wc", "stat", "file", "test",
+	"[", "du", "df", "md5sum", "sha1sum", "sha256sum", "cmp", "diff", "readlink",
+	"realpath", "tree"
+};
+
+// Programs whose arguments are text rather than paths.
+static const char *Plain[] = {
+	"echo", "printf", "true", "false", "sleep", "date", "uname", "hostname", "id", "whoami",
+	"pwd", "printenv", "which", "ps", "basename", "dirname", "seq", "nproc", "uptime",
+	"getent", "ping"
+};
+
+// Programs running the program which follows them.
+static const char *Wrappers[] = {
+	"sudo", "nice", "nohup", "time", "command", "env", "stdbuf", "ionice"
+};
+
+// Package managers, which share a lock.
+static const char *Packagers[] = {
+	"apt", "apt-get", "aptitude", "dpkg", "yum", "dnf", "rpm", "zypper", "apk", "pacman", "snap"
+};
+
+// Programs whose first argument is a verb or pattern rather than something touched.
+static const char *Verbs[] = {
+	"systemctl", "git", "docker", "podman", "kubectl", "helm", "npm", "pip", "pip3",
+	"brew", "gem", "cargo", "chmod", "chown", "chgrp", "sed", "awk"
+};
+
+#define TABLE_HAS(table, word, len) table_has(table, sizeof(table) / sizeof(table[0]), word, len)
+
+static int table_has(const char **table, size_t size, const char *word, size_t len) {
+	for (size_t i = 0; i < size; i++) {
+		if (strlen(table[i]) == len && strncmp(table[i], word, len) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+// Program being scanned and what was learnt about it so far.
+typedef struct {
+	char prog[64];
+	size_t prog_len;
+	int started;
+	int wrapped;
+	int assigned;
+	int reader;
+	int plain;
+	int verb;
+	int skip_verb;
+	int end_opts;
+	size_t named;
+} CmdSegment;
+
+static int path_push(CmdClass *cls, const char *path, size_t len, int write) {
+	if (cls->path_ctr == cls->path_cap) {
+		size_t n_cap = cls->path_cap ? cls->path_cap * 2 : 8;
+		size_t *n_starts = VAlloc_realloc(cls->alloc, cls->starts, n_cap * sizeof(size_t));
+		if (null_check(n_starts, "cmdclass path")) return -1;
+		cls->starts = n_starts;
+		size_t *n_lens = VAlloc_realloc(cls->alloc, cls->lens, n_cap * sizeof(size_t));
+		if (null_check(n_lens, "cmdclass path")) return -1;
+		cls->lens = n_lens;
+		unsigned char *n_writes = VAlloc_realloc(cls->alloc, cls->writes, n_cap);
+		if (null_check(n_writes, "cmdclass path")) return -1;
+		cls->writes = n_writes;
+		cls->path_cap = n_cap;
+	}
+
+	cls->starts[cls->path_ctr] = cls->text.str_size;
+	cls->lens[cls->path_ctr] = len;
+	cls->writes[cls->path_ctr] = write ? 1 : 0;
+	cls->path_ctr++;
+	VString_pushn(&cls->text, path, len);
+	return 0;
+}
+
+static int key_push(CmdClass *cls, const char *name, size_t len, int write) {
+	char key[64];
+
+	if (len + 1 > sizeof(key))
+		len = sizeof(key) - 1;
+
+	key[0] = KEY_MARK;
+	memcpy(key + 1, name, len);
+	return path_push(cls, key, len + 1, write);
+}
+
+// Store path with empty and . components dropped, a glob stands for the directory it is in.
+static int path_add(CmdClass *cls, const char *word, size_t len, int glob, int write) {
+	char norm[4096];
+	size_t n = 0;
+	int absolute = len && word[0] == '/';
+
+	if (glob) {
+		size_t cut = strcspn(word, "*?[");
+		while (cut && word[cut - 1] != '/')
+			cut--;
+		len = cut;
+	}
+
+	if (len >= sizeof(norm))
+		len = sizeof(norm) - 1;
+
+	// Writing to these never affects another command.
+	if (len >= 5 && strncmp(word, "/dev/", 5) == 0)
+		return 0;
+
+	for (size_t i = 0; i < len;) {
+		size_t end = i;
+		while (end < len && word[end] != '/')
+			end++;
+
+		size_t part = end - i;
+
+		if (part == 2 && word[i] == '.' && word[i + 1] == '.') {
+			// Relative paths leaving the directory could be anything in it.
+			if (!absolute) {
+				n = 0;
+				break;
+			}
+			while (n && norm[n - 1] != '/')
+				n--;
+			if (n)
+				n--;
+		}
+		else if (part && !(part == 1 && word[i] == '.')) {
+			if (n || absolute)
+				norm[n++] = '/';
+			memcpy(norm + n, word + i, part);
+			n += part;
+		}
+
+		i = end + 1;
+	}
+
+	if (!n && absolute)
+		norm[n++] = '/';
+	else if (!n)
+		norm[n++] = '.';
+
+	return path_push(cls, norm, n, write);
+}
+
+// A segment of a pipeline or list ended, settle what its program touches.
+static void segment_end(CmdClass *cls, CmdSegment *seg) {
+	if (!seg->started) {
+		// A bare assignment sets a variable of the shell.
+		if (seg->assigned) {
+			cls->ordered = 1;
+			cls->shell = 1;
+		}
+	}
+	else if (seg->plain) {
+		// Touches nothing besides what it is redirected to.
+	}
+	else if (seg->verb) {
+		key_push(cls, seg->prog, seg->prog_len, seg->named == 0);
+	}
+	else if (!seg->named && !seg->reader) {
+		cls->ordered = 1;
+	}
+	else if (!seg->named) {
+		// Readers such as ls look at the directory when given nothing.
+		path_push(cls, ".", 1, 0);
+	}
+
+	memset(seg, 0, sizeof(CmdSegment));
+}
+
+// Read the word starting at cmd into word, returns the number of bytes consumed or 0 if it can't be analysed.
+static size_t word_read(const char *cmd, VString *word, int *glob) {
+	size_t i = 0;
+	char quote = 0;
+
+	VString_set(word, "");
+	*glob = 0;
+
+	if (cmd[0] == '~')
+		return 0;
+
+	for (; cmd[i]; i++) {
+		char c = cmd[i];
+
+		if (quote) {
+			if (c == quote)
+				quote = 0;
+			else if (quote == '"' && (c == '$' || c == '`'))
+				return 0;
+			else if (quote == '"' && c == '\\' && cmd[i + 1])
+				VString_pushc(word, cmd[++i]);
+			else
+				VString_pushc(word, c);
+			continue;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || strchr(";|&<>()", c))
+			break;
+
+		if (c == '$' || c == '`')
+			return 0;
+
+		if (c == '\'' || c == '"') {
+			quote = c;
+		}
+		else if (c == '\\' && cmd[i + 1]) {
+			VString_pushc(word, cmd[++i]);
+		}
+		else {
+			if (c == '*' || c == '?' || c == '[')
+				*glob = 1;
+			VString_pushc(word, c);
+		}
+	}
+
+	return quote ? 0 : i;
+}
+
+// NAME=value before a program, which only sets the environment of that program.
+static int is_assignment(const char *word) {
+	size_t i = 0;
+
+	if (!isalpha((unsigned char) word[0]) && word[0] != '_')
+		return 0;
+
+	while (isalnum((unsigned char) word[i]) || word[i] == '_')
+		i++;
+
+	return word[i] == '=';
+}
+
+// Handle a word of a segment, returns -1 if it makes the command ordered.
+static int segment_word(CmdClass *cls, CmdSegment *seg, const char *word, size_t len, int glob) {
+	if (!seg->started) {
+		if (is_assignment(word)) {
+			seg->assigned = 1;
+			return 0;
+		}
+
+		if (seg->wrapped && word[0] == '-')
+			return 0;
+
+		const char *base = strrchr(word, '/');
+		base = base ? base + 1 : word;
+		size_t base_len = len - (base - word);
+
+		if (TABLE_HAS(Shell_State, base, base_len)) {
+			cls->shell = 1;
+			return -1;
+		}
+
+		if (strcmp(word, "{") == 0 || strcmp(word, "}") == 0)
+			return -1;
+
+		if (strcmp(word, "!") == 0)
+			return 0;
+
+		if (TABLE_HAS(Wrappers, base, base_len)) {
+			seg->wrapped = 1;
+			return 0;
+		}
+
+		seg->started = 1;
+		seg->prog_len = base_len < sizeof(seg->prog) ? base_len : sizeof(seg->prog) - 1;
+		memcpy(seg->prog, base, seg->prog_len);
+		seg->reader = TABLE_HAS(Readers, base, base_len);
+		seg->plain = TABLE_HAS(Plain, base, base_len);
+		seg->verb = TABLE_HAS(Verbs, base, base_len);
+		seg->skip_verb = seg->verb;
+
+		// What a package manager installs is covered by the lock they share.
+		if (TABLE_HAS(Packagers, base, base_len)) {
+			seg->plain = 1;
+			return key_push(cls, "pkg", 3, 1);
+		}
+
+		return 0;
+	}
+
+	if (seg->plain)
+		return 0;
+
+	if (word[0] == '-' && !seg->end_opts) {
+		const char *value = strchr(word, '=');
+
+		if (strcmp(word, "--") == 0)
+			seg->end_opts = 1;
+		else if (value && strchr(value, '/'))
+			return path_add(cls, value + 1, len - (value + 1 - word), glob, !seg->reader);
+
+		return 0;
+	}
+
+	if (seg->skip_verb) {
+		seg->skip_verb = 0;
+		return 0;
+	}
+
+	seg->named++;
+	return path_add(cls, word, len, glob, !seg->reader);
+}
+
+// Whether any word of what couldn't be analysed could change the shell, such as cd or an assignment.
+static int shell_words(const char *cmd) {
+	static const char *Breaks = " \t\r\n;|&(){}`'\"$";
+
+	while (*cmd) {
+		size_t len = strcspn(cmd, Breaks);
+
+		if (len) {
+			char word[64];
+			size_t n = len < sizeof(word) ? len : sizeof(word) - 1;
+
+			memcpy(word, cmd, n);
+			word[n] = '\0';
+			if (TABLE_HAS(Shell_State, word, len) || is_assignment(word))
+				return 1;
+		}
+
+		cmd += len ? len : 1;
+	}
+
+	return 0;
+}
+
+void CmdClass_init(CmdClass *cls, VAllocator *alloc) {
+	if (null_check(cls, "cmdclass init")) return;
+
+	cls->ordered = 0;
+	cls->shell = 0;
+	cls->text = VString_new(alloc);
+	cls->starts = NULL;
+	cls->lens = NULL;
+	cls->writes = NULL;
+	cls->path_ctr = 0;
+	cls->path_cap = 0;
+	cls->alloc = alloc;
+}
+
+int CmdClass_scan(CmdClass *cls, const char *cmd) {
+	if (null_check(cls, "cmdclass scan") || null_check((void *) cmd, "cmdclass scan")) return -1;
+
+	VString word = VString_new(cls->alloc);
+	CmdSegment seg;
+	// 1 when the next word is read by a redirection, 2 when written.
+	int redirect = 0;
+	int glob = 0;
+	int ret = 0;
+	size_t i = 0;
+
+	cls->ordered = 0;
+	cls->shell = 0;
+	cls->path_ctr = 0;
+	VString_set(&cls->text, "");
+	memset(&seg, 0, sizeof(CmdSegment));
+
+	while (!cls->ordered && ret == 0) {
+		while (cmd[i] == ' ' || cmd[i] == '\t' || cmd[i] == '\r')
+			i++;
+
+		char c = cmd[i];
+
+		if (c == '\0' || c == '#' || c == '\n' || c == ';' || c == '|' || (c == '&' && cmd[i + 1] == '&')) {
+			if (redirect)
+				cls->ordered = 1;
+
+			segment_end(cls, &seg);
+			if (c == '\0' || c == '#')
+				break;
+
+			i += (cmd[i + 1] == c && c != ';' && c != '\n') ? 2 : 1;
+			continue;
+		}
+
+		if (c == '&' && cmd[i + 1] == '>') {
+			redirect = 2;
+			i += cmd[i + 2] == '>' ? 3 : 2;
+			continue;
+		}
+
+		// Background jobs, subshells and here documents aren't followed.
+		if (c == '&' || c == '(' || c == ')' || (c == '<' && cmd[i + 1] == '<')) {
+			cls->ordered = 1;
+			break;
+		}
+
+		if (c == '<') {
+			redirect = cmd[i + 1] == '>' ? 2 : 1;
+			i += cmd[i + 1] == '>' ? 2 : 1;
+			continue;
+		}
+
+		if (c == '>') {
+			i++;
+			if (cmd[i] == '>' || cmd[i] == '|')
+				i++;
+
+			// Duplicating a descriptor such as 2>&1 touches no path.
+			if (cmd[i] == '&') {
+				i++;
+				while (isalnum((unsigned char) cmd[i]) || cmd[i] == '-')
+					i++;
+				continue;
+			}
+
+			redirect = 2;
+			continue;
+		}
+
+		// Descriptor number of a redirection such as 2>.
+		if (isdigit((unsigned char) c)) {
+			size_t end = i;
+			while (isdigit((unsigned char) cmd[end]))
+				end++;
+			if (cmd[end] == '>' || cmd[end] == '<') {
+				i = end;
+				continue;
+			}
+		}
+
+		size_t used = word_read(cmd + i, &word, &glob);
+		if (!used) {
+			cls->ordered = 1;
+			break;
+		}
+		i += used;
+
+		if (redirect) {
+			ret = path_add(cls, VString_str(&word), word.str_size, glob, redirect == 2);
+			redirect = 0;
+		}
+		else if (segment_word(cls, &seg, VString_str(&word), word.str_size, glob)) {
+			cls->ordered = 1;
+		}
+	}
+
+	if (ret)
+		cls->ordered = 1;
+
+	// Scanning stopped early, look for anything in the rest which could change the shell.
+	if (cls->ordered && !cls->shell && cmd[i])
+		cls->shell = shell_words(cmd + i);
+
+	VString_free(&word);
+	return ret;
+}
+
+// Two stored paths refer to the same file or one is below the other.
+static int path_overlap(const char *a, size_t a_len, const char *b, size_t b_len) {
+	int a_key = a[0] == KEY_MARK;
+	int b_key = b[0] == KEY_MARK;
+
+	if (a_key || b_key)
+		return a_key && b_key && a_len == b_len && memcmp(a, b, a_len) == 0;
+
+	// Without the directory a relative path could be any absolute one.
+	if ((a[0] == '/') != (b[0] == '/'))
+		return 1;
+
+	if ((a_len == 1 && a[0] == '.') || (b_len == 1 && b[0] == '.'))
+		return 1;
+
+	if (a_len > b_len) {
+		const char *t = a;
+		a = b;
+		b = t;
+		size_t t_len = a_len;
+		a_len = b_len;
+		b_len = t_len;
+	}
+
+	if (memcmp(a, b, a_len) != 0)
+		return 0;
+
+	return a_len == b_len || b[a_len] == '/' || (a_len == 1 && a[0] == '/');
+}
+
+int CmdClass_conflicts(const CmdClass *a, const CmdClass *b) {
+	if (null_check((void *) a, "cmdclass conflicts") || null_check((void *) b, "cmdclass conflicts")) return 1;
+
+	if (a->ordered || b->ordered)
+		return 1;
+
+	const char *a_text = VString_str((VString *) &a->text);
+	const char *b_text = VString_str((VString *) &b->text);
+
+	for (size_t i = 0; i < a->path_ctr; i++) {
+		for (size_t j = 0; j < b->path_ctr; j++) {
+			if (!a->writes[i] && !b->writes[j])
+				continue;
+			if (path_overlap(a_text + a->starts[i], a->lens[i], b_text + b->starts[j], b->lens[j]))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+void CmdClass_free(CmdClass *cls) {
+	if (null_check(cls, "cmdclass free")) return;
+
+	VString_free(&cls->text);
+	VAlloc_free(cls->alloc, cls->starts);
+	VAlloc_free(cls->alloc, cls->lens);
+	VAlloc_free(cls->alloc, cls->writes);
+	cls->path_ctr = 0;
+	cls->path_cap = 0;
+}
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dag.h"
+#include "vstring.h"
+#include "conf.h"
+#include "utils.h"
+
+#define ERR_UNDEFINED_NEED 0
+#define ERR_CYCLE 1
+
+static const char *Error_Templates[] = {
+	"Parsing error: Group {@0} needs undefined group {@1} in line @L",
+	"Parsing error: Group {@0} needs itself through @1 in line @L",
+};
+
+// Line a group was defined on.
+static unsigned int group_lineno(SyTable *layout, Node *group) {
+	Symbol *sy = layout ? SyTable_get_symbol(layout, group->value) : NULL;
+	return sy ? sy->lineno : 0;
+}
+
+// Index of the group called name or -1.
+static long dag_find_name(GroupDag *dag, const char *name) {
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		if (strcmp(dag->groups[i].group->value, name) == 0)
+			return (long) i;
+	}
+
+	return -1;
+}
+
+// Commands of a group form a circular list which ends at the group itself.
+static size_t group_cmd_ctr(Node *group) {
+	size_t ctr = 0;
+	Node *cmd = group->data->GroupNode.next;
+
+	while (cmd && cmd != group) {
+		ctr++;
+		cmd = cmd->data->GroupNode.next;
+	}
+
+	return ctr;
+}
+
+// Follow needs from a group left over by the topological sort until one repeats, and report the loop.
+static void dag_report_cycle(GroupDag *dag, size_t *remaining, SyTable *layout, Error *err_handle) {
+	size_t *next = VAlloc_alloc(dag->alloc, (dag->group_ctr + 1) * sizeof(size_t));
+	size_t curr = 0;
+
+	if (null_check(next, "group dag cycle")) return;
+
+	for (size_t i = 0; i < dag->group_ctr; i++)
+		next[i] = (size_t) -1;
+
+	while (!remaining[curr])
+		curr++;
+
+	// Every group left over needs another left over group.
+	while (next[curr] == (size_t) -1) {
+		for (size_t n = 0; n < dag->groups[curr].need_ctr; n++) {
+			if (remaining[dag->groups[curr].needs[n]]) {
+				next[curr] = dag->groups[curr].needs[n];
+				break;
+			}
+		}
+		curr = next[curr];
+	}
+
+	VString path = VString_new(dag->alloc);
+	size_t itr = curr;
+
+	do {
+		VString_pushs(&path, "{");
+		VString_pushs(&path, dag->groups[itr].group->value);
+		VString_pushs(&path, "} -> ");
+		itr = next[itr];
+	} while (itr != curr);
+
+	VString_pushs(&path, "{");
+	VString_pushs(&path, dag->groups[curr].group->value);
+	VString_pushs(&path, "}");
+
+	Node *group = dag->groups[curr].group;
+	Error_add_record(err_handle, Error_Templates, ERR_CYCLE, group_lineno(layout, group), 2, group->value, VString_str(&path));
+	VString_free(&path);
+	VAlloc_free(dag->alloc, next);
+}
+
+// Order groups so each comes after its needs, groups are taken in order of definition where free to.
+static int dag_sort(GroupDag *dag, SyTable *layout, Error *err_handle) {
+	size_t n = dag->group_ctr;
+	size_t *remaining = VAlloc_alloc(dag->alloc, (n + 1) * sizeof(size_t));
+	size_t head = 0;
+	size_t tail = 0;
+
+	if (null_check(remaining, "group dag sort")) return -1;
+
+	for (size_t i = 0; i < n; i++) {
+		remaining[i] = dag->groups[i].need_ctr;
+		if (!remaining[i])
+			dag->topo[tail++] = i;
+	}
+
+	while (head < tail) {
+		DagGroup *g = &dag->groups[dag->topo[head++]];
+		for (size_t u = 0; u < g->user_ctr; u++) {
+			if (--remaining[g->users[u]] == 0)
+				dag->topo[tail++] = g->users[u];
+		}
+	}
+
+	if (tail < n)
+		dag_report_cycle(dag, remaining, layout, err_handle);
+
+	VAlloc_free(dag->alloc, remaining);
+	return tail < n ? -1 : 0;
+}
+
+// Resolve the names a group needs and link the groups both ways, 1 if a name is undefined.
+static int dag_link(GroupDag *dag, SyTable *layout, Error *err_handle) {
+	int ret = 0;
+
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		DagGroup *g = &dag->groups[i];
+		Node *group = g->group;
+
+		g->needs = VAlloc_alloc(dag->alloc, (group->data->GroupNode.need_ctr + 1) * sizeof(size_t));
+		if (null_check(g->needs, "group dag link")) return -1;
+
+		for (size_t n = 0; n < group->data->GroupNode.need_ctr; n++) {
+			char *name = group->data->GroupNode.needs[n];
+			long need = dag_find_name(dag, name);
+
+			if (need < 0) {
+				Error_add_record(err_handle, Error_Templates, ERR_UNDEFINED_NEED, group_lineno(layout, group), 2, group->value, name);
+				ret = 1;
+				continue;
+			}
+
+			g->needs[g->need_ctr++] = (size_t) need;
+			dag->groups[need].user_ctr++;
+		}
+	}
+
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		DagGroup *g = &dag->groups[i];
+		g->users = VAlloc_alloc(dag->alloc, (g->user_ctr + 1) * sizeof(size_t));
+		if (null_check(g->users, "group dag link")) return -1;
+		g->user_ctr = 0;
+	}
+
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		for (size_t n = 0; n < dag->groups[i].need_ctr; n++) {
+			DagGroup *need = &dag->groups[dag->groups[i].needs[n]];
+			need->users[need->user_ctr++] = i;
+		}
+	}
+
+	return ret;
+}
+
+GroupDag *GroupDag_build(NodeMgr *node_mgr, SyTable *layout, Error *err_handle, VAllocator *alloc) {
+	if (null_check(node_mgr, "group dag build") || null_check(err_handle, "group dag build")) return NULL;
+
+	size_t group_ctr = 0;
+	int has_needs = 0;
+
+	for (size_t i = 0; i < node_mgr->nodes_ctr; i++) {
+		Node *node = node_mgr->nodes[i];
+		if (node->type == E_GROUP_NODE) {
+			group_ctr++;
+			has_needs |= node->data->GroupNode.need_ctr > 0;
+		}
+	}
+
+	// Without needs every group runs on its own as before.
+	if (!has_needs)
+		return NULL;
+
+	GroupDag *dag = VAlloc_alloc(alloc, sizeof(GroupDag));
+	if (null_check(dag, "group dag build")) return NULL;
+
+	dag->alloc = alloc;
+	dag->group_ctr = group_ctr;
+	dag->groups = VAlloc_calloc(alloc, group_ctr * sizeof(DagGroup));
+	dag->topo = VAlloc_alloc(alloc, group_ctr * sizeof(size_t));
+
+	if (null_check(dag->groups, "group dag build") || null_check(dag->topo, "group dag build")) {
+		GroupDag_free(dag);
+		return NULL;
+	}
+
+	for (size_t i = 0, g = 0; i < node_mgr->nodes_ctr; i++) {
+		Node *node = node_mgr->nodes[i];
+		if (node->type != E_GROUP_NODE)
+			continue;
+
+		dag->groups[g].group = node;
+		dag->groups[g].cmd_ctr = group_cmd_ctr(node);
+		g++;
+	}
+
+	// Cycles among the needs which resolved are reported along with the undefined ones.
+	int ret = dag_link(dag, layout, err_handle);
+	if (ret >= 0 && dag_sort(dag, layout, err_handle))
+		ret = -1;
+
+	if (ret) {
+		GroupDag_free(dag);
+		return NULL;
+	}
+
+	return dag;
+}
+
+long GroupDag_find(GroupDag *dag, Node *group) {
+	if (!dag || !group)
+		return -1;
+
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		if (dag->groups[i].group == group)
+			return (long) i;
+	}
+
+	return -1;
+}
+
+size_t GroupDag_plan(GroupDag *dag, DagHistory *history, size_t target, size_t *order, long long *prio) {
+	if (null_check(dag, "group dag plan") || target >= dag->group_ctr) return 0;
+
+	size_t n = dag->group_ctr;
+	size_t *pending = VAlloc_calloc(dag->alloc, (n + 1) * sizeof(size_t));
+	size_t ctr = 0;
+
+	if (null_check(pending, "group dag plan")) return 0;
+
+	// Groups target needs are marked with a prio of 0, order serves as the stack.
+	for (size_t i = 0; i < n; i++)
+		prio[i] = -1;
+
+	prio[target] = 0;
+	order[ctr++] = target;
+
+	while (ctr) {
+		DagGroup *g = &dag->groups[order[--ctr]];
+		for (size_t i = 0; i < g->need_ctr; i++) {
+			if (prio[g->needs[i]] < 0) {
+				prio[g->needs[i]] = 0;
+				order[ctr++] = g->needs[i];
+			}
+		}
+	}
+
+	if (history)
+		pthread_mutex_lock(&history->lock);
+
+	// Users come later in topo, so walking it backwards their paths are known before ours.
+	// Users target doesn't need are left at -1 and don't count.
+	for (size_t t = n; t-- > 0;) {
+		size_t i = dag->topo[t];
+		DagGroup *g = &dag->groups[i];
+		long long longest = 0;
+
+		if (prio[i] < 0)
+			continue;
+
+		for (size_t u = 0; u < g->user_ctr; u++) {
+			if (prio[g->users[u]] > longest)
+				longest = prio[g->users[u]];
+		}
+
+		long long us = history ? history->us[i] : 0;
+		prio[i] = longest + (us ? us : (long long) (g->cmd_ctr ? g->cmd_ctr : 1) * VMEL_DAG_COMMAND_US);
+		pending[i] = g->need_ctr;
+	}
+
+	if (history)
+		pthread_mutex_unlock(&history->lock);
+
+	// Each time take the ready group with the longest path left, ties go to the one defined first.
+	for (;;) {
+		long best = -1;
+
+		for (size_t i = 0; i < n; i++) {
+			if (prio[i] >= 0 && pending[i] == 0 && (best < 0 || prio[i] > prio[best]))
+				best = (long) i;
+		}
+
+		if (best < 0)
+			break;
+
+		order[ctr++] = (size_t) best;
+		pending[best] = (size_t) -1;
+
+		DagGroup *g = &dag->groups[best];
+		for (size_t u = 0; u < g->user_ctr; u++) {
+			if (prio[g->users[u]] >= 0)
+				pending[g->users[u]]--;
+		}
+	}
+
+	VAlloc_free(dag->alloc, pending);
+	return ctr;
+}
+
+size_t GroupDag_lanes(GroupDag *dag, const size_t *order, size_t len, size_t *lane, long *seed) {
+	if (null_check(dag, "group dag lanes") || null_check((void *) order, "group dag lanes")) return 0;
+
+	unsigned char *continued = VAlloc_calloc(dag->alloc, dag->group_ctr + 1);
+	size_t lane_ctr = 0;
+
+	if (null_check(continued, "group dag lanes")) return 0;
+
+	for (size_t i = 0; i < dag->group_ctr; i++) {
+		lane[i] = 0;
+		seed[i] = -1;
+	}
+
+	// Needs come first in the plan so the lane of the first need is always known.
+	for (size_t i = 0; i < len; i++) {
+		DagGroup *g = &dag->groups[order[i]];
+
+		if (g->need_ctr && !continued[g->needs[0]]) {
+			continued[g->needs[0]] = 1;
+			lane[order[i]] = lane[g->needs[0]];
+			continue;
+		}
+
+		lane[order[i]] = lane_ctr++;
+		if (g->need_ctr)
+			seed[order[i]] = (long) g->needs[0];
+	}
+
+	VAlloc_free(dag->alloc, continued);
+	return lane_ctr;
+}
+
+void GroupDag_free(GroupDag *dag) {
+	if (null_check(dag, "group dag free")) return;
+
+	for (size_t i = 0; dag->groups && i < dag->group_ctr; i++) {
+		VAlloc_free(dag->alloc, dag->groups[i].needs);
+		VAlloc_free(dag->alloc, dag->groups[i].users);
+	}
+
+	VAlloc_free(dag->alloc, dag->groups);
+	VAlloc_free(dag->alloc, dag->topo);
+	VAlloc_free(dag->alloc, dag);
+}
+
+DagHistory *DagHistory_new(GroupDag *dag, VAllocator *alloc) {
+	if (null_check(dag, "dag history new")) return NULL;
+
+	DagHistory *history = VAlloc_alloc(alloc, sizeof(DagHistory));
+	if (null_check(history, "dag history new")) return NULL;
+
+	history->us = VAlloc_calloc(alloc, (dag->group_ctr + 1) * sizeof(long long));
+	if (null_check(history->us, "dag history new")) {
+		VAlloc_free(alloc, history);
+		return NULL;
+	}
+
+	history->ctr = dag->group_ctr;
+	history->dirty = 0;
+	history->alloc = alloc;
+	pthread_mutex_init(&history->lock, NULL);
+	return history;
+}
+
+int DagHistory_load(DagHistory *history, GroupDag *dag, const char *path) {
+	if (null_check(history, "dag history load") || null_check(dag, "dag history load")) return -1;
+
+	FILE *fptr = fopen(path, "r");
+	if (!fptr)
+		return -1;
+
+	char *line = NULL;
+	size_t cap = 0;
+
+	while (getline(&line, &cap, fptr) >= 0) {
+		char *sep = strchr(line, ' ');
+		if (!sep)
+			continue;
+
+		*sep = '\0';
+		long idx = dag_find_name(dag, line);
+		long long us = strtoll(sep + 1, NULL, 10);
+
+		if (idx >= 0 && (size_t) idx < history->ctr && us > 0)
+			history->us[idx] = us;
+	}
+
+	free(line);
+	fclose(fptr);
+	return 0;
+}
+
+void DagHistory_record(DagHistory *history, size_t idx, long long us) {
+	if (null_check(history, "dag history record") || idx >= history->ctr) return;
+
+	pthread_mutex_lock(&history->lock);
+	if (history->us[idx])
+		history->us[idx] += (us - history->us[idx]) / 4;
+	else
+		history->us[idx] = us > 0 ? us : 1;
+	history->dirty = 1;
+	pthread_mutex_unlock(&history->lock);
+}
+
+int DagHistory_save(DagHistory *history, GroupDag *dag, const char *path) {
+	if (null_check(history, "dag history save") || null_check(dag, "dag history save")) return -1;
+
+	if (!history->dirty)
+		return 0;
+
+	FILE *fptr = fopen(path, "w");
+	if (!fptr)
+		return -1;
+
+	for (size_t i = 0; i < history->ctr && i < dag->group_ctr; i++) {
+		if (history->us[i])
+			fprintf(fptr, "%s %lld\n", dag->groups[i].group->value, history->us[i]);
+	}
+
+	history->dirty = 0;
+	return fclose(fptr) ? -1 : 0;
+}
+
+void DagHistory_free(DagHistory *history) {
+	if (null_check(history, "dag history free")) return;
+
+	pthread_mutex_destroy(&history->lock);
+	VAlloc_free(history->alloc, history->us);
+	VAlloc_free(history->alloc, history);
+}
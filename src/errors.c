@@ -1,45 +1,175 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
 #include "errors.h"
 #include "utils.h"
+#include "stats.h"
 
-Error *Error_new(void) {
-	Error *err_handle = malloc(sizeof(Error));
-	err_handle->error_cap = INIT_MAX_ERRORS;
+// Template used for preformatted errors.
+static const char *Plain_Templates[] = {
+	"@0"
+};
+
+Error *Error_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_ERROR, alloc);
+	Error *err_handle = VAlloc_alloc(alloc, sizeof(Error));
+	err_handle->records = NULL;
+	err_handle->error_cap = 0;
 	err_handle->error_ctr = 0;
+	err_handle->error_flushed = 0;
+	err_handle->args = NULL;
+	err_handle->args_len = 0;
+	err_handle->args_cap = 0;
+	err_handle->alloc = alloc;
 	return err_handle;
 }
 
-int Error_add(Error *err_handle, char *err) {
-	if (!err_handle || !err)
-		return -1;
+// Copy argument into argument buffer and return its offset.
+static int error_push_arg(Error *err_handle, const char *arg, size_t *offset) {
+	size_t len = strlen(arg) + 1;
+
+	if (err_handle->args_cap - err_handle->args_len < len) {
+		size_t n_cap = err_handle->args_cap ? err_handle->args_cap * 2 : 256;
+		while (n_cap - err_handle->args_len < len)
+			n_cap *= 2;
+
+		char *n_args = VAlloc_realloc(err_handle->alloc, err_handle->args, n_cap);
+		if (null_check(n_args, "error push arg")) return -1;
+		err_handle->args = n_args;
+		err_handle->args_cap = n_cap;
+	}
+
+	*offset = err_handle->args_len;
+	memcpy(err_handle->args + err_handle->args_len, arg, len);
+	err_handle->args_len += len;
+	return 0;
+}
 
-	if (err_handle->error_ctr == err_handle->error_cap)
+// Store record whose arguments are given as an array.
+static int error_push_record(Error *err_handle, const char *const *templates, unsigned int code, unsigned int lineno, unsigned int argc, const char **args) {
+	if (err_handle->error_ctr == ERROR_LIMIT)
 		return 0;
 
-	err_handle->errors[err_handle->error_ctr] = err;
+	if (err_handle->error_ctr == err_handle->error_cap) {
+		size_t n_cap = err_handle->error_cap ? err_handle->error_cap * 2 : INIT_MAX_ERRORS;
+		ErrorRecord *n_records = VAlloc_realloc(err_handle->alloc, err_handle->records, n_cap * sizeof(ErrorRecord));
+		if (null_check(n_records, "error add record")) return -1;
+		err_handle->records = n_records;
+		err_handle->error_cap = n_cap;
+	}
+
+	ErrorRecord *rec = &err_handle->records[err_handle->error_ctr];
+	rec->templates = templates;
+	rec->code = code;
+	rec->lineno = lineno;
+	rec->argc = 0;
+
+	for (unsigned int i = 0; i < argc; i++) {
+		if (error_push_arg(err_handle, args[i] ? args[i] : "", &rec->args[i]))
+			return -1;
+		rec->argc++;
+	}
+
 	err_handle->error_ctr++;
 	return 0;
 }
 
+int Error_add_record(Error *err_handle, const char *const *templates, unsigned int code, unsigned int lineno, unsigned int argc, ...) {
+	if (!err_handle || !templates || argc > ERROR_MAX_ARGS)
+		return -1;
+
+	const char *args[ERROR_MAX_ARGS];
+	va_list ap;
+	va_start(ap, argc);
+
+	for (unsigned int i = 0; i < argc; i++)
+		args[i] = va_arg(ap, const char *);
+
+	va_end(ap);
+	return error_push_record(err_handle, templates, code, lineno, argc, args);
+}
+
+int Error_add(Error *err_handle, const char *err) {
+	if (!err_handle || !err)
+		return -1;
+
+	return Error_add_record(err_handle, Plain_Templates, 0, 0, 1, err);
+}
+
+int Error_append(Error *dest, Error *src, size_t from, size_t to) {
+	if (null_check(dest, "error append") || null_check(src, "error append")) return -1;
+
+	const char *args[ERROR_MAX_ARGS];
+
+	for (size_t in = from; in < to && in < src->error_ctr; in++) {
+		ErrorRecord *rec = &src->records[in];
+
+		for (unsigned int i = 0; i < rec->argc; i++)
+			args[i] = src->args + rec->args[i];
+
+		if (error_push_record(dest, rec->templates, rec->code, rec->lineno, rec->argc, args))
+			return -1;
+	}
+
+	return 0;
+}
+
+void Error_clear(Error *err_handle) {
+	if (null_check(err_handle, "error clear")) return;
+
+	err_handle->error_ctr = 0;
+	err_handle->error_flushed = 0;
+	err_handle->args_len = 0;
+}
+
 int Error_free(Error *err_handle) {
 	if (null_check(err_handle, "error free")) return -1;
 
-	if (err_handle->error_ctr != 0) {
-		for (size_t in = 0; in < err_handle->error_ctr; in++) {
-			free(err_handle->errors[in]);
+	VAlloc_free(err_handle->alloc, err_handle->records);
+	VAlloc_free(err_handle->alloc, err_handle->args);
+	VAlloc_free(err_handle->alloc, err_handle);
+	return 0;
+}
+
+// Substitute arguments of a record into its template.
+static void error_print_record(Error *err_handle, ErrorRecord *rec, FILE *out) {
+	const char *itr = rec->templates[rec->code];
+
+	for (; *itr; itr++) {
+		if (*itr == '@' && itr[1] == 'L') {
+			fprintf(out, "%u", rec->lineno);
+			itr++;
+		}
+		else if (*itr == '@' && isdigit(itr[1])) {
+			unsigned int idx = itr[1] - '0';
+			if (idx < rec->argc)
+				fputs(err_handle->args + rec->args[idx], out);
+			itr++;
+		}
+		else {
+			fputc(*itr, out);
 		}
 	}
-	free(err_handle);	
-	return 0;
+
+	fputc('\n', out);
+}
+
+size_t Error_flush(Error *err_handle, FILE *out) {
+	if (null_check(err_handle, "error flush")) return 0;
+
+	size_t printed = err_handle->error_ctr - err_handle->error_flushed;
+
+	for (size_t in = err_handle->error_flushed; in < err_handle->error_ctr; in++)
+		error_print_record(err_handle, &err_handle->records[in], out);
+
+	err_handle->error_flushed = err_handle->error_ctr;
+	return printed;
 }
 
 void Error_print_all(Error *err_handle) {
 	if (null_check(err_handle, "error print all")) return;
-	
-	if (err_handle->error_ctr != 0) {
-		for (size_t in = 0; in < err_handle->error_ctr; in++) {	
-			printf("%s\n",err_handle->errors[in]);
-		}
-	}
+
+	for (size_t in = 0; in < err_handle->error_ctr; in++)
+		error_print_record(err_handle, &err_handle->records[in], stdout);
 }
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "evloop.h"
+#include "conf.h"
+#include "utils.h"
+
+#define EV_OUT 0
+#define EV_ERR 1
+#define EV_PID 2
+
+// Events read per epoll_wait call.
+#define EVLOOP_EVENTS 64
+
+// Descriptor of a child registered with epoll, the signalfd is registered with NULL.
+typedef struct {
+	EvChild *child;
+	int kind;
+} EvSrc;
+
+struct EvChild {
+	Proc *proc;
+	EvData data;
+	EvDone done;
+	void *ctx;
+	int pid_fd;
+	int open_ctr;
+	int reaped;
+	int paused;
+	int unbounded;
+	EvSrc src[3];
+};
+
+static int pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+EvLoop *EvLoop_new(VAllocator *alloc, size_t max_buffered) {
+	EvLoop *loop = VAlloc_alloc(alloc, sizeof(EvLoop));
+	if (null_check(loop, "evloop new")) return NULL;
+
+	loop->ep_fd = epoll_create1(EPOLL_CLOEXEC);
+	loop->sig_fd = -1;
+	loop->children = NULL;
+	loop->child_ctr = 0;
+	loop->child_cap = 0;
+	loop->max_buffered = max_buffered ? max_buffered : VMEL_EVLOOP_MAX_BUFFERED;
+	loop->alloc = alloc;
+
+	if (loop->ep_fd < 0) {
+		perror("Error: ");
+		VAlloc_free(alloc, loop);
+		return NULL;
+	}
+
+	// Without pidfd exits arrive as SIGCHLD, which a signalfd only receives while blocked.
+	int probe = pidfd_open(getpid());
+
+	if (probe >= 0) {
+		close(probe);
+	}
+	else {
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		pthread_sigmask(SIG_BLOCK, &mask, &loop->old_mask);
+		loop->sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+		struct epoll_event ev = {EPOLLIN, {NULL}};
+		if (loop->sig_fd >= 0)
+			epoll_ctl(loop->ep_fd, EPOLL_CTL_ADD, loop->sig_fd, &ev);
+	}
+
+	return loop;
+}
+
+static int src_fd(EvChild *child, int kind) {
+	if (kind == EV_OUT)
+		return child->proc->out_fd;
+	if (kind == EV_ERR)
+		return child->proc->err_fd;
+	return child->pid_fd;
+}
+
+static void src_watch(EvLoop *loop, EvChild *child, int kind) {
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &child->src[kind];
+	epoll_ctl(loop->ep_fd, EPOLL_CTL_ADD, src_fd(child, kind), &ev);
+}
+
+// Stop or resume reading the pipes of a child. Pipes are removed rather than left without
+// events since a hang up is reported regardless.
+static void child_pause(EvLoop *loop, EvChild *child, int pause) {
+	if (child->paused == pause)
+		return;
+
+	for (int kind = EV_OUT; kind <= EV_ERR; kind++) {
+		if (src_fd(child, kind) < 0)
+			continue;
+
+		if (pause)
+			epoll_ctl(loop->ep_fd, EPOLL_CTL_DEL, src_fd(child, kind), NULL);
+		else
+			src_watch(loop, child, kind);
+	}
+
+	child->paused = pause;
+}
+
+int EvLoop_add(EvLoop *loop, Proc *proc, EvData data, EvDone done, void *ctx) {
+	if (null_check(loop, "evloop add") || null_check(proc, "evloop add")) return -1;
+
+	if (proc->pid <= 0)
+		return -1;
+
+	if (loop->child_ctr == loop->child_cap) {
+		size_t n_cap = loop->child_cap ? loop->child_cap * 2 : 16;
+		EvChild **n_children = VAlloc_realloc(loop->alloc, loop->children, n_cap * sizeof(EvChild *));
+		if (null_check(n_children, "evloop add")) return -1;
+		loop->children = n_children;
+		loop->child_cap = n_cap;
+	}
+
+	EvChild *child = VAlloc_alloc(loop->alloc, sizeof(EvChild));
+	if (null_check(child, "evloop add")) return -1;
+
+	child->proc = proc;
+	child->data = data;
+	child->done = done;
+	child->ctx = ctx;
+	child->open_ctr = 0;
+	child->reaped = 0;
+	child->paused = 0;
+	child->unbounded = 0;
+
+	for (int kind = EV_OUT; kind <= EV_PID; kind++) {
+		child->src[kind].child = child;
+		child->src[kind].kind = kind;
+	}
+
+	for (int kind = EV_OUT; kind <= EV_ERR; kind++) {
+		if (src_fd(child, kind) >= 0) {
+			src_watch(loop, child, kind);
+			child->open_ctr++;
+		}
+	}
+
+	// Without a pidfd the child is reaped once SIGCHLD arrives or its pipes close.
+	child->pid_fd = loop->sig_fd < 0 ? pidfd_open(proc->pid) : -1;
+	if (child->pid_fd >= 0)
+		src_watch(loop, child, EV_PID);
+
+	loop->children[loop->child_ctr++] = child;
+	return 0;
+}
+
+static EvChild *find_child(EvLoop *loop, Proc *proc) {
+	for (size_t i = 0; i < loop->child_ctr; i++) {
+		if (loop->children[i]->proc == proc)
+			return loop->children[i];
+	}
+
+	return NULL;
+}
+
+int EvLoop_stream(EvLoop *loop, Proc *proc, EvData data, void *ctx) {
+	if (null_check(loop, "evloop stream") || null_check(data, "evloop stream")) return -1;
+
+	EvChild *child = find_child(loop, proc);
+	if (!child)
+		return -1;
+
+	if (proc->out.str_size)
+		data(proc, VString_str(&proc->out), proc->out.str_size, ctx);
+	if (proc->err.str_size)
+		data(proc, VString_str(&proc->err), proc->err.str_size, ctx);
+
+	VString_set(&proc->out, "");
+	VString_set(&proc->err, "");
+	child->data = data;
+	child->ctx = ctx;
+	child_pause(loop, child, 0);
+	return 0;
+}
+
+// Read what is available on one pipe of a child, closing it at end of file.
+static void child_read(EvLoop *loop, EvChild *child, int kind) {
+	Proc *proc = child->proc;
+	int fd = src_fd(child, kind);
+	char buf[16384];
+
+	if (fd < 0)
+		return;
+
+	ssize_t n = read(fd, buf, sizeof(buf));
+
+	if (n > 0) {
+		if (child->data) {
+			child->data(proc, buf, n, child->ctx);
+			return;
+		}
+
+		VString_pushn(kind == EV_OUT ? &proc->out : &proc->err, buf, n);
+
+		if (!child->unbounded && proc->out.str_size + proc->err.str_size >= loop->max_buffered)
+			child_pause(loop, child, 1);
+		return;
+	}
+
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+
+	epoll_ctl(loop->ep_fd, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+
+	if (kind == EV_OUT)
+		proc->out_fd = -1;
+	else
+		proc->err_fd = -1;
+
+	child->open_ctr--;
+}
+
+// Collect the exit status of a child if it has exited.
+static void child_reap(EvLoop *loop, EvChild *child) {
+	int wstatus = 0;
+
+	if (child->reaped || waitpid(child->proc->pid, &wstatus, WNOHANG) != child->proc->pid)
+		return;
+
+	Proc_exited(child->proc, wstatus);
+	child->reaped = 1;
+
+	if (child->pid_fd >= 0) {
+		epoll_ctl(loop->ep_fd, EPOLL_CTL_DEL, child->pid_fd, NULL);
+		close(child->pid_fd);
+		child->pid_fd = -1;
+	}
+}
+
+int EvLoop_run_once(EvLoop *loop, int timeout_ms) {
+	if (null_check(loop, "evloop run once")) return -1;
+
+	struct epoll_event events[EVLOOP_EVENTS];
+	// Children reaped by polling rather than through a pidfd.
+	int polling = 0;
+	int finished = 0;
+	int sig = 0;
+
+	for (size_t i = 0; i < loop->child_ctr; i++) {
+		EvChild *child = loop->children[i];
+		if (!child->reaped && child->pid_fd < 0 && child->open_ctr == 0)
+			polling = 1;
+	}
+
+	// SIGCHLD may be taken by another thread, don't rely on it alone.
+	if (polling && (timeout_ms < 0 || timeout_ms > VMEL_EVLOOP_REAP_MS))
+		timeout_ms = VMEL_EVLOOP_REAP_MS;
+
+	int ctr = epoll_wait(loop->ep_fd, events, EVLOOP_EVENTS, timeout_ms);
+
+	if (ctr < 0 && errno != EINTR)
+		return -1;
+
+	for (int i = 0; i < ctr; i++) {
+		EvSrc *src = events[i].data.ptr;
+
+		if (!src) {
+			struct signalfd_siginfo info;
+			while (read(loop->sig_fd, &info, sizeof(info)) == sizeof(info));
+			sig = 1;
+		}
+		else if (src->kind == EV_PID) {
+			child_reap(loop, src->child);
+		}
+		else {
+			child_read(loop, src->child, src->kind);
+		}
+	}
+
+	for (size_t i = 0; i < loop->child_ctr; i++) {
+		EvChild *child = loop->children[i];
+		if (!child->reaped && child->pid_fd < 0 && (sig || child->open_ctr == 0))
+			child_reap(loop, child);
+	}
+
+	// Hand finished children over, callbacks may add new ones.
+	for (size_t i = 0; i < loop->child_ctr;) {
+		EvChild *child = loop->children[i];
+
+		if (!child->reaped || child->open_ctr > 0) {
+			i++;
+			continue;
+		}
+
+		loop->children[i] = loop->children[--loop->child_ctr];
+		if (child->done)
+			child->done(child->proc, child->ctx);
+		VAlloc_free(loop->alloc, child);
+		finished++;
+	}
+
+	return finished;
+}
+
+int EvLoop_wait(EvLoop *loop, Proc *proc) {
+	if (null_check(loop, "evloop wait") || null_check(proc, "evloop wait")) return -1;
+
+	EvChild *child = find_child(loop, proc);
+
+	if (child) {
+		child->unbounded = 1;
+		child_pause(loop, child, 0);
+	}
+
+	while (find_child(loop, proc)) {
+		if (EvLoop_run_once(loop, -1) < 0)
+			break;
+	}
+
+	return proc->status;
+}
+
+// Stop watching a child, killing and reaping it if still running. Closing its descriptors
+// also removes them from epoll.
+static void child_kill(EvLoop *loop, EvChild *child, int *wstatus) {
+	Proc *proc = child->proc;
+
+	if (proc->out_fd >= 0)
+		close(proc->out_fd);
+	if (proc->err_fd >= 0)
+		close(proc->err_fd);
+	if (child->pid_fd >= 0)
+		close(child->pid_fd);
+
+	proc->out_fd = -1;
+	proc->err_fd = -1;
+	child->pid_fd = -1;
+
+	if (!child->reaped) {
+		kill(proc->pid, SIGKILL);
+		while (waitpid(proc->pid, wstatus, 0) < 0 && errno == EINTR);
+	}
+
+	VAlloc_free(loop->alloc, child);
+}
+
+int EvLoop_cancel(EvLoop *loop, Proc *proc) {
+	if (null_check(loop, "evloop cancel") || null_check(proc, "evloop cancel")) return -1;
+
+	for (size_t i = 0; i < loop->child_ctr; i++) {
+		EvChild *child = loop->children[i];
+		int wstatus = 0;
+
+		if (child->proc != proc)
+			continue;
+
+		int reaped = child->reaped;
+		loop->children[i] = loop->children[--loop->child_ctr];
+		child_kill(loop, child, &wstatus);
+
+		if (!reaped)
+			Proc_exited(proc, wstatus);
+		return 0;
+	}
+
+	return -1;
+}
+
+void EvLoop_free(EvLoop *loop) {
+	if (null_check(loop, "evloop free")) return;
+
+	for (size_t i = 0; i < loop->child_ctr; i++)
+		child_kill(loop, loop->children[i], NULL);
+
+	if (loop->sig_fd >= 0) {
+		close(loop->sig_fd);
+		pthread_sigmask(SIG_SETMASK, &loop->old_mask, NULL);
+	}
+
+	close(loop->ep_fd);
+	VAlloc_free(loop->alloc, loop->children);
+	VAlloc_free(loop->alloc, loop);
+}
@@ -0,0 +1,98 @@
+#include <string.h>
+#include "hedge.h"
+#include "conf.h"
+#include "utils.h"
+
+Hedge *Hedge_new(unsigned int percentile, VAllocator *alloc) {
+	Hedge *hedge = VAlloc_calloc(alloc, sizeof(Hedge));
+	if (null_check(hedge, "hedge new")) return NULL;
+
+	hedge->percentile = percentile < 1 ? 1 : percentile > 100 ? 100 : percentile;
+	hedge->alloc = alloc;
+	pthread_mutex_init(&hedge->lock, NULL);
+	return hedge;
+}
+
+// Peers of a command, added when create is set. The lock must be held.
+static HedgePeers *hedge_peers(Hedge *hedge, const void *group, size_t idx, int create) {
+	for (size_t i = 0; i < hedge->peer_ctr; i++) {
+		if (hedge->peers[i].group == group && hedge->peers[i].idx == idx)
+			return &hedge->peers[i];
+	}
+
+	if (!create)
+		return NULL;
+
+	if (hedge->peer_ctr == hedge->peer_cap) {
+		size_t cap = hedge->peer_cap ? hedge->peer_cap * 2 : 16;
+		HedgePeers *peers = VAlloc_realloc(hedge->alloc, hedge->peers, cap * sizeof(HedgePeers));
+		if (null_check(peers, "hedge peers")) return NULL;
+
+		hedge->peers = peers;
+		hedge->peer_cap = cap;
+	}
+
+	HedgePeers *peers = &hedge->peers[hedge->peer_ctr++];
+	memset(peers, 0, sizeof(HedgePeers));
+	peers->group = group;
+	peers->idx = idx;
+	return peers;
+}
+
+long long Hedge_threshold(Hedge *hedge, const void *group, size_t idx) {
+	if (null_check(hedge, "hedge threshold")) return -1;
+
+	long long us = -1;
+
+	pthread_mutex_lock(&hedge->lock);
+	HedgePeers *peers = hedge_peers(hedge, group, idx, 0);
+
+	// Nearest rank, the smallest duration at least percentile of the peers didn't exceed.
+	if (peers && peers->us_ctr >= VMEL_HEDGE_PEERS) {
+		size_t rank = (peers->us_ctr * hedge->percentile + 99) / 100;
+		us = peers->us[rank ? rank - 1 : 0];
+		if (us < VMEL_HEDGE_MIN_MS * 1000LL)
+			us = VMEL_HEDGE_MIN_MS * 1000LL;
+	}
+
+	pthread_mutex_unlock(&hedge->lock);
+	return us;
+}
+
+void Hedge_record(Hedge *hedge, const void *group, size_t idx, long long us) {
+	if (null_check(hedge, "hedge record")) return;
+
+	pthread_mutex_lock(&hedge->lock);
+	HedgePeers *peers = hedge_peers(hedge, group, idx, 1);
+
+	if (peers && peers->us_ctr == peers->us_cap) {
+		size_t cap = peers->us_cap ? peers->us_cap * 2 : 16;
+		long long *grown = VAlloc_realloc(hedge->alloc, peers->us, cap * sizeof(long long));
+
+		if (!null_check(grown, "hedge record")) {
+			peers->us = grown;
+			peers->us_cap = cap;
+		}
+	}
+
+	// Kept sorted so a percentile is a lookup.
+	if (peers && peers->us_ctr < peers->us_cap) {
+		size_t i = peers->us_ctr++;
+		for (; i > 0 && peers->us[i - 1] > us; i--)
+			peers->us[i] = peers->us[i - 1];
+		peers->us[i] = us;
+	}
+
+	pthread_mutex_unlock(&hedge->lock);
+}
+
+void Hedge_free(Hedge *hedge) {
+	if (null_check(hedge, "hedge free")) return;
+
+	for (size_t i = 0; i < hedge->peer_ctr; i++)
+		VAlloc_free(hedge->alloc, hedge->peers[i].us);
+
+	pthread_mutex_destroy(&hedge->lock);
+	VAlloc_free(hedge->alloc, hedge->peers);
+	VAlloc_free(hedge->alloc, hedge);
+}
@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "journal.h"
+#include "utils.h"
+
+// Changing the records must change this so journals of older versions are never resumed.
+#define JOURNAL_TAG "vmel-journal 1"
+
+Journal *Journal_new(const char *path, const char *source, VAllocator *alloc) {
+	if (null_check((void *) path, "journal new") || null_check((void *) source, "journal new")) return NULL;
+
+	Journal *journal = VAlloc_alloc(alloc, sizeof(Journal));
+	if (null_check(journal, "journal new")) return NULL;
+
+	journal->path = VString_new(alloc);
+	VString_set(&journal->path, (char *) path);
+
+	// Only the same script may resume the journal.
+	Sha256 ctx;
+	Sha256_init(&ctx);
+	Sha256_update(&ctx, source, strlen(source));
+	Sha256_final(&ctx, journal->script);
+
+	journal->fd = -1;
+	journal->resume = 0;
+	journal->cmds = NULL;
+	journal->cmd_ctr = 0;
+	journal->cmd_cap = 0;
+	journal->snapshot = VString_new(alloc);
+	journal->pending = VString_new(alloc);
+	journal->versions = NULL;
+	journal->version_ctr = 0;
+	journal->alloc = alloc;
+	pthread_mutex_init(&journal->lock, NULL);
+	return journal;
+}
+
+// Header identifying the script a journal belongs to.
+static void journal_header(Journal *journal, VString *dest) {
+	char hex[SHA256_HEX + 1];
+
+	Sha256_hex(journal->script, hex);
+	VString_pushs(dest, JOURNAL_TAG " ");
+	VString_pushs(dest, hex);
+	VString_pushc(dest, '\n');
+}
+
+static int journal_write(int fd, const char *data, size_t len) {
+	while (len) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int cmd_compare(const void *a, const void *b) {
+	const JournalCmd *x = a;
+	const JournalCmd *y = b;
+
+	if (x->stmt != y->stmt)
+		return x->stmt < y->stmt ? -1 : 1;
+	return memcmp(x->key, y->key, SHA256_SIZE);
+}
+
+// Add a command read from the journal, duplicates are merged once every command was read.
+static void journal_add_cmd(Journal *journal, size_t stmt, const char *hex) {
+	if (journal->cmd_ctr == journal->cmd_cap) {
+		size_t cap = journal->cmd_cap ? journal->cmd_cap * 2 : 64;
+		JournalCmd *cmds = VAlloc_realloc(journal->alloc, journal->cmds, cap * sizeof(JournalCmd));
+		if (null_check(cmds, "journal add cmd")) return;
+		journal->cmds = cmds;
+		journal->cmd_cap = cap;
+	}
+
+	JournalCmd *cmd = &journal->cmds[journal->cmd_ctr++];
+	cmd->stmt = stmt;
+	cmd->left = 1;
+	for (int i = 0; i < SHA256_SIZE; i++)
+		sscanf(hex + i * 2, "%2hhx", &cmd->key[i]);
+}
+
+// Read a whole file, NULL when it can't be read.
+static char *journal_read(const char *path, size_t *len) {
+	FILE *fptr = fopen(path, "rb");
+	if (!fptr)
+		return NULL;
+
+	fseek(fptr, 0, SEEK_END);
+	long size = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+
+	char *buff = size >= 0 ? calloc(1, size + 1) : NULL;
+	if (buff)
+		*len = fread(buff, 1, size, fptr);
+
+	fclose(fptr);
+	return buff;
+}
+
+// Restore one variable, arrays are rebuilt element by element.
+static void journal_restore(SyTable *sy_table, char *name, char kind, char *val, size_t len) {
+	Symbol *sy = SyTable_get_symbol(sy_table, name);
+	if (!sy || sy->pinned)
+		return;
+
+	if (kind == 's') {
+		SyTable_update_symbol(sy_table, name, val);
+		return;
+	}
+
+	VArray *arr = VArray_new(sy_table->alloc, kind == 'i' ? VARRAY_INT : VARRAY_STR, 0);
+	char *end = val + len;
+
+	while (arr && val < end) {
+		char *next = NULL;
+		long num = strtol(val, &next, 10);
+
+		if (next == val)
+			break;
+
+		if (kind == 'i') {
+			VArray_push_int(arr, (int) num);
+			val = next;
+		}
+		else if (*next == ':' && next + 1 + num <= end) {
+			VArray_push_str(arr, next + 1, num);
+			val = next + 1 + num;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (arr)
+		SyTable_update_symbol_array(sy_table, name, arr);
+}
+
+int Journal_resume(Journal *journal, SyTable *sy_table) {
+	if (null_check(journal, "journal resume") || null_check(sy_table, "journal resume")) return -1;
+
+	size_t len = 0;
+	char *buff = journal_read(VString_str(&journal->path), &len);
+	if (!buff)
+		return -1;
+
+	VString header = VString_new(journal->alloc);
+	journal_header(journal, &header);
+
+	if (len < header.str_size || memcmp(buff, VString_str(&header), header.str_size) != 0) {
+		VString_free(&header);
+		free(buff);
+		return -1;
+	}
+
+	char *pos = buff + header.str_size;
+	char *end = buff + len;
+	// Records before cut belong to statements which ran before the first failure.
+	char *cut = pos;
+	int stopped = 0;
+
+	VString_free(&header);
+
+	// Find where the first failure is and every command which succeeded.
+	for (char *at = pos; at < end;) {
+		char *eol = memchr(at, '\n', end - at);
+		if (!eol)
+			break;
+
+		char hex[SHA256_HEX + 1];
+		char *next = eol + 1;
+		size_t stmt = 0;
+		size_t val_len = 0;
+		char kind = 0;
+
+		*eol = '\0';
+		if (sscanf(at, "set %*s %c %zu", &kind, &val_len) == 2) {
+			// A value cut short by a crash ends the journal.
+			next += val_len + 1;
+			if (next > end)
+				stopped = 1;
+		}
+		else if (sscanf(at, "done %zu", &stmt) == 1 && !stopped) {
+			journal->resume = stmt + 1;
+			cut = eol + 1;
+		}
+		else if (sscanf(at, "fail %zu", &stmt) == 1 && !stopped) {
+			journal->resume = stmt;
+			stopped = 1;
+		}
+		else if (sscanf(at, "cmd %zu %64s", &stmt, hex) == 2 && strlen(hex) == SHA256_HEX) {
+			journal_add_cmd(journal, stmt, hex);
+		}
+
+		*eol = '\n';
+		at = next;
+	}
+
+	// Restore variables as they were when the statement resumed at last ran.
+	for (char *at = pos; at < cut;) {
+		char *eol = memchr(at, '\n', cut - at);
+		if (!eol)
+			break;
+
+		char name[256];
+		size_t val_len = 0;
+		char kind = 0;
+
+		*eol = '\0';
+		if (sscanf(at, "set %255s %c %zu", name, &kind, &val_len) == 3) {
+			char *val = eol + 1;
+			char saved = val[val_len];
+
+			val[val_len] = '\0';
+			journal_restore(sy_table, name, kind, val, val_len);
+			val[val_len] = saved;
+
+			*eol = '\n';
+			VString_pushn(&journal->snapshot, at, val + val_len + 1 - at);
+			at = val + val_len + 1;
+			continue;
+		}
+
+		if (strncmp(at, "done ", 5) == 0) {
+			*eol = '\n';
+			VString_pushn(&journal->snapshot, at, eol + 1 - at);
+		}
+
+		*eol = '\n';
+		at = eol + 1;
+	}
+
+	free(buff);
+
+	// Commands recorded several times may be skipped as many times.
+	if (journal->cmd_ctr) {
+		size_t uniq = 0;
+
+		qsort(journal->cmds, journal->cmd_ctr, sizeof(JournalCmd), cmd_compare);
+		for (size_t i = 1; i < journal->cmd_ctr; i++) {
+			if (cmd_compare(&journal->cmds[uniq], &journal->cmds[i]) == 0)
+				journal->cmds[uniq].left++;
+			else
+				journal->cmds[++uniq] = journal->cmds[i];
+		}
+		journal->cmd_ctr = uniq + 1;
+	}
+
+	return 0;
+}
+
+// Remember the version of every symbol so only changes are recorded.
+static void journal_versions(Journal *journal, SyTable *sy_table) {
+	if (journal->version_ctr < sy_table->sym_ctr) {
+		unsigned long *versions = VAlloc_realloc(journal->alloc, journal->versions, sy_table->sym_ctr * sizeof(unsigned long));
+		if (null_check(versions, "journal versions")) return;
+
+		memset(versions + journal->version_ctr, 0, (sy_table->sym_ctr - journal->version_ctr) * sizeof(unsigned long));
+		journal->versions = versions;
+		journal->version_ctr = sy_table->sym_ctr;
+	}
+}
+
+int Journal_start(Journal *journal, SyTable *sy_table) {
+	if (null_check(journal, "journal start") || null_check(sy_table, "journal start")) return -1;
+
+	journal_versions(journal, sy_table);
+	for (size_t i = 0; i < journal->version_ctr; i++)
+		journal->versions[i] = sy_table->symbols[i]->version;
+
+	// A new run never resumes an older one.
+	if (!journal->resume && !journal->cmd_ctr) {
+		unlink(VString_str(&journal->path));
+		return 0;
+	}
+
+	VString data = VString_new(journal->alloc);
+	VString tmp = VString_new(journal->alloc);
+	char hex[SHA256_HEX + 1];
+	char line[SHA256_HEX + 48];
+
+	journal_header(journal, &data);
+	VString_pushn(&data, VString_str(&journal->snapshot), journal->snapshot.str_size);
+
+	for (size_t i = 0; i < journal->cmd_ctr; i++) {
+		Sha256_hex(journal->cmds[i].key, hex);
+		int len = snprintf(line, sizeof(line), "cmd %zu %s\n", journal->cmds[i].stmt, hex);
+
+		for (size_t n = 0; n < journal->cmds[i].left; n++)
+			VString_pushn(&data, line, len);
+	}
+
+	// Written aside and renamed so a crash leaves the journal being resumed intact.
+	VString_set(&tmp, VString_str(&journal->path));
+	VString_pushs(&tmp, ".tmp");
+
+	int ret = -1;
+	int fd = open(VString_str(&tmp), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+	if (fd >= 0 && journal_write(fd, VString_str(&data), data.str_size) == 0 && rename(VString_str(&tmp), VString_str(&journal->path)) == 0) {
+		journal->fd = fd;
+		ret = 0;
+	}
+	else if (fd >= 0) {
+		close(fd);
+		unlink(VString_str(&tmp));
+	}
+
+	VString_free(&tmp);
+	VString_free(&data);
+	return ret;
+}
+
+// Append a variable and its value to dest.
+static void journal_set(VString *dest, Symbol *sy) {
+	VString val = VString_new(NULL);
+	char num[32];
+	char kind = 's';
+
+	if (sy->arr) {
+		kind = sy->arr->kind == VARRAY_INT ? 'i' : 'a';
+
+		for (size_t i = 0; i < sy->arr->len; i++) {
+			if (kind == 'i') {
+				VString_pushn(&val, num, snprintf(num, sizeof(num), i ? " %d" : "%d", sy->arr->ints[i]));
+			}
+			else {
+				const char *str = VArray_str_at(sy->arr, i);
+				size_t len = strlen(str);
+
+				VString_pushn(&val, num, snprintf(num, sizeof(num), "%zu:", len));
+				VString_pushn(&val, str, len);
+			}
+		}
+	}
+	else {
+		char *str = Symbol_value(sy);
+		if (!str) {
+			VString_free(&val);
+			return;
+		}
+		VString_pushs(&val, str);
+	}
+
+	VString_pushs(dest, "set ");
+	VString_pushs(dest, sy->label);
+	VString_pushn(dest, num, snprintf(num, sizeof(num), " %c %zu\n", kind, val.str_size));
+	VString_pushn(dest, VString_str(&val), val.str_size);
+	VString_pushc(dest, '\n');
+	VString_free(&val);
+}
+
+void Journal_statement(Journal *journal, SyTable *sy_table, size_t stmt, int failed) {
+	if (null_check(journal, "journal statement") || null_check(sy_table, "journal statement")) return;
+
+	char line[48];
+
+	pthread_mutex_lock(&journal->lock);
+	journal_versions(journal, sy_table);
+
+	for (size_t i = 0; i < sy_table->sym_ctr && i < journal->version_ctr; i++) {
+		Symbol *sy = sy_table->symbols[i];
+
+		if (sy->version == journal->versions[i] || sy->sy_type == E_GROUP_TYPE || sy->sy_type == E_FUNC_TYPE)
+			continue;
+
+		journal_set(&journal->pending, sy);
+		journal->versions[i] = sy->version;
+	}
+
+	VString_pushn(&journal->pending, line, snprintf(line, sizeof(line), "%s %zu\n", failed ? "fail" : "done", stmt));
+	pthread_mutex_unlock(&journal->lock);
+}
+
+void Journal_command(Journal *journal, size_t stmt, const unsigned char *key) {
+	if (null_check(journal, "journal command")) return;
+
+	char hex[SHA256_HEX + 1];
+	char line[SHA256_HEX + 48];
+
+	Sha256_hex(key, hex);
+	int len = snprintf(line, sizeof(line), "cmd %zu %s\n", stmt, hex);
+
+	pthread_mutex_lock(&journal->lock);
+
+	// Created by the first command, a run which never got that far has nothing to resume.
+	if (journal->fd < 0) {
+		journal->fd = open(VString_str(&journal->path), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+		if (journal->fd >= 0) {
+			VString header = VString_new(journal->alloc);
+			journal_header(journal, &header);
+			journal_write(journal->fd, VString_str(&header), header.str_size);
+			VString_free(&header);
+		}
+	}
+
+	// Statements come first so a crash never leaves a command without the statements before it.
+	if (journal->fd >= 0) {
+		VString_pushn(&journal->pending, line, len);
+		journal_write(journal->fd, VString_str(&journal->pending), journal->pending.str_size);
+		VString_set(&journal->pending, "");
+	}
+
+	pthread_mutex_unlock(&journal->lock);
+}
+
+int Journal_skip(Journal *journal, size_t stmt, const unsigned char *key) {
+	if (null_check(journal, "journal skip")) return 0;
+
+	if (!journal->cmd_ctr)
+		return 0;
+
+	JournalCmd find;
+	find.stmt = stmt;
+	memcpy(find.key, key, SHA256_SIZE);
+
+	int skip = 0;
+	pthread_mutex_lock(&journal->lock);
+
+	JournalCmd *cmd = bsearch(&find, journal->cmds, journal->cmd_ctr, sizeof(JournalCmd), cmd_compare);
+	if (cmd && cmd->left) {
+		cmd->left--;
+		skip = 1;
+	}
+
+	pthread_mutex_unlock(&journal->lock);
+	return skip;
+}
+
+void Journal_end(Journal *journal, int failed) {
+	if (null_check(journal, "journal end")) return;
+
+	pthread_mutex_lock(&journal->lock);
+
+	if (failed && journal->fd >= 0)
+		journal_write(journal->fd, VString_str(&journal->pending), journal->pending.str_size);
+	else if (!failed)
+		unlink(VString_str(&journal->path));
+
+	if (journal->fd >= 0)
+		close(journal->fd);
+
+	journal->fd = -1;
+	VString_set(&journal->pending, "");
+	pthread_mutex_unlock(&journal->lock);
+}
+
+void Journal_free(Journal *journal) {
+	if (null_check(journal, "journal free")) return;
+
+	if (journal->fd >= 0)
+		close(journal->fd);
+
+	pthread_mutex_destroy(&journal->lock);
+	VString_free(&journal->path);
+	VString_free(&journal->snapshot);
+	VString_free(&journal->pending);
+	VAlloc_free(journal->alloc, journal->cmds);
+	VAlloc_free(journal->alloc, journal->versions);
+	VAlloc_free(journal->alloc, journal);
+}
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liveness.h"
+#include "tokens.h"
+#include "utils.h"
+#include "stats.h"
+
+#define WORD_BITS (sizeof(unsigned long) * 8)
+
+// Facts about an assignment gathered by the forward pass.
+#define STMT_KILLS 0x1
+#define STMT_PURE 0x2
+
+// Pseudo variable written by every statement running commands, keeps them in program order.
+static const char Run_Var[] = "{run}";
+
+// Interned variable names, slots hold index + 1 or 0 when empty.
+typedef struct {
+	const char **names;
+	size_t *lens;
+	size_t *slots;
+	size_t ctr;
+	size_t cap;
+	size_t slot_cap;
+	VAllocator *alloc;
+} VarTab;
+
+// State shared with per variable callbacks.
+typedef struct {
+	VarTab *tab;
+	unsigned long *set;
+	int ok;
+	Liveness *live;
+	size_t use_ctr;
+	size_t use_cap;
+	NodeMgr *node_mgr;
+} VarCtx;
+
+typedef void (*VarFn)(const char *name, size_t len, VarCtx *ctx);
+
+static size_t var_hash(const char *name, size_t len) {
+	size_t hash = 14695981039346656037UL;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char) name[i]) * 1099511628211UL;
+	return hash;
+}
+
+// Double the number of slots and rehash existing names.
+static int vartab_grow(VarTab *tab) {
+	size_t n_cap = tab->slot_cap ? tab->slot_cap * 2 : 64;
+	size_t *n_slots = VAlloc_calloc(tab->alloc, n_cap * sizeof(size_t));
+	if (null_check(n_slots, "vartab grow")) return -1;
+
+	for (size_t i = 0; i < tab->ctr; i++) {
+		size_t pos = var_hash(tab->names[i], tab->lens[i]) & (n_cap - 1);
+		while (n_slots[pos])
+			pos = (pos + 1) & (n_cap - 1);
+		n_slots[pos] = i + 1;
+	}
+
+	VAlloc_free(tab->alloc, tab->slots);
+	tab->slots = n_slots;
+	tab->slot_cap = n_cap;
+	return 0;
+}
+
+// Index of name or (size_t) -1 if unknown, unknown names are added when add is set.
+static size_t vartab_find(VarTab *tab, const char *name, size_t len, int add) {
+	if (tab->slot_cap) {
+		size_t pos = var_hash(name, len) & (tab->slot_cap - 1);
+
+		for (; tab->slots[pos]; pos = (pos + 1) & (tab->slot_cap - 1)) {
+			size_t idx = tab->slots[pos] - 1;
+			if (tab->lens[idx] == len && memcmp(tab->names[idx], name, len) == 0)
+				return idx;
+		}
+	}
+
+	if (!add)
+		return (size_t) -1;
+
+	// Keep load below a half.
+	if ((tab->ctr + 1) * 2 > tab->slot_cap && vartab_grow(tab))
+		return (size_t) -1;
+
+	if (tab->ctr == tab->cap) {
+		size_t n_cap = tab->cap ? tab->cap * 2 : 32;
+		const char **n_names = VAlloc_realloc(tab->alloc, tab->names, n_cap * sizeof(char *));
+		if (null_check(n_names, "vartab find")) return (size_t) -1;
+		tab->names = n_names;
+
+		size_t *n_lens = VAlloc_realloc(tab->alloc, tab->lens, n_cap * sizeof(size_t));
+		if (null_check(n_lens, "vartab find")) return (size_t) -1;
+		tab->lens = n_lens;
+		tab->cap = n_cap;
+	}
+
+	size_t pos = var_hash(name, len) & (tab->slot_cap - 1);
+	while (tab->slots[pos])
+		pos = (pos + 1) & (tab->slot_cap - 1);
+
+	tab->names[tab->ctr] = name;
+	tab->lens[tab->ctr] = len;
+	tab->slots[pos] = ++tab->ctr;
+	return tab->ctr - 1;
+}
+
+static int set_has(unsigned long *set, size_t idx) {
+	return idx != (size_t) -1 && (set[idx / WORD_BITS] >> (idx % WORD_BITS)) & 1;
+}
+
+static void set_add(unsigned long *set, size_t idx) {
+	if (idx != (size_t) -1)
+		set[idx / WORD_BITS] |= 1UL << (idx % WORD_BITS);
+}
+
+static void set_remove(unsigned long *set, size_t idx) {
+	if (idx != (size_t) -1)
+		set[idx / WORD_BITS] &= ~(1UL << (idx % WORD_BITS));
+}
+
+// Call fn for every $var reference in a template, using the same rules as the executor.
+static void template_each_var(const char *tmpl, VarFn fn, VarCtx *ctx) {
+	const char *itr = tmpl;
+
+	while ((itr = strchr(itr, VAR))) {
+		const char *end = itr + 1;
+
+		while (is_valid_identifier(*end))
+			end++;
+
+		fn(itr + 1, end - itr - 1, ctx);
+		itr = end;
+	}
+}
+
+// Call fn for every variable read while evaluating node.
+static void node_each_var(Node *node, VarFn fn, VarCtx *ctx) {
+	if (!node)
+		return;
+
+	if (Node_is_binop(node) || Node_is_compare(node)) {
+		node_each_var(node->data->BinExpNode.left, fn, ctx);
+		node_each_var(node->data->BinExpNode.right, fn, ctx);
+	}
+	else if (node->type == E_ARRAY_NODE) {
+		ArrStore *store = node->data->ArrayNode.store;
+		for (size_t i = 0; store && i < store->node_ctr; i++)
+			node_each_var(store->nodes[i], fn, ctx);
+	}
+	else if (node->type == E_REDUCE_NODE) {
+		node_each_var(node->data->ReduceNode.args, fn, ctx);
+	}
+	else if (node->type == E_SETOP_NODE) {
+		node_each_var(node->data->SetOpNode.left, fn, ctx);
+		node_each_var(node->data->SetOpNode.right, fn, ctx);
+	}
+	else if (node->type == E_IDENTIFIER_NODE) {
+		fn(node->value, strlen(node->value), ctx);
+	}
+	else if (node->type == E_MIXSTR_NODE) {
+		template_each_var(node->value, fn, ctx);
+	}
+}
+
+// Group commands form a circular list which ends at the group itself.
+static void group_each_var(Node *group, VarFn fn, VarCtx *ctx) {
+	Node *cmd = group->data->GroupNode.next;
+
+	while (cmd && cmd != group) {
+		template_each_var(cmd->value, fn, ctx);
+		cmd = cmd->data->GroupNode.next;
+	}
+}
+
+// Running a group also runs every group it needs, seen marks groups visited by index in node_mgr.
+static void run_each_var(NodeMgr *node_mgr, char *name, unsigned char *seen, VarFn fn, VarCtx *ctx) {
+	for (size_t i = 0; i < node_mgr->nodes_ctr; i++) {
+		Node *group = node_mgr->nodes[i];
+		if (group->type != E_GROUP_NODE || seen[i] || !string_compare(group->value, name))
+			continue;
+
+		seen[i] = 1;
+		group_each_var(group, fn, ctx);
+		for (size_t n = 0; n < group->data->GroupNode.need_ctr; n++)
+			run_each_var(node_mgr, group->data->GroupNode.needs[n], seen, fn, ctx);
+	}
+}
+
+// Statement runs the commands of a group, directly or from a loop body.
+static int stmt_runs(Node *stmt) {
+	if (stmt->type == E_FUNC_NODE)
+		return string_compare(stmt->value, "run");
+
+	if (stmt->type == E_FOREACH_NODE) {
+		for (size_t i = 0; i < stmt->data->ForeachNode.body_ctr; i++) {
+			if (stmt_runs(stmt->data->ForeachNode.body[i]))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Call fn for every variable a top level statement reads.
+static void stmt_each_var(Node *stmt, VarFn fn, VarCtx *ctx) {
+	switch (stmt->type) {
+		case E_EQUAL_NODE:
+			node_each_var(stmt->data->AsnStmtNode.right, fn, ctx);
+			break;
+		case E_FUNC_NODE:
+			// Running a group reads whatever its commands substitute.
+			if (stmt_runs(stmt)) {
+				unsigned char *seen = ctx->node_mgr ? VAlloc_calloc(ctx->tab->alloc, ctx->node_mgr->nodes_ctr + 1) : NULL;
+				if (seen)
+					run_each_var(ctx->node_mgr, stmt->data->FuncNode.args->value, seen, fn, ctx);
+				VAlloc_free(ctx->tab->alloc, seen);
+				node_each_var(stmt->data->FuncNode.hosts, fn, ctx);
+				break;
+			}
+			node_each_var(stmt->data->FuncNode.args, fn, ctx);
+			break;
+		case E_GROUP_NODE:
+			group_each_var(stmt, fn, ctx);
+			break;
+		case E_FOREACH_NODE:
+			// Assignments inside the body are private to an iteration, only reads escape.
+			node_each_var(stmt->data->ForeachNode.items, fn, ctx);
+			for (size_t i = 0; i < stmt->data->ForeachNode.body_ctr; i++)
+				stmt_each_var(stmt->data->ForeachNode.body[i], fn, ctx);
+			break;
+		default:
+			break;
+	}
+}
+
+// Intern name and append it to the uses of the statement being collected.
+static void var_intern(const char *name, size_t len, VarCtx *ctx) {
+	Liveness *live = ctx->live;
+	size_t idx = vartab_find(ctx->tab, name, len, 1);
+
+	if (idx == (size_t) -1)
+		return;
+
+	if (ctx->use_ctr == ctx->use_cap) {
+		size_t n_cap = ctx->use_cap ? ctx->use_cap * 2 : 64;
+		size_t *n_uses = VAlloc_realloc(live->alloc, live->uses, n_cap * sizeof(size_t));
+		if (null_check(n_uses, "var intern")) return;
+		live->uses = n_uses;
+		ctx->use_cap = n_cap;
+	}
+
+	live->uses[ctx->use_ctr++] = idx;
+}
+
+static void var_defined(const char *name, size_t len, VarCtx *ctx) {
+	if (!set_has(ctx->set, vartab_find(ctx->tab, name, len, 0)))
+		ctx->ok = 0;
+}
+
+// Range operand of '><' which can't raise an error, an array literal of two integers.
+static int range_pure(Node *node) {
+	return node && node->type == E_ARRAY_NODE && node->data->ArrayNode.store
+		&& node->data->ArrayNode.store->kind == ARR_INT && node->data->ArrayNode.store->len == 2;
+}
+
+// Evaluation can't raise an error if every variable read is defined, no division may be by zero
+// and every range is valid.
+static int node_pure(Node *node, VarCtx *ctx) {
+	if (!node)
+		return 0;
+
+	if (node->type == E_REDUCE_NODE)
+		return node_pure(node->data->ReduceNode.args, ctx);
+
+	if (node->type == E_SETOP_NODE)
+		return node_pure(node->data->SetOpNode.left, ctx)
+			&& (!node->data->SetOpNode.right || node_pure(node->data->SetOpNode.right, ctx));
+
+	if (Node_is_binop(node) || Node_is_compare(node)) {
+		Node *right = node->data->BinExpNode.right;
+
+		if (node->type == E_DIV_NODE && (!right || right->type != E_INTEGER_NODE || string_to_int(right->value, strlen(right->value)) <= 0))
+			return 0;
+
+		if (node->type == E_BETWEEN_NODE && !range_pure(right))
+			return 0;
+
+		return node_pure(node->data->BinExpNode.left, ctx) && node_pure(right, ctx);
+	}
+
+	ctx->ok = 1;
+	node_each_var(node, var_defined, ctx);
+	return ctx->ok;
+}
+
+// Determine whether an assignment always stores a value and whether skipping it is safe.
+static unsigned char asn_flags(Node *stmt, VarCtx *ctx) {
+	Node *right = stmt->data->AsnStmtNode.right;
+	unsigned char flags = 0;
+
+	if (!right || !stmt->data->AsnStmtNode.left)
+		return 0;
+
+	switch (right->type) {
+		case E_INTEGER_NODE:
+		case E_STRING_NODE:
+		case E_MIXSTR_NODE:
+		case E_ARRAY_NODE:
+		case E_REDUCE_NODE:
+		case E_SETOP_NODE:
+			flags |= STMT_KILLS;
+			break;
+		case E_IDENTIFIER_NODE:
+			// Copying an undefined variable silently stores nothing.
+			flags |= STMT_PURE;
+			if (set_has(ctx->set, vartab_find(ctx->tab, right->value, strlen(right->value), 0)))
+				flags |= STMT_KILLS;
+			break;
+		default:
+			if (Node_is_binop(right) || Node_is_compare(right))
+				flags |= STMT_KILLS;
+			break;
+	}
+
+	if (node_pure(right, ctx))
+		flags |= STMT_PURE;
+
+	return flags;
+}
+
+Liveness *Liveness_analyse(NodeMgr *node_mgr, VAllocator *alloc) {
+	if (null_check(node_mgr, "liveness analyse")) return NULL;
+
+	alloc = STATS_ALLOC(STAT_PARSER, alloc);
+
+	size_t stmt_ctr = node_mgr->nodes_ctr;
+	Liveness *live = VAlloc_alloc(alloc, sizeof(Liveness));
+	live->alloc = alloc;
+	live->stmt_ctr = stmt_ctr;
+	live->dead_ctr = 0;
+	live->dead = VAlloc_calloc(alloc, stmt_ctr + 1);
+	live->defs = VAlloc_alloc(alloc, (stmt_ctr + 1) * sizeof(size_t));
+	live->use_start = VAlloc_calloc(alloc, (stmt_ctr + 1) * sizeof(size_t));
+	live->uses = NULL;
+
+	VarTab tab = {NULL, NULL, NULL, 0, 0, 0, alloc};
+	VarCtx ctx = {&tab, NULL, 1, live, 0, 0, node_mgr};
+
+	// Number every variable written or read so sets can be bitmaps, collecting uses and defs as we go.
+	for (size_t i = 0; i < stmt_ctr; i++) {
+		Node *stmt = node_mgr->nodes[i];
+		Node *left = stmt->type == E_EQUAL_NODE ? stmt->data->AsnStmtNode.left : NULL;
+
+		live->defs[i] = left ? vartab_find(&tab, left->value, strlen(left->value), 1) : LIVE_NONE;
+		if (stmt_runs(stmt))
+			live->defs[i] = vartab_find(&tab, Run_Var, sizeof(Run_Var) - 1, 1);
+		stmt_each_var(stmt, var_intern, &ctx);
+		live->use_start[i + 1] = ctx.use_ctr;
+	}
+
+	size_t words = tab.ctr / WORD_BITS + 1;
+	unsigned char *flags = VAlloc_calloc(alloc, stmt_ctr + 1);
+	ctx.set = VAlloc_calloc(alloc, words * sizeof(unsigned long));
+
+	// Forward pass tracks variables which are definitely defined at each statement.
+	for (size_t i = 0; i < stmt_ctr; i++) {
+		Node *stmt = node_mgr->nodes[i];
+
+		if (stmt->type != E_EQUAL_NODE)
+			continue;
+
+		flags[i] = asn_flags(stmt, &ctx);
+
+		if (flags[i] & STMT_KILLS)
+			set_add(ctx.set, live->defs[i]);
+	}
+
+	// Backward pass, everything is live at exit since the final symbol table is observable.
+	memset(ctx.set, 0xff, words * sizeof(unsigned long));
+
+	for (size_t i = stmt_ctr; i-- > 0;) {
+		size_t target = live->defs[i];
+
+		if (target != LIVE_NONE) {
+			if ((flags[i] & STMT_PURE) && !set_has(ctx.set, target)) {
+				live->dead[i] = 1;
+				live->dead_ctr++;
+				continue;
+			}
+
+			if (flags[i] & STMT_KILLS)
+				set_remove(ctx.set, target);
+		}
+
+		for (size_t u = live->use_start[i]; u < live->use_start[i + 1]; u++)
+			set_add(ctx.set, live->uses[u]);
+	}
+
+	live->var_ctr = tab.ctr;
+
+	VAlloc_free(alloc, ctx.set);
+	VAlloc_free(alloc, flags);
+	VAlloc_free(alloc, (void *) tab.names);
+	VAlloc_free(alloc, tab.lens);
+	VAlloc_free(alloc, tab.slots);
+	return live;
+}
+
+void Liveness_print_report(Liveness *live, NodeMgr *node_mgr, FILE *out) {
+	if (null_check(live, "liveness report") || null_check(node_mgr, "liveness report")) return;
+
+	fprintf(out, "Dead stores: %lu of %lu statements eliminated | Variables: %lu\n", live->dead_ctr, live->stmt_ctr, live->var_ctr);
+
+	for (size_t i = 0; i < live->stmt_ctr; i++) {
+		if (live->dead[i])
+			fprintf(out, "  statement %lu: $%s\n", i + 1, node_mgr->nodes[i]->data->AsnStmtNode.left->value);
+	}
+}
+
+void Liveness_free(Liveness *live) {
+	if (null_check(live, "liveness free")) return;
+
+	VAlloc_free(live->alloc, live->dead);
+	VAlloc_free(live->alloc, live->defs);
+	VAlloc_free(live->alloc, live->use_start);
+	VAlloc_free(live->alloc, live->uses);
+	VAlloc_free(live->alloc, live);
+}
@@ -1,12 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
 #include "nexec.h"
+#include "parallel.h"
+#include "proc.h"
 #include "utils.h"
+#include "conf.h"
+#include "stats.h"
+#include "cmdclass.h"
 
 #define ERR_UNDEFINE_VAR 0
+#define ERR_DIV_ZERO 1
+#define ERR_BAD_RANGE 2
+#define ERR_NO_GROUP 3
+#define ERR_CMD_FAILED 4
+#define ERR_HOST_FAILED 5
+#define ERR_NO_INVENTORY 6
+#define ERR_GROUP_SKIPPED 7
+#define ERR_OVERFLOW 8
+#define ERR_EMPTY_REDUCE 9
 
 static const char *Error_Templates[] = {
-	"Use of undefined variable '$@0' near @1"
+	"Use of undefined variable '$@0' near @1",
+	"Division by zero near @0",
+	"Range for '><' must be an array of two values near @0",
+	"Group {@0} is not defined near @1",
+	"Command '@0' in group {@1} exited with status @2",
+	"Command '@0' in group {@1} on @2 exited with status @3",
+	"Inventory '@0' can't be read near @1",
+	"Group {@0} skipped since {@1} failed",
+	"Sum doesn't fit an integer near @0",
+	"'@0' of an empty array near @1"
 };
 
 // Execute a string node.
@@ -14,177 +43,826 @@ static char *exec_string(Node *node) {
 	return node->value;
 }
 
-// Get the value of a variable stored in symbol table.
-// Return NULL if it doesn't exist or undefined.
-static char *expand_variable(SyTable *sy_table, char *name) {
-	if (!name)
-		return NULL;
-		
-	Symbol *sy = SyTable_get_symbol(sy_table, name);
-	
-	if (!sy)
-		return NULL;
-		
-	return sy->val;
+// Look up a symbol read by the current statement, recording it while reads are tracked.
+static Symbol *nexec_read(NexecMgr *nexec_mgr, char *name) {
+	Symbol *sy = SyTable_get_symbol(nexec_mgr->sy_table, name);
+
+	if (!nexec_mgr->track)
+		return sy;
+
+	if (nexec_mgr->read_ctr == nexec_mgr->read_cap) {
+		size_t n_cap = nexec_mgr->read_cap ? nexec_mgr->read_cap * 2 : 8;
+		SymRead *n_reads = VAlloc_realloc(nexec_mgr->alloc, nexec_mgr->reads, n_cap * sizeof(SymRead));
+		if (null_check(n_reads, "nexec read")) return sy;
+		nexec_mgr->reads = n_reads;
+		nexec_mgr->read_cap = n_cap;
+	}
+
+	nexec_mgr->reads[nexec_mgr->read_ctr].sy = sy;
+	nexec_mgr->reads[nexec_mgr->read_ctr].version = sy ? sy->version : 0;
+	nexec_mgr->read_ctr++;
+	return sy;
+}
+
+// Text which best describes the statement being executed for errors.
+static char *nexec_hint(NexecMgr *nexec_mgr) {
+	Node *node = nexec_mgr->curr_node;
+
+	if (node->type == E_EQUAL_NODE)
+		return node->data->AsnStmtNode.left->value;
+
+	return node->value ? node->value : "statement";
+}
+
+// Append a piece of expanded template.
+static void add_segment(NexecMgr *nexec_mgr, const char *str, size_t len, Symbol *sy) {
+	if (nexec_mgr->seg_ctr == nexec_mgr->seg_cap) {
+		nexec_mgr->seg_cap = nexec_mgr->seg_cap ? nexec_mgr->seg_cap * 2 : 8;
+		nexec_mgr->segs = VAlloc_realloc(nexec_mgr->alloc, nexec_mgr->segs, nexec_mgr->seg_cap * sizeof(TmplSeg));
+	}
+
+	TmplSeg *seg = &nexec_mgr->segs[nexec_mgr->seg_ctr++];
+	seg->str = str;
+	seg->len = len;
+	seg->sy = sy;
+}
+
+// Copy a rope piece into buff.
+static int push_piece(const char *str, size_t len, void *ctx) {
+	VString_pushn(ctx, str, len);
+	return 0;
 }
 
-// Expand a mixed string and return malloc'ed value. 
+// Expand a mixed string. Result is stored in buff unless rope is provided and the result
+// exceeds VMEL_ROPE_THRESHOLD, in which case it is built inside rope instead and 1 is returned.
+// Unless strict is set unknown names are kept as is without an error.
+static int exec_template(NexecMgr *nexec_mgr, char *mstr, VRope *rope, int strict) {
+	// Total length of expanded string.
+	size_t total = 0;
+	// Start of text not yet added.
+	char *lit = mstr;
+	// Current substitute char.
+	char *m_str_it = NULL;
+	// Symbol being substituted.
+	Symbol *sy = NULL;
+
+	nexec_mgr->seg_ctr = 0;
+
+	// Split template into literal text and symbol values.
+	while ((m_str_it = strchr(lit, VAR))) {
+		char *name_end = m_str_it + 1;
+
+		while (is_valid_identifier(*name_end))
+			name_end++;
+
+		if (m_str_it > lit)
+			add_segment(nexec_mgr, lit, m_str_it - lit, NULL);
+
+		VString_set(&nexec_mgr->name, "");
+		VString_pushn(&nexec_mgr->name, m_str_it + 1, name_end - m_str_it - 1);
+		sy = nexec_read(nexec_mgr, VString_str(&nexec_mgr->name));
+
+		// Arrays are substituted as text.
+		if (sy && sy->arr && !sy->val)
+			Symbol_value(sy);
+
+		// Only substitute if valid variable, otherwise keep the text as is.
+		if (sy && (sy->val || sy->rope.root)) {
+			add_segment(nexec_mgr, NULL, sy->val ? strlen(sy->val) : VRope_length(&sy->rope), sy);
+		}
+		else {
+			if (strict)
+				NexecMgr_add_error(nexec_mgr->err_handle, VString_str(&nexec_mgr->name), nexec_hint(nexec_mgr));
+			add_segment(nexec_mgr, m_str_it, name_end - m_str_it, NULL);
+		}
+
+		lit = name_end;
+	}
+
+	if (*lit)
+		add_segment(nexec_mgr, lit, strlen(lit), NULL);
+
+	for (size_t i = 0; i < nexec_mgr->seg_ctr; i++)
+		total += nexec_mgr->segs[i].len;
+
+	// Large results share pieces rather than copying them.
+	if (rope && total >= VMEL_ROPE_THRESHOLD) {
+		for (size_t i = 0; i < nexec_mgr->seg_ctr; i++) {
+			TmplSeg *seg = &nexec_mgr->segs[i];
+
+			// Template text lives as long as the program.
+			if (!seg->sy)
+				VRope_append_ref(rope, seg->str, seg->len);
+			else if (seg->sy->rope.root)
+				VRope_append_rope(rope, &seg->sy->rope);
+			else
+				VRope_append(rope, seg->sy->val, seg->len);
+		}
+		return 1;
+	}
+
+	VString_set(&nexec_mgr->buff, "");
+	VString_reserve(&nexec_mgr->buff, total);
+	STATS_INC(STAT_EXEC, copies);
+
+	for (size_t i = 0; i < nexec_mgr->seg_ctr; i++) {
+		TmplSeg *seg = &nexec_mgr->segs[i];
+
+		if (!seg->sy)
+			VString_pushn(&nexec_mgr->buff, seg->str, seg->len);
+		else if (seg->sy->val)
+			VString_pushn(&nexec_mgr->buff, seg->sy->val, seg->len);
+		else
+			VRope_each(&seg->sy->rope, push_piece, &nexec_mgr->buff);
+	}
+
+	return 0;
+}
+
+// Expand a mixed string into buff and return its value.
 static char *exec_mixed_string(char *mstr, NexecMgr *nexec_mgr) {
-	VString_set(&nexec_mgr->buff, mstr);
+	exec_template(nexec_mgr, mstr, NULL, 1);
+	return VString_str(&nexec_mgr->buff);
+}
 
-	char *m_str_it = strchr(mstr, VAR);
+// Print a rope followed by newline without flattening.
+static void print_rope(OutSink *out, VRope *rope) {
+	OutSink_write_rope(out, rope);
+	OutSink_write(out, "\n", 1);
+}
 
-	// Proceed only if it has substitute char.
-	if (m_str_it) {
+// Result of evaluating an expression. arr is set when the result is an array, owned
+// when it was built by the evaluation rather than borrowed from a symbol.
+typedef struct {
+	int num;
+	VArray *arr;
+	int owned;
+} ExecVal;
 
-		// Temp buffer for var names.
-		VString buf = VString_new();
-		// Expanded variable.
-		char *var_val;
+static void exec_value(NexecMgr *nexec_mgr, Node *node, ExecVal *val);
 
-		while(m_str_it) {
+// Report an error raised by the statement being executed.
+static void nexec_error(NexecMgr *nexec_mgr, unsigned int code) {
+	Error_add_record(nexec_mgr->err_handle, Error_Templates, code, 0, 1, nexec_hint(nexec_mgr));
+}
 
-			// Add '$' to buffer and increment.	
-			VString_pushc(&buf, *m_str_it++);
-		
-			while(is_valid_identifier(*m_str_it)) {
-				VString_pushc(&buf, *m_str_it);
-				m_str_it++;
-			}
+// Free array of val if it was built during evaluation.
+static void exec_release(ExecVal *val) {
+	if (val->owned)
+		VArray_free(val->arr);
+	val->arr = NULL;
+	val->owned = 0;
+}
 
-			var_val = expand_variable(nexec_mgr->sy_table, buf.str+1);
-			
-			// Only replace if valid variable.
-			if (!var_val) {
-				NexecMgr_add_error(nexec_mgr->err_handle, buf.str+1, nexec_mgr->curr_node->value);
-			}
-			else {
-				VString_replace(&nexec_mgr->buff, buf.str, var_val);
+// Build array value of an array literal. Elements of mixed and nested arrays are kept as text.
+static VArray *array_from_store(NexecMgr *nexec_mgr, ArrStore *store) {
+	VAllocator *alloc = nexec_mgr->sy_table->alloc;
+
+	if (!store || store->kind == ARR_EMPTY || store->kind == ARR_INT) {
+		VArray *arr = VArray_new(alloc, VARRAY_INT, store ? store->len : 0);
+		if (arr && store)
+			VArray_push_ints(arr, store->ints, store->int_ctr);
+		return arr;
+	}
+
+	VArray *arr = VArray_new(alloc, VARRAY_STR, store->len);
+	if (null_check(arr, "array from store")) return NULL;
+
+	ArrItem item;
+	char num[16];
+
+	for (size_t i = 0; i < store->len; i++) {
+		ArrStore_get(store, i, &item);
+
+		if (item.kind == ARR_INT) {
+			VArray_push_str(arr, num, snprintf(num, sizeof(num), "%d", item.val.num));
+		}
+		else if (item.kind == ARR_STR) {
+			VArray_push_str(arr, item.val.str, strlen(item.val.str));
+		}
+		else {
+			VArray *nested = array_from_store(nexec_mgr, item.val.node->data->ArrayNode.store);
+			size_t len = VArray_format(nested, NULL, 0);
+			char *text = VAlloc_alloc(alloc, len + 1);
+
+			if (!null_check(text, "array from store")) {
+				VArray_format(nested, text, len + 1);
+				VArray_push_str(arr, text, len);
 			}
 
-			VString_set(&buf, "");
-			m_str_it = strchr(m_str_it, VAR);
+			VAlloc_free(alloc, text);
+			VArray_free(nested);
 		}
-		VString_free(&buf);
 	}
-	return nexec_mgr->buff.str;
+
+	return arr;
 }
 
-// Execute a expression node (3 + 4).
-static int exec_expression(NexecMgr *nexec_mgr, Node *node) {
+// Convert string elements to integers the same way identifiers are.
+static void exec_as_ints(NexecMgr *nexec_mgr, ExecVal *val) {
+	if (!val->arr || val->arr->kind == VARRAY_INT)
+		return;
+
+	VArray *ints = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_INT, val->arr->len);
+	if (null_check(ints, "exec as ints")) return;
+
+	for (size_t i = 0; i < val->arr->len; i++) {
+		char *str = (char *) VArray_str_at(val->arr, i);
+		int n = string_to_int(str, strlen(str));
+		if (n < 0) n = string_to_ascii(str);
+		ints->ints[i] = n;
+	}
+	ints->len = val->arr->len;
+
+	exec_release(val);
+	val->arr = ints;
+	val->owned = 1;
+}
+
+// Convert integer elements to strings so they can be compared with string elements.
+static void exec_as_strs(NexecMgr *nexec_mgr, ExecVal *val) {
+	if (!val->arr || val->arr->kind == VARRAY_STR)
+		return;
+
+	VArray *strs = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_STR, val->arr->len);
+	if (null_check(strs, "exec as strs")) return;
+
+	char num[16];
+	for (size_t i = 0; i < val->arr->len; i++)
+		VArray_push_str(strs, num, snprintf(num, sizeof(num), "%d", val->arr->ints[i]));
+
+	exec_release(val);
+	val->arr = strs;
+	val->owned = 1;
+}
+
+// Treat an integer as an array holding it.
+static void exec_as_array(NexecMgr *nexec_mgr, ExecVal *val) {
+	if (val->arr)
+		return;
+
+	val->arr = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_INT, 1);
+	if (null_check(val->arr, "exec as array")) return;
+
+	VArray_push_int(val->arr, val->num);
+	val->owned = 1;
+}
+
+static int exec_scalar_op(NexecMgr *nexec_mgr, enum NodeType type, int lhs, int rhs) {
+	switch (type) {
+		case E_GREATERTHANEQ_NODE: return lhs >= rhs;
+		case E_GREATERTHAN_NODE: return lhs > rhs;
+		case E_LESSTHANEQ_NODE: return lhs <= rhs;
+		case E_LESSTHAN_NODE: return lhs < rhs;
+		case E_NEQUAL_NODE: return lhs != rhs;
+		case E_EEQUAL_NODE: return lhs == rhs;
+		case E_ADD_NODE: return lhs + rhs;
+		case E_MINUS_NODE: return lhs - rhs;
+		case E_DIV_NODE:
+			if (rhs == 0) {
+				nexec_error(nexec_mgr, ERR_DIV_ZERO);
+				return 0;
+			}
+			// Wraps like the array operations, INT_MIN / -1 would trap.
+			return rhs == -1 ? (int) (0u - (unsigned int) lhs) : lhs / rhs;
+		case E_TIMES_NODE: return lhs * rhs;
+		default: return 0;
+	}
+}
+
+static enum VArrayOp array_op(enum NodeType type) {
+	switch (type) {
+		case E_GREATERTHANEQ_NODE: return VARRAY_GE;
+		case E_GREATERTHAN_NODE: return VARRAY_GT;
+		case E_LESSTHANEQ_NODE: return VARRAY_LE;
+		case E_LESSTHAN_NODE: return VARRAY_LT;
+		case E_NEQUAL_NODE: return VARRAY_NE;
+		case E_EEQUAL_NODE: return VARRAY_EQ;
+		case E_MINUS_NODE: return VARRAY_SUB;
+		case E_DIV_NODE: return VARRAY_DIV;
+		case E_TIMES_NODE: return VARRAY_MUL;
+		default: return VARRAY_ADD;
+	}
+}
+
+// Element-wise operation where at least one operand is an array.
+static void exec_array_op(NexecMgr *nexec_mgr, Node *node, ExecVal *lhs, ExecVal *rhs, ExecVal *val) {
+	VArray *dest = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_INT, 0);
+	if (null_check(dest, "exec array op")) return;
+
+	enum VArrayOp op = array_op(node->type);
+	int ret = 0;
+
+	exec_as_ints(nexec_mgr, lhs);
+	exec_as_ints(nexec_mgr, rhs);
+
+	if (lhs->arr && rhs->arr)
+		ret = VArray_zip(dest, lhs->arr, rhs->arr, op);
+	else if (lhs->arr)
+		ret = VArray_map(dest, lhs->arr, op, rhs->num, 0);
+	else
+		ret = VArray_map(dest, rhs->arr, op, lhs->num, 1);
+
+	if (ret) {
+		nexec_error(nexec_mgr, ERR_DIV_ZERO);
+		dest->len = 0;
+	}
+
+	val->arr = dest;
+	val->owned = 1;
+}
+
+// Range filter, arrays keep the elements within [lo, hi] while integers become 1 or 0.
+static void exec_between(NexecMgr *nexec_mgr, ExecVal *lhs, ExecVal *rhs, ExecVal *val) {
+	int lo = 0;
+	int hi = 0;
+	int valid = 0;
+
+	exec_as_ints(nexec_mgr, rhs);
+
+	if (rhs->arr && rhs->arr->len == 2) {
+		lo = rhs->arr->ints[0];
+		hi = rhs->arr->ints[1];
+		valid = 1;
+	}
+	else {
+		nexec_error(nexec_mgr, ERR_BAD_RANGE);
+	}
+
+	if (!lhs->arr) {
+		val->num = valid && lo <= lhs->num && lhs->num <= hi;
+		return;
+	}
+
+	VArray *dest = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_INT, 0);
+	if (null_check(dest, "exec between")) return;
+
+	exec_as_ints(nexec_mgr, lhs);
+	if (valid)
+		VArray_filter_range(dest, lhs->arr, lo, hi);
+
+	val->arr = dest;
+	val->owned = 1;
+}
+
+// Reduce an array to a single integer, an integer is treated as an array holding it.
+static int exec_reduce(NexecMgr *nexec_mgr, Node *node) {
+	ExecVal arg;
 	int ret = 0;
+
+	exec_value(nexec_mgr, node->data->ReduceNode.args, &arg);
+
+	if (string_compare(node->value, "count")) {
+		ret = arg.arr ? (int) arg.arr->len : 1;
+	}
+	else if (!arg.arr) {
+		ret = arg.num;
+	}
+	else {
+		exec_as_ints(nexec_mgr, &arg);
+
+		if (string_compare(node->value, "sum")) {
+			long long sum = VArray_sum(arg.arr);
+
+			// Integers of the script are int, a sum which doesn't fit is an error rather than wrapped.
+			if (sum > INT_MAX || sum < INT_MIN)
+				nexec_error(nexec_mgr, ERR_OVERFLOW);
+			else
+				ret = (int) sum;
+		}
+		else if (!arg.arr->len) {
+			Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_EMPTY_REDUCE, 0, 2, node->value, nexec_hint(nexec_mgr));
+		}
+		else if (string_compare(node->value, "min")) {
+			VArray_min(arg.arr, &ret);
+		}
+		else {
+			VArray_max(arg.arr, &ret);
+		}
+	}
+
+	exec_release(&arg);
+	return ret;
+}
+
+// Sort, dedup or combine arrays, the result is always a new array.
+static void exec_setop(NexecMgr *nexec_mgr, Node *node, ExecVal *val) {
+	ExecVal lhs;
+	ExecVal rhs = {0, NULL, 0};
+	unsigned int jobs = nexec_mgr->jobs;
+
+	exec_value(nexec_mgr, node->data->SetOpNode.left, &lhs);
+	exec_as_array(nexec_mgr, &lhs);
+
+	if (node->data->SetOpNode.right) {
+		exec_value(nexec_mgr, node->data->SetOpNode.right, &rhs);
+		exec_as_array(nexec_mgr, &rhs);
+
+		// Mixed kinds are compared as text.
+		if (lhs.arr && rhs.arr && lhs.arr->kind != rhs.arr->kind) {
+			exec_as_strs(nexec_mgr, &lhs);
+			exec_as_strs(nexec_mgr, &rhs);
+		}
+	}
+
+	if (!lhs.arr || (node->data->SetOpNode.right && !rhs.arr)) {
+		exec_release(&lhs);
+		exec_release(&rhs);
+		return;
+	}
+
+	if (string_compare(node->value, "sort")) {
+		// Sorted in place, borrowed arrays are copied first.
+		val->arr = lhs.owned ? lhs.arr : VArray_copy(lhs.arr, nexec_mgr->sy_table->alloc);
+		lhs.owned = 0;
+		VArray_sort(val->arr, jobs);
+	}
+	else if (string_compare(node->value, "unique")) {
+		val->arr = VArray_unique(lhs.arr, jobs);
+	}
+	else if (string_compare(node->value, "union")) {
+		val->arr = VArray_union(lhs.arr, rhs.arr, jobs);
+	}
+	else if (string_compare(node->value, "intersect")) {
+		val->arr = VArray_intersect(lhs.arr, rhs.arr, jobs);
+	}
+	else {
+		val->arr = VArray_difference(lhs.arr, rhs.arr, jobs);
+	}
+
+	val->owned = val->arr != NULL;
+	exec_release(&lhs);
+	exec_release(&rhs);
+}
+
+// Execute a expression node (3 + 4), arrays are evaluated element-wise.
+static void exec_value(NexecMgr *nexec_mgr, Node *node, ExecVal *val) {
+	ExecVal lhs;
+	ExecVal rhs;
 	Symbol *sy;
 
+	val->num = 0;
+	val->arr = NULL;
+	val->owned = 0;
+
+	STATS_INC(STAT_EXEC, nodes);
+
+	if (Node_is_binop(node) || Node_is_compare(node)) {
+		exec_value(nexec_mgr, node->data->BinExpNode.left, &lhs);
+		exec_value(nexec_mgr, node->data->BinExpNode.right, &rhs);
+
+		if (node->type == E_BETWEEN_NODE)
+			exec_between(nexec_mgr, &lhs, &rhs, val);
+		else if (lhs.arr || rhs.arr)
+			exec_array_op(nexec_mgr, node, &lhs, &rhs, val);
+		else
+			val->num = exec_scalar_op(nexec_mgr, node->type, lhs.num, rhs.num);
+
+		exec_release(&lhs);
+		exec_release(&rhs);
+		return;
+	}
+
 	switch(node->type) {
-		case E_GREATERTHANEQ_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) >= exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_GREATERTHAN_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) > exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_LESSTHANEQ_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) <= exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_LESSTHAN_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) < exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_NEQUAL_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) != exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_EEQUAL_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) == exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_ADD_NODE: 
-			ret += exec_expression(nexec_mgr, node->data->BinExpNode.left) + exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_MINUS_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) - exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_DIV_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) / exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
-		case E_TIMES_NODE:
-			ret = exec_expression(nexec_mgr, node->data->BinExpNode.left) *  exec_expression(nexec_mgr, node->data->BinExpNode.right);
-			break;
 		case E_INTEGER_NODE:
-			ret = string_to_int(node->value, strlen(node->value));
+			val->num = string_to_int(node->value, strlen(node->value));
 			break;
 		case E_STRING_NODE:
-			ret = string_to_ascii(node->value);
+			val->num = string_to_ascii(node->value);
 			break;
 		case E_MIXSTR_NODE:
 			exec_mixed_string(node->value, nexec_mgr);
-			ret = string_to_ascii(nexec_mgr->buff.str);
+			val->num = string_to_ascii(VString_str(&nexec_mgr->buff));
+			break;
+		case E_ARRAY_NODE:
+			val->arr = array_from_store(nexec_mgr, node->data->ArrayNode.store);
+			val->owned = 1;
+			break;
+		case E_REDUCE_NODE:
+			val->num = exec_reduce(nexec_mgr, node);
+			break;
+		case E_SETOP_NODE:
+			exec_setop(nexec_mgr, node, val);
 			break;
 		case E_IDENTIFIER_NODE:
-			sy = SyTable_get_symbol(nexec_mgr->sy_table, node->value);
+			sy = nexec_read(nexec_mgr, node->value);
+
+			// Arrays are read in place.
+			if (sy && sy->arr) {
+				val->arr = sy->arr;
+				break;
+			}
+
+			if (!Symbol_value(sy)) {
+				NexecMgr_add_error(nexec_mgr->err_handle, node->value, nexec_hint(nexec_mgr));
+				break;
+			}
 			// TODO: At the moment no way of telling if identifier node
 			// is a 'Number' string or 'Alpha	' string so we attempt to
 			// first convert to integer if fails then fallback to ascii encoding.
 			// A fix would be to include type information in the symbol table by
 			// deducing all identifiers prior to function execution. But is this double 
 			// handling ?
-			ret = string_to_int(sy->val, strlen(sy->val));
-			if (ret < 0) ret = string_to_ascii(sy->val);
+			val->num = string_to_int(sy->val, strlen(sy->val));
+			if (val->num < 0) val->num = string_to_ascii(sy->val);
 			break;
 		default:
 			break;
 	}
-	return ret;
 }
 
-// Helper to convert intger to malloc'ed string.
-static char *expr_to_string(NexecMgr *nexec_mgr, int src) {
-	char *dest = malloc(6 * sizeof(char));
-	char *out = NULL;
-	
-	// Store any additional bytes if needed.
-	int extra_b = snprintf(dest, 6, "%d" , src);
-	
-	if (extra_b > 0) {
-		out = realloc(dest, (extra_b + 6) * sizeof(char));
-		dest = out;
+// Print an array followed by newline without formatting it into a single string.
+static void print_array(OutSink *out, VArray *arr) {
+	char num[16];
+
+	OutSink_write(out, "[", 1);
+
+	for (size_t i = 0; i < arr->len; i++) {
+		if (i > 0)
+			OutSink_write(out, ", ", 2);
+
+		if (arr->kind == VARRAY_INT) {
+			OutSink_write(out, num, snprintf(num, sizeof(num), "%d", arr->ints[i]));
+		}
+		else {
+			const char *str = VArray_str_at(arr, i);
+			OutSink_write(out, str, strlen(str));
+		}
 	}
 
+	OutSink_write(out, "]\n", 2);
+}
+
+// Helper to convert intger to string stored in buff.
+static char *expr_to_string(NexecMgr *nexec_mgr, int src) {
+	// Large enough for any int including sign.
+	char dest[16];
+	snprintf(dest, sizeof(dest), "%d", src);
 	VString_set(&nexec_mgr->buff, dest);
-	free (dest);
-	return nexec_mgr->buff.str;
+	STATS_INC(STAT_EXEC, copies);
+	return VString_str(&nexec_mgr->buff);
+}
+
+// Find the definition of a group among the top level statements.
+static Node *find_group(NodeMgr *node_mgr, char *name) {
+	for (size_t i = 0; node_mgr && i < node_mgr->nodes_ctr; i++) {
+		Node *node = node_mgr->nodes[i];
+		if (node->type == E_GROUP_NODE && string_compare(node->value, name))
+			return node;
+	}
+
+	return NULL;
 }
 
 void NexecMgr_add_error(Error *err_handle, char *offender, char *hint) {
 	if (!err_handle || !offender)
 		return;
-	
-	if (err_handle->error_cap == err_handle->error_ctr)
-		return;
-	
-	// The error template which is needed.
-	const char *template = Error_Templates[0];
-	// Array containing string of substitute values.
-	char *template_values[] = {offender, hint};
-	// Final template error.
-	char *template_fmt = NULL;
 
-	template_fmt = string_map_vars(template, template_values, strlen(template), 2);
-
-	err_handle->errors[err_handle->error_ctr] = template_fmt;
-	err_handle->error_ctr++;
-}	
+	Error_add_record(err_handle, Error_Templates, ERR_UNDEFINE_VAR, 0, 2, offender, hint);
+}
 
-NexecMgr *NexecMgr_new(void) {
-	NexecMgr *n = malloc(sizeof(NexecMgr));
+NexecMgr *NexecMgr_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_EXEC, alloc);
+	NexecMgr *n = VAlloc_alloc(alloc, sizeof(NexecMgr));
+	n->alloc = alloc;
 	n->err_handle = NULL;
 	n->node_mgr = NULL;
 	n->scope = 0;
 	n->sy_table = NULL;
 	n->curr_node = NULL;
+	n->segs = NULL;
+	n->seg_ctr = 0;
+	n->seg_cap = 0;
+	n->reads = NULL;
+	n->read_ctr = 0;
+	n->read_cap = 0;
+	n->track = 0;
+	n->pinned = 0;
+	n->defer_errors = 0;
+	n->jobs = 1;
+	n->threaded = 0;
+	n->flat = 0;
+	n->out = NULL;
+	n->log = NULL;
+	n->loop = NULL;
+	n->pool = NULL;
+	n->host = NULL;
+	n->session = NULL;
+	n->fanout = VMEL_FANOUT_HOSTS;
+	n->dag = NULL;
+	n->history = NULL;
+	n->steps = NULL;
+	n->journal = NULL;
+	n->stmt = 0;
+	n->hedge = NULL;
+	n->buff = VString_new(STATS_ALLOC(STAT_VSTRING, alloc));
+	n->name = VString_new(STATS_ALLOC(STAT_VSTRING, alloc));
 	return n;
 }
 
 int NexecMgr_free(NexecMgr *nexec_mgr) {
 	if (null_check(nexec_mgr, "nexecmgr free")) return -1;
 	VString_free(&nexec_mgr->buff);
-	free(nexec_mgr);
+	VString_free(&nexec_mgr->name);
+	if (nexec_mgr->loop)
+		EvLoop_free(nexec_mgr->loop);
+	VAlloc_free(nexec_mgr->alloc, nexec_mgr->segs);
+	VAlloc_free(nexec_mgr->alloc, nexec_mgr->reads);
+	VAlloc_free(nexec_mgr->alloc, nexec_mgr);
+	return 0;
+}
+
+// Hosts listed one per line, anything after the first word or a # is ignored.
+static VArray *read_inventory(NexecMgr *nexec_mgr, const char *path) {
+	FILE *fptr = fopen(path, "r");
+
+	if (!fptr) {
+		Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_NO_INVENTORY, 0, 2, path, nexec_hint(nexec_mgr));
+		return NULL;
+	}
+
+	VArray *hosts = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_STR, 0);
+	char *line = NULL;
+	size_t cap = 0;
+
+	while (hosts && getline(&line, &cap, fptr) >= 0) {
+		char *itr = line;
+		size_t len = 0;
+
+		while (isspace((unsigned char) *itr))
+			itr++;
+		while (itr[len] && itr[len] != '#' && !isspace((unsigned char) itr[len]))
+			len++;
+
+		if (len)
+			VArray_push_str(hosts, itr, len);
+	}
+
+	free(line);
+	fclose(fptr);
+	return hosts;
+}
+
+// Hosts a run statement fans out to. Arrays list the hosts, a string is an inventory file.
+static VArray *exec_hosts(NexecMgr *nexec_mgr, Node *node) {
+	Symbol *sy = NULL;
+	char num[16];
+
+	if (node->type == E_STRING_NODE)
+		return read_inventory(nexec_mgr, node->value);
+
+	if (node->type == E_MIXSTR_NODE) {
+		exec_template(nexec_mgr, node->value, NULL, 1);
+		return read_inventory(nexec_mgr, VString_str(&nexec_mgr->buff));
+	}
+
+	if (node->type == E_IDENTIFIER_NODE && (sy = nexec_read(nexec_mgr, node->value)) && !sy->arr && Symbol_value(sy))
+		return read_inventory(nexec_mgr, sy->val);
+
+	ExecVal val;
+	exec_value(nexec_mgr, node, &val);
+	exec_as_array(nexec_mgr, &val);
+	if (!val.arr) return NULL;
+
+	VArray *hosts = VArray_new(nexec_mgr->sy_table->alloc, VARRAY_STR, val.arr->len);
+
+	for (size_t i = 0; hosts && i < val.arr->len; i++) {
+		if (val.arr->kind == VARRAY_INT)
+			VArray_push_str(hosts, num, snprintf(num, sizeof(num), "%d", val.arr->ints[i]));
+		else
+			VArray_push_str(hosts, VArray_str_at(val.arr, i), strlen(VArray_str_at(val.arr, i)));
+	}
+
+	exec_release(&val);
+	return hosts;
+}
+
+// Take the session of every lane of a run, the lane of the group being run keeps the shell of
+// the host. Lanes starting with a group which needs nothing start from that shell as well.
+static int dag_sessions(NexecMgr *nexec_mgr, DagRun *run, size_t target) {
+	if (!nexec_mgr->pool)
+		return 0;
+
+	const char *host = nexec_mgr->host ? nexec_mgr->host : VMEL_LOCAL_HOST;
+	size_t first = run->lane[target];
+
+	if (!(run->sessions[first] = TransportPool_acquire(nexec_mgr->pool, host)))
+		return -1;
+
+	for (size_t l = 0; l < run->lane_ctr; l++) {
+		if (l != first && !(run->sessions[l] = TransportPool_acquire_spare(nexec_mgr->pool, host)))
+			return -1;
+	}
+
+	for (size_t i = 0; i < run->len; i++) {
+		size_t g = run->order[i];
+		if (!nexec_mgr->dag->groups[g].need_ctr && run->lane[g] != first)
+			Session_inherit(run->sessions[run->lane[g]], run->sessions[first]);
+	}
+
+	return 0;
+}
+
+// Run the groups of a plan one at a time in plan order, needs come first. A failure is passed
+// on to everything depending on it.
+static int dag_sequential(NexecMgr *nexec_mgr, DagRun *run) {
+	GroupDag *dag = nexec_mgr->dag;
+	long *failed = VAlloc_alloc(nexec_mgr->alloc, dag->group_ctr * sizeof(long));
+	int ret = 0;
+
+	if (null_check(failed, "dag sequential")) return -1;
+
+	for (size_t i = 0; i < dag->group_ctr; i++)
+		failed[i] = -1;
+
+	for (size_t i = 0; i < run->len; i++) {
+		DagGroup *g = &dag->groups[run->order[i]];
+		long blocker = -1;
+
+		for (size_t n = 0; n < g->need_ctr && blocker < 0; n++)
+			blocker = failed[g->needs[n]];
+
+		if (Nexec_dag_group(nexec_mgr, run, run->order[i], blocker)) {
+			failed[run->order[i]] = blocker >= 0 ? blocker : (long) run->order[i];
+			ret = -1;
+		}
+	}
+
+	VAlloc_free(nexec_mgr->alloc, failed);
+	return ret;
+}
+
+// Run a group after everything it needs, each needed group once. Groups without needs run on their own.
+static int run_group(NexecMgr *nexec_mgr, Node *group) {
+	GroupDag *dag = nexec_mgr->dag;
+	long idx = GroupDag_find(dag, group);
+
+	if (idx < 0) {
+		nexec_mgr->curr_node = group;
+		return Nexec_group_node(nexec_mgr);
+	}
+
+	if (!dag->groups[idx].need_ctr)
+		return Nexec_dag_group(nexec_mgr, NULL, idx, -1);
+
+	DagRun run;
+	int ret = -1;
+
+	run.order = VAlloc_alloc(nexec_mgr->alloc, dag->group_ctr * sizeof(size_t));
+	run.prio = VAlloc_alloc(nexec_mgr->alloc, dag->group_ctr * sizeof(long long));
+	run.lane = VAlloc_alloc(nexec_mgr->alloc, dag->group_ctr * sizeof(size_t));
+	run.seed = VAlloc_alloc(nexec_mgr->alloc, dag->group_ctr * sizeof(long));
+	run.sessions = NULL;
+	run.lane_ctr = 0;
+
+	if (!null_check(run.order, "run group") && !null_check(run.prio, "run group")
+		&& !null_check(run.lane, "run group") && !null_check(run.seed, "run group")) {
+		run.len = GroupDag_plan(dag, nexec_mgr->history, idx, run.order, run.prio);
+		run.lane_ctr = GroupDag_lanes(dag, run.order, run.len, run.lane, run.seed);
+		run.sessions = VAlloc_calloc(nexec_mgr->alloc, (run.lane_ctr + 1) * sizeof(Session *));
+
+		// Groups of different lanes never share a shell so ready ones may run at once. Groups only
+		// read symbols, which threads of a wave find flat already.
+		if (!null_check(run.sessions, "run group") && dag_sessions(nexec_mgr, &run, idx) == 0) {
+			if ((nexec_mgr->threaded || nexec_mgr->flat) && nexec_mgr->fanout > 1 && run.lane_ctr > 1)
+				ret = Parallel_dag(nexec_mgr, &run, nexec_mgr->fanout);
+			else
+				ret = dag_sequential(nexec_mgr, &run);
+		}
+
+		// Spares go first, the connection they share may be closed along with the first session.
+		for (size_t l = run.lane_ctr; run.sessions && l-- > 0;) {
+			if (l != run.lane[idx] && run.sessions[l])
+				TransportPool_release(nexec_mgr->pool, run.sessions[l]);
+		}
+		if (run.sessions && run.sessions[run.lane[idx]])
+			TransportPool_release(nexec_mgr->pool, run.sessions[run.lane[idx]]);
+	}
+
+	VAlloc_free(nexec_mgr->alloc, run.order);
+	VAlloc_free(nexec_mgr->alloc, run.prio);
+	VAlloc_free(nexec_mgr->alloc, run.lane);
+	VAlloc_free(nexec_mgr->alloc, run.seed);
+	VAlloc_free(nexec_mgr->alloc, run.sessions);
+	return ret;
+}
+
+// Run a group once per host, hosts are worked on concurrently when threads may be used.
+static int run_on_hosts(NexecMgr *nexec_mgr, Node *group) {
+	Node *run = nexec_mgr->curr_node;
+	VArray *hosts = exec_hosts(nexec_mgr, run->data->FuncNode.hosts);
+	if (!hosts) return -1;
+
+	if (nexec_mgr->threaded && nexec_mgr->fanout > 1 && hosts->len > 1) {
+		Parallel_fanout(nexec_mgr, group, hosts, nexec_mgr->fanout);
+	}
+	else {
+		for (size_t i = 0; i < hosts->len; i++)
+			Nexec_host(nexec_mgr, group, hosts, i);
+	}
+
+	nexec_mgr->curr_node = run;
+	VArray_free(hosts);
 	return 0;
 }
 
@@ -199,36 +877,797 @@ int Nexec_func_node(NexecMgr *nexec_mgr) {
 	if (string_compare(curr_node->value, "print")) {
 		
 		// Result of arithmetic operations.
-		int calc = 0;
+		ExecVal calc;
+		// Expanded variable.
+		char *var_val = NULL;
+		// Large template result.
+		VRope rope = VRope_new(nexec_mgr->alloc);
+		// Symbol being printed.
+		Symbol *sy = NULL;
+		// Formatted result, large enough for any int with sign and newline.
+		char num[16];
 
 		switch (curr_args->type) {
 			case E_STRING_NODE:
 			case E_INTEGER_NODE:
-				printf("%s\n", exec_string(curr_args));
+				OutSink_puts(nexec_mgr->out, exec_string(curr_args));
 				break;
 			case E_IDENTIFIER_NODE:
-				VString_set(&nexec_mgr->buff, expand_variable(nexec_mgr->sy_table, curr_args->value));
-				if (nexec_mgr->buff.str)
-					printf("%s\n", nexec_mgr->buff.str);
+				sy = SyTable_get_symbol(nexec_mgr->sy_table, curr_args->value);
+
+				// Large values are written directly from rope.
+				if (sy && !sy->val && sy->rope.root) {
+					print_rope(nexec_mgr->out, &sy->rope);
+					break;
+				}
+
+				if (sy && !sy->val && sy->arr) {
+					print_array(nexec_mgr->out, sy->arr);
+					break;
+				}
+
+				var_val = Symbol_value(sy);
+				if (var_val)
+					OutSink_puts(nexec_mgr->out, var_val);
 				else
 					NexecMgr_add_error(nexec_mgr->err_handle, curr_args->value, curr_node->value);
 				break;
 			case E_MIXSTR_NODE:
-				VString_set(&nexec_mgr->buff, exec_mixed_string(curr_args->value, nexec_mgr));
-				printf("%s\n", nexec_mgr->buff.str);
+				if (exec_template(nexec_mgr, curr_args->value, &rope, 1)) {
+					print_rope(nexec_mgr->out, &rope);
+					VRope_free(&rope);
+				}
+				else {
+					OutSink_puts(nexec_mgr->out, VString_str(&nexec_mgr->buff));
+				}
 				break;
 			default:
 				// Derive final value from operation node.
-				calc = exec_expression(nexec_mgr, curr_args);
-				printf("%d\n", calc);
+				exec_value(nexec_mgr, curr_args, &calc);
+				if (calc.arr)
+					print_array(nexec_mgr->out, calc.arr);
+				else
+					OutSink_write(nexec_mgr->out, num, snprintf(num, sizeof(num), "%d\n", calc.num));
+				exec_release(&calc);
 				break;
 		} 
 	}
+	else if (string_compare(curr_node->value, "run")) {
+		Node *group = find_group(nexec_mgr->node_mgr, curr_args->value);
+		int ret = -1;
+
+		if (group && curr_node->data->FuncNode.hosts) {
+			ret = run_on_hosts(nexec_mgr, group);
+		}
+		else if (group) {
+			ret = run_group(nexec_mgr, group);
+			nexec_mgr->curr_node = curr_node;
+		}
+		else {
+			Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_NO_GROUP, 0, 2, curr_args->value, curr_node->value);
+		}
+
+		return ret;
+	}
 	return 0;
 }
 
+// Start a command without a shell, in the context of the session if there is one. Return 1
+// when the transport of the session only runs commands through its shell.
+static int spawn_command(Session *session, char *line, Proc *proc, VAllocator *alloc) {
+	if (session)
+		return Session_spawn(session, line, proc);
+
+	return Proc_spawn(proc, line, alloc);
+}
+
+// Keep output of a copy of a hedged command, only the copy which wins is written.
+static void hedge_output(Proc *proc, const char *data, size_t len, void *ctx) {
+	(void) ctx;
+	VString_pushn(&proc->out, data, len);
+}
+
+static void hedge_done(Proc *proc, void *ctx) {
+	(void) proc;
+	*(int *) ctx = 1;
+}
+
+static long long clock_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Wait for a command of an idempotent group added to nothing yet, starting a second copy on
+// a spare session of the host once it runs longer than its peers allow. The first copy to
+// succeed is left in proc and the other killed, a copy which failed waits for the other.
+// Output is held until the command finished since either copy may win.
+static void group_cmd_hedged(NexecMgr *nexec_mgr, Session *session, Node *group, size_t idx, char *line, Proc *proc) {
+	EvLoop *loop = nexec_mgr->loop;
+	Session *spare = NULL;
+	Proc copy;
+	int done[2] = {0, 0};
+	int copies = 1;
+	int hedging = 1;
+	int winner = 0;
+	long long threshold = -1;
+
+	if (EvLoop_add(loop, proc, hedge_output, hedge_done, &done[0])) {
+		Proc_wait(proc);
+		return;
+	}
+
+	for (;;) {
+		if (done[0] && !proc->status)
+			break;
+		if (copies == 2 && done[1] && !copy.status) {
+			winner = 1;
+			break;
+		}
+		if (done[0] && (copies == 1 || done[1]))
+			break;
+
+		int timeout_ms = -1;
+
+		// Peers finish while this one runs, the threshold is looked up until there is one.
+		if (copies == 1 && hedging) {
+			if (threshold < 0)
+				threshold = Hedge_threshold(nexec_mgr->hedge, group, idx);
+
+			long long left = threshold < 0 ? VMEL_HEDGE_MIN_MS * 1000LL : threshold - (clock_us() - proc->start_us);
+
+			if (threshold >= 0 && left <= 0) {
+				// The copy starts where the first did but doesn't share its session.
+				if (session && nexec_mgr->pool)
+					spare = TransportPool_acquire_spare(nexec_mgr->pool, nexec_mgr->host ? nexec_mgr->host : VMEL_LOCAL_HOST);
+				if (spare)
+					Session_inherit(spare, session);
+
+				int spawned = spawn_command(spare ? spare : session, line, &copy, nexec_mgr->alloc);
+
+				if (spawned == 0 && EvLoop_add(loop, &copy, hedge_output, hedge_done, &done[1]) == 0) {
+					proc->hedged = 1;
+					copy.hedged = 1;
+					copies = 2;
+					continue;
+				}
+
+				// A copy which can't be watched is stopped again, the first copy runs on alone.
+				if (spawned == 0) {
+					kill(copy.pid, SIGKILL);
+					Proc_wait(&copy);
+				}
+				if (spawned != 1)
+					Proc_free(&copy);
+				hedging = 0;
+				continue;
+			}
+
+			timeout_ms = (int) (left / 1000) + 1;
+		}
+
+		if (EvLoop_run_once(loop, timeout_ms) < 0)
+			break;
+	}
+
+	// Loser is killed, its output dropped.
+	if (!done[0])
+		EvLoop_cancel(loop, proc);
+	if (copies == 2 && !done[1])
+		EvLoop_cancel(loop, &copy);
+	if (spare)
+		TransportPool_release(nexec_mgr->pool, spare);
+
+	// Peers are compared with how long a copy took to run, the winner is timed from the first start.
+	if (winner) {
+		Hedge_record(nexec_mgr->hedge, group, idx, copy.elapsed_us);
+		copy.elapsed_us += copy.start_us - proc->start_us;
+		copy.start_us = proc->start_us;
+		Proc_free(proc);
+		*proc = copy;
+		return;
+	}
+
+	if (copies == 2)
+		Proc_free(&copy);
+	if (!proc->status)
+		Hedge_record(nexec_mgr->hedge, group, idx, proc->elapsed_us);
+}
+
+// Commands of a parallel group running and whether one failed.
+typedef struct {
+	size_t running;
+	int failed;
+} GroupRun;
+
+// A command of a group, proc comes first so callbacks can find its command. The context of
+// callbacks changes once output is streamed, so the run is kept here. step is set when the
+// result may come from the step cache under key, kept then holds the output streamed so far.
+// mark identifies the command in the journal.
+typedef struct {
+	Proc proc;
+	char *line;
+	CmdClass cls;
+	int state;
+	GroupRun *run;
+	int step;
+	unsigned char key[SHA256_SIZE];
+	VString kept;
+	unsigned char mark[SHA256_SIZE];
+} GroupCmd;
+
+enum {E_CMD_WAITING, E_CMD_RUNNING, E_CMD_DONE, E_CMD_SKIPPED};
+
+// Step cache of a group declared with cache. Keys chain from one command to the next so a
+// changed command also runs every command after it, end follows the last command. steps
+// is set for commands which may come from the cache, intact while the declared outputs
+// still hold what the group left last time.
+typedef struct {
+	StepCache *cache;
+	char **outputs;
+	size_t output_ctr;
+	unsigned char *keys;
+	unsigned char *steps;
+	unsigned char end[SHA256_SIZE];
+	int intact;
+} GroupCache;
+
+// Write output of a running command to the program output as it arrives, keep it as well
+// when the command may be stored in the step cache. Each chunk is flushed so a long
+// command is watched live whatever the flush policy. Standard error is merged into the
+// same sink, keeping it in order with standard output and under the [host] line.
+static void group_cmd_output(Proc *proc, const char *data, size_t len, void *ctx) {
+	GroupCmd *cmd = (GroupCmd *) proc;
+
+	OutSink_write(ctx, data, len);
+	OutSink_flush(ctx);
+	if (cmd->step)
+		VString_pushn(&cmd->kept, data, len);
+}
+
+// Copy of a command or path of a group with variables of the script substituted.
+static char *group_line(NexecMgr *nexec_mgr, char *tmpl) {
+	exec_template(nexec_mgr, tmpl, NULL, 0);
+
+	char *line = VAlloc_alloc(nexec_mgr->alloc, nexec_mgr->buff.str_size + 1);
+	if (null_check(line, "group line")) return NULL;
+
+	memcpy(line, VString_str(&nexec_mgr->buff), nexec_mgr->buff.str_size + 1);
+	return line;
+}
+
+// Identity of the host a group runs on, hosts of different transports may share a name.
+static void group_host(NexecMgr *nexec_mgr, VString *host) {
+	VString_set(host, (char *) (nexec_mgr->pool ? nexec_mgr->pool->transport->name : "local"));
+	VString_pushc(host, ':');
+	VString_pushs(host, (char *) (nexec_mgr->host ? nexec_mgr->host : VMEL_LOCAL_HOST));
+}
+
+// Key every command of a group and check its outputs, cache is left NULL unless the group is cached.
+static void group_cache_init(NexecMgr *nexec_mgr, Node *group, GroupCache *gc) {
+	size_t input_ctr = group->data->GroupNode.input_ctr;
+	size_t output_ctr = group->data->GroupNode.output_ctr;
+	size_t cmd_ctr = 0;
+
+	gc->cache = group->data->GroupNode.cached ? nexec_mgr->steps : NULL;
+	gc->outputs = NULL;
+	gc->output_ctr = 0;
+	gc->keys = NULL;
+	gc->steps = NULL;
+	gc->intact = 0;
+
+	if (!gc->cache)
+		return;
+
+	for (Node *cmd = group->data->GroupNode.next; cmd && cmd != group; cmd = cmd->data->GroupNode.next)
+		cmd_ctr++;
+
+	char **inputs = VAlloc_calloc(nexec_mgr->alloc, (input_ctr + 1) * sizeof(char *));
+	gc->outputs = VAlloc_calloc(nexec_mgr->alloc, (output_ctr + 1) * sizeof(char *));
+	gc->keys = VAlloc_alloc(nexec_mgr->alloc, (cmd_ctr + 1) * SHA256_SIZE);
+	gc->steps = VAlloc_calloc(nexec_mgr->alloc, cmd_ctr + 1);
+
+	if (null_check(inputs, "group cache") || null_check(gc->outputs, "group cache")
+		|| null_check(gc->keys, "group cache") || null_check(gc->steps, "group cache")) {
+		gc->cache = NULL;
+		VAlloc_free(nexec_mgr->alloc, inputs);
+		return;
+	}
+
+	for (size_t i = 0; i < input_ctr && gc->cache; i++) {
+		if (!(inputs[i] = group_line(nexec_mgr, group->data->GroupNode.inputs[i])))
+			gc->cache = NULL;
+	}
+
+	for (; gc->output_ctr < output_ctr && gc->cache; gc->output_ctr++) {
+		if (!(gc->outputs[gc->output_ctr] = group_line(nexec_mgr, group->data->GroupNode.outputs[gc->output_ctr])))
+			gc->cache = NULL;
+	}
+
+	if (gc->cache) {
+		unsigned char digest[SHA256_SIZE];
+		VString host = VString_new(nexec_mgr->alloc);
+		CmdClass cls;
+		size_t idx = 0;
+
+		group_host(nexec_mgr, &host);
+		StepCache_inputs(inputs, input_ctr, digest);
+		CmdClass_init(&cls, nexec_mgr->alloc);
+
+		// Commands changing the shell always run so later ones find the directory and environment they expect.
+		for (Node *cmd = group->data->GroupNode.next; cmd && cmd != group; cmd = cmd->data->GroupNode.next, idx++) {
+			exec_template(nexec_mgr, cmd->value, NULL, 0);
+			StepCache_key(idx ? gc->keys + (idx - 1) * SHA256_SIZE : NULL, VString_str(&host), digest,
+				VString_str(&nexec_mgr->buff), gc->keys + idx * SHA256_SIZE);
+			CmdClass_scan(&cls, VString_str(&nexec_mgr->buff));
+			gc->steps[idx] = !cls.shell;
+		}
+
+		// Commands are never empty, so the key of an empty one can't belong to a step.
+		StepCache_key(idx ? gc->keys + (idx - 1) * SHA256_SIZE : NULL, VString_str(&host), digest, "", gc->end);
+		gc->intact = StepCache_check(gc->cache, gc->end, gc->outputs, gc->output_ctr);
+
+		CmdClass_free(&cls);
+		VString_free(&host);
+	}
+
+	for (size_t i = 0; i < input_ctr; i++)
+		VAlloc_free(nexec_mgr->alloc, inputs[i]);
+	VAlloc_free(nexec_mgr->alloc, inputs);
+}
+
+// Set up command idx of a group for the step cache.
+static void group_cache_step(GroupCache *gc, size_t idx, GroupCmd *cmd) {
+	cmd->step = gc->cache && gc->steps[idx];
+	VString_set(&cmd->kept, "");
+
+	if (cmd->step)
+		memcpy(cmd->key, gc->keys + idx * SHA256_SIZE, SHA256_SIZE);
+}
+
+// Take the result of a command from the step cache, return 1 if it needn't run. Once one
+// has to run, later commands run as well since they may depend on what it does.
+static int group_cache_replay(NexecMgr *nexec_mgr, GroupCache *gc, GroupCmd *cmd) {
+	if (!cmd->step || !gc->intact)
+		return 0;
+
+	Proc_init(&cmd->proc, !Proc_needs_shell(cmd->line), nexec_mgr->alloc);
+
+	if (StepCache_lookup(gc->cache, cmd->key, &cmd->proc.out)) {
+		cmd->proc.cached = 1;
+		return 1;
+	}
+
+	Proc_free(&cmd->proc);
+	gc->intact = 0;
+	return 0;
+}
+
+// Keep the result of a command which ran, with everything it printed.
+static void group_cache_store(GroupCache *gc, GroupCmd *cmd) {
+	if (!cmd->step || cmd->proc.cached)
+		return;
+
+	VString_pushn(&cmd->kept, VString_str(&cmd->proc.out), cmd->proc.out.str_size);
+	VString_pushn(&cmd->kept, VString_str(&cmd->proc.err), cmd->proc.err.str_size);
+	StepCache_store(gc->cache, cmd->key, cmd->proc.status, VString_str(&cmd->kept), cmd->kept.str_size);
+}
+
+// Record the outputs of a group which succeeded and release the cache state.
+static void group_cache_free(NexecMgr *nexec_mgr, GroupCache *gc, int failed) {
+	if (gc->cache && !failed)
+		StepCache_record(gc->cache, gc->end, gc->outputs, gc->output_ctr);
+
+	for (size_t i = 0; i < gc->output_ctr; i++)
+		VAlloc_free(nexec_mgr->alloc, gc->outputs[i]);
+
+	VAlloc_free(nexec_mgr->alloc, gc->outputs);
+	VAlloc_free(nexec_mgr->alloc, gc->keys);
+	VAlloc_free(nexec_mgr->alloc, gc->steps);
+}
+
+// Mark command idx of a group for the journal, return 1 if it succeeded in the run being
+// resumed. Commands changing the shell run again so later ones find the directory and
+// environment they expect.
+static int group_cmd_journal(NexecMgr *nexec_mgr, Node *group, size_t idx, GroupCmd *cmd) {
+	if (!nexec_mgr->journal)
+		return 0;
+
+	VString host = VString_new(nexec_mgr->alloc);
+	char num[24];
+	Sha256 ctx;
+
+	group_host(nexec_mgr, &host);
+	Sha256_init(&ctx);
+	Sha256_update(&ctx, VString_str(&host), host.str_size + 1);
+	Sha256_update(&ctx, group->value, strlen(group->value) + 1);
+	Sha256_update(&ctx, num, snprintf(num, sizeof(num), "%zu", idx) + 1);
+	Sha256_update(&ctx, cmd->line, strlen(cmd->line));
+	Sha256_final(&ctx, cmd->mark);
+	VString_free(&host);
+
+	if (!nexec_mgr->journal->cmd_ctr)
+		return 0;
+
+	CmdClass_scan(&cmd->cls, cmd->line);
+	return !cmd->cls.shell && Journal_skip(nexec_mgr->journal, nexec_mgr->stmt, cmd->mark);
+}
+
+static void group_cmd_done(Proc *proc, void *ctx) {
+	(void) ctx;
+	GroupCmd *cmd = (GroupCmd *) proc;
+	cmd->state = E_CMD_DONE;
+	cmd->run->running--;
+	if (proc->status)
+		cmd->run->failed = 1;
+}
+
+// Write what a finished command left and record it, return -1 if it failed. Standard error
+// follows standard output in the program output, see group_cmd_output().
+static int group_cmd_emit(NexecMgr *nexec_mgr, Node *group, GroupCmd *cmd) {
+	char status[16];
+
+	OutSink_write(nexec_mgr->out, VString_str(&cmd->proc.out), cmd->proc.out.str_size);
+	OutSink_write(nexec_mgr->out, VString_str(&cmd->proc.err), cmd->proc.err.str_size);
+
+	if (nexec_mgr->log)
+		ProcLog_add(nexec_mgr->log, group->value, nexec_mgr->host, &cmd->proc, cmd->line);
+
+	if (!cmd->proc.status) {
+		if (nexec_mgr->journal)
+			Journal_command(nexec_mgr->journal, nexec_mgr->stmt, cmd->mark);
+		return 0;
+	}
+
+	snprintf(status, sizeof(status), "%d", cmd->proc.status);
+	if (nexec_mgr->host)
+		Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_HOST_FAILED, 0, 4, cmd->line, group->value, nexec_mgr->host, status);
+	else
+		Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_CMD_FAILED, 0, 3, cmd->line, group->value, status);
+	return -1;
+}
+
+// Start a command of a parallel group. Ordered commands and those the transport can only
+// run through its shell are finished before returning, others are watched by the loop.
+static void group_cmd_start(NexecMgr *nexec_mgr, Session *session, GroupCache *gc, GroupCmd *cmd, GroupRun *run) {
+	int spawned;
+
+	cmd->run = run;
+
+	if (group_cache_replay(nexec_mgr, gc, cmd)) {
+		cmd->state = E_CMD_DONE;
+		return;
+	}
+
+	if (session && cmd->cls.ordered && Proc_needs_shell(cmd->line)) {
+		Session_exec(session, cmd->line, &cmd->proc);
+	}
+	else if ((spawned = spawn_command(session, cmd->line, &cmd->proc, nexec_mgr->alloc)) == 1) {
+		Session_exec(session, cmd->line, &cmd->proc);
+	}
+	else if (spawned == 0 && EvLoop_add(nexec_mgr->loop, &cmd->proc, NULL, group_cmd_done, NULL) == 0) {
+		cmd->state = E_CMD_RUNNING;
+		run->running++;
+		return;
+	}
+	else {
+		Proc_wait(&cmd->proc);
+	}
+
+	cmd->state = E_CMD_DONE;
+	if (cmd->proc.status)
+		run->failed = 1;
+}
+
+// Run the commands of a group concurrently where they don't conflict. A command starts once
+// every earlier command it conflicts with is done, output is written in the order of the group.
+static int group_parallel(NexecMgr *nexec_mgr, Node *group, Session *session) {
+	size_t cmd_ctr = 0;
+	for (Node *cmd = group->data->GroupNode.next; cmd && cmd != group; cmd = cmd->data->GroupNode.next)
+		cmd_ctr++;
+
+	GroupCmd *cmds = VAlloc_calloc(nexec_mgr->alloc, (cmd_ctr ? cmd_ctr : 1) * sizeof(GroupCmd));
+	if (null_check(cmds, "group parallel")) return -1;
+
+	GroupCache gc;
+	size_t idx = 0;
+	int ret = 0;
+
+	group_cache_init(nexec_mgr, group, &gc);
+
+	for (Node *cmd = group->data->GroupNode.next; cmd && cmd != group; cmd = cmd->data->GroupNode.next, idx++) {
+		// Lines are expanded up front since the buffer is reused by every template.
+		cmds[idx].line = group_line(nexec_mgr, cmd->value);
+		cmds[idx].kept = VString_new(nexec_mgr->alloc);
+		CmdClass_init(&cmds[idx].cls, nexec_mgr->alloc);
+
+		if (!cmds[idx].line) {
+			cmds[idx].cls.ordered = 1;
+			cmds[idx].state = E_CMD_SKIPPED;
+			ret = -1;
+			continue;
+		}
+
+		CmdClass_scan(&cmds[idx].cls, cmds[idx].line);
+		group_cache_step(&gc, idx, &cmds[idx]);
+
+		// Commands which succeeded before a resume are never started, nor written.
+		if (group_cmd_journal(nexec_mgr, group, idx, &cmds[idx]))
+			cmds[idx].state = E_CMD_SKIPPED;
+	}
+
+	unsigned int jobs = group->data->GroupNode.jobs ? group->data->GroupNode.jobs : VMEL_GROUP_JOBS;
+	GroupRun run = {0, 0};
+	size_t next = 0;
+	int streamed = 0;
+
+	while (next < cmd_ctr) {
+		// Once a command failed nothing else is started, those running are waited for.
+		if (run.failed) {
+			for (size_t i = next; i < cmd_ctr; i++) {
+				if (cmds[i].state == E_CMD_WAITING)
+					cmds[i].state = E_CMD_SKIPPED;
+			}
+		}
+
+		// Finished commands are written in order.
+		while (next < cmd_ctr && cmds[next].state >= E_CMD_DONE) {
+			if (cmds[next].state == E_CMD_DONE) {
+				group_cache_store(&gc, &cmds[next]);
+				if (group_cmd_emit(nexec_mgr, group, &cmds[next]))
+					ret = -1;
+			}
+			next++;
+			streamed = 0;
+		}
+
+		if (next == cmd_ctr)
+			break;
+
+		int started = 0;
+		for (size_t i = next; i < cmd_ctr && run.running < jobs && !run.failed; i++) {
+			if (cmds[i].state != E_CMD_WAITING)
+				continue;
+
+			// Nothing passes an ordered command, which itself waits for everything before it.
+			if (cmds[i].cls.ordered && i != next)
+				break;
+
+			size_t j = next;
+			while (j < i && (cmds[j].state >= E_CMD_DONE || !CmdClass_conflicts(&cmds[j].cls, &cmds[i].cls)))
+				j++;
+			if (j < i)
+				continue;
+
+			group_cmd_start(nexec_mgr, session, &gc, &cmds[i], &run);
+			started = 1;
+
+			if (cmds[i].cls.ordered)
+				break;
+		}
+
+		if (started && cmds[next].state >= E_CMD_DONE)
+			continue;
+
+		// The first command not written yet streams its output, others are buffered until their turn.
+		if (!streamed && cmds[next].state == E_CMD_RUNNING) {
+			OutSink_flush(nexec_mgr->out);
+			EvLoop_stream(nexec_mgr->loop, &cmds[next].proc, group_cmd_output, nexec_mgr->out);
+			streamed = 1;
+		}
+
+		if (run.running)
+			EvLoop_run_once(nexec_mgr->loop, -1);
+	}
+
+	for (size_t i = 0; i < cmd_ctr; i++) {
+		if (cmds[i].state == E_CMD_DONE)
+			Proc_free(&cmds[i].proc);
+		CmdClass_free(&cmds[i].cls);
+		VString_free(&cmds[i].kept);
+		VAlloc_free(nexec_mgr->alloc, cmds[i].line);
+	}
+
+	group_cache_free(nexec_mgr, &gc, ret);
+	VAlloc_free(nexec_mgr->alloc, cmds);
+	return ret;
+}
+
 int Nexec_group_node(NexecMgr *nexec_mgr) {
 	if (null_check(nexec_mgr, "nexec group node")) return -1;
+
+	if (!nexec_mgr->loop)
+		nexec_mgr->loop = EvLoop_new(nexec_mgr->alloc, 0);
+
+	Node *group = nexec_mgr->curr_node;
+
+	// Held until the group ends so groups on one host don't interleave, unless the caller holds one for us.
+	Session *held = nexec_mgr->session;
+	Session *session = held;
+	if (!session && nexec_mgr->pool)
+		session = TransportPool_acquire(nexec_mgr->pool, nexec_mgr->host ? nexec_mgr->host : VMEL_LOCAL_HOST);
+
+	if (group->data->GroupNode.parallel) {
+		int ret = group_parallel(nexec_mgr, group, session);
+	
+		if (session && !held)
+			TransportPool_release(nexec_mgr->pool, session);
+		return ret;
+	}
+
+	// Commands form a circular list which ends at the group itself.
+	Node *cmd = group->data->GroupNode.next;
+	GroupCache gc;
+	GroupCmd step;
+	size_t idx = 0;
+	int spawned;
+	int ret = 0;
+	// Copies of commands may only be started when running one twice does no harm.
+	int hedged = group->data->GroupNode.idempotent && nexec_mgr->hedge;
+
+	group_cache_init(nexec_mgr, group, &gc);
+	step.kept = VString_new(nexec_mgr->alloc);
+	CmdClass_init(&step.cls, nexec_mgr->alloc);
+
+	for (; cmd && cmd != group; cmd = cmd->data->GroupNode.next, idx++) {
+		// Variables of the script are substituted, anything else is left for the shell.
+		exec_template(nexec_mgr, cmd->value, NULL, 0);
+		step.line = VString_str(&nexec_mgr->buff);
+		group_cache_step(&gc, idx, &step);
+
+		if (group_cmd_journal(nexec_mgr, group, idx, &step))
+			continue;
+
+		if (!group_cache_replay(nexec_mgr, &gc, &step)) {
+			int shell = session && Proc_needs_shell(step.line);
+			// Hedged commands which leave the shell alone may start outside it like any other.
+			if (shell && hedged && CmdClass_scan(&step.cls, step.line) == 0 && !step.cls.ordered)
+				shell = 0;
+
+			// Shell syntax goes through the session so directory and environment carry over.
+			if (shell)
+				Session_stream(session, step.line, &step.proc, group_cmd_output, nexec_mgr->out);
+			else if ((spawned = spawn_command(session, step.line, &step.proc, nexec_mgr->alloc)) == 1)
+				Session_stream(session, step.line, &step.proc, group_cmd_output, nexec_mgr->out);
+			else if (spawned == 0 && hedged)
+				group_cmd_hedged(nexec_mgr, session, group, idx, step.line, &step.proc);
+			else if (spawned == 0 && EvLoop_add(nexec_mgr->loop, &step.proc, group_cmd_output, NULL, nexec_mgr->out) == 0)
+				EvLoop_wait(nexec_mgr->loop, &step.proc);
+			else
+				Proc_wait(&step.proc);
+		}
+
+		// Output is streamed as it arrives, anything left in proc was captured without the loop.
+		group_cache_store(&gc, &step);
+		int failed = group_cmd_emit(nexec_mgr, group, &step);
+		Proc_free(&step.proc);
+
+		// Later commands usually depend on earlier ones, stop at the first failure.
+		if (failed) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if (session && !held)
+		TransportPool_release(nexec_mgr->pool, session);
+
+	CmdClass_free(&step.cls);
+	VString_free(&step.kept);
+	group_cache_free(nexec_mgr, &gc, ret);
+	return ret;
+}
+
+int Nexec_host(NexecMgr *nexec_mgr, Node *group, VArray *hosts, size_t idx) {
+	if (null_check(nexec_mgr, "nexec host") || null_check(hosts, "nexec host")) return -1;
+
+	const char *host = VArray_str_at(hosts, idx);
+
+	// Output of every host starts with its name.
+	OutSink_write(nexec_mgr->out, "[", 1);
+	OutSink_write(nexec_mgr->out, host, strlen(host));
+	OutSink_write(nexec_mgr->out, "]\n", 2);
+
+	nexec_mgr->host = host;
+	int ret = run_group(nexec_mgr, group);
+	nexec_mgr->host = NULL;
+	return ret;
+}
+
+int Nexec_dag_group(NexecMgr *nexec_mgr, DagRun *run, size_t idx, long blocker) {
+	if (null_check(nexec_mgr, "nexec dag group") || null_check(nexec_mgr->dag, "nexec dag group")) return -1;
+
+	GroupDag *dag = nexec_mgr->dag;
+	Node *group = dag->groups[idx].group;
+
+	if (blocker >= 0) {
+		Error_add_record(nexec_mgr->err_handle, Error_Templates, ERR_GROUP_SKIPPED, 0, 2, group->value, dag->groups[blocker].group->value);
+		return -1;
+	}
+
+	struct timespec start;
+	struct timespec end;
+
+	Session *outer = nexec_mgr->session;
+	Session *session = run ? run->sessions[run->lane[idx]] : NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	nexec_mgr->curr_node = group;
+	nexec_mgr->session = session;
+	int ret = Nexec_group_node(nexec_mgr);
+	nexec_mgr->session = outer;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// Users starting a shell of their own begin where this group left off, before any of them is ready.
+	for (size_t u = 0; session && u < dag->groups[idx].user_ctr; u++) {
+		size_t user = dag->groups[idx].users[u];
+		if (run->seed[user] == (long) idx)
+			Session_inherit(run->sessions[run->lane[user]], session);
+	}
+
+	// A failed group stopped early, its time says nothing about how long it takes.
+	if (ret == 0 && nexec_mgr->history)
+		DagHistory_record(nexec_mgr->history, idx, (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000);
+
+	return ret;
+}
+
+int Nexec_iteration(NexecMgr *nexec_mgr, Node *loop, VArray *items, size_t idx) {
+	if (null_check(nexec_mgr, "nexec iteration") || null_check(items, "nexec iteration")) return -1;
+
+	char num[16];
+	char *val = num;
+
+	if (items->kind == VARRAY_INT)
+		snprintf(num, sizeof(num), "%d", items->ints[idx]);
+	else
+		val = (char *) VArray_str_at(items, idx);
+
+	SyTable_clear(nexec_mgr->sy_table);
+	SyTable_add_symbol(nexec_mgr->sy_table, loop->data->ForeachNode.var->value, val, 0, E_IDN_TYPE);
+
+	for (size_t i = 0; i < loop->data->ForeachNode.body_ctr; i++)
+		Nexec_exec(nexec_mgr, loop->data->ForeachNode.body[i]);
+
+	return 0;
+}
+
+int Nexec_foreach_node(NexecMgr *nexec_mgr) {
+	if (null_check(nexec_mgr, "nexec foreach node")) return -1;
+
+	Node *loop = nexec_mgr->curr_node;
+	ExecVal items;
+
+	exec_value(nexec_mgr, loop->data->ForeachNode.items, &items);
+	exec_as_array(nexec_mgr, &items);
+	if (!items.arr) return -1;
+
+	// Without a limit use the threads given to the run, or every cpu.
+	unsigned int jobs = loop->data->ForeachNode.jobs;
+	if (jobs == 0 && nexec_mgr->jobs > 1) {
+		jobs = nexec_mgr->jobs;
+	}
+	else if (jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+
+	if (loop->data->ForeachNode.parallel && nexec_mgr->threaded && jobs > 1 && items.arr->len > 1) {
+		Parallel_foreach(nexec_mgr, loop, items.arr, jobs);
+	}
+	else {
+		SyTable *outer = nexec_mgr->sy_table;
+		nexec_mgr->sy_table = SyTable_new_frame(outer, outer->alloc);
+
+		for (size_t i = 0; i < items.arr->len; i++)
+			Nexec_iteration(nexec_mgr, loop, items.arr, i);
+
+		SyTable_free(nexec_mgr->sy_table);
+		nexec_mgr->sy_table = outer;
+	}
+
+	nexec_mgr->curr_node = loop;
+	exec_release(&items);
 	return 0;
 }
 
@@ -239,6 +1678,13 @@ int Nexec_assignment_node(NexecMgr *nexec_mgr) {
 	Node *asn_left_node = nexec_mgr->curr_node->data->AsnStmtNode.left;
 	// Right child node of assignment node.
 	Node *asn_right_node = nexec_mgr->curr_node->data->AsnStmtNode.right;
+
+	// Values set by the host win over the script.
+	if (nexec_mgr->pinned) {
+		Symbol *target = SyTable_get_symbol(nexec_mgr->sy_table, asn_left_node->value);
+		if (target && target->pinned)
+			return 0;
+	}
 	
 	// Determine which execution path to take based on the right side of assignment.
 	if (asn_right_node->type == E_INTEGER_NODE || asn_right_node->type == E_STRING_NODE) {
@@ -247,23 +1693,49 @@ int Nexec_assignment_node(NexecMgr *nexec_mgr) {
 		SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, asn_right_node->value);
 	}
 	else if (asn_right_node->type == E_IDENTIFIER_NODE) {	
-		// First expand variable value from symbol table.
-		VString_set(&nexec_mgr->buff, expand_variable(nexec_mgr->sy_table, asn_right_node->value));
-		if (nexec_mgr->buff.str)
-			SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, nexec_mgr->buff.str);
+		Symbol *sy = nexec_read(nexec_mgr, asn_right_node->value);
+
+		// Share large values rather than copying.
+		if (sy && sy->arr) {
+			SyTable_update_symbol_array(nexec_mgr->sy_table, asn_left_node->value, VArray_copy(sy->arr, nexec_mgr->sy_table->alloc));
+		}
+		else if (sy && !sy->val && sy->rope.root) {
+			VRope rope = VRope_new(nexec_mgr->sy_table->alloc);
+			VRope_append_rope(&rope, &sy->rope);
+			SyTable_update_symbol_rope(nexec_mgr->sy_table, asn_left_node->value, &rope);
+		}
+		else if (Symbol_value(sy)) {
+			SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, sy->val);
+		}
 	}
 	//TODO: Since no concept of ternary operators we can group storage of below.
-	else if (Node_is_binop(asn_right_node)|| Node_is_compare(asn_right_node)) {
+	else if (Node_is_binop(asn_right_node) || Node_is_compare(asn_right_node)
+		|| asn_right_node->type == E_ARRAY_NODE || asn_right_node->type == E_REDUCE_NODE
+		|| asn_right_node->type == E_SETOP_NODE) {
 		
 		// Derive final value from operation node.
-		int calc = exec_expression(nexec_mgr, asn_right_node); 
-		// Convert the integer to string.
-		expr_to_string(nexec_mgr, calc);
-		SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, nexec_mgr->buff.str);
+		ExecVal calc;
+		exec_value(nexec_mgr, asn_right_node, &calc);
+
+		if (calc.arr) {
+			// Symbol takes the array, borrowed ones are copied.
+			VArray *arr = calc.owned ? calc.arr : VArray_copy(calc.arr, nexec_mgr->sy_table->alloc);
+			calc.owned = 0;
+			SyTable_update_symbol_array(nexec_mgr->sy_table, asn_left_node->value, arr);
+		}
+		else {
+			// Convert the integer to string.
+			expr_to_string(nexec_mgr, calc.num);
+			SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, VString_str(&nexec_mgr->buff));
+		}
 	}
 	else if (asn_right_node->type == E_MIXSTR_NODE) {
-		exec_mixed_string(asn_right_node->value, nexec_mgr);
-		SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, nexec_mgr->buff.str);
+		VRope rope = VRope_new(nexec_mgr->sy_table->alloc);
+
+		if (exec_template(nexec_mgr, asn_right_node->value, &rope, 1))
+			SyTable_update_symbol_rope(nexec_mgr->sy_table, asn_left_node->value, &rope);
+		else
+			SyTable_update_symbol(nexec_mgr->sy_table, asn_left_node->value, VString_str(&nexec_mgr->buff));
 	}
 
 	return 0;
@@ -273,11 +1745,10 @@ NexecMgr *Nexec_init(SyTable *sy_table, NodeMgr *node_mgr, Error *err_handle) {
 	if (null_check(sy_table, "nexec init") || null_check(node_mgr, "nexec init")) return NULL;
 
 	// Setup wrapper structs.
-	NexecMgr *nexec_mgr = NexecMgr_new();
+	NexecMgr *nexec_mgr = NexecMgr_new(sy_table->alloc);
 	nexec_mgr->node_mgr = node_mgr;
 	nexec_mgr->sy_table = sy_table;
 	nexec_mgr->err_handle = err_handle;
-	nexec_mgr->buff = VString_new();
 
 	return nexec_mgr;
 }
@@ -286,6 +1757,8 @@ int Nexec_exec(NexecMgr *nexec_mgr, Node *node) {
 	if (null_check(node ,"nexec exec") || null_check(node ,"nexec exec")) return -1;
 	
 	nexec_mgr->curr_node = node;
+	STATS_INC(STAT_EXEC, nodes);
+
 	switch (node->type) {
 			case E_FUNC_NODE:
 				Nexec_func_node(nexec_mgr);
@@ -293,10 +1766,20 @@ int Nexec_exec(NexecMgr *nexec_mgr, Node *node) {
 			case E_EQUAL_NODE:
 				Nexec_assignment_node(nexec_mgr);
 				break;
+			case E_FOREACH_NODE:
+				Nexec_foreach_node(nexec_mgr);
+				break;
 			default:
 				break;
 	}
 	
-	Error_print_all(nexec_mgr->err_handle);
+	// Only report errors raised by this statement, after the output which preceded them.
+	if (!nexec_mgr->defer_errors && nexec_mgr->err_handle->error_ctr > nexec_mgr->err_handle->error_flushed) {
+		OutSink_flush(nexec_mgr->out);
+		Error_flush(nexec_mgr->err_handle, stdout);
+		fflush(stdout);
+	}
+
+	OutSink_end_statement(nexec_mgr->out);
 	return 0;
 }
@@ -4,12 +4,16 @@
 #include "node.h"
 #include "utils.h"
 #include "conf.h"
+#include "stats.h"
 
-NodeMgr *NodeMgr_new(void) {
-	NodeMgr *node_mgr = malloc(sizeof(NodeMgr)) ;  
+NodeMgr *NodeMgr_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_PARSER, alloc);
+	NodeMgr *node_mgr = VAlloc_alloc(alloc, sizeof(NodeMgr)) ;  
     node_mgr->nodes_ctr = 0;
     node_mgr->nodes_cap = INIT_NODEMGR_SIZE;
-    node_mgr->nodes = malloc(node_mgr->nodes_cap * sizeof(Node *));
+    node_mgr->nodes = VAlloc_alloc(alloc, node_mgr->nodes_cap * sizeof(Node *));
+    node_mgr->cons = NULL;
+    node_mgr->alloc = alloc;
     return node_mgr;
 }
 
@@ -29,92 +33,127 @@ static int is_array_node(Node *n) {
 	return 	n->type ==  E_ARRAY_NODE;
 }
 
-static void node_free(Node *node) {
+static void node_free(VAllocator *alloc, Node *node) {
 	if (!node) 
 		return;
+
+	// Shared by other trees so leave for last owner.
+	if (--node->refs > 0)
+		return;
 	
 	if (Node_is_binop(node) || Node_is_compare(node)) {
-		node_free(node->data->BinExpNode.left);
-		node_free(node->data->BinExpNode.right);
-		free(node->data);
+		node_free(alloc, node->data->BinExpNode.left);
+		node_free(alloc, node->data->BinExpNode.right);
+		VAlloc_free(alloc, node->data);
 	}
 	else if (is_array_node(node)) {
-		for (size_t i = 0; i < node->data->ArrayNode.dctr; i++) {
-			if (is_array_node(node->data->ArrayNode.items[i])) {
-				node_free(node->data->ArrayNode.items[i]);	
-			}
-			else {
-				free(node->data->ArrayNode.items[i]);
-			}
-		} 	
+		ArrStore *store = node->data->ArrayNode.store;
+
+		// Only nested arrays are nodes, other elements go with the store.
+		if (store) {
+			for (size_t i = 0; i < store->node_ctr; i++)
+				node_free(alloc, store->nodes[i]);
+			ArrStore_free(store);
+		}
+
+		VAlloc_free(alloc, node->data);	
+	}
+	else if (node->type == E_REDUCE_NODE) {
+		node_free(alloc, node->data->ReduceNode.args);
+		VAlloc_free(alloc, node->data);
+	}
+	else if (node->type == E_SETOP_NODE) {
+		node_free(alloc, node->data->SetOpNode.left);
+		node_free(alloc, node->data->SetOpNode.right);
+		VAlloc_free(alloc, node->data);
+	}
+
+	VAlloc_free(alloc, node);
+}
 
-		free(node->data->ArrayNode.items);
-		free(node->data);	
+// Free a statement along with the statements nested inside it.
+static void stmt_free(VAllocator *alloc, Node *root_node) {
+	Node *itr = NULL;
+	Node *prev = NULL;
+
+	switch (root_node->type) {
+		case E_EQUAL_NODE:
+			itr = root_node->data->AsnStmtNode.right;
+			node_free(alloc, root_node->data->AsnStmtNode.left);
+			node_free(alloc, itr);
+			break;
+		case E_FUNC_NODE:
+			node_free(alloc, root_node->data->FuncNode.args);
+			node_free(alloc, root_node->data->FuncNode.hosts);
+			break;
+		case E_GROUP_NODE:
+			itr = root_node->data->GroupNode.next;
+			while (itr && itr != root_node) {
+				prev = itr;
+				itr = itr->data->GroupNode.next;
+				VAlloc_free(alloc, prev->data);
+				VAlloc_free(alloc, prev);
+			}
+			VAlloc_free(alloc, root_node->data->GroupNode.needs);
+			VAlloc_free(alloc, root_node->data->GroupNode.inputs);
+			VAlloc_free(alloc, root_node->data->GroupNode.outputs);
+			break;
+		case E_FOREACH_NODE:
+			node_free(alloc, root_node->data->ForeachNode.var);
+			node_free(alloc, root_node->data->ForeachNode.items);
+			for (size_t i = 0; i < root_node->data->ForeachNode.body_ctr; i++)
+				stmt_free(alloc, root_node->data->ForeachNode.body[i]);
+			VAlloc_free(alloc, root_node->data->ForeachNode.body);
+			break;
+		default:
+			break;
 	}
 
-	free(node);
+	/**
+	 * Free root node of every AST.
+	 *             =   ---> free this node.
+	 *           /   \
+	 *          /     \
+	 *          s      +
+	 *                / \
+	 *               /   \
+	 *              1     3
+	 */               
+	VAlloc_free(alloc, root_node->data);
+	VAlloc_free(alloc, root_node);
 }
 
 int NodeMgr_free(NodeMgr *node_mgr) {
     if (null_check(node_mgr,"nodemgr free")) return -1;
 
-    Node *root_node = NULL;     
-    Node *itr = NULL;
-    Node *prev = NULL;
-    
-    for (size_t n = 0; n < node_mgr->nodes_ctr; n++) {
-		root_node = node_mgr->nodes[n];
-        switch (root_node->type) {
-            case E_EQUAL_NODE:
-				itr = root_node->data->AsnStmtNode.right;
-				free(root_node->data->AsnStmtNode.left);
-				node_free(itr);
-                break;
-			case E_FUNC_NODE:
-				node_free(root_node->data->FuncNode.args);
-				break;
-			case E_GROUP_NODE:
-                itr = root_node->data->GroupNode.next;
-				while (itr && itr != root_node) {
-                    prev = itr;
-                    itr = itr->data->GroupNode.next;
-                    free(prev->data);
-                    free(prev);
-				}
-                break;
-            default:
-                break;
-        }
-
-        /**
-         * Free root node of every AST.
-         *             =   ---> free this node.
-         *           /   \
-         *          /     \
-         *          s      +
-         *                / \
-         *               /   \
-         *              1     3
-         */               
-        free(root_node->data);
-        free(root_node);
-    }
-
-	free(node_mgr->nodes);
-    free(node_mgr);
+    VAllocator *alloc = node_mgr->alloc;
+
+    for (size_t n = 0; n < node_mgr->nodes_ctr; n++)
+		stmt_free(alloc, node_mgr->nodes[n]);
+
+	if (node_mgr->cons) {
+		VAlloc_free(alloc, node_mgr->cons->slots);
+		VAlloc_free(alloc, node_mgr->cons);
+	}
+
+	VAlloc_free(alloc, node_mgr->nodes);
+    VAlloc_free(alloc, node_mgr);
     return 0;
 }
 
-Node *Node_new(int wdata) {
-    Node *n = malloc(sizeof(struct Node));
+Node *Node_new(VAllocator *alloc, int wdata) {
+    Node *n = VAlloc_alloc(alloc, sizeof(struct Node));
     
-    // Malloc data if needed.
+    // Allocate data if needed.
     if (wdata)
-        n->data = malloc(sizeof(union SyntaxNode));
+        n->data = VAlloc_alloc(alloc, sizeof(union SyntaxNode));
     else
         n->data = NULL;
     
     n->depth = 0;
+    n->refs = 1;
+    n->hash = 0;
+    n->value = NULL;
     n->type = E_EOF_NODE;
     return n;
 }
@@ -123,7 +162,7 @@ Node **grow_nodes(NodeMgr *node_mgr) {
     if (null_check(node_mgr, "nodemgr grow")) return NULL;
 
     node_mgr->nodes_cap *= 2;
-    Node **nodes_new = realloc(node_mgr->nodes, sizeof(Node *) * node_mgr->nodes_cap);		
+    Node **nodes_new = VAlloc_realloc(node_mgr->alloc, node_mgr->nodes, sizeof(Node *) * node_mgr->nodes_cap);		
     return nodes_new;
 }
 
@@ -152,3 +191,126 @@ Node *NodeMgr_find_node(NodeMgr *node_mgr, char *value) {
 
 	return itr;
 }
+
+// Only leaves and operations are immutable once parsed.
+static int node_is_consable(Node *n) {
+	if (n->type == E_INTEGER_NODE || n->type == E_STRING_NODE
+		|| n->type == E_MIXSTR_NODE || n->type == E_IDENTIFIER_NODE)
+		return n->value != NULL;
+
+	if (Node_is_binop(n) || Node_is_compare(n))
+		return n->data->BinExpNode.left && n->data->BinExpNode.right;
+
+	return 0;
+}
+
+// Structural hash of node, children are assumed to be hashed already.
+static unsigned long node_hash(Node *n) {
+	unsigned long hash = 14695981039346656037UL ^ (unsigned long) n->type;
+	hash *= 1099511628211UL;
+
+	if (Node_is_binop(n) || Node_is_compare(n)) {
+		hash = (hash ^ n->data->BinExpNode.left->hash) * 1099511628211UL;
+		hash = (hash ^ n->data->BinExpNode.right->hash) * 1099511628211UL;
+		return hash;
+	}
+
+	return string_hash(n->value, hash);
+}
+
+// Determine if two nodes are structurally identical.
+static int node_equals(Node *a, Node *b) {
+	if (a->type != b->type || a->hash != b->hash)
+		return 0;
+
+	if (Node_is_binop(a) || Node_is_compare(a))
+		return a->data->BinExpNode.left == b->data->BinExpNode.left
+			&& a->data->BinExpNode.right == b->data->BinExpNode.right;
+
+	return string_compare(a->value, b->value);
+}
+
+// Double the number of slots and rehash existing entries.
+static int grow_cons(NodeMgr *node_mgr) {
+	NodeCons *cons = node_mgr->cons;
+	size_t n_cap = cons->slot_cap * 2;
+	Node **n_slots = VAlloc_calloc(node_mgr->alloc, n_cap * sizeof(Node *));
+
+	if (null_check(n_slots, "grow cons")) return -1;
+
+	for (size_t i = 0; i < cons->slot_cap; i++) {
+		if (!cons->slots[i])
+			continue;
+		size_t idx = cons->slots[i]->hash & (n_cap - 1);
+		while (n_slots[idx])
+			idx = (idx + 1) & (n_cap - 1);
+		n_slots[idx] = cons->slots[i];
+	}
+
+	VAlloc_free(node_mgr->alloc, cons->slots);
+	cons->slots = n_slots;
+	cons->slot_cap = n_cap;
+	return 0;
+}
+
+int NodeMgr_enable_cons(NodeMgr *node_mgr) {
+	if (null_check(node_mgr, "nodemgr enable cons")) return -1;
+	if (node_mgr->cons) return 0;
+
+	NodeCons *cons = VAlloc_alloc(node_mgr->alloc, sizeof(NodeCons));
+	cons->slot_cap = INIT_NODECONS_SIZE;
+	cons->slot_ctr = 0;
+	cons->hits = 0;
+	cons->bytes_saved = 0;
+	cons->slots = VAlloc_calloc(node_mgr->alloc, cons->slot_cap * sizeof(Node *));
+	node_mgr->cons = cons;
+	return 0;
+}
+
+Node *NodeMgr_cons_node(NodeMgr *node_mgr, Node *node) {
+	if (!node || !node_is_consable(node))
+		return node;
+
+	// Hashed even without consing so later passes can tell identical subtrees apart.
+	node->hash = node_hash(node);
+
+	if (!node_mgr || !node_mgr->cons)
+		return node;
+
+	NodeCons *cons = node_mgr->cons;
+	size_t idx = node->hash & (cons->slot_cap - 1);
+
+	while (cons->slots[idx]) {
+		Node *match = cons->slots[idx];
+
+		// Already shared.
+		if (match == node)
+			return node;
+
+		if (node_equals(match, node)) {
+			cons->hits++;
+			cons->bytes_saved += sizeof(struct Node);
+			match->refs++;
+
+			// Children are now referenced through match.
+			if (node->data) {
+				cons->bytes_saved += sizeof(union SyntaxNode);
+				node_free(node_mgr->alloc, node->data->BinExpNode.left);
+				node_free(node_mgr->alloc, node->data->BinExpNode.right);
+				VAlloc_free(node_mgr->alloc, node->data);
+			}
+			VAlloc_free(node_mgr->alloc, node);
+			return match;
+		}
+		idx = (idx + 1) & (cons->slot_cap - 1);
+	}
+
+	cons->slots[idx] = node;
+	cons->slot_ctr++;
+
+	// Keep load factor below 70%.
+	if (cons->slot_ctr * 10 >= cons->slot_cap * 7)
+		grow_cons(node_mgr);
+
+	return node;
+}
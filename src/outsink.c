@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "outsink.h"
+#include "conf.h"
+#include "utils.h"
+#include "stats.h"
+
+// Rope pieces from this length are referenced instead of copied.
+#define OUTSINK_REF_MIN 1024
+
+OutSink *OutSink_new(VAllocator *alloc, int fd, size_t cap, enum SinkFlush policy) {
+	alloc = STATS_ALLOC(STAT_EXEC, alloc);
+	OutSink *sink = VAlloc_alloc(alloc, sizeof(OutSink));
+	if (null_check(sink, "outsink new")) return NULL;
+
+	if (cap == 0)
+		cap = VMEL_OUT_BUFFER_SIZE;
+
+	sink->buf = VAlloc_alloc(alloc, cap);
+	if (null_check(sink->buf, "outsink new")) {
+		VAlloc_free(alloc, sink);
+		return NULL;
+	}
+
+	sink->fd = fd;
+	sink->policy = policy;
+	sink->len = 0;
+	sink->cap = cap;
+	sink->seg_start = 0;
+	sink->iov_ctr = 0;
+	sink->written = 0;
+	sink->error = 0;
+	sink->alloc = alloc;
+	return sink;
+}
+
+// Buffer grows rather than being written when capturing or flushing at exit.
+static int sink_grows(OutSink *sink) {
+	return sink->fd < 0 || sink->policy == SINK_FLUSH_EXIT;
+}
+
+static int sink_grow(OutSink *sink, size_t need) {
+	size_t n_cap = sink->cap;
+	while (n_cap - sink->len < need)
+		n_cap *= 2;
+
+	char *n_buf = VAlloc_realloc(sink->alloc, sink->buf, n_cap);
+	if (null_check(n_buf, "outsink grow")) return -1;
+
+	// Queued segments point into the old buffer.
+	for (int i = 0; i < sink->iov_ctr; i++) {
+		char *base = sink->iov[i].iov_base;
+		if (base >= sink->buf && base < sink->buf + sink->cap)
+			sink->iov[i].iov_base = n_buf + (base - sink->buf);
+	}
+
+	sink->buf = n_buf;
+	sink->cap = n_cap;
+	return 0;
+}
+
+// Queue bytes of buf which were appended since the last queued segment.
+static void sink_close_segment(OutSink *sink) {
+	if (sink->len == sink->seg_start)
+		return;
+
+	sink->iov[sink->iov_ctr].iov_base = sink->buf + sink->seg_start;
+	sink->iov[sink->iov_ctr].iov_len = sink->len - sink->seg_start;
+	sink->iov_ctr++;
+	sink->seg_start = sink->len;
+}
+
+// Write every queued segment, retrying on partial writes.
+static int sink_writev(OutSink *sink) {
+	struct iovec *iov = sink->iov;
+	int cnt = sink->iov_ctr;
+
+	while (cnt > 0) {
+		ssize_t n = writev(sink->fd, iov, cnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			sink->error = errno;
+			return -1;
+		}
+
+		sink->written += n;
+
+		while (cnt > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+
+		if (cnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return 0;
+}
+
+int OutSink_flush(OutSink *sink) {
+	if (null_check(sink, "outsink flush")) return -1;
+
+	if (sink->fd < 0)
+		return 0;
+
+	sink_close_segment(sink);
+
+	int ret = sink->error ? -1 : sink_writev(sink);
+
+	// Pending output is dropped on failure so a broken fd doesn't grow the buffer forever.
+	sink->len = 0;
+	sink->seg_start = 0;
+	sink->iov_ctr = 0;
+	return ret;
+}
+
+// Queue str without copying, caller must flush before str is released.
+static int sink_ref(OutSink *sink, const char *str, size_t len) {
+	// Room is always kept for a buffer segment, the reference and a final segment.
+	if (sink->iov_ctr > OUTSINK_IOV - 3 && OutSink_flush(sink))
+		return -1;
+
+	sink_close_segment(sink);
+	sink->iov[sink->iov_ctr].iov_base = (void *) str;
+	sink->iov[sink->iov_ctr].iov_len = len;
+	sink->iov_ctr++;
+	return 0;
+}
+
+int OutSink_write(OutSink *sink, const char *str, size_t len) {
+	if (null_check(sink, "outsink write") || !str) return -1;
+
+	if (sink->cap - sink->len < len) {
+		if (sink_grows(sink)) {
+			if (sink_grow(sink, len))
+				return -1;
+		}
+		else {
+			if (OutSink_flush(sink))
+				return -1;
+
+			// Too large to ever fit, hand it to the kernel directly.
+			if (len > sink->cap)
+				return sink_ref(sink, str, len) || OutSink_flush(sink) ? -1 : 0;
+		}
+	}
+
+	memcpy(sink->buf + sink->len, str, len);
+	sink->len += len;
+	return 0;
+}
+
+int OutSink_puts(OutSink *sink, const char *str) {
+	if (!str) return -1;
+
+	if (OutSink_write(sink, str, strlen(str)))
+		return -1;
+	return OutSink_write(sink, "\n", 1);
+}
+
+static int sink_piece(const char *str, size_t len, void *ctx) {
+	OutSink *sink = ctx;
+
+	if (len >= OUTSINK_REF_MIN && !sink_grows(sink))
+		return sink_ref(sink, str, len);
+	return OutSink_write(sink, str, len);
+}
+
+int OutSink_write_rope(OutSink *sink, VRope *rope) {
+	if (null_check(sink, "outsink write rope") || null_check(rope, "outsink write rope")) return -1;
+
+	int ret = VRope_each(rope, sink_piece, sink);
+
+	// Referenced pieces belong to the rope so they can't outlive this call.
+	if (sink->iov_ctr > 0 && OutSink_flush(sink))
+		ret = -1;
+
+	return ret;
+}
+
+void OutSink_end_statement(OutSink *sink) {
+	if (sink && sink->policy == SINK_FLUSH_STATEMENT)
+		OutSink_flush(sink);
+}
+
+int OutSink_redirect(OutSink *sink, int fd, enum SinkFlush policy) {
+	if (null_check(sink, "outsink redirect")) return -1;
+
+	int ret = OutSink_flush(sink);
+	sink->fd = fd;
+	sink->policy = policy;
+	sink->error = 0;
+	return ret;
+}
+
+const char *OutSink_data(OutSink *sink, size_t *len) {
+	if (null_check(sink, "outsink data")) return NULL;
+
+	if (len)
+		*len = sink->len;
+	return sink->buf;
+}
+
+void OutSink_clear(OutSink *sink) {
+	if (null_check(sink, "outsink clear")) return;
+
+	sink->len = 0;
+	sink->seg_start = 0;
+	sink->iov_ctr = 0;
+}
+
+int OutSink_free(OutSink *sink) {
+	if (null_check(sink, "outsink free")) return -1;
+
+	int ret = OutSink_flush(sink);
+	if (sink->error)
+		ret = -1;
+
+	VAlloc_free(sink->alloc, sink->buf);
+	VAlloc_free(sink->alloc, sink);
+	return ret;
+}
@@ -0,0 +1,761 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "parallel.h"
+#include "conf.h"
+#include "utils.h"
+
+// Level of statements which aren't scheduled.
+#define LEVEL_NONE ((size_t) -1)
+
+Schedule *Schedule_build(Liveness *live, int skip_dead, VAllocator *alloc) {
+	if (null_check(live, "schedule build")) return NULL;
+
+	size_t stmt_ctr = live->stmt_ctr;
+	size_t var_ctr = live->var_ctr + 1;
+	size_t *level = VAlloc_alloc(alloc, (stmt_ctr + 1) * sizeof(size_t));
+	// Wave after the last write and after the last read of each variable, 0 if none yet.
+	size_t *after_write = VAlloc_calloc(alloc, var_ctr * sizeof(size_t));
+	size_t *after_read = VAlloc_calloc(alloc, var_ctr * sizeof(size_t));
+
+	Schedule *sched = VAlloc_alloc(alloc, sizeof(Schedule));
+	sched->alloc = alloc;
+	sched->stmt_ctr = stmt_ctr;
+	sched->wave_ctr = 0;
+	sched->widest = 0;
+
+	for (size_t i = 0; i < stmt_ctr; i++) {
+		size_t def = live->defs[i];
+		size_t lvl = 0;
+
+		if (skip_dead && live->dead[i]) {
+			level[i] = LEVEL_NONE;
+			continue;
+		}
+
+		for (size_t u = live->use_start[i]; u < live->use_start[i + 1]; u++) {
+			if (after_write[live->uses[u]] > lvl)
+				lvl = after_write[live->uses[u]];
+		}
+
+		if (def != LIVE_NONE) {
+			if (after_write[def] > lvl)
+				lvl = after_write[def];
+			if (after_read[def] > lvl)
+				lvl = after_read[def];
+		}
+
+		for (size_t u = live->use_start[i]; u < live->use_start[i + 1]; u++) {
+			if (after_read[live->uses[u]] < lvl + 1)
+				after_read[live->uses[u]] = lvl + 1;
+		}
+
+		if (def != LIVE_NONE)
+			after_write[def] = lvl + 1;
+
+		level[i] = lvl;
+		if (lvl + 1 > sched->wave_ctr)
+			sched->wave_ctr = lvl + 1;
+	}
+
+	// Counting sort by level keeps program order inside each wave.
+	sched->wave_start = VAlloc_calloc(alloc, (sched->wave_ctr + 1) * sizeof(size_t));
+	sched->order = VAlloc_alloc(alloc, (stmt_ctr + 1) * sizeof(size_t));
+
+	for (size_t i = 0; i < stmt_ctr; i++) {
+		if (level[i] != LEVEL_NONE)
+			sched->wave_start[level[i] + 1]++;
+	}
+
+	for (size_t w = 0; w < sched->wave_ctr; w++) {
+		if (sched->wave_start[w + 1] > sched->widest)
+			sched->widest = sched->wave_start[w + 1];
+		sched->wave_start[w + 1] += sched->wave_start[w];
+	}
+
+	// after_write is reused as the insert position of each wave.
+	VAlloc_free(alloc, after_write);
+	after_write = VAlloc_alloc(alloc, (sched->wave_ctr + 1) * sizeof(size_t));
+	memcpy(after_write, sched->wave_start, (sched->wave_ctr + 1) * sizeof(size_t));
+
+	for (size_t i = 0; i < stmt_ctr; i++) {
+		if (level[i] != LEVEL_NONE)
+			sched->order[after_write[level[i]]++] = i;
+	}
+
+	VAlloc_free(alloc, after_write);
+	VAlloc_free(alloc, after_read);
+	VAlloc_free(alloc, level);
+	return sched;
+}
+
+void Schedule_free(Schedule *sched) {
+	if (null_check(sched, "schedule free")) return;
+
+	VAlloc_free(sched->alloc, sched->order);
+	VAlloc_free(sched->alloc, sched->wave_start);
+	VAlloc_free(sched->alloc, sched);
+}
+
+// Private state of a thread, output and errors are captured until emitted.
+typedef struct {
+	NexecMgr *nexec_mgr;
+	OutSink *out;
+	Error *err_handle;
+} Worker;
+
+// Set up a worker running statements for nexec_mgr on sy_table.
+static void worker_init(Worker *w, NexecMgr *nexec_mgr, SyTable *sy_table) {
+	w->err_handle = Error_new(NULL);
+	w->out = OutSink_new(NULL, -1, 4096, SINK_FLUSH_EXIT);
+	w->nexec_mgr = Nexec_init(sy_table, nexec_mgr->node_mgr, w->err_handle);
+	w->nexec_mgr->out = w->out;
+	w->nexec_mgr->pinned = nexec_mgr->pinned;
+	w->nexec_mgr->log = nexec_mgr->log;
+	w->nexec_mgr->pool = nexec_mgr->pool;
+	w->nexec_mgr->fanout = nexec_mgr->fanout;
+	w->nexec_mgr->dag = nexec_mgr->dag;
+	w->nexec_mgr->history = nexec_mgr->history;
+	w->nexec_mgr->steps = nexec_mgr->steps;
+	w->nexec_mgr->journal = nexec_mgr->journal;
+	w->nexec_mgr->hedge = nexec_mgr->hedge;
+	w->nexec_mgr->stmt = nexec_mgr->stmt;
+	w->nexec_mgr->defer_errors = 1;
+}
+
+// Where the output and errors of a statement were captured.
+typedef struct {
+	unsigned int worker;
+	int done;
+	size_t out_start;
+	size_t out_len;
+	size_t err_start;
+	size_t err_end;
+} StmtResult;
+
+typedef struct {
+	NodeMgr *node_mgr;
+	Worker *workers;
+	StmtResult *results;
+	const size_t *wave;
+	size_t wave_len;
+	size_t next;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned long generation;
+	unsigned int busy;
+	int stop;
+} Pool;
+
+typedef struct {
+	Pool *pool;
+	unsigned int id;
+} PoolArg;
+
+// Execute statements of the current wave until none are left.
+static void pool_drain(Pool *pool, unsigned int id) {
+	Worker *w = &pool->workers[id];
+	size_t idx;
+
+	while ((idx = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->wave_len) {
+		size_t stmt = pool->wave[idx];
+		StmtResult *res = &pool->results[stmt];
+
+		res->worker = id;
+		res->out_start = w->out->len;
+		res->err_start = w->err_handle->error_ctr;
+		w->nexec_mgr->stmt = stmt;
+		Nexec_exec(w->nexec_mgr, pool->node_mgr->nodes[stmt]);
+		res->out_len = w->out->len - res->out_start;
+		res->err_end = w->err_handle->error_ctr;
+		res->done = 1;
+	}
+}
+
+static void *pool_thread(void *arg) {
+	Pool *pool = ((PoolArg *) arg)->pool;
+	unsigned int id = ((PoolArg *) arg)->id;
+	unsigned long seen = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->stop)
+			pthread_cond_wait(&pool->start, &pool->lock);
+
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		pool_drain(pool, id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+// Run one wave, small waves aren't worth waking the other threads for.
+static void pool_run_wave(Pool *pool, unsigned int threads, const size_t *wave, size_t wave_len) {
+	pool->wave = wave;
+	pool->wave_len = wave_len;
+	pool->next = 0;
+
+	if (threads > 1 && wave_len >= VMEL_PARALLEL_MIN_WAVE) {
+		pthread_mutex_lock(&pool->lock);
+		pool->busy = threads - 1;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+
+		pool_drain(pool, 0);
+
+		pthread_mutex_lock(&pool->lock);
+		while (pool->busy)
+			pthread_cond_wait(&pool->done, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	else {
+		pool_drain(pool, 0);
+	}
+}
+
+// Flat copies are made now so statements of later waves only ever read symbols.
+static void flatten_symbols(SyTable *sy_table) {
+	for (size_t i = 0; i < sy_table->sym_ctr; i++) {
+		Symbol *sy = sy_table->symbols[i];
+		if (!sy->val && (sy->rope.root || sy->arr))
+			Symbol_value(sy);
+	}
+}
+
+static void flatten_targets(Pool *pool, SyTable *sy_table, const size_t *wave, size_t wave_len) {
+	for (size_t i = 0; i < wave_len; i++) {
+		Node *stmt = pool->node_mgr->nodes[wave[i]];
+
+		if (stmt->type != E_EQUAL_NODE || !stmt->data->AsnStmtNode.left)
+			continue;
+
+		Symbol *sy = SyTable_get_symbol(sy_table, stmt->data->AsnStmtNode.left->value);
+		if (sy && !sy->val && (sy->rope.root || sy->arr))
+			Symbol_value(sy);
+	}
+}
+
+// Emit statements in program order up to the first one which hasn't run, returns the new position.
+static size_t pool_emit(Pool *pool, NexecMgr *nexec_mgr, size_t emit_next, size_t stmt_ctr, size_t *emitted) {
+	for (; emit_next < stmt_ctr && pool->results[emit_next].done; emit_next++) {
+		StmtResult *res = &pool->results[emit_next];
+		Worker *w = &pool->workers[res->worker];
+
+		// Skipped statements have nothing to emit.
+		if (res->done < 0)
+			continue;
+
+		(*emitted)++;
+
+		OutSink_write(nexec_mgr->out, w->out->buf + res->out_start, res->out_len);
+
+		if (res->err_end > res->err_start) {
+			Error_append(nexec_mgr->err_handle, w->err_handle, res->err_start, res->err_end);
+			OutSink_flush(nexec_mgr->out);
+			Error_flush(nexec_mgr->err_handle, stdout);
+			fflush(stdout);
+		}
+
+		OutSink_end_statement(nexec_mgr->out);
+	}
+
+	return emit_next;
+}
+
+int Parallel_run(Schedule *sched, NexecMgr *nexec_mgr, unsigned int jobs) {
+	if (null_check(sched, "parallel run") || null_check(nexec_mgr, "parallel run")) return -1;
+
+	unsigned int threads = jobs ? jobs : 1;
+	if (threads > sched->widest)
+		threads = sched->widest ? sched->widest : 1;
+
+	Pool pool;
+	pool.node_mgr = nexec_mgr->node_mgr;
+	pool.results = calloc(sched->stmt_ctr + 1, sizeof(StmtResult));
+	pool.workers = calloc(threads, sizeof(Worker));
+	pool.generation = 0;
+	pool.busy = 0;
+	pool.stop = 0;
+
+	if (null_check(pool.results, "parallel run") || null_check(pool.workers, "parallel run")) {
+		free(pool.results);
+		free(pool.workers);
+		return -1;
+	}
+
+	// Statements left out of the schedule count as already emitted.
+	for (size_t i = 0; i < sched->stmt_ctr; i++)
+		pool.results[i].done = -1;
+	for (size_t i = 0; i < sched->wave_start[sched->wave_ctr]; i++)
+		pool.results[sched->order[i]].done = 0;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		worker_init(&pool.workers[i], nexec_mgr, nexec_mgr->sy_table);
+		pool.workers[i].nexec_mgr->flat = 1;
+	}
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.start, NULL);
+	pthread_cond_init(&pool.done, NULL);
+
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	PoolArg *args = malloc(threads * sizeof(PoolArg));
+	unsigned int started = 1;
+
+	for (; tids && args && started < threads; started++) {
+		args[started].pool = &pool;
+		args[started].id = started;
+		if (pthread_create(&tids[started], NULL, pool_thread, &args[started]))
+			break;
+	}
+
+	flatten_symbols(nexec_mgr->sy_table);
+
+	size_t emit_next = 0;
+	size_t emitted = 0;
+	size_t ran = 0;
+
+	for (size_t w = 0; w < sched->wave_ctr; w++) {
+		const size_t *wave = sched->order + sched->wave_start[w];
+		size_t wave_len = sched->wave_start[w + 1] - sched->wave_start[w];
+
+		pool_run_wave(&pool, started, wave, wave_len);
+		flatten_targets(&pool, nexec_mgr->sy_table, wave, wave_len);
+		ran += wave_len;
+
+		emit_next = pool_emit(&pool, nexec_mgr, emit_next, sched->stmt_ctr, &emitted);
+
+		// Once everything which ran has been emitted the captured output can be dropped.
+		if (emitted == ran) {
+			for (unsigned int i = 0; i < threads; i++) {
+				OutSink_clear(pool.workers[i].out);
+				Error_clear(pool.workers[i].err_handle);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.start);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (unsigned int i = 1; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		NexecMgr_free(pool.workers[i].nexec_mgr);
+		OutSink_free(pool.workers[i].out);
+		Error_free(pool.workers[i].err_handle);
+	}
+
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.start);
+	pthread_cond_destroy(&pool.done);
+	free(tids);
+	free(args);
+	free(pool.workers);
+	free(pool.results);
+	return 0;
+}
+
+// Iterations a thread has left, other threads steal from the end.
+typedef struct {
+	size_t lo;
+	size_t hi;
+	pthread_mutex_t lock;
+} IterRange;
+
+// Runs task idx of items, an iteration of a loop or a group on a host.
+typedef int (*LoopTask)(NexecMgr *nexec_mgr, Node *node, VArray *items, size_t idx);
+
+typedef struct {
+	Node *loop;
+	VArray *items;
+	LoopTask task;
+	Worker *workers;
+	IterRange *ranges;
+	StmtResult *results;
+	unsigned int threads;
+} LoopPool;
+
+typedef struct {
+	LoopPool *pool;
+	unsigned int id;
+} LoopArg;
+
+// Take the next iteration of our own range, once empty steal the upper half of another.
+static int loop_take(LoopPool *pool, unsigned int id, size_t *idx) {
+	IterRange *own = &pool->ranges[id];
+	int found = 0;
+
+	pthread_mutex_lock(&own->lock);
+	if (own->lo < own->hi) {
+		*idx = own->lo++;
+		found = 1;
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	for (unsigned int i = 1; !found && i < pool->threads; i++) {
+		IterRange *victim = &pool->ranges[(id + i) % pool->threads];
+		size_t lo = 0;
+		size_t hi = 0;
+
+		pthread_mutex_lock(&victim->lock);
+		if (victim->lo < victim->hi) {
+			hi = victim->hi;
+			lo = victim->lo + (victim->hi - victim->lo) / 2;
+			victim->hi = lo;
+		}
+		pthread_mutex_unlock(&victim->lock);
+
+		if (lo < hi) {
+			pthread_mutex_lock(&own->lock);
+			own->lo = lo + 1;
+			own->hi = hi;
+			pthread_mutex_unlock(&own->lock);
+			*idx = lo;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+static void loop_drain(LoopPool *pool, unsigned int id) {
+	Worker *w = &pool->workers[id];
+	size_t idx;
+
+	while (loop_take(pool, id, &idx)) {
+		StmtResult *res = &pool->results[idx];
+
+		res->worker = id;
+		res->out_start = w->out->len;
+		res->err_start = w->err_handle->error_ctr;
+		pool->task(w->nexec_mgr, pool->loop, pool->items, idx);
+		res->out_len = w->out->len - res->out_start;
+		res->err_end = w->err_handle->error_ctr;
+		res->done = 1;
+	}
+}
+
+static void *loop_thread(void *arg) {
+	loop_drain(((LoopArg *) arg)->pool, ((LoopArg *) arg)->id);
+	return NULL;
+}
+
+// Run every task on up to jobs threads, output and errors are emitted in task order. flat is
+// set when tasks never assign, so the symbols they read stay flat.
+static int run_tasks(NexecMgr *nexec_mgr, Node *loop, VArray *items, unsigned int jobs, LoopTask task, int flat) {
+	size_t iter_ctr = items->len;
+	unsigned int threads = jobs ? jobs : 1;
+	if (threads > iter_ctr)
+		threads = iter_ctr ? (unsigned int) iter_ctr : 1;
+
+	LoopPool pool;
+	pool.loop = loop;
+	pool.items = items;
+	pool.task = task;
+	pool.threads = threads;
+	pool.results = calloc(iter_ctr + 1, sizeof(StmtResult));
+	pool.workers = calloc(threads, sizeof(Worker));
+	pool.ranges = calloc(threads, sizeof(IterRange));
+
+	if (null_check(pool.results, "parallel foreach") || null_check(pool.workers, "parallel foreach")
+		|| null_check(pool.ranges, "parallel foreach")) {
+		free(pool.results);
+		free(pool.workers);
+		free(pool.ranges);
+		return -1;
+	}
+
+	// Frames only read the tables below them, flatten those while still single threaded.
+	for (SyTable *sy_table = nexec_mgr->sy_table; sy_table; sy_table = sy_table->parent)
+		flatten_symbols(sy_table);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		worker_init(&pool.workers[i], nexec_mgr, SyTable_new_frame(nexec_mgr->sy_table, nexec_mgr->sy_table->alloc));
+		pool.workers[i].nexec_mgr->flat = flat;
+
+		// Contiguous share of iterations.
+		pool.ranges[i].lo = iter_ctr * i / threads;
+		pool.ranges[i].hi = iter_ctr * (i + 1) / threads;
+		pthread_mutex_init(&pool.ranges[i].lock, NULL);
+	}
+
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	LoopArg *args = malloc(threads * sizeof(LoopArg));
+	unsigned int started = 1;
+
+	// Ranges of threads which failed to start are stolen by the others.
+	for (; tids && args && started < threads; started++) {
+		args[started].pool = &pool;
+		args[started].id = started;
+		if (pthread_create(&tids[started], NULL, loop_thread, &args[started]))
+			break;
+	}
+
+	loop_drain(&pool, 0);
+
+	for (unsigned int i = 1; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	for (size_t i = 0; i < iter_ctr; i++) {
+		StmtResult *res = &pool.results[i];
+		Worker *w = &pool.workers[res->worker];
+
+		OutSink_write(nexec_mgr->out, w->out->buf + res->out_start, res->out_len);
+
+		if (res->err_end > res->err_start) {
+			Error_append(nexec_mgr->err_handle, w->err_handle, res->err_start, res->err_end);
+
+			if (!nexec_mgr->defer_errors) {
+				OutSink_flush(nexec_mgr->out);
+				Error_flush(nexec_mgr->err_handle, stdout);
+				fflush(stdout);
+			}
+		}
+
+		OutSink_end_statement(nexec_mgr->out);
+	}
+
+	for (unsigned int i = 0; i < threads; i++) {
+		SyTable_free(pool.workers[i].nexec_mgr->sy_table);
+		NexecMgr_free(pool.workers[i].nexec_mgr);
+		OutSink_free(pool.workers[i].out);
+		Error_free(pool.workers[i].err_handle);
+		pthread_mutex_destroy(&pool.ranges[i].lock);
+	}
+
+	free(tids);
+	free(args);
+	free(pool.workers);
+	free(pool.ranges);
+	free(pool.results);
+	return 0;
+}
+
+int Parallel_foreach(NexecMgr *nexec_mgr, Node *loop, VArray *items, unsigned int jobs) {
+	if (null_check(nexec_mgr, "parallel foreach") || null_check(loop, "parallel foreach") || null_check(items, "parallel foreach")) return -1;
+	return run_tasks(nexec_mgr, loop, items, jobs, Nexec_iteration, 0);
+}
+
+int Parallel_fanout(NexecMgr *nexec_mgr, Node *group, VArray *hosts, unsigned int jobs) {
+	if (null_check(nexec_mgr, "parallel fanout") || null_check(group, "parallel fanout") || null_check(hosts, "parallel fanout")) return -1;
+	return run_tasks(nexec_mgr, group, hosts, jobs, Nexec_host, 1);
+}
+
+// Groups of a plan, each is ready once every group it needs finished.
+typedef struct {
+	GroupDag *dag;
+	DagRun *run;
+	Worker *workers;
+	StmtResult *results;
+	size_t *pending;
+	long *blocker;
+	size_t *ready;
+	size_t ready_ctr;
+	size_t left;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+} DagPool;
+
+typedef struct {
+	DagPool *pool;
+	unsigned int id;
+} DagArg;
+
+// Wait for a ready group and take the one with the longest path left, 0 once every group was taken.
+static int dag_take(DagPool *pool, size_t *idx) {
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->ready_ctr && pool->left)
+		pthread_cond_wait(&pool->wake, &pool->lock);
+
+	if (!pool->ready_ctr) {
+		pthread_mutex_unlock(&pool->lock);
+		return 0;
+	}
+
+	size_t best = 0;
+	for (size_t i = 1; i < pool->ready_ctr; i++) {
+		if (pool->run->prio[pool->ready[i]] > pool->run->prio[pool->ready[best]])
+			best = i;
+	}
+
+	*idx = pool->ready[best];
+	pool->ready[best] = pool->ready[--pool->ready_ctr];
+
+	// Threads left waiting have nothing more to do.
+	if (--pool->left == 0)
+		pthread_cond_broadcast(&pool->wake);
+
+	pthread_mutex_unlock(&pool->lock);
+	return 1;
+}
+
+static void dag_drain(DagPool *pool, unsigned int id) {
+	Worker *w = &pool->workers[id];
+	size_t idx;
+
+	while (dag_take(pool, &idx)) {
+		StmtResult *res = &pool->results[idx];
+
+		res->worker = id;
+		res->out_start = w->out->len;
+		res->err_start = w->err_handle->error_ctr;
+		int ret = Nexec_dag_group(w->nexec_mgr, pool->run, idx, pool->blocker[idx]);
+		res->out_len = w->out->len - res->out_start;
+		res->err_end = w->err_handle->error_ctr;
+		res->done = ret ? -1 : 1;
+
+		// Groups outside the plan have a prio below 0 and are left alone.
+		DagGroup *g = &pool->dag->groups[idx];
+		int woken = 0;
+
+		pthread_mutex_lock(&pool->lock);
+		for (size_t u = 0; u < g->user_ctr; u++) {
+			size_t user = g->users[u];
+			if (pool->run->prio[user] < 0)
+				continue;
+
+			if (ret && pool->blocker[user] < 0)
+				pool->blocker[user] = pool->blocker[idx] >= 0 ? pool->blocker[idx] : (long) idx;
+
+			if (--pool->pending[user] == 0) {
+				pool->ready[pool->ready_ctr++] = user;
+				woken = 1;
+			}
+		}
+		if (woken)
+			pthread_cond_broadcast(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+static void *dag_thread(void *arg) {
+	dag_drain(((DagArg *) arg)->pool, ((DagArg *) arg)->id);
+	return NULL;
+}
+
+int Parallel_dag(NexecMgr *nexec_mgr, DagRun *run, unsigned int jobs) {
+	if (null_check(nexec_mgr, "parallel dag") || null_check(nexec_mgr->dag, "parallel dag") || null_check(run, "parallel dag")) return -1;
+
+	GroupDag *dag = nexec_mgr->dag;
+	unsigned int threads = jobs ? jobs : 1;
+
+	// Groups running at once are in different lanes, more threads would only wait.
+	if (threads > run->lane_ctr)
+		threads = run->lane_ctr ? (unsigned int) run->lane_ctr : 1;
+
+	DagPool pool;
+	pool.dag = dag;
+	pool.run = run;
+	pool.ready_ctr = 0;
+	pool.left = run->len;
+	pool.results = calloc(dag->group_ctr + 1, sizeof(StmtResult));
+	pool.pending = calloc(dag->group_ctr + 1, sizeof(size_t));
+	pool.blocker = calloc(dag->group_ctr + 1, sizeof(long));
+	pool.ready = calloc(run->len + 1, sizeof(size_t));
+	pool.workers = calloc(threads, sizeof(Worker));
+
+	if (null_check(pool.results, "parallel dag") || null_check(pool.pending, "parallel dag") || null_check(pool.blocker, "parallel dag")
+		|| null_check(pool.ready, "parallel dag") || null_check(pool.workers, "parallel dag")) {
+		free(pool.results);
+		free(pool.pending);
+		free(pool.blocker);
+		free(pool.ready);
+		free(pool.workers);
+		return -1;
+	}
+
+	for (size_t i = 0; i < run->len; i++) {
+		size_t idx = run->order[i];
+		pool.blocker[idx] = -1;
+		pool.pending[idx] = dag->groups[idx].need_ctr;
+		if (!pool.pending[idx])
+			pool.ready[pool.ready_ctr++] = idx;
+	}
+
+	// Groups only read symbols, flatten them while still single threaded. Other statements of
+	// a wave may be running, which only ever read flat symbols.
+	for (SyTable *sy_table = nexec_mgr->sy_table; sy_table && !nexec_mgr->flat; sy_table = sy_table->parent)
+		flatten_symbols(sy_table);
+
+	// Sessions come from the lanes of run, the pool of nexec_mgr is shared.
+	for (unsigned int i = 0; i < threads; i++) {
+		worker_init(&pool.workers[i], nexec_mgr, nexec_mgr->sy_table);
+		pool.workers[i].nexec_mgr->host = nexec_mgr->host;
+	}
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.wake, NULL);
+
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	DagArg *args = malloc(threads * sizeof(DagArg));
+	unsigned int started = 1;
+
+	for (; tids && args && started < threads; started++) {
+		args[started].pool = &pool;
+		args[started].id = started;
+		if (pthread_create(&tids[started], NULL, dag_thread, &args[started]))
+			break;
+	}
+
+	dag_drain(&pool, 0);
+
+	for (unsigned int i = 1; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	int ret = 0;
+
+	// Emit in plan order, which is what a single thread would have printed.
+	for (size_t i = 0; i < run->len; i++) {
+		StmtResult *res = &pool.results[run->order[i]];
+		Worker *w = &pool.workers[res->worker];
+
+		if (res->done < 0)
+			ret = -1;
+
+		OutSink_write(nexec_mgr->out, w->out->buf + res->out_start, res->out_len);
+
+		if (res->err_end > res->err_start) {
+			Error_append(nexec_mgr->err_handle, w->err_handle, res->err_start, res->err_end);
+
+			if (!nexec_mgr->defer_errors) {
+				OutSink_flush(nexec_mgr->out);
+				Error_flush(nexec_mgr->err_handle, stdout);
+				fflush(stdout);
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < threads; i++) {
+		NexecMgr_free(pool.workers[i].nexec_mgr);
+		OutSink_free(pool.workers[i].out);
+		Error_free(pool.workers[i].err_handle);
+	}
+
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.wake);
+	free(tids);
+	free(args);
+	free(pool.workers);
+	free(pool.ready);
+	free(pool.blocker);
+	free(pool.pending);
+	free(pool.results);
+	return ret;
+}
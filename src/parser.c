@@ -7,6 +7,7 @@
 #include "node.h"
 #include "sytable.h"
 #include "errors.h"
+#include "stats.h"
 
 // Below are the errors which map to Error_Templates.
 #define ERR_UNEXPECTED 0
@@ -20,20 +21,22 @@
 #define ERR_NAKED_VARIABLE 8
 #define ERR_INVALID_TYPES 9
 #define ERR_EMPTY_GROUP 10
+#define ERR_ARRAY_ITEM 11
 
 // These are the errors a parser may generate. They are mapped to the #DEFINE above.
 static const char *Error_Templates[] = {
-	"Parsing error : unexpected @0 found in line @1",
-	"Parsing Error : Duplicate definition {@0} already defined in line @1",
-	"Syntax error : Group {@0} missing closing tag in line @1",
-	"Parsing error: Statement '@0' missing arguments in line @1",
-	"Parsing error : Expected array item after comma but found NULL near @0 in line @1",
-	"Syntax error: Missing closing ']' near '@0' in line @1",
-	"Syntax error: Missing closing '}' near '@0' in line @1",
-	"Syntax error: Missing closing ')' near '@0' in line @1",
-	"Parsing error: '$@0' declaraion must be followed by valid assignment in line @1",
-	"Parsing error: Operation on incompatible types near '@0' in line @1",
-	"Parsing error: Group {@0} must contain commands, in line @1",
+	"Parsing error : unexpected @0 found in line @L",
+	"Parsing Error : Duplicate definition {@0} already defined in line @L",
+	"Syntax error : Group {@0} missing closing tag in line @L",
+	"Parsing error: Statement '@0' missing arguments in line @L",
+	"Parsing error : Expected array item after comma but found NULL near @0 in line @L",
+	"Syntax error: Missing closing ']' near '@0' in line @L",
+	"Syntax error: Missing closing '}' near '@0' in line @L",
+	"Syntax error: Missing closing ')' near '@0' in line @L",
+	"Parsing error: '$@0' declaraion must be followed by valid assignment in line @L",
+	"Parsing error: Operation on incompatible types near '@0' in line @L",
+	"Parsing error: Group {@0} must contain commands, in line @L",
+	"Parsing error: Array items must be numbers, strings or arrays, found '@0' in line @L",
 };
 
 // Sync ParserMgr internal token to be current token held by TokenMgr.
@@ -46,6 +49,11 @@ static void par_mgr_next(ParserMgr *par_mgr) {
 	par_mgr->curr_token = TokenMgr_next_token(par_mgr->tok_mgr);
 }
 
+// Hash node and share it with identical subtrees when hash-consing is enabled.
+static Node *par_mgr_cons(ParserMgr *par_mgr, Node *node) {
+	return NodeMgr_cons_node(par_mgr->node_mgr, node);
+}
+
 // Check to make sure operation is one of (== != <= >= < >)
 static int is_compare_operator(TokenType op) {
 	return (op == E_EQUAL_TOKEN
@@ -85,24 +93,35 @@ static enum NodeType get_compare_type(char *op) {
 	return E_EOF_NODE;
 }
 
-// Allocate more memory for array node items.
-static Node **grow_arr_nodes(Node *arr_node) {
-	if (null_check(arr_node, "grow array nodes")) return NULL;
-	Node **new_items = NULL;
-	arr_node->data->ArrayNode.dcap = arr_node->data->ArrayNode.dcap * (arr_node->data->ArrayNode.dcap / 2);
-	new_items = realloc(arr_node->data->ArrayNode.items, arr_node->data->ArrayNode.dcap * sizeof(Node *));
-	return new_items;
+// Check to make sure keyword names a reduction over an array.
+static int is_reduce_keyword(Token *tok) {
+	return tok->type == E_KEYWORD_TOKEN
+		&& (string_compare(tok->value, "sum") || string_compare(tok->value, "min")
+		|| string_compare(tok->value, "max") || string_compare(tok->value, "count"));
 }
 
-// Shorthand for malloc'ed array node and items.
-static Node *node_new_array() {
+// Number of arrays taken by keyword naming a set operation, 0 if it isn't one.
+static int setop_arity(Token *tok) {
+	if (tok->type != E_KEYWORD_TOKEN)
+		return 0;
+
+	if (string_compare(tok->value, "sort") || string_compare(tok->value, "unique"))
+		return 1;
+
+	if (string_compare(tok->value, "union") || string_compare(tok->value, "intersect")
+		|| string_compare(tok->value, "difference"))
+		return 2;
+
+	return 0;
+}
+
+// Shorthand for allocating array node and its element store.
+static Node *node_new_array(ParserMgr *par_mgr) {
 	Node *arr = NULL;
-	arr = Node_new(1);
+	arr = Node_new(par_mgr->alloc, 1);
 	arr->type = E_ARRAY_NODE;
-	arr->data->ArrayNode.dctr = 0;
-	arr->data->ArrayNode.dcap = 15;
 	arr->value = NULL;
-	arr->data->ArrayNode.items = malloc(arr->data->ArrayNode.dcap * sizeof(Node *));
+	arr->data->ArrayNode.store = ArrStore_new(par_mgr->alloc);
 	return arr;
 }
 
@@ -125,8 +144,10 @@ static int parser_expects(ParserMgr *par_mgr, int err_code, int ct, ...) {
 	return ret;
 }
 
-ParserMgr *ParserMgr_new() {
-	ParserMgr *ps = malloc(sizeof(ParserMgr));
+ParserMgr *ParserMgr_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_PARSER, alloc);
+	ParserMgr *ps = VAlloc_alloc(alloc, sizeof(ParserMgr));
+	ps->alloc = alloc;
 	ps->curr_token = NULL;
 	ps->node_mgr = NULL;
 	ps->tok_mgr = NULL;
@@ -140,31 +161,17 @@ int ParserMgr_free(ParserMgr *par_mgr) {
 	par_mgr->curr_token = NULL;
 	par_mgr->err_handle = NULL;
 	par_mgr->tok_mgr = NULL;
-	free(par_mgr);
+	VAlloc_free(par_mgr->alloc, par_mgr);
 
 	return 0;
 }
 
 void ParserMgr_add_error(Error *err_handle, Token *offender, int err_type) {
-	// Don't exceed error limit.
-	if (err_handle->error_cap == err_handle->error_ctr)
+	if (!err_handle || !offender)
 		return;
-	 
-	char off_lineno[16]; // Assume that a source file won't exceed 9999,9999,9999,9999 lines ?
-	char *off_value = offender->value;
-	const char *template = Error_Templates[err_type];
-	char *template_values[] = {off_value, off_lineno};
-	char *template_fmt = NULL;
 
-	// We can't convert line number to string so replace with undefined.	
-	if (int_to_string(off_lineno, offender->lineno) < 0)
-		strncpy(off_lineno, "undefined", 10);
-
-	template_fmt = string_map_vars(template, template_values, strlen(template), 2);
-	
-	// Add the final template string to error handler.
-	err_handle->errors[err_handle->error_ctr] = template_fmt;
-	err_handle->error_ctr++;
+	// Formatting is deferred until errors are flushed.
+	Error_add_record(err_handle, Error_Templates, err_type, offender->lineno, 1, offender->value);
 }
 
 void ParserMgr_skip_to(ParserMgr *par_mgr, TokenType type) {
@@ -176,7 +183,7 @@ void ParserMgr_skip_to(ParserMgr *par_mgr, TokenType type) {
 Node *parse_string(ParserMgr *par_mgr) {
 	Node *str = NULL;
 	if (par_mgr->curr_token->type == E_STRING_TOKEN || par_mgr->curr_token->type == E_MIXSTR_TOKEN) {
-		str = Node_new(0);
+		str = Node_new(par_mgr->alloc, 0);
 		str->type = E_STRING_NODE;
 		
 		// Change type if mix string.
@@ -193,17 +200,23 @@ Node *parse_factor(ParserMgr *par_mgr) {
 	par_mgr_sync(par_mgr);
 	Node *res = NULL;
 	 if (par_mgr->curr_token->type == E_INTEGER_TOKEN) {
-		 res = Node_new(0);
+		 res = Node_new(par_mgr->alloc, 0);
 		 res->type = E_INTEGER_NODE;
 		 res->value = par_mgr->curr_token->value; 
 		 par_mgr_next(par_mgr);
 	 }
 	 else if (par_mgr->curr_token->type == E_IDENTIFIER_TOKEN) {
-		 res = Node_new(0);
+		 res = Node_new(par_mgr->alloc, 0);
 		 res->type = E_IDENTIFIER_NODE;
 		 res->value = par_mgr->curr_token->value; 
 		 par_mgr_next(par_mgr);
 	 }
+	 else if (par_mgr->curr_token->type == E_LBRACKET_TOKEN) {
+		 res = parse_array(par_mgr);
+	 }
+	 else if (is_reduce_keyword(par_mgr->curr_token) || setop_arity(par_mgr->curr_token)) {
+		 res = parse_builtin(par_mgr);
+	 }
 	 else if (par_mgr->curr_token->type == E_LPAREN_TOKEN) {
 		 TokenMgr_next_token(par_mgr->tok_mgr);
 		 res = parse_expr(par_mgr);
@@ -217,7 +230,60 @@ Node *parse_factor(ParserMgr *par_mgr) {
 		 res = parse_string(par_mgr);
 	 }
 	 
-	 return res;
+	 return par_mgr_cons(par_mgr, res);
+}
+
+Node *parse_builtin(ParserMgr *par_mgr) {
+	// Store builtin name token.
+	Token *name = par_mgr->curr_token;
+	// Number of arguments of a set operation, reductions take one.
+	int arity = setop_arity(name);
+
+	par_mgr_next(par_mgr);
+
+	if (!parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_LPAREN_TOKEN)) return NULL;
+
+	par_mgr_next(par_mgr);
+
+	Node *args = parse_expr(par_mgr);
+	Node *other = NULL;
+	par_mgr_sync(par_mgr);
+
+	if (!args) {
+		ParserMgr_add_error(par_mgr->err_handle, name, ERR_EMPTY_STMT);
+		return NULL;
+	}
+
+	// Node is still built when the second array is missing so args is freed with it.
+	if (arity == 2 && parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_COMMA_TOKEN)) {
+		par_mgr_next(par_mgr);
+		other = parse_expr(par_mgr);
+		par_mgr_sync(par_mgr);
+
+		if (!other)
+			ParserMgr_add_error(par_mgr->err_handle, name, ERR_EMPTY_STMT);
+	}
+
+	Node *res = Node_new(par_mgr->alloc, 1);
+	res->value = name->value;
+
+	if (arity) {
+		res->type = E_SETOP_NODE;
+		res->data->SetOpNode.left = args;
+		res->data->SetOpNode.right = other;
+	}
+	else {
+		res->type = E_REDUCE_NODE;
+		res->data->ReduceNode.args = args;
+	}
+
+	// Should have closing paren.
+	if (par_mgr->curr_token->type != E_RPAREN_TOKEN)
+		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_prev_token(par_mgr->tok_mgr), ERR_MISSING_PAREN);
+	else
+		par_mgr_next(par_mgr);
+
+	return res;
 }
 
 Node *parse_term(ParserMgr *par_mgr) {
@@ -227,7 +293,7 @@ Node *parse_term(ParserMgr *par_mgr) {
 		|| par_mgr->curr_token->type == E_ASTERISK_TOKEN)) {
 		
 		// Operation node.
-		Node *bop = Node_new(1);
+		Node *bop = Node_new(par_mgr->alloc, 1);
 
 		if (par_mgr->curr_token->type == E_ASTERISK_TOKEN) {
 			bop->type = E_TIMES_NODE;
@@ -250,7 +316,7 @@ Node *parse_term(ParserMgr *par_mgr) {
 		}
 
 		par_mgr->expr_depth++;
-		res = bop;
+		res = par_mgr_cons(par_mgr, bop);
 	}
 	
 	return res;
@@ -265,7 +331,7 @@ Node *parse_expr(ParserMgr *par_mgr) {
 		|| is_compare_operator(par_mgr->curr_token->type))) {
 		
 		// Operation node.
-		Node *bop = Node_new(1);
+		Node *bop = Node_new(par_mgr->alloc, 1);
 
 		if (par_mgr->curr_token->type == E_MINUS_TOKEN) {
 			bop->type = E_MINUS_NODE;
@@ -290,61 +356,114 @@ Node *parse_expr(ParserMgr *par_mgr) {
 		}
 
 		par_mgr->expr_depth++;
-		res = bop;
+		res = par_mgr_cons(par_mgr, bop);
 	}
 	
 	return res;
 }
 
+// Items must be followed by a comma or the end of the array. A token on a later line means
+// the array was never closed, anything else starts an expression.
+static void array_item_end(ParserMgr *par_mgr) {
+	Token *tok = par_mgr->curr_token;
+
+	if (tok->type == E_COMMA_TOKEN || tok->type == E_RBRACKET_TOKEN)
+		return;
+
+	Token *prev = TokenMgr_prev_token(par_mgr->tok_mgr);
+
+	if (tok->type == E_EOF_TOKEN || tok->lineno > prev->lineno)
+		ParserMgr_add_error(par_mgr->err_handle, prev, ERR_MISSING_BRACKET);
+	else
+		ParserMgr_add_error(par_mgr->err_handle, tok, ERR_ARRAY_ITEM);
+}
+
 Node *parse_array(ParserMgr *par_mgr) {
 	
-	// Store retrun node from each root level evaluation.
-	Node *ret = NULL;
 	// Store final array node.
 	Node *arr = NULL;
+	// Store nested array.
+	Node *nested = NULL;
+	Token *tok = NULL;
+	// Parsing stops at the first error reported within the array.
+	size_t errors = par_mgr->err_handle->error_ctr;
 
 	if (par_mgr->curr_token->type != E_LBRACKET_TOKEN)
 		return NULL;
 
 	// Instansiate array node.
-	arr = node_new_array();
+	arr = node_new_array(par_mgr);
+	ArrStore *store = arr->data->ArrayNode.store;
 	
-	while (!TokenMgr_is_last_token(par_mgr->tok_mgr) && par_mgr->curr_token->type != E_RBRACKET_TOKEN) {
+	while (par_mgr->err_handle->error_ctr == errors && !TokenMgr_is_last_token(par_mgr->tok_mgr) && par_mgr->curr_token->type != E_RBRACKET_TOKEN) {
 		
 		// Next token.
 		par_mgr_next(par_mgr);		
+		tok = par_mgr->curr_token;
 
-		switch(par_mgr->curr_token->type) {
+		// Literals are stored by value, only nested arrays remain nodes.
+		switch(tok->type) {
 			case E_INTEGER_TOKEN: 
-				ret = parse_factor(par_mgr);
+				ArrStore_push_int(store, string_to_int(tok->value, strlen(tok->value)));
+				par_mgr_next(par_mgr);
+				array_item_end(par_mgr);
 				break;
 			case E_STRING_TOKEN: 
-				ret = parse_string(par_mgr);
+				ArrStore_push_str(store, tok->value);
+				par_mgr_next(par_mgr);
+				array_item_end(par_mgr);
+				break;
+			case E_MINUS_TOKEN:
+				// Only a number may be negated.
+				par_mgr_next(par_mgr);
+				if (par_mgr->curr_token->type != E_INTEGER_TOKEN) {
+					ParserMgr_add_error(par_mgr->err_handle, par_mgr->curr_token, ERR_ARRAY_ITEM);
+					break;
+				}
+				ArrStore_push_int(store, -string_to_int(par_mgr->curr_token->value, strlen(par_mgr->curr_token->value)));
+				par_mgr_next(par_mgr);
+				array_item_end(par_mgr);
 				break;
 			case E_LBRACKET_TOKEN: 
-				ret = parse_array(par_mgr);
+				nested = parse_array(par_mgr);
+				if (nested)
+					ArrStore_push_node(store, nested);
+				if (par_mgr->err_handle->error_ctr == errors)
+					array_item_end(par_mgr);
+				break;
+			case E_COMMA_TOKEN:
+			case E_RBRACKET_TOKEN:
+				// Ignore empty values after comma.
 				break;
 			default:
-				ret = NULL;
+				// Literals are stored when parsed, variables and expressions have no value yet.
+				ParserMgr_add_error(par_mgr->err_handle, tok, ERR_ARRAY_ITEM);
 				break;
 		}
+	}
+	
+	if (par_mgr->err_handle->error_ctr != errors) {
+		// Skip the rest of the array when it is on the same line, parsing carries on after it.
+		int line = TokenMgr_prev_token(par_mgr->tok_mgr)->lineno;
+		int depth = 0;
 
-		// Ignore empty values after comma.
-		if (!ret) {
-			continue;
+		while (!TokenMgr_is_last_token(par_mgr->tok_mgr) && par_mgr->curr_token->lineno == line) {
+			if (par_mgr->curr_token->type == E_RBRACKET_TOKEN && depth-- == 0)
+				break;
+			if (par_mgr->curr_token->type == E_LBRACKET_TOKEN)
+				depth++;
+			par_mgr_next(par_mgr);
 		}
-
-		// Resize if need be, prior to appending array node.
-		if (arr->data->ArrayNode.dcap - arr->data->ArrayNode.dctr <= 5)
-			arr->data->ArrayNode.items = grow_arr_nodes(arr);
-
-		arr->data->ArrayNode.items[arr->data->ArrayNode.dctr++] = ret;	
+		if (par_mgr->curr_token->lineno == line && par_mgr->curr_token->type == E_RBRACKET_TOKEN)
+			par_mgr_next(par_mgr);
 	}
-	
-	if (par_mgr->curr_token->type != E_RBRACKET_TOKEN)
+	else if (par_mgr->curr_token->type != E_RBRACKET_TOKEN)
 		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_prev_token(par_mgr->tok_mgr), ERR_MISSING_BRACKET);
 	else
 		par_mgr_next(par_mgr);
+
+	// Growth left spare room, drop it now the array is complete.
+	ArrStore_trim(store);
 	
 	return arr;
 
@@ -375,12 +494,13 @@ Node *parse_assignment(ParserMgr *par_mgr) {
 				SyTable_add_symbol(par_mgr->sy_table, tok_start_ptr->value, NULL, tok_start_ptr->lineno ,E_IDN_TYPE);
 			
 			// Identifier.
-			lhand = Node_new(0); 
+			lhand = Node_new(par_mgr->alloc, 0); 
 			lhand->type = E_IDENTIFIER_NODE;
 			lhand->value = tok_start_ptr->value;
+			lhand = par_mgr_cons(par_mgr, lhand);
 
 			// Join to return ast from expression.
-			ast = Node_new(1); 
+			ast = Node_new(par_mgr->alloc, 1); 
 			ast->type = E_EQUAL_NODE;
 			ast->data->AsnStmtNode.left = lhand;
 			ast->data->AsnStmtNode.right = expr;
@@ -397,25 +517,137 @@ Node *parse_assignment(ParserMgr *par_mgr) {
 	return ast;
 }
 
+// Collect the names after needs up to the opening brace of a group.
+static char **parse_needs(ParserMgr *par_mgr, size_t *need_ctr) {
+	char **needs = NULL;
+	size_t cap = 0;
+	*need_ctr = 0;
+
+	par_mgr_next(par_mgr);
+
+	// Group names are lexed as keywords, commas between them are optional.
+	while (!TokenMgr_is_last_token(par_mgr->tok_mgr)
+		&& (par_mgr->curr_token->type == E_KEYWORD_TOKEN || par_mgr->curr_token->type == E_COMMA_TOKEN)
+		&& !string_compare(par_mgr->curr_token->value, "parallel") && !string_compare(par_mgr->curr_token->value, "idempotent")
+		&& !string_compare(par_mgr->curr_token->value, "cache")) {
+		if (par_mgr->curr_token->type == E_KEYWORD_TOKEN) {
+			if (*need_ctr == cap) {
+				size_t n_cap = cap ? cap * 2 : 4;
+				char **n_needs = VAlloc_realloc(par_mgr->alloc, needs, n_cap * sizeof(char *));
+				if (null_check(n_needs, "parse needs")) break;
+				needs = n_needs;
+				cap = n_cap;
+			}
+			needs[(*need_ctr)++] = par_mgr->curr_token->value;
+		}
+		par_mgr_next(par_mgr);
+	}
+
+	if (!*need_ctr)
+		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_prev_token(par_mgr->tok_mgr), ERR_EMPTY_STMT);
+
+	return needs;
+}
+
+// Collect the strings of a cache clause, commas between them are optional.
+static char **parse_cache_paths(ParserMgr *par_mgr, size_t *ctr) {
+	char **paths = NULL;
+	size_t cap = 0;
+
+	*ctr = 0;
+
+	while (!TokenMgr_is_last_token(par_mgr->tok_mgr)
+		&& (par_mgr->curr_token->type == E_STRING_TOKEN || par_mgr->curr_token->type == E_MIXSTR_TOKEN
+		|| par_mgr->curr_token->type == E_COMMA_TOKEN)) {
+		if (par_mgr->curr_token->type != E_COMMA_TOKEN) {
+			if (*ctr == cap) {
+				size_t n_cap = cap ? cap * 2 : 4;
+				char **n_paths = VAlloc_realloc(par_mgr->alloc, paths, n_cap * sizeof(char *));
+				if (null_check(n_paths, "parse cache")) break;
+				paths = n_paths;
+				cap = n_cap;
+			}
+			paths[(*ctr)++] = par_mgr->curr_token->value;
+		}
+		par_mgr_next(par_mgr);
+	}
+
+	return paths;
+}
+
 Node *parse_group(ParserMgr *par_mgr) {
 	Token *grp = NULL;
+	char **needs = NULL;
+	size_t need_ctr = 0;
+	unsigned int jobs = 0;
+	int parallel = 0;
+	char **inputs = NULL;
+	size_t input_ctr = 0;
+	char **outputs = NULL;
+	size_t output_ctr = 0;
+	int cached = 0;
+	int idempotent = 0;
 
 	// Index group name token.
 	grp = TokenMgr_prev_token(par_mgr->tok_mgr);
 
-	if (!parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_LBRACE_TOKEN)) return NULL;
+	// Optional list of groups to run first.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "needs"))
+		needs = parse_needs(par_mgr, &need_ctr);
+
+	// Optional parallel modifier with a limit on commands running at once.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "parallel")) {
+		parallel = 1;
+		par_mgr_next(par_mgr);
+
+		if (par_mgr->curr_token->type == E_INTEGER_TOKEN) {
+			jobs = string_to_int(par_mgr->curr_token->value, strlen(par_mgr->curr_token->value));
+			par_mgr_next(par_mgr);
+		}
+	}
+
+	// Optional marker allowing commands to be run again while slow.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "idempotent")) {
+		idempotent = 1;
+		par_mgr_next(par_mgr);
+	}
+
+	// Optional step cache with its inputs, then the outputs commands leave behind.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "cache")) {
+		cached = 1;
+		par_mgr_next(par_mgr);
+		inputs = parse_cache_paths(par_mgr, &input_ctr);
+
+		if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "creates")) {
+			par_mgr_next(par_mgr);
+			outputs = parse_cache_paths(par_mgr, &output_ctr);
+
+			if (!output_ctr)
+				ParserMgr_add_error(par_mgr->err_handle, TokenMgr_prev_token(par_mgr->tok_mgr), ERR_EMPTY_STMT);
+		}
+	}
+
+	if (!parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_LBRACE_TOKEN)) {
+		VAlloc_free(par_mgr->alloc, needs);
+		VAlloc_free(par_mgr->alloc, inputs);
+		VAlloc_free(par_mgr->alloc, outputs);
+		return NULL;
+	}
 
 	// Check if group already defined.
 	if (SyTable_get_symbol(par_mgr->sy_table, par_mgr->curr_token->value)) {
 		ParserMgr_add_error(par_mgr->err_handle, par_mgr->curr_token, ERR_GROUP_EXIST);
 		par_mgr_next(par_mgr);
+		VAlloc_free(par_mgr->alloc, needs);
+		VAlloc_free(par_mgr->alloc, inputs);
+		VAlloc_free(par_mgr->alloc, outputs);
 		return NULL;
 	}
 
 	par_mgr_next(par_mgr);
 
 	// Group node itself. i.e {some_group}.
-	Node *group = Node_new(1);
+	Node *group = Node_new(par_mgr->alloc, 1);
 	// Previously read command.
 	Node *prev = NULL;
 	// Recently read command.
@@ -423,6 +655,16 @@ Node *parse_group(ParserMgr *par_mgr) {
 	// Setup group node data.
 	group->value = grp->value;
 	group->data->GroupNode.next = NULL;
+	group->data->GroupNode.needs = needs;
+	group->data->GroupNode.need_ctr = need_ctr;
+	group->data->GroupNode.jobs = jobs;
+	group->data->GroupNode.parallel = parallel;
+	group->data->GroupNode.inputs = inputs;
+	group->data->GroupNode.input_ctr = input_ctr;
+	group->data->GroupNode.outputs = outputs;
+	group->data->GroupNode.output_ctr = output_ctr;
+	group->data->GroupNode.cached = cached;
+	group->data->GroupNode.idempotent = idempotent;
 	group->type = E_GROUP_NODE;
 
 	// Create group entry.
@@ -432,7 +674,7 @@ Node *parse_group(ParserMgr *par_mgr) {
 	// Below will build a circular single linked list.
 	while (!TokenMgr_is_last_token(par_mgr->tok_mgr) && par_mgr->curr_token->type == E_STRING_TOKEN) {
 		curr = parse_string(par_mgr);
-		curr->data = malloc(sizeof(union SyntaxNode));
+		curr->data = VAlloc_alloc(par_mgr->alloc, sizeof(union SyntaxNode));
 		
 		if (!prev)
 			group->data->GroupNode.next = curr;
@@ -450,20 +692,177 @@ Node *parse_group(ParserMgr *par_mgr) {
 	return group;
 }
 
+// Append a statement to the body of a loop.
+static int foreach_push(ParserMgr *par_mgr, Node *loop, Node *stmt, size_t *cap) {
+	if (loop->data->ForeachNode.body_ctr == *cap) {
+		size_t n_cap = *cap ? *cap * 2 : 4;
+		Node **n_body = VAlloc_realloc(par_mgr->alloc, loop->data->ForeachNode.body, n_cap * sizeof(Node *));
+		if (null_check(n_body, "foreach push")) return -1;
+		loop->data->ForeachNode.body = n_body;
+		*cap = n_cap;
+	}
+
+	loop->data->ForeachNode.body[loop->data->ForeachNode.body_ctr++] = stmt;
+	return 0;
+}
+
+Node *parse_foreach(ParserMgr *par_mgr) {
+	// Store loop keyword token.
+	Token *name = par_mgr->curr_token;
+
+	par_mgr_next(par_mgr);
+
+	if (!parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_IDENTIFIER_TOKEN)) return NULL;
+
+	// Loop variable only exists inside the body so it isn't added to the symbol table.
+	Node *var = Node_new(par_mgr->alloc, 0);
+	var->type = E_IDENTIFIER_NODE;
+	var->value = par_mgr->curr_token->value;
+
+	par_mgr_next(par_mgr);
+
+	if (par_mgr->curr_token->type != E_KEYWORD_TOKEN || !string_compare(par_mgr->curr_token->value, "in")) {
+		ParserMgr_add_error(par_mgr->err_handle, par_mgr->curr_token, ERR_UNEXPECTED);
+		VAlloc_free(par_mgr->alloc, var);
+		return NULL;
+	}
+
+	par_mgr_next(par_mgr);
+
+	Node *items = parse_expr(par_mgr);
+	par_mgr_sync(par_mgr);
+
+	if (!items) {
+		ParserMgr_add_error(par_mgr->err_handle, name, ERR_EMPTY_STMT);
+		VAlloc_free(par_mgr->alloc, var);
+		return NULL;
+	}
+
+	Node *loop = Node_new(par_mgr->alloc, 1);
+	loop->type = E_FOREACH_NODE;
+	loop->value = name->value;
+	loop->data->ForeachNode.var = var;
+	loop->data->ForeachNode.items = items;
+	loop->data->ForeachNode.body = NULL;
+	loop->data->ForeachNode.body_ctr = 0;
+	loop->data->ForeachNode.jobs = 0;
+	loop->data->ForeachNode.parallel = 0;
+
+	// Optional parallel modifier with a limit on threads.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "parallel")) {
+		loop->data->ForeachNode.parallel = 1;
+		par_mgr_next(par_mgr);
+
+		if (par_mgr->curr_token->type == E_INTEGER_TOKEN) {
+			loop->data->ForeachNode.jobs = string_to_int(par_mgr->curr_token->value, strlen(par_mgr->curr_token->value));
+			par_mgr_next(par_mgr);
+		}
+	}
+
+	if (!parser_expects(par_mgr, ERR_UNEXPECTED, 1, E_LBRACE_TOKEN)) return loop;
+
+	par_mgr_next(par_mgr);
+
+	// Body is parsed the same way as top level statements.
+	size_t cap = 0;
+	Node *stmt = NULL;
+
+	while (!TokenMgr_is_last_token(par_mgr->tok_mgr) && par_mgr->curr_token->type != E_RBRACE_TOKEN) {
+		if (par_mgr->curr_token->type == E_IDENTIFIER_TOKEN) {
+			stmt = parse_assignment(par_mgr);
+		}
+		else if (par_mgr->curr_token->type == E_KEYWORD_TOKEN) {
+			stmt = parse_keyword(par_mgr);
+		}
+		else {
+			ParserMgr_add_error(par_mgr->err_handle, par_mgr->curr_token, ERR_UNEXPECTED);
+			par_mgr_next(par_mgr);
+			continue;
+		}
+
+		if (stmt) {
+			stmt->depth = par_mgr->expr_depth;
+			foreach_push(par_mgr, loop, stmt, &cap);
+		}
+
+		par_mgr_sync(par_mgr);
+	}
+
+	if (par_mgr->curr_token->type != E_RBRACE_TOKEN)
+		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_prev_token(par_mgr->tok_mgr), ERR_MISSING_BRACE);
+	else
+		par_mgr_next(par_mgr);
+
+	return loop;
+}
+
+Node *parse_run(ParserMgr *par_mgr) {
+	// Store run keyword token.
+	Token *name = par_mgr->curr_token;
+
+	par_mgr_next(par_mgr);
+
+	// Group names are lexed as keywords, the group itself is looked up when run.
+	if (par_mgr->curr_token->type != E_KEYWORD_TOKEN) {
+		ParserMgr_add_error(par_mgr->err_handle, name, ERR_EMPTY_STMT);
+		return NULL;
+	}
+
+	Node *args = Node_new(par_mgr->alloc, 0);
+	args->type = E_STRING_NODE;
+	args->value = par_mgr->curr_token->value;
+
+	Node *stmt = Node_new(par_mgr->alloc, 1);
+	stmt->type = E_FUNC_NODE;
+	stmt->value = name->value;
+	stmt->data->FuncNode.args = args;
+	stmt->data->FuncNode.hosts = NULL;
+
+	par_mgr_next(par_mgr);
+
+	// Optional hosts, an array or the path of an inventory file.
+	if (par_mgr->curr_token->type == E_KEYWORD_TOKEN && string_compare(par_mgr->curr_token->value, "on")) {
+		par_mgr_next(par_mgr);
+
+		Node *hosts = parse_expr(par_mgr);
+		par_mgr_sync(par_mgr);
+		if (!hosts)
+			hosts = parse_string(par_mgr);
+
+		if (!hosts)
+			ParserMgr_add_error(par_mgr->err_handle, par_mgr->curr_token, ERR_UNEXPECTED);
+
+		stmt->data->FuncNode.hosts = hosts;
+	}
+
+	return stmt;
+}
+
 Node *parse_keyword(ParserMgr *par_mgr) {
 	// Peek into the next token in TokenMgr.
 	Token *peek = TokenMgr_peek_token(par_mgr->tok_mgr);
 
-	if (peek->type == E_LBRACE_TOKEN) {
+	if (string_compare(par_mgr->curr_token->value, "foreach"))
+		return parse_foreach(par_mgr);
+
+	if (peek->type == E_LBRACE_TOKEN
+		|| (peek->type == E_KEYWORD_TOKEN && (string_compare(peek->value, "needs") || string_compare(peek->value, "parallel")
+		|| string_compare(peek->value, "idempotent") || string_compare(peek->value, "cache")))) {
 		par_mgr_next(par_mgr);
 		return parse_group(par_mgr);
 	}
 
+	if (string_compare(par_mgr->curr_token->value, "run"))
+		return parse_run(par_mgr);
+
 	// If valid arg isn't next then store error and move to next token.
 	if (peek->type != E_STRING_TOKEN
 		&& peek->type != E_MIXSTR_TOKEN
 		&& peek->type != E_INTEGER_TOKEN
-		&& peek->type != E_IDENTIFIER_TOKEN) {
+		&& peek->type != E_IDENTIFIER_TOKEN
+		&& peek->type != E_LBRACKET_TOKEN
+		&& !is_reduce_keyword(peek)
+		&& !setop_arity(peek)) {
 		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_current_token(par_mgr->tok_mgr), ERR_EMPTY_STMT);
 		par_mgr_next(par_mgr);
 		return NULL;
@@ -481,10 +880,11 @@ Node *parse_keyword(ParserMgr *par_mgr) {
 	// If args is valid then store.
 	// TODO: Consolidate below to one ?
 	if ((args = parse_expr(par_mgr)) || (args = parse_string(par_mgr))) {
-		stmt = Node_new(1);
+		stmt = Node_new(par_mgr->alloc, 1);
 		stmt->type = E_FUNC_NODE;
 		stmt->value = name->value;
 		stmt->data->FuncNode.args = args;
+		stmt->data->FuncNode.hosts = NULL;
 	}
 	else {
 		ParserMgr_add_error(par_mgr->err_handle, TokenMgr_current_token(par_mgr->tok_mgr), ERR_UNEXPECTED);
@@ -497,7 +897,7 @@ Node *parse_keyword(ParserMgr *par_mgr) {
 ParserMgr *ParseMgr_init(TokenMgr *tok_mgr, SyTable *sy_table, NodeMgr *node_mgr, Error *err) {
 	if (!tok_mgr || !sy_table || !node_mgr || !err) return NULL;
 
-	ParserMgr *par_mgr = ParserMgr_new();
+	ParserMgr *par_mgr = ParserMgr_new(node_mgr->alloc);
 	par_mgr->tok_mgr = tok_mgr;
 	par_mgr->sy_table = sy_table;
 	par_mgr->err_handle = err;
@@ -535,8 +935,6 @@ Node *Parser_parse(ParserMgr *par_mgr) {
 
 		par_mgr_sync(par_mgr);
 	}
-	
-	Error_print_all(par_mgr->err_handle);
 
 	return ast;
 }
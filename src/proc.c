@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "proc.h"
+#include "utils.h"
+
+extern char **environ;
+
+// Characters which only a shell knows how to interpret.
+static const char *Shell_Meta = "|&;<>()$`\\\"'*?[]#~{}!\n";
+
+// Commands which change the shell itself rather than run a program.
+static const char *Shell_Builtins[] = {
+	"cd", "export", "unset", "source", ".", "exit", "set", "alias", "ulimit",
+	"umask", "exec", "eval", "read", "wait", "trap", "shift"
+};
+
+#define SHELL_BUILTINS_SIZE (sizeof(Shell_Builtins) / sizeof(Shell_Builtins[0]))
+
+static int is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static long long now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int Proc_needs_shell(const char *cmd) {
+	if (null_check((void *) cmd, "proc needs shell")) return 1;
+
+	while (is_blank(*cmd))
+		cmd++;
+
+	if (*cmd == '\0' || strpbrk(cmd, Shell_Meta))
+		return 1;
+
+	size_t len = 0;
+	while (cmd[len] && !is_blank(cmd[len]))
+		len++;
+
+	// Variable assignment such as FOO=1 make.
+	if (memchr(cmd, '=', len))
+		return 1;
+
+	for (size_t i = 0; i < SHELL_BUILTINS_SIZE; i++) {
+		if (strlen(Shell_Builtins[i]) == len && strncmp(Shell_Builtins[i], cmd, len) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+// Split a command into whitespace separated words, words point into copy.
+static char **split_argv(const char *cmd, char *copy, VAllocator *alloc) {
+	size_t ctr = 0;
+	size_t cap = 8;
+	char **argv = VAlloc_alloc(alloc, cap * sizeof(char *));
+	if (null_check(argv, "split argv")) return NULL;
+
+	strcpy(copy, cmd);
+
+	for (char *itr = copy; *itr;) {
+		while (is_blank(*itr))
+			*itr++ = '\0';
+
+		if (*itr == '\0')
+			break;
+
+		// Keep room for the terminating NULL.
+		if (ctr + 1 == cap) {
+			cap *= 2;
+			char **n_argv = VAlloc_realloc(alloc, argv, cap * sizeof(char *));
+			if (null_check(n_argv, "split argv")) {
+				VAlloc_free(alloc, argv);
+				return NULL;
+			}
+			argv = n_argv;
+		}
+
+		argv[ctr++] = itr;
+		while (*itr && !is_blank(*itr))
+			itr++;
+	}
+
+	argv[ctr] = NULL;
+	return argv;
+}
+
+// Record why a command couldn't be started.
+static void spawn_failed(Proc *proc, const char *what, int code) {
+	VString_pushs(&proc->err, "vmel: ");
+	VString_pushs(&proc->err, (char *) what);
+	VString_pushs(&proc->err, ": ");
+	VString_pushs(&proc->err, strerror(code));
+	VString_pushc(&proc->err, '\n');
+	proc->status = 127;
+}
+
+void Proc_init(Proc *proc, int direct, VAllocator *alloc) {
+	if (null_check(proc, "proc init")) return;
+
+	proc->pid = -1;
+	proc->out_fd = -1;
+	proc->err_fd = -1;
+	proc->status = 0;
+	proc->direct = direct;
+	proc->cached = 0;
+	proc->hedged = 0;
+	proc->elapsed_us = 0;
+	proc->out = VString_new(alloc);
+	proc->err = VString_new(alloc);
+	proc->start_us = now_us();
+}
+
+int Proc_spawn(Proc *proc, const char *cmd, VAllocator *alloc) {
+	return Proc_spawn_in(proc, cmd, NULL, NULL, alloc);
+}
+
+// Start path with argv, output connected to new pipes stored in proc.
+static int spawn_argv(Proc *proc, const char *path, char *const *argv, const char *cwd, char *const *env) {
+	int out_pipe[2];
+	int err_pipe[2];
+
+	// Close on exec so children spawned by other threads don't inherit them.
+	if (pipe2(out_pipe, O_CLOEXEC)) {
+		spawn_failed(proc, "pipe", errno);
+		return -1;
+	}
+
+	if (pipe2(err_pipe, O_CLOEXEC)) {
+		spawn_failed(proc, "pipe", errno);
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		return -1;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+	if (cwd)
+		posix_spawn_file_actions_addchdir_np(&actions, cwd);
+	posix_spawnattr_init(&attr);
+
+	// Threads running an event loop block SIGCHLD, children start with nothing blocked.
+	sigset_t mask;
+	short flags = POSIX_SPAWN_SETSIGMASK;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+
+	int ret = posix_spawnp(&proc->pid, path, &actions, &attr, argv, env ? env : environ);
+	if (ret)
+		spawn_failed(proc, path, ret);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	// Write ends now belong to the child.
+	close(out_pipe[1]);
+	close(err_pipe[1]);
+
+	if (ret) {
+		proc->pid = -1;
+		close(out_pipe[0]);
+		close(err_pipe[0]);
+		return -1;
+	}
+
+	proc->out_fd = out_pipe[0];
+	proc->err_fd = err_pipe[0];
+	return 0;
+}
+
+int Proc_spawn_in(Proc *proc, const char *cmd, const char *cwd, char *const *env, VAllocator *alloc) {
+	if (null_check(proc, "proc spawn") || null_check((void *) cmd, "proc spawn")) return -1;
+
+	Proc_init(proc, !Proc_needs_shell(cmd), alloc);
+
+	if (!proc->direct) {
+		char *argv[] = {"sh", "-c", (char *) cmd, NULL};
+		return spawn_argv(proc, "/bin/sh", argv, cwd, env);
+	}
+
+	char *copy = VAlloc_alloc(alloc, strlen(cmd) + 1);
+	char **argv = copy ? split_argv(cmd, copy, alloc) : NULL;
+	int ret = -1;
+
+	if (argv)
+		ret = spawn_argv(proc, argv[0], argv, cwd, env);
+	else
+		spawn_failed(proc, "spawn", ENOMEM);
+
+	VAlloc_free(alloc, argv);
+	VAlloc_free(alloc, copy);
+	return ret;
+}
+
+int Proc_spawn_argv(Proc *proc, char *const *argv, const char *cwd, char *const *env, VAllocator *alloc) {
+	if (null_check(proc, "proc spawn argv") || null_check((void *) argv, "proc spawn argv")) return -1;
+
+	Proc_init(proc, 1, alloc);
+	return spawn_argv(proc, argv[0], argv, cwd, env);
+}
+
+int Proc_wait(Proc *proc) {
+	if (null_check(proc, "proc wait")) return -1;
+
+	char buf[4096];
+	struct pollfd fds[2] = {
+		{proc->out_fd, POLLIN, 0},
+		{proc->err_fd, POLLIN, 0}
+	};
+	VString *dest[2] = {&proc->out, &proc->err};
+	int open_ctr = (proc->out_fd >= 0) + (proc->err_fd >= 0);
+
+	// Drain both pipes together so a child blocked writing one of them can't stall.
+	while (open_ctr > 0) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+
+			ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+
+			if (n > 0) {
+				VString_pushn(dest[i], buf, n);
+			}
+			else if (n == 0 || errno != EINTR) {
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				open_ctr--;
+			}
+		}
+	}
+
+	// Pipes which were never polled still need closing.
+	for (int i = 0; i < 2; i++) {
+		if (fds[i].fd >= 0)
+			close(fds[i].fd);
+	}
+
+	proc->out_fd = -1;
+	proc->err_fd = -1;
+
+	int wstatus = 0;
+
+	if (proc->pid > 0)
+		while (waitpid(proc->pid, &wstatus, 0) < 0 && errno == EINTR);
+
+	Proc_exited(proc, wstatus);
+	return proc->status;
+}
+
+void Proc_exited(Proc *proc, int wstatus) {
+	if (null_check(proc, "proc exited")) return;
+
+	// Commands which never started keep the status set when spawning failed.
+	if (proc->pid > 0) {
+		if (WIFEXITED(wstatus))
+			proc->status = WEXITSTATUS(wstatus);
+		else if (WIFSIGNALED(wstatus))
+			proc->status = 128 + WTERMSIG(wstatus);
+	}
+
+	proc->pid = -1;
+	proc->elapsed_us = now_us() - proc->start_us;
+}
+
+void Proc_free(Proc *proc) {
+	if (null_check(proc, "proc free")) return;
+
+	VString_free(&proc->out);
+	VString_free(&proc->err);
+}
+
+ProcLog *ProcLog_new(VAllocator *alloc) {
+	ProcLog *log = VAlloc_alloc(alloc, sizeof(ProcLog));
+	if (null_check(log, "proclog new")) return NULL;
+
+	log->stats = NULL;
+	log->ctr = 0;
+	log->cap = 0;
+	log->alloc = alloc;
+	pthread_mutex_init(&log->lock, NULL);
+	return log;
+}
+
+int ProcLog_add(ProcLog *log, const char *group, const char *host, Proc *proc, const char *cmd) {
+	if (null_check(log, "proclog add") || null_check(proc, "proclog add")) return -1;
+
+	// Host and command share one allocation, the host first.
+	size_t len = strlen(cmd);
+	size_t host_len = host ? strlen(host) + 1 : 0;
+	char *copy = VAlloc_alloc(log->alloc, host_len + len + 1);
+	if (null_check(copy, "proclog add")) return -1;
+	if (host)
+		memcpy(copy, host, host_len);
+	memcpy(copy + host_len, cmd, len + 1);
+
+	pthread_mutex_lock(&log->lock);
+
+	if (log->ctr == log->cap) {
+		size_t n_cap = log->cap ? log->cap * 2 : 16;
+		ProcStat *n_stats = VAlloc_realloc(log->alloc, log->stats, n_cap * sizeof(ProcStat));
+
+		if (null_check(n_stats, "proclog add")) {
+			pthread_mutex_unlock(&log->lock);
+			VAlloc_free(log->alloc, copy);
+			return -1;
+		}
+
+		log->stats = n_stats;
+		log->cap = n_cap;
+	}
+
+	ProcStat *stat = &log->stats[log->ctr++];
+	stat->group = group;
+	stat->host = host ? copy : NULL;
+	stat->cmd = copy + host_len;
+	stat->status = proc->status;
+	stat->direct = proc->direct;
+	stat->cached = proc->cached;
+	stat->hedged = proc->hedged;
+	stat->elapsed_us = proc->elapsed_us;
+
+	pthread_mutex_unlock(&log->lock);
+	return 0;
+}
+
+void ProcLog_print(ProcLog *log, FILE *out) {
+	if (null_check(log, "proclog print")) return;
+
+	size_t failed = 0;
+	size_t direct = 0;
+	size_t cached = 0;
+	size_t hedged = 0;
+	long long total = 0;
+
+	for (size_t i = 0; i < log->ctr; i++) {
+		failed += log->stats[i].status != 0;
+		direct += log->stats[i].direct && !log->stats[i].cached;
+		cached += log->stats[i].cached;
+		hedged += log->stats[i].hedged;
+		total += log->stats[i].elapsed_us;
+	}
+
+	fprintf(out, "Commands: %lu run, %lu failed, %lu without shell", log->ctr - cached, failed, direct);
+	if (cached)
+		fprintf(out, ", %lu cached", cached);
+	if (hedged)
+		fprintf(out, ", %lu hedged", hedged);
+	fprintf(out, " | Time: %.3f ms\n", total / 1000.0);
+
+	for (size_t i = 0; i < log->ctr; i++) {
+		ProcStat *stat = &log->stats[i];
+		fprintf(out, "  {%s}%s%s %-6s status %-3d %10.3f ms  %s\n", stat->group, stat->host ? "@" : "",
+			stat->host ? stat->host : "", stat->cached ? "cached" : stat->hedged ? "hedged" : stat->direct ? "direct" : "shell", stat->status, stat->elapsed_us / 1000.0, stat->cmd);
+	}
+}
+
+void ProcLog_free(ProcLog *log) {
+	if (null_check(log, "proclog free")) return;
+
+	for (size_t i = 0; i < log->ctr; i++)
+		VAlloc_free(log->alloc, log->stats[i].host ? log->stats[i].host : log->stats[i].cmd);
+
+	pthread_mutex_destroy(&log->lock);
+	VAlloc_free(log->alloc, log->stats);
+	VAlloc_free(log->alloc, log);
+}
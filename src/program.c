@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "program.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "utils.h"
+#include "conf.h"
+
+Program *Program_compile(char *buff, unsigned int flags, VAllocator *alloc, Error *err_handle) {
+	if (null_check(buff, "program compile") || null_check(err_handle, "program compile")) return NULL;
+
+	TokenMgr *tok_mgr = TokenMgr_new(alloc);
+	tok_mgr->err_handle = err_handle;
+
+	if (TokenMgr_build_tokens(buff, tok_mgr)) {
+		TokenMgr_free(tok_mgr);
+		return NULL;
+	}
+
+	if (flags & PROGRAM_DUMP_TOKENS)
+		TokenMgr_print_tokens(tok_mgr);
+
+	Program *program = VAlloc_alloc(alloc, sizeof(Program));
+	program->alloc = alloc;
+	program->layout = SyTable_new(alloc);
+	program->node_mgr = NodeMgr_new(alloc);
+	program->liveness = NULL;
+	program->schedule = NULL;
+	program->dag = NULL;
+	program->group_ctr = 0;
+	program->flags = flags;
+
+	if (flags & PROGRAM_HASH_CONS)
+		NodeMgr_enable_cons(program->node_mgr);
+
+	ParserMgr *par_mgr = ParseMgr_init(tok_mgr, program->layout, program->node_mgr, err_handle);
+	Parser_parse(par_mgr);
+	ParserMgr_free(par_mgr);
+
+	for (size_t i = 0; i < program->layout->sym_ctr; i++)
+		program->group_ctr += program->layout->symbols[i]->sy_type == E_GROUP_TYPE;
+
+	// Undefined needs and cycles are compile errors so check them before anything else.
+	if (err_handle->error_ctr == 0)
+		program->dag = GroupDag_build(program->node_mgr, program->layout, err_handle, alloc);
+
+	// Statements of a program with errors are never run so there is nothing to analyse.
+	if ((flags & (PROGRAM_DSE | PROGRAM_PARALLEL)) && err_handle->error_ctr == 0)
+		program->liveness = Liveness_analyse(program->node_mgr, alloc);
+
+	if ((flags & PROGRAM_PARALLEL) && program->liveness)
+		program->schedule = Schedule_build(program->liveness, flags & PROGRAM_DSE, alloc);
+
+	// Nodes reference token values so keep them alive with the program.
+	program->consts = TokenMgr_release_pool(tok_mgr);
+	TokenMgr_free(tok_mgr);
+
+	return program;
+}
+
+void Program_free(Program *program) {
+	if (null_check(program, "program free")) return;
+
+	if (program->schedule)
+		Schedule_free(program->schedule);
+	if (program->liveness)
+		Liveness_free(program->liveness);
+	if (program->dag)
+		GroupDag_free(program->dag);
+	NodeMgr_free(program->node_mgr);
+	SyTable_free(program->layout);
+	StrPool_free(program->consts);
+	VAlloc_free(program->alloc, program);
+}
+
+void Program_print_report(Program *program, FILE *out) {
+	if (null_check(program, "program report")) return;
+
+	fprintf(out, "Statements: %lu | Constants: %lu bytes\n", program->node_mgr->nodes_ctr, program->consts->bytes);
+
+	NodeCons *cons = program->node_mgr->cons;
+	if (cons)
+		fprintf(out, "Hash-consing: %lu unique nodes | %lu duplicates shared | %lu bytes saved\n", cons->slot_ctr, cons->hits, cons->bytes_saved);
+
+	if (program->liveness && (program->flags & PROGRAM_DSE))
+		Liveness_print_report(program->liveness, program->node_mgr, out);
+
+	if (program->schedule)
+		fprintf(out, "Waves: %lu | Widest: %lu statements\n", program->schedule->wave_ctr, program->schedule->widest);
+}
+
+// Determine if an assignment would store the same value as last time.
+static int cache_fresh(StmtCache *entry) {
+	if (!entry->valid || entry->target->version != entry->version)
+		return 0;
+
+	for (size_t i = 0; i < entry->read_ctr; i++) {
+		if (entry->reads[i].sy->version != entry->reads[i].version)
+			return 0;
+	}
+
+	return 1;
+}
+
+// Remember what an assignment read, those which raised errors or read unknown names are always rerun.
+static void cache_store(Frame *frame, StmtCache *entry, Node *stmt, size_t errors) {
+	NexecMgr *nexec_mgr = frame->nexec_mgr;
+
+	entry->valid = 0;
+
+	if (frame->err_handle->error_ctr != errors || !stmt->data->AsnStmtNode.left)
+		return;
+
+	Symbol *target = SyTable_get_symbol(frame->sy_table, stmt->data->AsnStmtNode.left->value);
+	if (!target)
+		return;
+
+	for (size_t i = 0; i < nexec_mgr->read_ctr; i++) {
+		if (!nexec_mgr->reads[i].sy)
+			return;
+	}
+
+	if (entry->read_cap < nexec_mgr->read_ctr) {
+		SymRead *n_reads = VAlloc_realloc(frame->alloc, entry->reads, nexec_mgr->read_ctr * sizeof(SymRead));
+		if (null_check(n_reads, "cache store")) return;
+		entry->reads = n_reads;
+		entry->read_cap = nexec_mgr->read_ctr;
+	}
+
+	if (nexec_mgr->read_ctr)
+		memcpy(entry->reads, nexec_mgr->reads, nexec_mgr->read_ctr * sizeof(SymRead));
+	entry->read_ctr = nexec_mgr->read_ctr;
+	entry->target = target;
+	entry->version = target->version;
+	entry->valid = 1;
+}
+
+// Execute an assignment unless its cached result is still up to date.
+static void run_cached(Frame *frame, StmtCache *entry, Node *stmt) {
+	if (cache_fresh(entry)) {
+		frame->reused++;
+		return;
+	}
+
+	size_t errors = frame->err_handle->error_ctr;
+
+	frame->nexec_mgr->track = 1;
+	frame->nexec_mgr->read_ctr = 0;
+	Nexec_exec(frame->nexec_mgr, stmt);
+	frame->nexec_mgr->track = 0;
+
+	cache_store(frame, entry, stmt, errors);
+}
+
+// Create what only groups use once a Program with groups first runs, before any thread may need it.
+static int frame_groups(Program *program, Frame *frame) {
+	NexecMgr *nexec_mgr = frame->nexec_mgr;
+
+	if (frame->pool || !program->group_ctr)
+		return 0;
+
+	frame->pool = TransportPool_new(frame->transport, frame->latency_ms, nexec_mgr->fanout, frame->alloc);
+	if (!frame->pool)
+		return -1;
+
+	frame->steps = StepCache_new(VMEL_CACHE_DIR, frame->alloc);
+	frame->hedge = frame->hedge_pct ? Hedge_new(frame->hedge_pct, frame->alloc) : NULL;
+
+	// Durations of earlier runs order groups by their critical path.
+	if (program->dag) {
+		frame->history = DagHistory_new(program->dag, frame->alloc);
+		if (frame->history)
+			DagHistory_load(frame->history, program->dag, VMEL_DAG_HISTORY);
+	}
+
+	nexec_mgr->pool = frame->pool;
+	nexec_mgr->steps = frame->steps;
+	nexec_mgr->hedge = frame->hedge;
+	nexec_mgr->history = frame->history;
+	return 0;
+}
+
+int Program_run(Program *program, Frame *frame) {
+	if (null_check(program, "program run") || null_check(frame, "program run")) return -1;
+
+	if (frame_groups(program, frame))
+		return -1;
+
+	unsigned char *dead = (program->flags & PROGRAM_DSE) && program->liveness ? program->liveness->dead : NULL;
+	size_t nodes_ctr = program->node_mgr->nodes_ctr;
+
+	// Threads share the symbol table so its allocator must be thread safe.
+	int shared_alloc = !frame->alloc || frame->alloc == VAlloc_system();
+
+	// Statements of a run being resumed start in the middle, waves would run them all.
+	size_t resume = frame->journal ? frame->journal->resume : 0;
+
+	if (program->schedule && frame->jobs > 1 && !frame->incremental && shared_alloc && !resume)
+		return Parallel_run(program->schedule, frame->nexec_mgr, frame->jobs);
+
+	if (frame->incremental && !frame->cache) {
+		frame->cache = VAlloc_calloc(frame->alloc, (nodes_ctr + 1) * sizeof(StmtCache));
+		if (null_check(frame->cache, "program run")) return -1;
+		frame->cache_ctr = nodes_ctr;
+	}
+
+	for (size_t i = resume; i < nodes_ctr; i++) {
+		Node *stmt = program->node_mgr->nodes[i];
+		size_t errors = frame->err_handle->error_ctr;
+
+		if (dead && dead[i])
+			continue;
+
+		frame->nexec_mgr->stmt = i;
+
+		if (frame->cache && stmt->type == E_EQUAL_NODE)
+			run_cached(frame, &frame->cache[i], stmt);
+		else
+			Nexec_exec(frame->nexec_mgr, stmt);
+
+		if (frame->journal)
+			Journal_statement(frame->journal, frame->sy_table, i, frame->err_handle->error_ctr != errors);
+	}
+
+	return 0;
+}
+
+Frame *Frame_new(Program *program, VAllocator *alloc) {
+	if (null_check(program, "frame new")) return NULL;
+
+	Frame *frame = VAlloc_alloc(alloc, sizeof(Frame));
+	frame->alloc = alloc;
+	frame->sy_table = SyTable_clone(program->layout, alloc);
+	frame->err_handle = Error_new(alloc);
+	frame->nexec_mgr = Nexec_init(frame->sy_table, program->node_mgr, frame->err_handle);
+	frame->out = OutSink_new(alloc, STDOUT_FILENO, 0, SINK_FLUSH_SIZE);
+	frame->nexec_mgr->out = frame->out;
+	frame->nexec_mgr->threaded = !alloc || alloc == VAlloc_system();
+	frame->nexec_mgr->dag = program->dag;
+	frame->pool = NULL;
+	frame->history = NULL;
+	frame->steps = NULL;
+	frame->journal = NULL;
+	frame->hedge = NULL;
+	frame->transport = Transport_find("local");
+	frame->latency_ms = 0;
+	frame->hedge_pct = VMEL_HEDGE_PERCENTILE;
+	frame->jobs = 1;
+	frame->incremental = 0;
+	frame->cache = NULL;
+	frame->cache_ctr = 0;
+	frame->reused = 0;
+	return frame;
+}
+
+// Release cached dependencies of every statement.
+static void frame_free_cache(Frame *frame) {
+	if (!frame->cache)
+		return;
+
+	for (size_t i = 0; i < frame->cache_ctr; i++)
+		VAlloc_free(frame->alloc, frame->cache[i].reads);
+
+	VAlloc_free(frame->alloc, frame->cache);
+	frame->cache = NULL;
+	frame->cache_ctr = 0;
+}
+
+int Frame_set_incremental(Frame *frame, int enable) {
+	if (null_check(frame, "frame set incremental")) return -1;
+
+	frame->incremental = enable ? 1 : 0;
+	if (!enable)
+		frame_free_cache(frame);
+	return 0;
+}
+
+int Frame_set_jobs(Frame *frame, unsigned int jobs) {
+	if (null_check(frame, "frame set jobs")) return -1;
+
+	if (jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+
+	frame->jobs = jobs;
+	frame->nexec_mgr->jobs = jobs;
+	return 0;
+}
+
+int Frame_set_journal(Frame *frame, Journal *journal) {
+	if (null_check(frame, "frame set journal")) return -1;
+
+	if (journal && Journal_start(journal, frame->sy_table))
+		return -1;
+
+	frame->journal = journal;
+	frame->nexec_mgr->journal = journal;
+	return 0;
+}
+
+int Frame_set_hedge(Frame *frame, unsigned int percentile) {
+	if (null_check(frame, "frame set hedge")) return -1;
+
+	if (percentile > 100)
+		return -1;
+
+	frame->hedge_pct = percentile;
+
+	// Durations of peers are kept once groups ran, only the percentile changes.
+	if (frame->hedge && percentile) {
+		frame->hedge->percentile = percentile;
+	}
+	else if (frame->hedge) {
+		Hedge_free(frame->hedge);
+		frame->hedge = NULL;
+		frame->nexec_mgr->hedge = NULL;
+	}
+	else if (frame->pool && percentile) {
+		frame->hedge = Hedge_new(percentile, frame->alloc);
+		frame->nexec_mgr->hedge = frame->hedge;
+	}
+	return 0;
+}
+
+int Frame_set_log(Frame *frame, ProcLog *log) {
+	if (null_check(frame, "frame set log")) return -1;
+
+	frame->nexec_mgr->log = log;
+	return 0;
+}
+
+int Frame_set_transport(Frame *frame, const Transport *transport, unsigned int latency_ms) {
+	if (null_check(frame, "frame set transport") || null_check((void *) transport, "frame set transport")) return -1;
+
+	frame->transport = transport;
+	frame->latency_ms = latency_ms;
+
+	// Pools are created by the first run of a Program with groups.
+	if (!frame->pool)
+		return 0;
+
+	TransportPool *pool = TransportPool_new(transport, latency_ms, frame->nexec_mgr->fanout, frame->alloc);
+	if (!pool)
+		return -1;
+
+	TransportPool_free(frame->pool);
+	frame->pool = pool;
+	frame->nexec_mgr->pool = pool;
+	return 0;
+}
+
+int Frame_set_fanout(Frame *frame, unsigned int hosts) {
+	if (null_check(frame, "frame set fanout")) return -1;
+
+	if (hosts == 0)
+		hosts = VMEL_FANOUT_HOSTS;
+
+	frame->nexec_mgr->fanout = hosts;
+	if (frame->pool)
+		frame->pool->max_active = hosts;
+	return 0;
+}
+
+int Frame_set_var(Frame *frame, char *name, char *value) {
+	if (null_check(frame, "frame set var")) return -1;
+
+	Symbol *sy = SyTable_get_symbol(frame->sy_table, name);
+	if (!sy || SyTable_update_symbol(frame->sy_table, name, value))
+		return -1;
+
+	if (!sy->pinned) {
+		sy->pinned = 1;
+		frame->nexec_mgr->pinned++;
+	}
+
+	return 0;
+}
+
+int Frame_set_output(Frame *frame, int fd, enum SinkFlush policy) {
+	if (null_check(frame, "frame set output")) return -1;
+	return OutSink_redirect(frame->out, fd, policy);
+}
+
+int Frame_free(Frame *frame) {
+	if (null_check(frame, "frame free")) return -1;
+
+	frame_free_cache(frame);
+	NexecMgr_free(frame->nexec_mgr);
+	if (frame->pool)
+		TransportPool_free(frame->pool);
+	if (frame->history)
+		DagHistory_free(frame->history);
+	if (frame->steps)
+		StepCache_free(frame->steps);
+	if (frame->hedge)
+		Hedge_free(frame->hedge);
+	OutSink_free(frame->out);
+	Error_free(frame->err_handle);
+	SyTable_free(frame->sy_table);
+	VAlloc_free(frame->alloc, frame);
+	return 0;
+}
@@ -0,0 +1,537 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "session.h"
+#include "transport.h"
+#include "utils.h"
+
+extern char **environ;
+
+Session *Session_new(const Transport *transport, const char *host, unsigned int latency_ms, VAllocator *alloc) {
+	if (null_check((void *) transport, "session new") || null_check((void *) host, "session new")) return NULL;
+
+	Session *session = VAlloc_alloc(alloc, sizeof(Session));
+	if (null_check(session, "session new")) return NULL;
+
+	session->transport = transport;
+	session->host = VString_new(alloc);
+	VString_set(&session->host, (char *) host);
+	session->home = VString_new(alloc);
+	session->latency_ms = latency_ms;
+	session->pid = -1;
+	session->in_fd = -1;
+	session->out_fd = -1;
+	session->err_fd = -1;
+	session->marker[0] = '\0';
+	session->cwd = VString_new(alloc);
+	session->env = VArray_new(alloc, VARRAY_STR, 0);
+	session->env_ptrs = NULL;
+	session->out = VString_new(alloc);
+	session->err = VString_new(alloc);
+	session->cmd = VString_new(alloc);
+	session->started = 0;
+	session->busy = 0;
+	session->live = 0;
+	session->spare = 0;
+	session->next = NULL;
+	session->stream = NULL;
+	session->stream_ctx = NULL;
+	session->alloc = alloc;
+	pthread_mutex_init(&session->lock, NULL);
+	return session;
+}
+
+int Session_stop(Session *session) {
+	if (null_check(session, "session stop")) return 0;
+
+	int wstatus = 0;
+
+	if (session->in_fd >= 0)
+		close(session->in_fd);
+	if (session->out_fd >= 0)
+		close(session->out_fd);
+	if (session->err_fd >= 0)
+		close(session->err_fd);
+
+	if (session->pid > 0)
+		while (waitpid(session->pid, &wstatus, 0) < 0 && errno == EINTR);
+
+	session->pid = -1;
+	session->in_fd = -1;
+	session->out_fd = -1;
+	session->err_fd = -1;
+	return wstatus;
+}
+
+int Session_start(Session *session, char *const *argv, const char *cwd, char *const *env) {
+	if (null_check(session, "session start") || null_check((void *) argv, "session start")) return -1;
+
+	int in_pipe[2];
+	int out_pipe[2];
+	int err_pipe[2];
+
+	if (pipe2(in_pipe, O_CLOEXEC))
+		return -1;
+
+	if (pipe2(out_pipe, O_CLOEXEC)) {
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		return -1;
+	}
+
+	if (pipe2(err_pipe, O_CLOEXEC)) {
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		return -1;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t mask;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+	if (cwd)
+		posix_spawn_file_actions_addchdir_np(&actions, cwd);
+
+	sigemptyset(&mask);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	int ret = posix_spawnp(&session->pid, argv[0], &actions, &attr, argv, env ? env : environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+	close(err_pipe[1]);
+
+	if (ret) {
+		session->pid = -1;
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+		close(err_pipe[0]);
+		errno = ret;
+		return -1;
+	}
+
+	session->in_fd = in_pipe[1];
+	session->out_fd = out_pipe[0];
+	session->err_fd = err_pipe[0];
+	session->started++;
+
+	// Output of a command can't end its own frame without guessing the marker.
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	snprintf(session->marker, sizeof(session->marker), "__vmel_%ld_%lx_%lu__", (long) getpid(),
+		(unsigned long) ts.tv_nsec ^ (unsigned long) (size_t) session, session->started);
+	return 0;
+}
+
+// Write all of buff to the shell. SIGPIPE is held back so a dead shell is reported as an error.
+static int session_write(Session *session, const char *buff, size_t len) {
+	sigset_t pipe_mask;
+	sigset_t old_mask;
+	sigset_t pending;
+	int ret = 0;
+
+	sigemptyset(&pipe_mask);
+	sigaddset(&pipe_mask, SIGPIPE);
+	sigpending(&pending);
+	int was_pending = sigismember(&pending, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_mask, &old_mask);
+
+	while (len > 0) {
+		ssize_t n = write(session->in_fd, buff, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0) {
+			ret = -1;
+			break;
+		}
+
+		buff += n;
+		len -= n;
+	}
+
+	// Discard the SIGPIPE raised by this write.
+	if (ret && errno == EPIPE && !was_pending) {
+		struct timespec zero = {0, 0};
+		sigtimedwait(&pipe_mask, NULL, &zero);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	return ret;
+}
+
+// Quote cmd for eval and append the footer reporting status, directory and environment.
+// eval runs through command so a syntax error fails the command instead of the shell.
+// Frames start with a record separator rather than a newline, so a line the command
+// printed can be passed on before it is known whether more output follows.
+static void session_frame(Session *session, const char *cmd) {
+	VString *buff = &session->cmd;
+
+	VString_set(buff, "command eval '");
+	for (const char *itr = cmd; *itr; itr++) {
+		if (*itr == '\'')
+			VString_pushs(buff, "'\\''");
+		else
+			VString_pushc(buff, *itr);
+	}
+
+	VString_pushs(buff, "' </dev/null\n__vmel_status=$?\nprintf '\\036%s %d\\n' '");
+	VString_pushs(buff, session->marker);
+	VString_pushs(buff, "' \"$__vmel_status\"; pwd; export -p; printf '%s\\n' '");
+	VString_pushs(buff, session->marker);
+	VString_pushs(buff, "'; printf '\\036%s\\n' '");
+	VString_pushs(buff, session->marker);
+	VString_pushs(buff, "' >&2\n");
+}
+
+// Position of needle inside buff at or after from, or -1.
+static long find(VString *buff, size_t from, const char *needle, size_t len) {
+	if (from > buff->str_size)
+		return -1;
+
+	char *str = VString_str(buff);
+	char *pos = memmem(str + from, buff->str_size - from, needle, len);
+	return pos ? pos - str : -1;
+}
+
+// Point env_ptrs at every element of env.
+static void session_env_ptrs(Session *session) {
+	char **n_ptrs = VAlloc_realloc(session->alloc, session->env_ptrs, (session->env->len + 1) * sizeof(char *));
+	if (null_check(n_ptrs, "session env ptrs")) return;
+
+	session->env_ptrs = n_ptrs;
+	for (size_t i = 0; i < session->env->len; i++)
+		session->env_ptrs[i] = (char *) VArray_str_at(session->env, i);
+	session->env_ptrs[session->env->len] = NULL;
+}
+
+// Replace env with the variables printed by export -p, values are quoted like shell words.
+static void session_parse_env(Session *session, const char *itr, const char *end) {
+	VString *buff = &session->cmd;
+
+	VArray_free(session->env);
+	session->env = VArray_new(session->alloc, VARRAY_STR, 0);
+
+	while (itr < end) {
+		if (strncmp(itr, "export ", 7) != 0) {
+			while (itr < end && *itr++ != '\n');
+			continue;
+		}
+
+		itr += 7;
+		VString_set(buff, "");
+
+		while (itr < end && *itr != '=' && *itr != '\n')
+			VString_pushc(buff, *itr++);
+
+		// Exported without a value.
+		if (itr >= end || *itr == '\n') {
+			itr++;
+			continue;
+		}
+
+		VString_pushc(buff, *itr++);
+
+		while (itr < end && *itr != '\n') {
+			if (*itr == '\'') {
+				for (itr++; itr < end && *itr != '\''; itr++)
+					VString_pushc(buff, *itr);
+				itr++;
+			}
+			else if (*itr == '"') {
+				for (itr++; itr < end && *itr != '"'; itr++) {
+					if (*itr == '\\' && itr + 1 < end && strchr("$`\"\\\n", itr[1]))
+						itr++;
+					VString_pushc(buff, *itr);
+				}
+				itr++;
+			}
+			else if (*itr == '\\' && itr + 1 < end) {
+				VString_pushc(buff, itr[1]);
+				itr += 2;
+			}
+			else {
+				VString_pushc(buff, *itr++);
+			}
+		}
+
+		itr++;
+
+		// Set by the shell to the last command it ran.
+		if (strncmp(VString_str(buff), "_=", 2) != 0)
+			VArray_push_str(session->env, VString_str(buff), buff->str_size);
+	}
+
+	session_env_ptrs(session);
+}
+
+// Hand output of the command up to end, or all but what may be the start of marker when
+// the end is not known yet, to the stream of the session. sent is how much of dest was
+// handed on before.
+static void session_forward(Session *session, Proc *proc, VString *dest, long end, size_t *sent, const char *marker, size_t len) {
+	size_t upto = end >= 0 ? (size_t) end : dest->str_size;
+
+	for (size_t k = len - 1 < upto ? len - 1 : upto; end < 0 && k > 0; k--) {
+		if (memcmp(VString_str(dest) + upto - k, marker, k) == 0) {
+			upto -= k;
+			break;
+		}
+	}
+
+	if (upto > *sent) {
+		session->stream(proc, VString_str(dest) + *sent, upto - *sent, session->stream_ctx);
+		*sent = upto;
+	}
+}
+
+// Read from the shell until both frames of the current command are complete, hdr is where
+// the footer starts in out. Return 0 once they are or -1 if the shell went away first.
+static int session_read(Session *session, Proc *proc, size_t *sent, long *hdr, long *out_end, long *err_end) {
+	size_t mlen = strlen(session->marker);
+	char head[80];
+	char tail[80];
+	char seal[80];
+	char buf[16384];
+
+	snprintf(head, sizeof(head), "\036%s ", session->marker);
+	snprintf(tail, sizeof(tail), "\n%s\n", session->marker);
+	snprintf(seal, sizeof(seal), "\036%s\n", session->marker);
+	*hdr = -1;
+	*out_end = -1;
+	*err_end = -1;
+
+	while (*out_end < 0 || *err_end < 0) {
+		struct pollfd fds[2] = {
+			{*out_end < 0 ? session->out_fd : -1, POLLIN, 0},
+			{*err_end < 0 ? session->err_fd : -1, POLLIN, 0}
+		};
+
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+
+			VString *dest = i == 0 ? &session->out : &session->err;
+			ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+
+			if (n == 0 || (n < 0 && errno != EINTR))
+				return -1;
+			if (n < 0)
+				continue;
+
+			// Markers may be split between reads, search from just before the new data.
+			size_t from = dest->str_size > mlen + 2 ? dest->str_size - mlen - 2 : 0;
+			VString_pushn(dest, buf, n);
+
+			if (i == 1) {
+				*err_end = find(dest, from, seal, mlen + 2);
+			}
+			else {
+				if (*hdr < 0)
+					*hdr = find(dest, from, head, mlen + 2);
+				if (*hdr >= 0)
+					*out_end = find(dest, *hdr + 1, tail, mlen + 2);
+			}
+
+			if (session->stream)
+				session_forward(session, proc, dest, i == 0 ? *hdr : *err_end, &sent[i], i == 0 ? head : seal, mlen + 2);
+		}
+	}
+
+	return 0;
+}
+
+int Session_run(Session *session, const char *cmd, Proc *proc) {
+	if (null_check(session, "session run") || null_check(proc, "session run")) return -1;
+
+	long hdr = -1;
+	long out_end = -1;
+	long err_end = -1;
+	size_t sent[2] = {0, 0};
+
+	VString_set(&session->out, "");
+	VString_set(&session->err, "");
+	session_frame(session, cmd);
+
+	if (session_write(session, VString_str(&session->cmd), session->cmd.str_size) || session_read(session, proc, sent, &hdr, &out_end, &err_end)) {
+		// Shell exited, everything it printed belongs to the command.
+		int wstatus = Session_stop(session);
+		VString_pushn(&proc->out, VString_str(&session->out) + sent[0], session->out.str_size - sent[0]);
+		VString_pushn(&proc->err, VString_str(&session->err) + sent[1], session->err.str_size - sent[1]);
+		proc->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+		return proc->status;
+	}
+
+	// Footer holds the status, the directory follows on the next line then the environment.
+	char *out = VString_str(&session->out);
+	char *itr = out + hdr + strlen(session->marker) + 2;
+	proc->status = (int) strtol(itr, &itr, 10);
+	itr = strchr(itr, '\n') + 1;
+
+	char *cwd_end = strchr(itr, '\n');
+	VString_set(&session->cwd, "");
+	VString_pushn(&session->cwd, itr, cwd_end - itr);
+	session_parse_env(session, cwd_end + 1, out + out_end + 1);
+
+	// What was streamed already is not kept.
+	VString_pushn(&proc->out, out + sent[0], hdr - sent[0]);
+	VString_pushn(&proc->err, VString_str(&session->err) + sent[1], err_end - sent[1]);
+	return proc->status;
+}
+
+// Start the shell through the transport unless it is running. Fill in proc on failure.
+static int session_open(Session *session, Proc *proc) {
+	if (session->pid >= 0 || session->transport->open(session) == 0)
+		return 0;
+
+	VString_pushs(&proc->err, "vmel: ");
+	VString_pushs(&proc->err, VString_str(&session->host));
+	VString_pushs(&proc->err, ": ");
+	VString_pushs(&proc->err, strerror(errno));
+	VString_pushc(&proc->err, '\n');
+	proc->status = 127;
+	return -1;
+}
+
+int Session_exec(Session *session, const char *cmd, Proc *proc) {
+	return Session_stream(session, cmd, proc, NULL, NULL);
+}
+
+int Session_stream(Session *session, const char *cmd, Proc *proc, EvData data, void *ctx) {
+	if (null_check(session, "session exec") || null_check(proc, "session exec")) return -1;
+
+	Proc_init(proc, 0, session->alloc);
+	pthread_mutex_lock(&session->lock);
+
+	if (session_open(session, proc) == 0) {
+		session->stream = data;
+		session->stream_ctx = ctx;
+		session->transport->exec(session, cmd, proc);
+		session->stream = NULL;
+		session->stream_ctx = NULL;
+	}
+
+	pthread_mutex_unlock(&session->lock);
+	Proc_exited(proc, 0);
+	return proc->status;
+}
+
+int Session_spawn(Session *session, const char *cmd, Proc *proc) {
+	if (null_check(session, "session spawn")) return -1;
+
+	pthread_mutex_lock(&session->lock);
+	int ret = session->transport->spawn(session, cmd, proc);
+	pthread_mutex_unlock(&session->lock);
+	return ret;
+}
+
+// Copy a file in either direction once the shell runs, so the directory is known.
+static int session_copy(Session *session, const char *from, const char *to, int put) {
+	Proc proc;
+	int ret = -1;
+
+	Proc_init(&proc, 0, session->alloc);
+	pthread_mutex_lock(&session->lock);
+
+	if (session_open(session, &proc) == 0)
+		ret = put ? session->transport->put(session, from, to) : session->transport->get(session, from, to);
+
+	pthread_mutex_unlock(&session->lock);
+
+	if (proc.err.str_size)
+		fputs(VString_str(&proc.err), stderr);
+	Proc_free(&proc);
+	return ret;
+}
+
+int Session_put(Session *session, const char *local, const char *remote) {
+	if (null_check(session, "session put") || null_check((void *) local, "session put") || null_check((void *) remote, "session put")) return -1;
+	return session_copy(session, local, remote, 1);
+}
+
+int Session_get(Session *session, const char *remote, const char *local) {
+	if (null_check(session, "session get") || null_check((void *) remote, "session get") || null_check((void *) local, "session get")) return -1;
+	return session_copy(session, remote, local, 0);
+}
+
+void Session_inherit(Session *session, Session *from) {
+	if (null_check(session, "session inherit") || null_check(from, "session inherit") || session == from) return;
+
+	pthread_mutex_lock(&session->lock);
+	pthread_mutex_lock(&from->lock);
+
+	VString_set(&session->cwd, "");
+	VString_pushn(&session->cwd, VString_str(&from->cwd), from->cwd.str_size);
+	VArray_free(session->env);
+	session->env = VArray_new(session->alloc, VARRAY_STR, from->env->len);
+
+	for (size_t i = 0; i < from->env->len; i++)
+		VArray_push_str(session->env, VArray_str_at(from->env, i), strlen(VArray_str_at(from->env, i)));
+
+	// Until the shell of from reported its environment children inherit that of vmel.
+	if (from->env_ptrs) {
+		session_env_ptrs(session);
+	}
+	else {
+		VAlloc_free(session->alloc, session->env_ptrs);
+		session->env_ptrs = NULL;
+	}
+
+	pthread_mutex_unlock(&from->lock);
+
+	// The connection of the host stays, only this shell goes.
+	if (session->pid >= 0)
+		Session_stop(session);
+
+	pthread_mutex_unlock(&session->lock);
+}
+
+void Session_close(Session *session) {
+	if (null_check(session, "session close")) return;
+
+	pthread_mutex_lock(&session->lock);
+	if (session->pid >= 0)
+		session->transport->close(session);
+	pthread_mutex_unlock(&session->lock);
+}
+
+void Session_free(Session *session) {
+	if (null_check(session, "session free")) return;
+
+	session->transport->close(session);
+	VString_free(&session->host);
+	VString_free(&session->home);
+	VString_free(&session->cwd);
+	VString_free(&session->out);
+	VString_free(&session->err);
+	VString_free(&session->cmd);
+	VArray_free(session->env);
+	VAlloc_free(session->alloc, session->env_ptrs);
+	pthread_mutex_destroy(&session->lock);
+	VAlloc_free(session->alloc, session);
+}
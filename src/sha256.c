@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "sha256.h"
+
+static const uint32_t Rounds[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Process one 64 byte block.
+static void sha256_block(Sha256 *ctx, const unsigned char *block) {
+	uint32_t w[64];
+	uint32_t s[8];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (uint32_t) block[i * 4] << 24 | (uint32_t) block[i * 4 + 1] << 16 | (uint32_t) block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	memcpy(s, ctx->state, sizeof(s));
+
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = s[7] + (ROTR(s[4], 6) ^ ROTR(s[4], 11) ^ ROTR(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + Rounds[i] + w[i];
+		uint32_t t2 = (ROTR(s[0], 2) ^ ROTR(s[0], 13) ^ ROTR(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(s + 1, s, 7 * sizeof(uint32_t));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+
+	for (int i = 0; i < 8; i++)
+		ctx->state[i] += s[i];
+}
+
+void Sha256_init(Sha256 *ctx) {
+	static const uint32_t Initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(ctx->state, Initial, sizeof(Initial));
+	ctx->len = 0;
+	ctx->buf_len = 0;
+}
+
+void Sha256_update(Sha256 *ctx, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	ctx->len += len;
+
+	if (ctx->buf_len) {
+		size_t take = 64 - ctx->buf_len < len ? 64 - ctx->buf_len : len;
+		memcpy(ctx->buf + ctx->buf_len, bytes, take);
+		ctx->buf_len += take;
+		bytes += take;
+		len -= take;
+
+		if (ctx->buf_len < 64)
+			return;
+
+		sha256_block(ctx, ctx->buf);
+		ctx->buf_len = 0;
+	}
+
+	for (; len >= 64; bytes += 64, len -= 64)
+		sha256_block(ctx, bytes);
+
+	memcpy(ctx->buf, bytes, len);
+	ctx->buf_len = len;
+}
+
+void Sha256_final(Sha256 *ctx, unsigned char *digest) {
+	uint64_t bits = ctx->len * 8;
+	unsigned char pad[72] = {0x80};
+	size_t pad_len = ctx->buf_len < 56 ? 56 - ctx->buf_len : 120 - ctx->buf_len;
+
+	for (int i = 0; i < 8; i++)
+		pad[pad_len + i] = (unsigned char) (bits >> (56 - i * 8));
+
+	Sha256_update(ctx, pad, pad_len + 8);
+
+	for (int i = 0; i < 8; i++) {
+		digest[i * 4] = (unsigned char) (ctx->state[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char) (ctx->state[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char) (ctx->state[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char) ctx->state[i];
+	}
+}
+
+int Sha256_file(Sha256 *ctx, const char *path) {
+	unsigned char buf[65536];
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	ssize_t n;
+
+	if (fd < 0)
+		return -1;
+
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		Sha256_update(ctx, buf, n);
+	}
+
+	close(fd);
+	return n < 0 ? -1 : 0;
+}
+
+void Sha256_hex(const unsigned char *digest, char *hex) {
+	static const char Digits[] = "0123456789abcdef";
+
+	for (int i = 0; i < SHA256_SIZE; i++) {
+		hex[i * 2] = Digits[digest[i] >> 4];
+		hex[i * 2 + 1] = Digits[digest[i] & 0xf];
+	}
+
+	hex[SHA256_HEX] = '\0';
+}
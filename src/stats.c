@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "stats.h"
+
+static const char *Stat_Names[STAT_SUBSYS_SIZE] = {
+	"tokenizer", "parser", "sytable", "vstring", "error", "executor"
+};
+
+#ifdef VMEL_STATS
+
+// Number of distinct allocators which can be wrapped per subsystem.
+#define STATS_MAX_WRAPS 16
+
+// Wrapper slot states.
+#define WRAP_FREE 0
+#define WRAP_CLAIMED 1
+#define WRAP_READY 2
+
+StatCounters Stat_Table[STAT_SUBSYS_SIZE];
+
+// Live and peak bytes across every subsystem.
+static StatCounters Stat_Overall;
+
+typedef struct {
+	VAllocator iface;
+	VAllocator *base;
+	enum StatSubsys subsys;
+	int state;
+} StatWrap;
+
+// Size of each allocation is kept in front of it so frees can be counted.
+typedef struct {
+	size_t size;
+	size_t pad;
+} StatHdr;
+
+static StatWrap Stat_Wraps[STAT_SUBSYS_SIZE][STATS_MAX_WRAPS];
+
+// Add to live bytes of counters and raise peak if needed.
+static void counters_live_add(StatCounters *c, size_t size) {
+	size_t live = __atomic_add_fetch(&c->live, size, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+
+	while (live > peak && !__atomic_compare_exchange_n(&c->peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static void stats_live_add(StatCounters *c, size_t size) {
+	counters_live_add(c, size);
+	counters_live_add(&Stat_Overall, size);
+}
+
+static void stats_live_sub(StatCounters *c, size_t size) {
+	__atomic_fetch_sub(&c->live, size, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&Stat_Overall.live, size, __ATOMIC_RELAXED);
+}
+
+static void *stats_alloc(void *ctx, size_t size) {
+	StatWrap *w = ctx;
+	StatCounters *c = &Stat_Table[w->subsys];
+	StatHdr *hdr = VAlloc_alloc(w->base, sizeof(StatHdr) + size);
+
+	if (!hdr)
+		return NULL;
+
+	hdr->size = size;
+	__atomic_fetch_add(&c->allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->bytes, size, __ATOMIC_RELAXED);
+	stats_live_add(c, size);
+	return hdr + 1;
+}
+
+static void *stats_realloc(void *ctx, void *ptr, size_t size) {
+	if (!ptr)
+		return stats_alloc(ctx, size);
+
+	StatWrap *w = ctx;
+	StatCounters *c = &Stat_Table[w->subsys];
+	StatHdr *hdr = (StatHdr *) ptr - 1;
+	size_t old = hdr->size;
+
+	hdr = VAlloc_realloc(w->base, hdr, sizeof(StatHdr) + size);
+	if (!hdr)
+		return NULL;
+
+	hdr->size = size;
+	__atomic_fetch_add(&c->allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->bytes, size, __ATOMIC_RELAXED);
+	stats_live_sub(c, old);
+	stats_live_add(c, size);
+	return hdr + 1;
+}
+
+static void stats_free(void *ctx, void *ptr) {
+	StatWrap *w = ctx;
+	StatHdr *hdr = (StatHdr *) ptr - 1;
+
+	stats_live_sub(&Stat_Table[w->subsys], hdr->size);
+	VAlloc_free(w->base, hdr);
+}
+
+// Live bytes aren't adjusted since the share of each subsystem is unknown.
+static void stats_reset(void *ctx) {
+	StatWrap *w = ctx;
+	VAlloc_reset(w->base);
+}
+
+VAllocator *Stats_allocator(enum StatSubsys subsys, VAllocator *alloc) {
+	// Never wrap twice.
+	if (alloc && alloc->alloc == stats_alloc) {
+		StatWrap *w = alloc->ctx;
+		if (w->subsys == subsys)
+			return alloc;
+		alloc = w->base;
+	}
+
+	if (!alloc)
+		alloc = VAlloc_system();
+
+	for (size_t i = 0; i < STATS_MAX_WRAPS; i++) {
+		StatWrap *w = &Stat_Wraps[subsys][i];
+		int state = __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+
+		// Claim free slot, if another thread beat us wait until it is filled in.
+		if (state == WRAP_FREE) {
+			if (__atomic_compare_exchange_n(&w->state, &state, WRAP_CLAIMED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+				w->base = alloc;
+				w->subsys = subsys;
+				w->iface.alloc = stats_alloc;
+				w->iface.realloc = stats_realloc;
+				w->iface.free = stats_free;
+				w->iface.reset = stats_reset;
+				w->iface.destroy = NULL;
+				w->iface.ctx = w;
+				__atomic_store_n(&w->state, WRAP_READY, __ATOMIC_RELEASE);
+				return &w->iface;
+			}
+		}
+
+		while (state == WRAP_CLAIMED)
+			state = __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+
+		if (w->base == alloc)
+			return &w->iface;
+	}
+
+	return alloc;
+}
+
+void Stats_print(FILE *out) {
+	StatCounters total = {0, 0, Stat_Overall.live, Stat_Overall.peak, 0, 0, 0};
+
+	fprintf(out, "%-10s %10s %12s %12s %12s %10s %10s %10s\n",
+		"subsystem", "allocs", "bytes", "peak", "live", "lookups", "copies", "nodes");
+
+	for (int i = 0; i < STAT_SUBSYS_SIZE; i++) {
+		StatCounters *c = &Stat_Table[i];
+		fprintf(out, "%-10s %10lu %12lu %12lu %12lu %10lu %10lu %10lu\n", Stat_Names[i],
+			c->allocs, c->bytes, c->peak, c->live, c->lookups, c->copies, c->nodes);
+		total.allocs += c->allocs;
+		total.bytes += c->bytes;
+		total.lookups += c->lookups;
+		total.copies += c->copies;
+		total.nodes += c->nodes;
+	}
+
+	fprintf(out, "%-10s %10lu %12lu %12lu %12lu %10lu %10lu %10lu\n", "total",
+		total.allocs, total.bytes, total.peak, total.live, total.lookups, total.copies, total.nodes);
+}
+
+#else
+
+void Stats_print(FILE *out) {
+	(void) Stat_Names;
+	fprintf(out, "Stats not compiled in, rebuild with -DVMEL_STATS=ON\n");
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "strpool.h"
+#include "utils.h"
+#include "conf.h"
+
+// Allocate a block which can hold at least size bytes.
+static StrBlock *strpool_new_block(StrPool *pool, size_t size) {
+	size_t cap = size > INIT_STRPOOL_BLOCK_SIZE ? size : INIT_STRPOOL_BLOCK_SIZE;
+	StrBlock *blk = VAlloc_alloc(pool->alloc, sizeof(StrBlock) + cap);
+
+	if (!blk)
+		return NULL;
+
+	blk->next = NULL;
+	blk->used = 0;
+	blk->cap = cap;
+	return blk;
+}
+
+StrPool *StrPool_new(VAllocator *alloc) {
+	StrPool *pool = VAlloc_alloc(alloc, sizeof(StrPool));
+	pool->head = NULL;
+	pool->bytes = 0;
+	pool->alloc = alloc;
+	return pool;
+}
+
+char *StrPool_add(StrPool *pool, const char *str) {
+	if (null_check(pool, "strpool add") || !str) return NULL;
+
+	size_t len = strlen(str) + 1;
+	StrBlock *blk = pool->head;
+
+	// Start a new block when the current one is full.
+	if (!blk || blk->cap - blk->used < len) {
+		blk = strpool_new_block(pool, len);
+		if (null_check(blk, "strpool new block")) return NULL;
+		blk->next = pool->head;
+		pool->head = blk;
+	}
+
+	char *dest = blk->data + blk->used;
+	memcpy(dest, str, len);
+	blk->used += len;
+	pool->bytes += len;
+	return dest;
+}
+
+void StrPool_free(StrPool *pool) {
+	if (null_check(pool, "strpool free")) return;
+
+	StrBlock *blk = pool->head;
+	StrBlock *next = NULL;
+
+	while (blk) {
+		next = blk->next;
+		VAlloc_free(pool->alloc, blk);
+		blk = next;
+	}
+
+	VAlloc_free(pool->alloc, pool);
+}
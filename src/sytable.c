@@ -1,49 +1,180 @@
 #include "sytable.h"
 #include "utils.h"
 #include "conf.h"
+#include "stats.h"
 
-SyTable *SyTable_new() {
-	SyTable *sy_table = malloc(sizeof(SyTable));
+// Copy value into symbol reusing the existing buffer when it is large enough.
+static int symbol_set_val(Symbol *sy, const char *val) {
+	size_t len = strlen(val);
+
+	STATS_INC(STAT_SYTABLE, copies);
+
+	// Value may be the current one so move rather than copy.
+	if (sy->val && len <= sy->val_cap) {
+		memmove(sy->val, val, len + 1);
+		return 0;
+	}
+
+	char *n_val = VAlloc_alloc(sy->alloc, len + 1);
+	if (null_check(n_val, "symbol set value")) return -1;
+	memcpy(n_val, val, len + 1);
+
+	VAlloc_free(sy->alloc, sy->val);
+	sy->val = n_val;
+	sy->val_cap = len;
+	return 0;
+}
+
+SyTable *SyTable_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_SYTABLE, alloc);
+	SyTable *sy_table = VAlloc_alloc(alloc, sizeof(SyTable));
 	sy_table->sym_cap = INIT_SYTABLE_SIZE;
 	sy_table->sym_ctr = 0;
-	sy_table->symbols = malloc(sy_table->sym_cap * sizeof(Symbol *));
+	sy_table->parent = NULL;
+	sy_table->alloc = alloc;
+	sy_table->symbols = VAlloc_alloc(alloc, sy_table->sym_cap * sizeof(Symbol *));
 	return sy_table;
 }
 
-void SyTable_free(SyTable *sy_table) {
-	if (null_check(sy_table, "sytable free")) return;
+SyTable *SyTable_new_frame(SyTable *parent, VAllocator *alloc) {
+	if (null_check(parent, "sytable new frame")) return NULL;
+
+	SyTable *frame = SyTable_new(alloc);
+	frame->parent = parent;
+	return frame;
+}
+
+SyTable *SyTable_clone(SyTable *src, VAllocator *alloc) {
+	if (null_check(src, "sytable clone")) return NULL;
+
+	alloc = STATS_ALLOC(STAT_SYTABLE, alloc);
+
+	SyTable *sy_table = VAlloc_alloc(alloc, sizeof(SyTable));
+	sy_table->sym_cap = src->sym_cap;
+	sy_table->sym_ctr = src->sym_ctr;
+	sy_table->parent = src->parent;
+	sy_table->alloc = alloc;
+	sy_table->symbols = VAlloc_alloc(alloc, sy_table->sym_cap * sizeof(Symbol *));
+
+	for (size_t i = 0; i < src->sym_ctr; i++) {
+		Symbol *sy = Symbol_new(alloc);
+		if (src->symbols[i]->val)
+			symbol_set_val(sy, src->symbols[i]->val);
+		VRope_append_rope(&sy->rope, &src->symbols[i]->rope);
+		sy->arr = VArray_copy(src->symbols[i]->arr, alloc);
+		sy->label = VAlloc_strdup(alloc, src->symbols[i]->label);
+		sy->lineno = src->symbols[i]->lineno;
+		sy->sy_type = src->symbols[i]->sy_type;
+		sy->version = src->symbols[i]->version;
+		sy->pinned = src->symbols[i]->pinned;
+		sy_table->symbols[i] = sy;
+	}
+
+	return sy_table;
+}
+
+void SyTable_clear(SyTable *sy_table) {
+	if (null_check(sy_table, "sytable clear")) return;
+
+	VAllocator *alloc = sy_table->alloc;
 
 	for (size_t i = 0; i < sy_table->sym_ctr; i++) {
 		if (sy_table->symbols[i]->val) {
-			free(sy_table->symbols[i]->val);
+			VAlloc_free(alloc, sy_table->symbols[i]->val);
 			
 		}
-		free(sy_table->symbols[i]->label);
-		free(sy_table->symbols[i]);
+		VRope_free(&sy_table->symbols[i]->rope);
+		VArray_free(sy_table->symbols[i]->arr);
+		VAlloc_free(alloc, sy_table->symbols[i]->label);
+		VAlloc_free(alloc, sy_table->symbols[i]);
 	}
-	
-	free(sy_table->symbols);
-	free(sy_table);
+
+	sy_table->sym_ctr = 0;
+}
+
+void SyTable_free(SyTable *sy_table) {
+	if (null_check(sy_table, "sytable free")) return;
+
+	VAllocator *alloc = sy_table->alloc;
+
+	SyTable_clear(sy_table);
+	VAlloc_free(alloc, sy_table->symbols);
+	VAlloc_free(alloc, sy_table);
 }
 
-Symbol *Symbol_new(void) {
-	Symbol *sy = malloc(sizeof(Symbol));
+Symbol *Symbol_new(VAllocator *alloc) {
+	Symbol *sy = VAlloc_alloc(alloc, sizeof(Symbol));
 	sy->val = NULL;
+	sy->val_cap = 0;
+	sy->version = 0;
+	sy->pinned = 0;
+	sy->alloc = alloc;
+	sy->rope = VRope_new(alloc);
+	sy->arr = NULL;
 	return sy;
 }
 
-Symbol *SyTable_get_symbol(SyTable *sy_table, char *sy_name) {
-	if (null_check(sy_table, "sytable free")) return NULL;
-		
+char *Symbol_value(Symbol *sy) {
+	if (!sy)
+		return NULL;
+
+	if (!sy->val && sy->rope.root) {
+		sy->val_cap = VRope_length(&sy->rope);
+		sy->val = VAlloc_alloc(sy->alloc, sy->val_cap + 1);
+		VRope_flatten(&sy->rope, sy->val);
+		STATS_INC(STAT_SYTABLE, copies);
+	}
+	else if (!sy->val && sy->arr) {
+		sy->val_cap = VArray_format(sy->arr, NULL, 0);
+		sy->val = VAlloc_alloc(sy->alloc, sy->val_cap + 1);
+		VArray_format(sy->arr, sy->val, sy->val_cap + 1);
+		STATS_INC(STAT_SYTABLE, copies);
+	}
+
+	return sy->val;
+}
+
+// Find a symbol held by the table itself, parents aren't searched.
+static Symbol *sytable_find(SyTable *sy_table, char *sy_name) {
 	for (size_t idx = 0; idx < sy_table->sym_ctr; idx++ ) {
-			if (strcmp(sy_table->symbols[idx]->label, sy_name) == 0) {
-				return sy_table->symbols[idx];
-			}
+		if (strcmp(sy_table->symbols[idx]->label, sy_name) == 0)
+			return sy_table->symbols[idx];
 	}
 
 	return NULL;
 }
 
+Symbol *SyTable_get_symbol(SyTable *sy_table, char *sy_name) {
+	if (null_check(sy_table, "sytable free")) return NULL;
+
+	STATS_INC(STAT_SYTABLE, lookups);
+
+	Symbol *sy = sytable_find(sy_table, sy_name);
+
+	if (!sy && sy_table->parent)
+		return SyTable_get_symbol(sy_table->parent, sy_name);
+
+	return sy;
+}
+
+// Symbol to update, frames get their own copy of a symbol only found in the parent.
+static Symbol *sytable_own(SyTable *sy_table, char *sy_name) {
+	if (!sy_table->parent)
+		return SyTable_get_symbol(sy_table, sy_name);
+
+	Symbol *sy = sytable_find(sy_table, sy_name);
+	if (sy)
+		return sy;
+
+	Symbol *outer = SyTable_get_symbol(sy_table->parent, sy_name);
+	if (!outer || SyTable_add_symbol(sy_table, outer->label, NULL, outer->lineno, outer->sy_type))
+		return NULL;
+
+	sy = sy_table->symbols[sy_table->sym_ctr - 1];
+	sy->pinned = outer->pinned;
+	return sy;
+}
+
 int SyTable_add_symbol(SyTable *sy_table, char *label, char *val, unsigned int lineno, enum SyType sy_type) {
 	if (null_check(sy_table, "sytable add")) 
 		return -1;
@@ -57,10 +188,11 @@ int SyTable_add_symbol(SyTable *sy_table, char *label, char *val, unsigned int l
 	}
 	
 	// Add symbol and increment counter.
-	Symbol *sy = Symbol_new();
-	sy->val = val ? string_dup(val) : NULL;
+	Symbol *sy = Symbol_new(sy_table->alloc);
+	if (val)
+		symbol_set_val(sy, val);
 	sy->lineno = lineno;
-	sy->label = string_dup(label);
+	sy->label = VAlloc_strdup(sy_table->alloc, label);
 	sy->sy_type = sy_type;
 	sy_table->symbols[sy_table->sym_ctr++] = sy;
 	sy = NULL;
@@ -70,18 +202,76 @@ int SyTable_add_symbol(SyTable *sy_table, char *label, char *val, unsigned int l
 int SyTable_update_symbol(SyTable *sy_table, char *sy_name, char *sy_n_value) {
 	if (!sy_table || !sy_name || !sy_n_value) return -1;
 
-	Symbol *sy = SyTable_get_symbol(sy_table, sy_name);
+	Symbol *sy = sytable_own(sy_table, sy_name);
 	
 	// Does the symbol exist.
 	if (!sy)
 		return -1;
+
+	// Unchanged values keep their version so dependants aren't recomputed.
+	if (!sy->arr && sy->val && strcmp(sy->val, sy_n_value) == 0)
+		return 0;
 	
-	// Has it already been set
-	if (sy->val)
-		free(sy->val);
+	// Reuses the current buffer where possible, value may be the current one.
+	if (symbol_set_val(sy, sy_n_value))
+		return -1;
+
+	VRope_free(&sy->rope);
+	VArray_free(sy->arr);
+	sy->arr = NULL;
+	sy->version++;
+	return 0;
+}
+
+int SyTable_update_symbol_rope(SyTable *sy_table, char *sy_name, VRope *rope) {
+	if (!sy_table || !sy_name || !rope) return -1;
+
+	Symbol *sy = sytable_own(sy_table, sy_name);
+
+	if (!sy)
+		return -1;
+
+	// Flat copy is stale now.
+	if (sy->val) {
+		VAlloc_free(sy_table->alloc, sy->val);
+		sy->val = NULL;
+	}
+
+	VRope_free(&sy->rope);
+	VArray_free(sy->arr);
+	sy->arr = NULL;
+	sy->rope = *rope;
+	*rope = VRope_new(rope->alloc);
+	sy->version++;
+	return 0;
+}
+
+int SyTable_update_symbol_array(SyTable *sy_table, char *sy_name, VArray *arr) {
+	if (!sy_table || !sy_name || !arr) return -1;
+
+	Symbol *sy = sytable_own(sy_table, sy_name);
+
+	if (!sy) {
+		VArray_free(arr);
+		return -1;
+	}
+
+	// Unchanged values keep their version so dependants aren't recomputed.
+	if (VArray_equal(sy->arr, arr)) {
+		VArray_free(arr);
+		return 0;
+	}
+
+	// Flat copy is stale now.
+	if (sy->val) {
+		VAlloc_free(sy_table->alloc, sy->val);
+		sy->val = NULL;
+	}
 
-	// Reassign to new value.
-	sy->val = string_dup(sy_n_value);
+	VRope_free(&sy->rope);
+	VArray_free(sy->arr);
+	sy->arr = arr;
+	sy->version++;
 	return 0;
 }
 
@@ -97,7 +287,7 @@ void SyTable_print_symbols(SyTable *sy_table) {
 			t = "Variable";
 		else
 			t = "Group Name";
-		char *sy_val = sy_table->symbols[i]->val ? sy_table->symbols[i]->val : "Undefined";
+		char *sy_val = Symbol_value(sy_table->symbols[i]) ? sy_table->symbols[i]->val : "Undefined";
 		printf("--> Name : %s | Type: %s  | Value: %s \n", sy_table->symbols[i]->label, t, sy_val);
 	}
 }
@@ -105,6 +295,6 @@ void SyTable_print_symbols(SyTable *sy_table) {
 Symbol **grow_sy_table(SyTable *sy_table) {
 	if (null_check(sy_table, "sytable grow")) return NULL;
     sy_table->sym_cap *= 2;
-    Symbol **sy_new = realloc(sy_table->symbols, sizeof(Symbol *) * sy_table->sym_cap);	
+    Symbol **sy_new = VAlloc_realloc(sy_table->alloc, sy_table->symbols, sizeof(Symbol *) * sy_table->sym_cap);	
     return sy_new;
 }
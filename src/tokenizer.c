@@ -6,6 +6,14 @@
 #include "tokenizer.h"
 #include "tokens.h"
 #include "vstring.h"
+#include "stats.h"
+
+// Errors which map to Error_Templates.
+#define ERR_UNKNOWN_TOKEN 0
+
+static const char *Error_Templates[] = {
+	"Token error: unknown '@0' found in line @L"
+};
 
 // Ensure a variable confirms to naming specifications.
 static int is_legal_variable(char *var) {
@@ -20,7 +28,7 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 	// Each character in buffer.
 	char c;
 	// Reusable storage to hold combined chars. 
-	VString store = VString_new();
+	VString store = VString_new(STATS_ALLOC(STAT_VSTRING, tokmgr->alloc));
 	// Buff iterator.
 	size_t bidx = 0;
 	// Error code.
@@ -28,6 +36,8 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 	// Track line no.
 	int lineno = 1;
 	int brlock = 0;
+	// Braces of a loop hold statements rather than group commands.
+	int loop = 0;
 
 	while (buff[bidx] != '\0' && !error) {
 		c = buff[bidx];
@@ -59,7 +69,8 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 		}
 		else if (c == LBRACE) {
 			TokenMgr_add_token(tokmgr, E_LBRACE_TOKEN, "{", lineno);
-			brlock = 1;
+			brlock = !loop;
+			loop = 0;
 			bidx++;
 		}
 		else if (c == RBRACE) {
@@ -110,7 +121,7 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 				error = 1;
 				continue;
 			}
-			TokenMgr_add_token(tokmgr, E_MIXSTR_TOKEN, store.str, lineno);
+			TokenMgr_add_token(tokmgr, E_MIXSTR_TOKEN, VString_str(&store), lineno);
 			bidx++;
 		}
 		else if (c == BANG) {
@@ -170,7 +181,7 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 				error = 1;
 				continue;
 			}
-			TokenMgr_add_token(tokmgr, E_STRING_TOKEN, store.str, lineno);
+			TokenMgr_add_token(tokmgr, E_STRING_TOKEN, VString_str(&store), lineno);
 			bidx++;
 		}
 		else if (c == VAR) {
@@ -182,20 +193,20 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 			}
 
 			// Prevent empty variables e.g $
-			if (store.str_size < 1 || !is_legal_variable(store.str)) {
+			if (store.str_size < 1 || !is_legal_variable(VString_str(&store))) {
 				error = 1;
 				bidx++;
 				continue;
 			}
 
-			TokenMgr_add_token(tokmgr, E_IDENTIFIER_TOKEN, store.str, lineno);
+			TokenMgr_add_token(tokmgr, E_IDENTIFIER_TOKEN, VString_str(&store), lineno);
 		}
 		else if (isdigit(c)) {
 			while (isdigit(c)) {
 				VString_pushc(&store, c);
 				c = buff[++bidx];
 			}
-			TokenMgr_add_token(tokmgr, E_INTEGER_TOKEN, store.str, lineno);
+			TokenMgr_add_token(tokmgr, E_INTEGER_TOKEN, VString_str(&store), lineno);
 		}
 		else if (isalpha(c)) {
 			if (brlock) {
@@ -211,9 +222,12 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 				}
 			}
 			if (brlock)
-				TokenMgr_add_token(tokmgr, E_STRING_TOKEN, store.str, lineno);
+				TokenMgr_add_token(tokmgr, E_STRING_TOKEN, VString_str(&store), lineno);
 			else
-				TokenMgr_add_token(tokmgr, E_KEYWORD_TOKEN, store.str, lineno);
+				TokenMgr_add_token(tokmgr, E_KEYWORD_TOKEN, VString_str(&store), lineno);
+
+			if (!brlock && string_compare(VString_str(&store), "foreach"))
+				loop = 1;
 		}
 		else {
 			VString_pushc(&store, c);
@@ -229,34 +243,38 @@ int TokenMgr_build_tokens(char *buff, TokenMgr *tokmgr) {
 
 	TokenMgr_add_token(tokmgr, E_EOF_TOKEN, "TAIL", 0);
 
-	if (error)
-		printf("Token error: unknown '%s' found in line %d\n", store.str, lineno);
+	// Report through error handler when one was provided.
+	if (error && tokmgr->err_handle)
+		Error_add_record(tokmgr->err_handle, Error_Templates, ERR_UNKNOWN_TOKEN, lineno, 1, VString_str(&store));
+	else if (error)
+		printf("Token error: unknown '%s' found in line %d\n", VString_str(&store), lineno);
 
 	VString_free(&store);
 	return error;
 }
 
-TokenMgr *TokenMgr_new(void) {
-	TokenMgr *tok_mgr = malloc(sizeof(TokenMgr));
+TokenMgr *TokenMgr_new(VAllocator *alloc) {
+	alloc = STATS_ALLOC(STAT_TOKENIZER, alloc);
+	TokenMgr *tok_mgr = VAlloc_alloc(alloc, sizeof(TokenMgr));
+	tok_mgr->alloc = alloc;
 	tok_mgr->toks_tail = NULL;
 	tok_mgr->toks_head = NULL;
 	tok_mgr->tok_ctr = 0;
 	tok_mgr->tok_cap = INIT_TOKMGR_TOKS_SIZE;
-	tok_mgr->toks_curr = malloc(tok_mgr->tok_cap * sizeof(Token*));	
+	tok_mgr->toks_curr = VAlloc_alloc(alloc, tok_mgr->tok_cap * sizeof(Token*));	
+	tok_mgr->pool = StrPool_new(alloc);
+	tok_mgr->err_handle = NULL;
 	return tok_mgr;
 }
 
 int TokenMgr_add_token(TokenMgr *tok_mgr, TokenType tok_type, char *tok_val, int tok_lineno) {
 	if (null_check(tok_mgr, "Tokenizer add token")) return -1;
 
-	// Get string length of value.
-	size_t tok_val_length = strlen(tok_val);
-	
 	// Create temp token on heap.
-	Token *tmp = malloc(sizeof(Token));	
-	tmp->value = calloc(tok_val_length+1, sizeof(char));
+	Token *tmp = VAlloc_alloc(tok_mgr->alloc, sizeof(Token));	
+	tmp->value = StrPool_add(tok_mgr->pool, tok_val);
+	STATS_INC(STAT_TOKENIZER, copies);
 	tmp->type = tok_type;
-	strcpy(tmp->value, tok_val);
 	tmp->lineno = tok_lineno;
 
 	// Determine if we need more room in toks.
@@ -309,21 +327,29 @@ int TokenMgr_free(TokenMgr *tok_mgr) {
 	TokenMgr_reset_curr(tok_mgr);
 	
 	for (size_t i = 0; i < tok_mgr->tok_ctr; i++) {
-		free(tok_mgr->toks_curr[i]->value);
-		free(tok_mgr->toks_curr[i]);
+		VAlloc_free(tok_mgr->alloc, tok_mgr->toks_curr[i]);
 	}
 
 	// Free resources.
-	free(tok_mgr->toks_curr);
+	if (tok_mgr->pool)
+		StrPool_free(tok_mgr->pool);
+	VAlloc_free(tok_mgr->alloc, tok_mgr->toks_curr);
 	tok_mgr->toks_curr = NULL;
 	tok_mgr->toks_head = NULL;
 	tok_mgr->toks_tail = NULL;
-	free(tok_mgr);
+	VAlloc_free(tok_mgr->alloc, tok_mgr);
 	tok_mgr = NULL;
 
 	return 0;
 }
 
+StrPool *TokenMgr_release_pool(TokenMgr *tok_mgr) {
+	if (null_check(tok_mgr, "Tokenizer release pool")) return NULL;
+	StrPool *pool = tok_mgr->pool;
+	tok_mgr->pool = NULL;
+	return pool;
+}
+
 Token *TokenMgr_next_token(TokenMgr *tok_mgr) {
 	if (null_check(tok_mgr, "Tokenizer next token")) return NULL;
 	
@@ -368,6 +394,6 @@ void TokenMgr_reset_curr(TokenMgr *tok_mgr) {
 Token **grow_curr_tokens(TokenMgr *tok_mgr) {
 	if (null_check(tok_mgr, "grow tokens")) return NULL;
 	tok_mgr->tok_cap *= 2;
-	Token **toks_curr_new = realloc(tok_mgr->toks_curr, sizeof(Token *) * tok_mgr->tok_cap);		
+	Token **toks_curr_new = VAlloc_realloc(tok_mgr->alloc, tok_mgr->toks_curr, sizeof(Token *) * tok_mgr->tok_cap);		
 	return toks_curr_new;
 }
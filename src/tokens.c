@@ -3,7 +3,11 @@
 #include "tokens.h"
 
 static const char *Keywords[] = {
-	"print", "func", "if", "else", "foreach", "assert"
+	"print", "func", "if", "else", "foreach", "assert",
+	"sum", "min", "max", "count",
+	"sort", "unique", "union", "intersect", "difference",
+	"in", "parallel", "run", "on", "needs", "cache", "creates",
+	"idempotent"
 };
 
 int is_valid_keyword(char *str) {
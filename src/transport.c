@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "transport.h"
+#include "conf.h"
+#include "utils.h"
+
+// Directory of the shell, home until the shell reported one, NULL if neither is known.
+static const char *session_dir(Session *session) {
+	if (session->cwd.str_size)
+		return VString_str(&session->cwd);
+	if (session->home.str_size)
+		return VString_str(&session->home);
+	return NULL;
+}
+
+// Store path in buff, relative paths are taken from dir when there is one.
+static const char *resolve(VString *buff, const char *dir, const char *path) {
+	VString_set(buff, "");
+
+	if (path[0] != '/' && dir) {
+		VString_pushs(buff, (char *) dir);
+		VString_pushc(buff, '/');
+	}
+
+	VString_pushs(buff, (char *) path);
+	return VString_str(buff);
+}
+
+// Copy a file on this machine, keeping its permission bits.
+static int copy_file(const char *from, const char *to) {
+	struct stat st;
+	char buf[65536];
+	int ret = 0;
+
+	int in_fd = open(from, O_RDONLY | O_CLOEXEC);
+	if (in_fd < 0 || fstat(in_fd, &st)) {
+		perror(from);
+		if (in_fd >= 0)
+			close(in_fd);
+		return -1;
+	}
+
+	int out_fd = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+	if (out_fd < 0) {
+		perror(to);
+		close(in_fd);
+		return -1;
+	}
+
+	for (;;) {
+		ssize_t n = read(in_fd, buf, sizeof(buf));
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			ret = n < 0 ? -1 : 0;
+			break;
+		}
+
+		for (ssize_t done = 0; done < n;) {
+			ssize_t w = write(out_fd, buf + done, n - done);
+
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w < 0) {
+				ret = -1;
+				break;
+			}
+
+			done += w;
+		}
+
+		if (ret)
+			break;
+	}
+
+	if (ret)
+		perror(to);
+
+	close(in_fd);
+	close(out_fd);
+	return ret;
+}
+
+// Run a helper program such as scp to completion, its errors go to stderr.
+static int run_argv(Session *session, char *const *argv) {
+	Proc proc;
+
+	Proc_spawn_argv(&proc, argv, NULL, NULL, session->alloc);
+	int status = Proc_wait(&proc);
+
+	if (proc.err.str_size)
+		fputs(VString_str(&proc.err), stderr);
+
+	Proc_free(&proc);
+	return status ? -1 : 0;
+}
+
+static int local_open(Session *session) {
+	char *argv[] = {"sh", "-s", NULL};
+	return Session_start(session, argv, session_dir(session), session->env_ptrs);
+}
+
+static int local_exec(Session *session, const char *cmd, Proc *proc) {
+	return Session_run(session, cmd, proc);
+}
+
+static int local_spawn(Session *session, const char *cmd, Proc *proc) {
+	return Proc_spawn_in(proc, cmd, session_dir(session), session->env_ptrs, session->alloc);
+}
+
+static int local_put(Session *session, const char *local, const char *remote) {
+	VString path = VString_new(session->alloc);
+	int ret = copy_file(local, resolve(&path, session_dir(session), remote));
+	VString_free(&path);
+	return ret;
+}
+
+static int local_get(Session *session, const char *remote, const char *local) {
+	VString path = VString_new(session->alloc);
+	int ret = copy_file(resolve(&path, session_dir(session), remote), local);
+	VString_free(&path);
+	return ret;
+}
+
+static void local_close(Session *session) {
+	Session_stop(session);
+}
+
+// Wait for the given number of simulated round trips.
+static void fake_delay(Session *session, unsigned int trips) {
+	unsigned long ms = (unsigned long) session->latency_ms * trips;
+	struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+
+	while (ms && nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+// Create the sandbox of the host unless it exists, its absolute path is stored in home.
+static int fake_home(Session *session) {
+	if (session->home.str_size)
+		return 0;
+
+	VString dir = VString_new(session->alloc);
+	char real[PATH_MAX];
+	int ret = -1;
+
+	VString_set(&dir, VMEL_FAKE_ROOT "/");
+	// Host names become one directory below the root.
+	for (const char *itr = VString_str(&session->host); *itr; itr++)
+		VString_pushc(&dir, *itr == '/' || (*itr == '.' && itr == VString_str(&session->host)) ? '_' : *itr);
+
+	if ((mkdir(VMEL_FAKE_ROOT, 0755) == 0 || errno == EEXIST) && (mkdir(VString_str(&dir), 0755) == 0 || errno == EEXIST)
+		&& realpath(VString_str(&dir), real)) {
+		VString_set(&session->home, real);
+		ret = 0;
+	}
+
+	VString_free(&dir);
+	return ret;
+}
+
+// Absolute paths of the host live below its sandbox.
+static const char *fake_path(VString *buff, Session *session, const char *path) {
+	if (path[0] != '/')
+		return resolve(buff, session_dir(session), path);
+
+	VString_set(buff, VString_str(&session->home));
+	VString_pushs(buff, (char *) path);
+	return VString_str(buff);
+}
+
+static int fake_open(Session *session) {
+	char *argv[] = {"sh", "-s", NULL};
+
+	fake_delay(session, VMEL_FAKE_OPEN_TRIPS);
+	if (fake_home(session))
+		return -1;
+
+	return Session_start(session, argv, session_dir(session), session->env_ptrs);
+}
+
+static int fake_exec(Session *session, const char *cmd, Proc *proc) {
+	fake_delay(session, 1);
+	return Session_run(session, cmd, proc);
+}
+
+static int fake_spawn(Session *session, const char *cmd, Proc *proc) {
+	fake_delay(session, 1);
+	if (fake_home(session))
+		return -1;
+
+	int ret = Proc_spawn_in(proc, cmd, session_dir(session), session->env_ptrs, session->alloc);
+	// The round trip is part of the time the command took.
+	proc->start_us -= (long long) session->latency_ms * 1000;
+	return ret;
+}
+
+static int fake_put(Session *session, const char *local, const char *remote) {
+	VString path = VString_new(session->alloc);
+	fake_delay(session, 1);
+	int ret = copy_file(local, fake_path(&path, session, remote));
+	VString_free(&path);
+	return ret;
+}
+
+static int fake_get(Session *session, const char *remote, const char *local) {
+	VString path = VString_new(session->alloc);
+	fake_delay(session, 1);
+	int ret = copy_file(fake_path(&path, session, remote), local);
+	VString_free(&path);
+	return ret;
+}
+
+// Append str to buff as one single quoted shell word.
+static void push_quoted(VString *buff, const char *str) {
+	VString_pushc(buff, '\'');
+	for (; *str; str++) {
+		if (*str == '\'')
+			VString_pushs(buff, "'\\''");
+		else
+			VString_pushc(buff, *str);
+	}
+	VString_pushc(buff, '\'');
+}
+
+static int ssh_open(Session *session) {
+	char *argv[] = {"ssh", "-T", "-o", "BatchMode=yes", "-o", "ControlMaster=auto",
+		"-o", "ControlPath=" VMEL_SSH_CONTROL_PATH, "-o", "ControlPersist=" VMEL_SSH_PERSIST,
+		"--", VString_str(&session->host), "sh -s", NULL};
+
+	if (Session_start(session, argv, NULL, NULL))
+		return -1;
+
+	// The remote shell starts in the home directory, carry over the last known context.
+	if (!session->cwd.str_size && !session->env_ptrs)
+		return 0;
+
+	VString restore = VString_new(session->alloc);
+	Proc proc;
+
+	for (size_t i = 0; session->env_ptrs && session->env_ptrs[i]; i++) {
+		VString_pushs(&restore, "export ");
+		push_quoted(&restore, session->env_ptrs[i]);
+		VString_pushs(&restore, " 2>/dev/null\n");
+	}
+
+	if (session->cwd.str_size) {
+		VString_pushs(&restore, "cd ");
+		push_quoted(&restore, VString_str(&session->cwd));
+	}
+
+	Proc_init(&proc, 0, session->alloc);
+	Session_run(session, VString_str(&restore), &proc);
+	Proc_free(&proc);
+	VString_free(&restore);
+
+	if (session->pid < 0) {
+		errno = ECONNABORTED;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ssh_exec(Session *session, const char *cmd, Proc *proc) {
+	return Session_run(session, cmd, proc);
+}
+
+// Run cmd as a command of its own over the shared connection, in the directory and
+// environment last reported by the shell, so its pipes can be watched like a local one.
+static int ssh_spawn(Session *session, const char *cmd, Proc *proc) {
+	VString remote = VString_new(session->alloc);
+	const char *dir = session_dir(session);
+
+	if (dir) {
+		VString_pushs(&remote, "cd ");
+		push_quoted(&remote, dir);
+		VString_pushs(&remote, " && ");
+	}
+
+	VString_pushs(&remote, "exec ");
+	if (session->env_ptrs) {
+		VString_pushs(&remote, "env -i ");
+		for (size_t i = 0; session->env_ptrs[i]; i++) {
+			push_quoted(&remote, session->env_ptrs[i]);
+			VString_pushc(&remote, ' ');
+		}
+	}
+
+	VString_pushs(&remote, "sh -c ");
+	push_quoted(&remote, cmd);
+
+	char *argv[] = {"ssh", "-T", "-o", "BatchMode=yes", "-o", "ControlMaster=auto",
+		"-o", "ControlPath=" VMEL_SSH_CONTROL_PATH, "-o", "ControlPersist=" VMEL_SSH_PERSIST,
+		"--", VString_str(&session->host), VString_str(&remote), NULL};
+
+	int ret = Proc_spawn_argv(proc, argv, NULL, NULL, session->alloc);
+	proc->direct = !Proc_needs_shell(cmd);
+	VString_free(&remote);
+	return ret;
+}
+
+// Copy with scp through the connection of the session, remote is host:path.
+static int ssh_copy(Session *session, const char *from, const char *to) {
+	char *argv[] = {"scp", "-q", "-B", "-o", "ControlPath=" VMEL_SSH_CONTROL_PATH, "--", (char *) from, (char *) to, NULL};
+	return run_argv(session, argv);
+}
+
+// Store host:path in buff, relative paths are taken from the directory of the shell.
+static const char *ssh_path(VString *buff, Session *session, const char *path) {
+	VString dir = VString_new(session->alloc);
+	resolve(&dir, session_dir(session), path);
+
+	VString_set(buff, VString_str(&session->host));
+	VString_pushc(buff, ':');
+	VString_pushs(buff, VString_str(&dir));
+	VString_free(&dir);
+	return VString_str(buff);
+}
+
+static int ssh_put(Session *session, const char *local, const char *remote) {
+	VString path = VString_new(session->alloc);
+	int ret = ssh_copy(session, local, ssh_path(&path, session, remote));
+	VString_free(&path);
+	return ret;
+}
+
+static int ssh_get(Session *session, const char *remote, const char *local) {
+	VString path = VString_new(session->alloc);
+	int ret = ssh_copy(session, ssh_path(&path, session, remote), local);
+	VString_free(&path);
+	return ret;
+}
+
+// Besides the shell, the shared connection is told to exit rather than linger.
+static void ssh_close(Session *session) {
+	char *argv[] = {"ssh", "-O", "exit", "-o", "ControlPath=" VMEL_SSH_CONTROL_PATH, "--", VString_str(&session->host), NULL};
+	Proc proc;
+
+	Session_stop(session);
+	// Spares share the connection of the first session of their host.
+	if (!session->started || session->spare)
+		return;
+
+	Proc_spawn_argv(&proc, argv, NULL, NULL, session->alloc);
+	Proc_wait(&proc);
+	Proc_free(&proc);
+}
+
+static const Transport Transports[] = {
+	{"local", local_open, local_exec, local_spawn, local_put, local_get, local_close},
+	{"fake", fake_open, fake_exec, fake_spawn, fake_put, fake_get, local_close},
+	{"ssh", ssh_open, ssh_exec, ssh_spawn, ssh_put, ssh_get, ssh_close}
+};
+
+const Transport *Transport_find(const char *name) {
+	if (null_check((void *) name, "transport find")) return NULL;
+
+	for (size_t i = 0; i < sizeof(Transports) / sizeof(Transports[0]); i++) {
+		if (strcmp(Transports[i].name, name) == 0)
+			return &Transports[i];
+	}
+
+	return NULL;
+}
+
+TransportPool *TransportPool_new(const Transport *transport, unsigned int latency_ms, unsigned int max_active, VAllocator *alloc) {
+	if (null_check((void *) transport, "transport pool new")) return NULL;
+
+	TransportPool *pool = VAlloc_alloc(alloc, sizeof(TransportPool));
+	if (null_check(pool, "transport pool new")) return NULL;
+
+	pool->transport = transport;
+	pool->latency_ms = latency_ms;
+	pool->sessions = NULL;
+	pool->ctr = 0;
+	pool->cap = 0;
+	pool->slots = NULL;
+	pool->slot_cap = 0;
+	pool->active = 0;
+	pool->max_active = max_active;
+	pool->live_ctr = 0;
+	pool->live_max = VMEL_POOL_LIVE_SHELLS;
+
+	// Idle shells take three descriptors each, leave most of them to running commands.
+	struct rlimit lim;
+	if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY && lim.rlim_cur / 16 < pool->live_max)
+		pool->live_max = lim.rlim_cur >= 32 ? lim.rlim_cur / 16 : 1;
+	pool->alloc = alloc;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->released, NULL);
+	return pool;
+}
+
+// Slot holding host or the free slot it belongs in, slot_cap is a power of 2.
+static size_t pool_slot(TransportPool *pool, const char *host) {
+	size_t mask = pool->slot_cap - 1;
+	size_t slot = string_hash(host, 0) & mask;
+
+	while (pool->slots[slot] && strcmp(VString_str(&pool->sessions[pool->slots[slot] - 1]->host), host) != 0)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+// Keep the index at most half full so probes stay short, hosts may number thousands.
+static int pool_grow(TransportPool *pool) {
+	if (pool->ctr + 1 <= pool->slot_cap / 2 && pool->ctr < pool->cap)
+		return 0;
+
+	if (pool->ctr == pool->cap) {
+		size_t n_cap = pool->cap ? pool->cap * 2 : 8;
+		Session **n_sessions = VAlloc_realloc(pool->alloc, pool->sessions, n_cap * sizeof(Session *));
+		if (null_check(n_sessions, "transport pool grow")) return -1;
+		pool->sessions = n_sessions;
+		pool->cap = n_cap;
+	}
+
+	if (pool->ctr + 1 <= pool->slot_cap / 2)
+		return 0;
+
+	size_t n_slot_cap = pool->slot_cap ? pool->slot_cap * 2 : 16;
+	size_t *n_slots = VAlloc_alloc(pool->alloc, n_slot_cap * sizeof(size_t));
+	if (null_check(n_slots, "transport pool grow")) return -1;
+
+	memset(n_slots, 0, n_slot_cap * sizeof(size_t));
+	VAlloc_free(pool->alloc, pool->slots);
+	pool->slots = n_slots;
+	pool->slot_cap = n_slot_cap;
+
+	// Spares are reached through the first session of their host.
+	for (size_t i = 0; i < pool->ctr; i++) {
+		if (!pool->sessions[i]->spare)
+			pool->slots[pool_slot(pool, VString_str(&pool->sessions[i]->host))] = i + 1;
+	}
+
+	return 0;
+}
+
+// Find or create the session of host, the lock of the pool must be held.
+static Session *pool_find(TransportPool *pool, const char *host) {
+	if (pool->slot_cap) {
+		size_t slot = pool_slot(pool, host);
+		if (pool->slots[slot])
+			return pool->sessions[pool->slots[slot] - 1];
+	}
+
+	if (pool_grow(pool))
+		return NULL;
+
+	Session *session = Session_new(pool->transport, host, pool->latency_ms, pool->alloc);
+	if (!session)
+		return NULL;
+
+	pool->sessions[pool->ctr++] = session;
+	pool->slots[pool_slot(pool, host)] = pool->ctr;
+	return session;
+}
+
+Session *TransportPool_get(TransportPool *pool, const char *host) {
+	if (null_check(pool, "transport pool get") || null_check((void *) host, "transport pool get")) return NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	Session *session = pool_find(pool, host);
+	pthread_mutex_unlock(&pool->lock);
+	return session;
+}
+
+Session *TransportPool_acquire(TransportPool *pool, const char *host) {
+	if (null_check(pool, "transport pool acquire") || null_check((void *) host, "transport pool acquire")) return NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	Session *session = pool_find(pool, host);
+	// A low descriptor limit bounds running groups as well as idle shells.
+	size_t limit = pool->max_active && pool->max_active < pool->live_max ? pool->max_active : pool->live_max;
+
+	while (session && (session->busy || (limit && pool->active >= limit)))
+		pthread_cond_wait(&pool->released, &pool->lock);
+
+	if (session) {
+		session->busy = 1;
+		pool->active++;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return session;
+}
+
+Session *TransportPool_acquire_spare(TransportPool *pool, const char *host) {
+	if (null_check(pool, "transport pool acquire spare") || null_check((void *) host, "transport pool acquire spare")) return NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	Session *first = pool_find(pool, host);
+	Session *session = first ? first->next : NULL;
+
+	while (session && session->busy)
+		session = session->next;
+
+	if (first && !session && pool_grow(pool) == 0 && (session = Session_new(pool->transport, host, pool->latency_ms, pool->alloc))) {
+		session->spare = 1;
+		session->next = first->next;
+		first->next = session;
+		pool->sessions[pool->ctr++] = session;
+	}
+
+	if (session)
+		session->busy = 1;
+
+	pthread_mutex_unlock(&pool->lock);
+	return session;
+}
+
+void TransportPool_release(TransportPool *pool, Session *session) {
+	if (null_check(pool, "transport pool release") || null_check(session, "transport pool release")) return;
+
+	// The session is still ours, its shell can't change meanwhile.
+	int live = session->pid >= 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (live && !session->live)
+		pool->live_ctr++;
+	else if (!live && session->live)
+		pool->live_ctr--;
+	session->live = live;
+
+	if (live && pool->live_ctr > pool->live_max) {
+		pthread_mutex_unlock(&pool->lock);
+		Session_close(session);
+		pthread_mutex_lock(&pool->lock);
+		session->live = 0;
+		pool->live_ctr--;
+	}
+
+	session->busy = 0;
+	if (!session->spare)
+		pool->active--;
+	pthread_cond_broadcast(&pool->released);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void TransportPool_free(TransportPool *pool) {
+	if (null_check(pool, "transport pool free")) return;
+
+	for (size_t i = 0; i < pool->ctr; i++)
+		Session_free(pool->sessions[i]);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->released);
+	VAlloc_free(pool->alloc, pool->slots);
+	VAlloc_free(pool->alloc, pool->sessions);
+	VAlloc_free(pool->alloc, pool);
+}
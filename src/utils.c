@@ -4,7 +4,27 @@
 #include "utils.h"
 
 void print_usage(void) {
-	printf("Usage: vmel [script]\n");
+	printf("Usage: vmel [options] [script]\n");
+	printf("       vmel --check [options] script...\n");
+	printf("Options:\n");
+	printf("  --hash-cons    Share identical subtrees and report memory saved\n");
+	printf("  --dse          Skip assignments overwritten before being read and report them\n");
+	printf("  --alloc TYPE   Allocator to run with: system (default), arena or pool\n");
+	printf("  --stats        Print allocation and hot path counters on exit\n");
+	printf("  --check        Lex and parse every script in parallel without running them\n");
+	printf("  --jobs N       Number of worker threads, defaults to one per cpu. When running\n");
+	printf("                 a script independent statements are executed in parallel\n");
+	printf("  --output FILE  Write program output to FILE instead of stdout\n");
+	printf("  --flush WHEN   Write buffered output per statement, on size (default) or at exit\n");
+	printf("  --timings      Print exit status and time of every command run by groups\n");
+	printf("  --transport T  Reach hosts through local (default), ssh or fake, which runs\n");
+	printf("                 every host in a directory below .vmel-hosts\n");
+	printf("  --latency MS   Delay the fake transport adds to every round trip\n");
+	printf("  --fanout N     Number of hosts worked on at once, defaults to 64\n");
+	printf("  --resume       Continue a failed run from the statement which failed, skipping\n");
+	printf("                 group commands which already succeeded\n");
+	printf("  --hedge PCT    Start commands of idempotent groups again once they run longer\n");
+	printf("                 than PCT percent of their peers, defaults to 95, 0 never does\n");
 }
 
 char *file_to_buffer(const char *filename) {
@@ -160,6 +180,19 @@ unsigned int string_to_ascii(char *str_rep) {
 	return asci;
 }
 
+unsigned long string_hash(const char *str, unsigned long seed) {
+	unsigned long hash = seed ? seed : 14695981039346656037UL;
+	
+	if (!str)
+		return hash;
+
+	while (*str) {
+		hash ^= (unsigned char) *str++;
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
 int is_valid_identifier(char id) {
 	return (isalpha(id) || id == '_' || id == '-' || isdigit(id));
 }
@@ -1,87 +1,289 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Custom includes.
-#include "tokenizer.h"
-#include "parser.h"
-#include "node.h"
-#include "nexec.h"
+#include "program.h"
 #include "errors.h"
 #include "utils.h"
+#include "stats.h"
+#include "check.h"
+#include "conf.h"
 
 int main(int argc, char *argv[]) {
 
 	// Input stream used for file.
-	int err = 0;
 	char *buff_in = NULL;
-	TokenMgr *tok_mgr = NULL;
-	NodeMgr *node_mgr = NULL;
-	SyTable *sy_table = NULL;
-	ParserMgr *par_mgr = NULL;
+	// Path of script being run.
+	char *script = NULL;
+	// PROGRAM_* flags derived from options.
+	unsigned int flags = 0;
+	// Print compile report to stderr.
+	int report = 0;
+	// Print counters to stderr on exit.
+	int stats = 0;
+	// Only validate the given files.
+	int check = 0;
+	// Number of worker threads, 0 for one per cpu.
+	int jobs = 0;
+	// Run independent statements on worker threads.
+	int parallel = 0;
+	// Report every command run by groups.
+	int timings = 0;
+	ProcLog *log = NULL;
+	// How hosts of group commands are reached.
+	const Transport *transport = NULL;
+	int latency = 0;
+	// Hosts worked on at once, 0 for the default.
+	int fanout = 0;
+	// Continue the failed run recorded in the journal.
+	int resume = 0;
+	Journal *journal = NULL;
+	// Percentile of their peers commands of idempotent groups are hedged at, -1 for the default.
+	int hedge = -1;
+	// File program output is redirected to.
+	char *output = NULL;
+	int out_fd = STDOUT_FILENO;
+	// When buffered output is written.
+	enum SinkFlush policy = SINK_FLUSH_SIZE;
+	// Every non option argument.
+	char **files = malloc(argc * sizeof(char *));
+	size_t files_ctr = 0;
+	// Allocator shared by the program and its frame.
+	VAllocator *alloc = NULL;
+	Program *program = NULL;
+	Frame *frame = NULL;
 	Error *err_handle = NULL;
-	NexecMgr *nexec_mgr = NULL;
+	// Exit status, 1 once the script didn't compile or its run recorded errors.
+	int ret = 0;
 
-	if (argc < 2) {
+	for (int i = 1; i < argc; i++) {
+		if (string_compare(argv[i], "--hash-cons")) {
+			flags |= PROGRAM_HASH_CONS;
+			report = 1;
+		}
+		else if (string_compare(argv[i], "--dse")) {
+			flags |= PROGRAM_DSE;
+			report = 1;
+		}
+		else if (string_compare(argv[i], "--stats")) {
+			stats = 1;
+		}
+		else if (string_compare(argv[i], "--check")) {
+			check = 1;
+		}
+		else if (string_compare(argv[i], "--timings")) {
+			timings = 1;
+		}
+		else if (string_compare(argv[i], "--resume")) {
+			resume = 1;
+		}
+		else if (string_compare(argv[i], "--jobs") && i + 1 < argc) {
+			i++;
+			jobs = string_to_int(argv[i], strlen(argv[i]));
+			flags |= PROGRAM_PARALLEL;
+			parallel = 1;
+			if (jobs < 0) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--transport") && i + 1 < argc) {
+			transport = Transport_find(argv[++i]);
+			if (!transport) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--latency") && i + 1 < argc) {
+			i++;
+			latency = string_to_int(argv[i], strlen(argv[i]));
+			if (latency < 0) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--fanout") && i + 1 < argc) {
+			i++;
+			fanout = string_to_int(argv[i], strlen(argv[i]));
+			if (fanout <= 0) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--hedge") && i + 1 < argc) {
+			i++;
+			hedge = string_to_int(argv[i], strlen(argv[i]));
+			if (hedge < 0 || hedge > 100) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--output") && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (string_compare(argv[i], "--flush") && i + 1 < argc) {
+			i++;
+			if (string_compare(argv[i], "statement"))
+				policy = SINK_FLUSH_STATEMENT;
+			else if (string_compare(argv[i], "exit"))
+				policy = SINK_FLUSH_EXIT;
+			else if (!string_compare(argv[i], "size")) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (string_compare(argv[i], "--alloc") && i + 1 < argc) {
+			i++;
+			if (string_compare(argv[i], "arena"))
+				alloc = VAlloc_arena_new(0, 0);
+			else if (string_compare(argv[i], "pool"))
+				alloc = VAlloc_pool_new();
+			else if (!string_compare(argv[i], "system")) {
+				print_usage();
+				free(files);
+				return 1;
+			}
+		}
+		else if (strncmp(argv[i], "--", 2) == 0) {
+			print_usage();
+			free(files);
+			return 1;
+		}
+		else {
+			files[files_ctr++] = argv[i];
+		}
+	}
+
+	if (files_ctr == 0) {
 		print_usage();
+		free(files);
 		return 0;
 	}
 
-	buff_in = file_to_buffer(argv[1]);
+	// Validate every file then exit.
+	if (check) {
+		size_t failed = Check_files(files, files_ctr, jobs, stdout);
+		free(files);
+		VAlloc_destroy(alloc);
+		if (stats)
+			Stats_print(stderr);
+		return failed ? 1 : 0;
+	}
+
+	script = files[0];
+	free(files);
+
+	buff_in = file_to_buffer(script);
 	
 	// 0 size file.
-	if (!buff_in)
+	if (!buff_in) {
+		VAlloc_destroy(alloc);
 		return 0;
-		
-	tok_mgr = TokenMgr_new();		
-	err = TokenMgr_build_tokens(buff_in, tok_mgr);
-	free(buff_in);
-	
-	if (!err) {
-		
-		// Instantiate required structs.
-		sy_table = SyTable_new();
-		node_mgr = NodeMgr_new();
-		err_handle = Error_new();
-
-		// Initialise Parser with correct structs.
-		par_mgr = ParseMgr_init(tok_mgr, sy_table, node_mgr, err_handle);
-
-		Parser_parse(par_mgr);
-
-		// Free since its no longer needed.
-		ParserMgr_free(par_mgr);
-
-		// No errors then proceed to execute nodes.
-		if (err_handle->error_ctr == 0) {
-			
-			// Initialise NexecMgr.
-			nexec_mgr = Nexec_init(sy_table, node_mgr, err_handle);
-
-			#ifndef NDEBUG
-				printf("--------------------------------------\n");
-				printf("** Program Output **\n");
-				printf("--------------------------------------\n");
-			#endif
-
-			// Iterate through nodes in generated ast and execute.
-			for (size_t i = 0; i < node_mgr->nodes_ctr; i++) {
-				Nexec_exec(nexec_mgr, node_mgr->nodes[i]);
-			}
-		}
 	}
 
+	if (output) {
+		out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out_fd < 0) {
+			perror("Error: ");
+			free(buff_in);
+			VAlloc_destroy(alloc);
+			return 1;
+		}
+	}
+		
 	#ifndef NDEBUG
-		SyTable_print_symbols(sy_table);
-		TokenMgr_print_tokens(tok_mgr);
+		flags |= PROGRAM_DUMP_TOKENS;
 	#endif
 
+	err_handle = Error_new(NULL);
+	program = Program_compile(buff_in, flags, alloc, err_handle);
+	Error_flush(err_handle, stdout);
+
+	if (program && report)
+		Program_print_report(program, stderr);
+	
+	// No errors then proceed to execute nodes.
+	if (program && err_handle->error_ctr == 0) {
+
+		// Per run state.
+		frame = Frame_new(program, alloc);
+		Frame_set_output(frame, out_fd, policy);
+		if (parallel)
+			Frame_set_jobs(frame, jobs);
+		if (transport || latency)
+			Frame_set_transport(frame, transport ? transport : Transport_find("local"), latency);
+		if (fanout)
+			Frame_set_fanout(frame, fanout);
+		if (hedge >= 0)
+			Frame_set_hedge(frame, hedge);
+		if (timings) {
+			log = ProcLog_new(NULL);
+			Frame_set_log(frame, log);
+		}
+
+		// Progress is recorded so a failed run can be resumed with the variables it left.
+		if (resume || program->group_ctr) {
+			journal = Journal_new(VMEL_JOURNAL, buff_in, NULL);
+			if (resume && Journal_resume(journal, frame->sy_table))
+				fprintf(stderr, "Nothing to resume for %s, running from the start\n", script);
+			Frame_set_journal(frame, journal);
+		}
+
+		#ifndef NDEBUG
+			printf("--------------------------------------\n");
+			printf("** Program Output **\n");
+			printf("--------------------------------------\n");
+		#endif
+
+		// Frame writes to the descriptor directly, anything stdio holds must go first.
+		fflush(stdout);
+		Program_run(program, frame);
+
+		#ifndef NDEBUG
+			OutSink_flush(frame->out);
+			SyTable_print_symbols(frame->sy_table);
+		#endif
+
+		if (frame->history)
+			DagHistory_save(frame->history, program->dag, VMEL_DAG_HISTORY);
+
+		ret = frame->err_handle->error_ctr > 0;
+		if (journal)
+			Journal_end(journal, ret);
+	}
+	else {
+		ret = 1;
+	}
+
 	// Free all resources.
-	NexecMgr_free(nexec_mgr);
+	free(buff_in);
+	if (frame)
+		Frame_free(frame);
+	if (journal)
+		Journal_free(journal);
+	if (log) {
+		ProcLog_print(log, stderr);
+		ProcLog_free(log);
+	}
+	if (program)
+		Program_free(program);
 	Error_free(err_handle);
-	SyTable_free(sy_table);
-	NodeMgr_free(node_mgr);
-	TokenMgr_free(tok_mgr);
+	VAlloc_destroy(alloc);
+
+	if (out_fd != STDOUT_FILENO)
+		close(out_fd);
+
+	if (stats)
+		Stats_print(stderr);
 
-	return 0;
+	return ret;
 }